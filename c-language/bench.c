@@ -0,0 +1,2751 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "flowmeter.h"
+#include "capture_merge.h"
+#include "clock_sync.h"
+#include "conduit.h"
+#include "csv_ingest.h"
+#include "fusion.h"
+#include "jit.h"
+#include "leak.h"
+#include "meter_state.h"
+#include "mqtt.h"
+#include "partial_fill.h"
+#include "pipeline.h"
+#include "quality.h"
+#include "query.h"
+#include "result_writer.h"
+#include "rollup.h"
+#include "sequence.h"
+#include "serial.h"
+#include "soundspeed.h"
+#include "thermal.h"
+#include "tomography.h"
+#include "transient.h"
+#include "wire.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * flowbench - throughput benchmarks for the flow meter library
+ *
+ * Usage: flowbench <benchmark> [arguments...]
+ */
+
+typedef struct {
+    const char *name;                  /* Benchmark name */
+    const char *usage;                 /* Argument summary */
+    int (*run)(int argc, char **argv); /* argv[0] is the benchmark name */
+} BenchCommand;
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Fill measurements for a configuration at the given flow velocity
+ * (same model as the demo program's simulate_measurements())
+ */
+static void bench_measurements(PathMeasurement *measurements,
+                               const FlowMeterConfig *config, double velocity)
+{
+    for (uint32_t i = 0; i < config->num_paths; i++) {
+        double path_component = config->paths[i].length * sin(config->paths[i].angle);
+        measurements[i].t_upstream = path_component / (1480.0 - velocity);
+        measurements[i].t_downstream = path_component / (1480.0 + velocity);
+    }
+}
+
+/* ---- CSV ingest ---- */
+
+typedef struct {
+    const CompiledConfig *compiled;
+    double flow_sum;
+    double transit_sum;
+} CsvBenchContext;
+
+static int csv_parse_only(void *context, const CsvFrameBatch *batch)
+{
+    CsvBenchContext *bench = context;
+
+    for (uint32_t f = 0; f < batch->num_frames; f++) {
+        bench->transit_sum += batch->measurements[(size_t)f * FLOWMETER_MAX_PATHS].t_upstream;
+    }
+    return 0;
+}
+
+static int csv_with_flow(void *context, const CsvFrameBatch *batch)
+{
+    CsvBenchContext *bench = context;
+
+    for (uint32_t f = 0; f < batch->num_frames; f++) {
+        bench->flow_sum += compiled_flow_rate(bench->compiled,
+                                              &batch->measurements[(size_t)f * FLOWMETER_MAX_PATHS]);
+    }
+    return 0;
+}
+
+/**
+ * Generate a CSV log of roughly the requested size from 4-path meters
+ */
+static int generate_csv(const char *filename, size_t target_bytes,
+                        const FlowMeterConfig *config)
+{
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        return -1;
+    }
+
+    size_t written = (size_t)fprintf(file, "timestamp,meter,path,t_up,t_down\n");
+    PathMeasurement measurements[FLOWMETER_MAX_PATHS];
+    uint64_t frame = 0;
+
+    while (written < target_bytes) {
+        uint32_t meter = (uint32_t)(frame % 100);
+        double velocity = 2.0 + 0.5 * (double)((frame * 7919) % 100) / 100.0;
+        bench_measurements(measurements, config, velocity);
+
+        for (uint32_t i = 0; i < config->num_paths; i++) {
+            written += (size_t)fprintf(file, "%llu.%06llu,%u,%u,%.10e,%.10e\n",
+                                       (unsigned long long)(frame / 100),
+                                       (unsigned long long)((frame % 100) * 1000),
+                                       meter, i,
+                                       measurements[i].t_upstream,
+                                       measurements[i].t_downstream);
+        }
+        frame++;
+    }
+
+    return fclose(file);
+}
+
+/**
+ * Parse a generated CSV log, with and without flow computation
+ */
+static int bench_csv(int argc, char **argv)
+{
+    if (argc > 3) {
+        return 2;
+    }
+
+    size_t megabytes = (argc > 1) ? strtoul(argv[1], NULL, 10) : 256;
+    const char *filename = (argc > 2) ? argv[2] : "flowbench.csv";
+
+    FlowMeterConfig *config = create_4path_config(0.1);
+    CompiledConfig compiled;
+    if (!config || flowmeter_compile(config, &compiled) != 0) {
+        free_config(config);
+        return 1;
+    }
+
+    printf("Generating %zu MB CSV in %s...\n", megabytes, filename);
+    if (generate_csv(filename, megabytes << 20, config) != 0) {
+        fprintf(stderr, "Error: Failed to write %s\n", filename);
+        flowmeter_compiled_free(&compiled);
+        free_config(config);
+        return 1;
+    }
+
+    CsvBatchHandler handlers[] = { csv_parse_only, csv_with_flow };
+    const char *names[] = { "parse only", "parse + flow" };
+    int status = 0;
+
+    for (int h = 0; h < 2 && status == 0; h++) {
+        CsvBenchContext bench = { &compiled, 0.0, 0.0 };
+        CsvIngest ingest;
+
+        if (csv_ingest_init(&ingest, 4096, handlers[h], &bench) != 0) {
+            status = 1;
+            break;
+        }
+
+        double start = now_seconds();
+        if (csv_ingest_file(&ingest, filename) != 0 || csv_ingest_finish(&ingest) != 0) {
+            status = 1;
+        }
+        double elapsed = now_seconds() - start;
+
+        printf("  %-14s %8.1f MB/s  %10.0f frames/s  (%llu rows, %llu rejected)\n",
+               names[h], (double)ingest.bytes / elapsed / 1e6,
+               (double)ingest.frames / elapsed, (unsigned long long)ingest.rows,
+               (unsigned long long)ingest.rows_rejected);
+        csv_ingest_free(&ingest);
+    }
+
+    remove(filename);
+    flowmeter_compiled_free(&compiled);
+    free_config(config);
+    return status;
+}
+
+/* ---- Result serialization ---- */
+
+/**
+ * Serialize synthetic 4-path results to /dev/null in every format,
+ * against a printf baseline
+ */
+static int bench_results(int argc, char **argv)
+{
+    if (argc > 2) {
+        return 2;
+    }
+
+    size_t count = (argc > 1) ? strtoul(argv[1], NULL, 10) : 5000000;
+    int fd = open("/dev/null", O_WRONLY);
+    FILE *null_file = fdopen(fd, "w");
+    if (fd < 0 || !null_file) {
+        return 1;
+    }
+
+    double velocities[4];
+    FlowResult result = { velocities, 0.0 };
+
+    /* Baseline: one fprintf per record with round-trip precision */
+    double start = now_seconds();
+    for (size_t i = 0; i < count; i++) {
+        velocities[0] = velocities[1] = 4.0 + (double)(i % 1000) * 1e-4;
+        velocities[2] = velocities[3] = 4.2 + (double)(i % 777) * 1e-4;
+        result.volumetric_flow = 0.0314159 + (double)(i % 1000) * 1e-6;
+        fprintf(null_file, "%llu,%u,%.17g,%.17g,%.17g,%.17g,%.17g\n",
+                (unsigned long long)(1700000000000000000ull + i * 1000000ull),
+                (unsigned)(i % 100), result.volumetric_flow, velocities[0],
+                velocities[1], velocities[2], velocities[3]);
+    }
+    fflush(null_file);
+    double elapsed = now_seconds() - start;
+    printf("  %-8s %12.0f results/s\n", "printf", (double)count / elapsed);
+
+    const char *names[] = { "jsonl", "csv", "binary" };
+    int status = 0;
+
+    for (int f = 0; f < 3 && status == 0; f++) {
+        ResultFormat format;
+        ResultWriter writer;
+
+        result_format_parse(names[f], &format);
+        if (result_writer_open(&writer, fd, format, 4, 0) != 0) {
+            status = 1;
+            break;
+        }
+
+        start = now_seconds();
+        for (size_t i = 0; i < count; i++) {
+            velocities[0] = velocities[1] = 4.0 + (double)(i % 1000) * 1e-4;
+            velocities[2] = velocities[3] = 4.2 + (double)(i % 777) * 1e-4;
+            result.volumetric_flow = 0.0314159 + (double)(i % 1000) * 1e-6;
+            if (result_writer_append(&writer, 1700000000000000000ull + i * 1000000ull,
+                                     (uint32_t)(i % 100), &result, 4) != 0) {
+                status = 1;
+                break;
+            }
+        }
+        if (result_writer_close(&writer) != 0) {
+            status = 1;
+        }
+        elapsed = now_seconds() - start;
+
+        printf("  %-8s %12.0f results/s %8.1f MB/s\n", names[f],
+               (double)count / elapsed, (double)writer.bytes_written / elapsed / 1e6);
+    }
+
+    fclose(null_file);
+    return status;
+}
+
+/* ---- Processing pipeline ---- */
+
+/**
+ * Fill frame-major measurements with a cycling, noisy flow profile
+ */
+static PathMeasurement* bench_frames(const FlowMeterConfig *config, size_t num_frames)
+{
+    PathMeasurement *frames = malloc(num_frames * config->num_paths * sizeof(PathMeasurement));
+    if (!frames) {
+        return NULL;
+    }
+
+    uint64_t noise = 88172645463325252ull;
+    for (size_t f = 0; f < num_frames; f++) {
+        noise ^= noise << 13;
+        noise ^= noise >> 7;
+        noise ^= noise << 17;
+        double velocity = 2.0 * sin((double)f * 1e-3) + (double)(noise % 1000) * 1e-4;
+        bench_measurements(&frames[f * config->num_paths], config, velocity);
+    }
+
+    return frames;
+}
+
+/**
+ * Fused pipeline kernel against stage-by-stage execution
+ */
+static int bench_pipeline(int argc, char **argv)
+{
+    if (argc > 2) {
+        return 2;
+    }
+
+    size_t num_frames = (argc > 1) ? strtoul(argv[1], NULL, 10) : 2000000;
+    FlowMeterConfig *config = create_4path_config(0.1);
+    if (!config || num_frames == 0) {
+        free_config(config);
+        return 1;
+    }
+
+    const double zero_offsets[4] = { 1e-11, -2e-11, 0.5e-11, 0.0 };
+    PipelineStageSpec stages[7];
+    memset(stages, 0, sizeof(stages));
+    stages[0].type = PIPELINE_STAGE_VALIDATE;
+    stages[0].params.validate.t_min = 1e-6;
+    stages[0].params.validate.t_max = 1e-3;
+    stages[1].type = PIPELINE_STAGE_ZERO_OFFSET;
+    stages[1].params.zero_offset.offsets = zero_offsets;
+    stages[2].type = PIPELINE_STAGE_VELOCITY;
+    stages[3].type = PIPELINE_STAGE_QUADRATURE;
+    stages[4].type = PIPELINE_STAGE_CALIBRATION;
+    stages[4].params.calibration.gain = 0.998;
+    stages[4].params.calibration.offset = 1e-6;
+    stages[5].type = PIPELINE_STAGE_FILTER;
+    stages[5].params.filter.alpha = 0.1;
+    stages[6].type = PIPELINE_STAGE_TOTALIZE;
+    stages[6].params.totalize.deadband = 1e-4;
+    stages[6].params.totalize.hysteresis = 5e-5;
+    stages[6].params.totalize.dt = 0.01;
+
+    PathMeasurement *frames = bench_frames(config, num_frames);
+    double *flows_fused = malloc(num_frames * sizeof(double));
+    double *flows_staged = malloc(num_frames * sizeof(double));
+    Pipeline fused, staged;
+    int status = 0;
+
+    if (!frames || !flows_fused || !flows_staged ||
+        pipeline_compile(stages, 7, config, &fused) != 0) {
+        status = 1;
+    } else if (pipeline_compile(stages, 7, config, &staged) != 0) {
+        pipeline_free(&fused);
+        status = 1;
+    }
+
+    if (status == 0) {
+        double start = now_seconds();
+        pipeline_run(&fused, frames, num_frames, flows_fused, NULL);
+        double fused_time = now_seconds() - start;
+
+        start = now_seconds();
+        pipeline_run_staged(&staged, frames, num_frames, flows_staged, NULL);
+        double staged_time = now_seconds() - start;
+
+        double max_difference = 0.0;
+        for (size_t f = 0; f < num_frames; f++) {
+            double difference = fabs(flows_fused[f] - flows_staged[f]);
+            if (difference > max_difference) {
+                max_difference = difference;
+            }
+        }
+
+        printf("  %-8s %12.0f frames/s\n", "staged", (double)num_frames / staged_time);
+        printf("  %-8s %12.0f frames/s (%.1fx)\n", "fused", (double)num_frames / fused_time,
+               staged_time / fused_time);
+        printf("  max flow difference %.2e m³/s, net total %.6f vs %.6f m³\n",
+               max_difference, fused.totalizer.net_total, staged.totalizer.net_total);
+
+        pipeline_free(&fused);
+        pipeline_free(&staged);
+    }
+
+    free(frames);
+    free(flows_fused);
+    free(flows_staged);
+    free_config(config);
+    return status;
+}
+
+/* ---- Generated kernels ---- */
+
+/**
+ * Build an evenly spread test configuration with any number of paths
+ */
+static FlowMeterConfig* bench_config(uint32_t num_paths, double pipe_diameter)
+{
+    FlowMeterConfig *config = malloc(sizeof(FlowMeterConfig));
+    if (!config) {
+        return NULL;
+    }
+
+    config->pipe_diameter = pipe_diameter;
+    config->num_paths = num_paths;
+    config->paths = malloc(num_paths * sizeof(AcousticPath));
+    if (!config->paths) {
+        free(config);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < num_paths; i++) {
+        double position = -0.9 + 1.8 * ((double)i + 0.5) / (double)num_paths;
+        double angle = (i % 2) ? M_PI / 3.0 : M_PI / 4.0;
+        config->paths[i].position = position;
+        config->paths[i].angle = angle;
+        config->paths[i].length = pipe_diameter * sqrt(1.0 - position * position) / sin(angle);
+        config->paths[i].weight = 1.0 / (double)num_paths;
+    }
+
+    return config;
+}
+
+/**
+ * Generated machine-code kernels against build-time specialized kernels
+ */
+static int bench_jit(int argc, char **argv)
+{
+    if (argc > 2) {
+        return 2;
+    }
+
+    size_t num_frames = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+    const uint32_t path_counts[] = { 2, 4, 8, 18 };
+    int status = 0;
+
+    for (size_t c = 0; c < sizeof(path_counts) / sizeof(path_counts[0]) && status == 0; c++) {
+        FlowMeterConfig *config = bench_config(path_counts[c], 0.5);
+        PathMeasurement *frames = config ? bench_frames(config, num_frames) : NULL;
+        double *flows = malloc(num_frames * sizeof(double));
+        CompiledConfig compiled;
+        FlowKernel portable, native;
+
+        if (!frames || !flows || flowmeter_compile(config, &compiled) != 0) {
+            status = 1;
+        } else {
+            flow_kernel_build(&compiled, 0.998, 1e-6, 0, &portable);
+            flow_kernel_build(&compiled, 0.998, 1e-6, 1, &native);
+            memset(flows, 0, num_frames * sizeof(double));  /* Fault pages in */
+
+            double start = now_seconds();
+            flow_kernel_run(&portable, frames, num_frames, flows);
+            double portable_time = now_seconds() - start;
+            double checksum = flows[num_frames - 1];
+
+            start = now_seconds();
+            flow_kernel_run(&native, frames, num_frames, flows);
+            double native_time = now_seconds() - start;
+
+            printf("  %2u paths: %s %10.0f frames/s, %s %10.0f frames/s (%.2fx)%s\n",
+                   path_counts[c], path_counts[c] <= 8 ? "AOT    " : "generic",
+                   (double)num_frames / portable_time,
+                   native.native ? "JIT" : "n/a", (double)num_frames / native_time,
+                   portable_time / native_time,
+                   checksum == flows[num_frames - 1] ? "" : " MISMATCH");
+
+            flow_kernel_free(&portable);
+            flow_kernel_free(&native);
+            flowmeter_compiled_free(&compiled);
+        }
+
+        free(flows);
+        free(frames);
+        free_config(config);
+    }
+
+    return status;
+}
+
+/* ---- Total-only flow ---- */
+
+/**
+ * Per-frame FlowResult computation against batch totals, with velocities
+ * for every frame, every 64th frame and none
+ */
+static int bench_lazy(int argc, char **argv)
+{
+    if (argc > 2) {
+        return 2;
+    }
+
+    size_t num_frames = (argc > 1) ? strtoul(argv[1], NULL, 10) : 2000000;
+    FlowMeterConfig *config = create_4path_config(0.5);
+    PathMeasurement *frames = config ? bench_frames(config, num_frames) : NULL;
+    double *flows = malloc(num_frames * sizeof(double));
+    double *velocities = config ? malloc(num_frames * config->num_paths * sizeof(double)) : NULL;
+    CompiledConfig compiled;
+    int status = 0;
+
+    if (!frames || !flows || !velocities || flowmeter_compile(config, &compiled) != 0) {
+        status = 1;
+    } else {
+        /* Fault the output pages in so every variant starts warm */
+        memset(flows, 0, num_frames * sizeof(double));
+        memset(velocities, 0, num_frames * config->num_paths * sizeof(double));
+
+        double start = now_seconds();
+        for (size_t f = 0; f < num_frames; f++) {
+            FlowResult result;
+            if (calculate_flow_rate_compiled(&compiled, &frames[f * config->num_paths],
+                                             &result) == 0) {
+                flows[f] = result.volumetric_flow;
+                free(result.path_velocities);
+            }
+        }
+        double baseline = now_seconds() - start;
+        double reference = flows[num_frames - 1];
+
+        printf("  %-22s %10.0f frames/s\n", "FlowResult per frame",
+               (double)num_frames / baseline);
+
+        const size_t intervals[] = { 1, 64, 0 };
+        const char *names[] = { "batch, all velocities", "batch, every 64th",
+                                "batch, total only" };
+
+        for (int v = 0; v < 3; v++) {
+            start = now_seconds();
+            calculate_flow_batch(&compiled, frames, num_frames, flows,
+                                 velocities, intervals[v]);
+            double elapsed = now_seconds() - start;
+
+            printf("  %-22s %10.0f frames/s (%.2fx)%s\n", names[v],
+                   (double)num_frames / elapsed, baseline / elapsed,
+                   flows[num_frames - 1] == reference ? "" : " MISMATCH");
+        }
+
+        flowmeter_compiled_free(&compiled);
+    }
+
+    free(velocities);
+    free(flows);
+    free(frames);
+    free_config(config);
+    return status;
+}
+
+/* ---- Incremental path updates ---- */
+
+/**
+ * Per-path update latency on an 18-path meter: full recomputation after
+ * every path measurement against the incremental meter state
+ */
+static int bench_incremental(int argc, char **argv)
+{
+    if (argc > 2) {
+        return 2;
+    }
+
+    size_t num_frames = (argc > 1) ? strtoul(argv[1], NULL, 10) : 200000;
+    FlowMeterConfig *config = bench_config(18, 0.5);
+    PathMeasurement *frames = config ? bench_frames(config, num_frames) : NULL;
+    CompiledConfig compiled;
+    MeterState state;
+    int status = 0;
+
+    if (!frames || flowmeter_compile(config, &compiled) != 0) {
+        free(frames);
+        free_config(config);
+        return 1;
+    }
+
+    uint32_t num_paths = config->num_paths;
+    size_t num_updates = num_frames * num_paths;
+    PathMeasurement current[FLOWMETER_MAX_PATHS];
+    double checksum[3] = { 0.0, 0.0, 0.0 };
+    double elapsed[3];
+
+    /* calculate_flow_rate() over the latest measurement of every path */
+    memset(current, 0, sizeof(current));
+    double start = now_seconds();
+    for (size_t u = 0; u < num_updates; u++) {
+        FlowResult result;
+        current[u % num_paths] = frames[u];
+        if (calculate_flow_rate(config, current, &result) == 0) {
+            checksum[0] += result.volumetric_flow;
+            free(result.path_velocities);
+        }
+    }
+    elapsed[0] = now_seconds() - start;
+
+    /* Total-only recomputation with precomputed coefficients */
+    memset(current, 0, sizeof(current));
+    start = now_seconds();
+    for (size_t u = 0; u < num_updates; u++) {
+        current[u % num_paths] = frames[u];
+        checksum[1] += compiled_flow_rate(&compiled, current);
+    }
+    elapsed[1] = now_seconds() - start;
+
+    /* O(1) incremental update, tracking drift against the exact total */
+    double max_drift = 0.0;
+    if (meter_state_init(&state, &compiled, 0) != 0) {
+        status = 1;
+    } else {
+        start = now_seconds();
+        for (size_t u = 0; u < num_updates; u++) {
+            checksum[2] += meter_state_update(&state, (uint32_t)(u % num_paths), &frames[u]);
+        }
+        elapsed[2] = now_seconds() - start;
+
+        meter_state_reset(&state);
+        state.renormalize_interval = UINT32_MAX;
+        for (size_t u = 0; u < num_updates; u++) {
+            double flow = meter_state_update(&state, (uint32_t)(u % num_paths), &frames[u]);
+            if (u % num_paths == num_paths - 1) {
+                double exact = compiled_flow_rate(&compiled, &frames[u + 1 - num_paths]);
+                double drift = fabs(flow - exact) / fabs(exact);
+                max_drift = drift > max_drift ? drift : max_drift;
+            }
+        }
+
+        const char *names[] = { "calculate_flow_rate", "compiled total", "incremental" };
+        for (int v = 0; v < 3; v++) {
+            printf("  %-20s %8.1f ns/update (%.2fx)\n", names[v],
+                   elapsed[v] * 1e9 / (double)num_updates, elapsed[0] / elapsed[v]);
+        }
+        printf("  Checksum vs compiled total: incremental %.2e, calculate_flow_rate %.2e\n",
+               fabs(checksum[2] - checksum[1]) / fabs(checksum[1]),
+               fabs(checksum[0] - checksum[1]) / fabs(checksum[1]));
+        printf("  Max drift without renormalization: %.2e after %zu updates\n",
+               max_drift, num_updates);
+    }
+
+    flowmeter_compiled_free(&compiled);
+    free(frames);
+    free_config(config);
+    return status;
+}
+
+/* ---- Quality-weighted fusion ---- */
+
+/**
+ * Two-pass baseline: screen every measurement into a filtered copy and
+ * failure masks, then weight the filtered frames
+ */
+static void screen_then_fuse(const QualityFusion *fusion,
+                             const QualifiedMeasurement *frames, size_t num_frames,
+                             PathMeasurement *screened, double *flows, uint32_t *masks)
+{
+    const QualityThresholds *limits = &fusion->thresholds;
+    uint32_t num_paths = fusion->num_paths;
+
+    for (size_t f = 0; f < num_frames; f++) {
+        uint32_t failed = 0;
+        for (uint32_t i = 0; i < num_paths; i++) {
+            const QualifiedMeasurement *m = &frames[f * num_paths + i];
+            int good = m->snr_db >= limits->min_snr_db &&
+                       m->gain_db <= limits->max_gain_db &&
+                       m->correlation >= limits->min_correlation;
+            PathMeasurement zero = { 0.0, 0.0 };
+            screened[f * num_paths + i] = good ? m->times : zero;
+            failed |= (uint32_t)!good << i;
+        }
+        masks[f] = failed;
+    }
+
+    for (size_t f = 0; f < num_frames; f++) {
+        const PathMeasurement *measurements = &screened[f * num_paths];
+        if (fusion->mode_coeffs) {
+            const double *row = &fusion->mode_coeffs[(size_t)masks[f] * num_paths];
+            double flow = 0.0;
+            for (uint32_t i = 0; i < num_paths; i++) {
+                flow += row[i] * path_transit_term(&measurements[i]);
+            }
+            flows[f] = flow;
+        } else {
+            double good_weight = 0.0;
+            for (uint32_t i = 0; i < num_paths; i++) {
+                good_weight += (masks[f] >> i & 1u) ? 0.0 : fusion->weights[i];
+            }
+            flows[f] = (good_weight != 0.0) ? compiled_flow_rate(&fusion->compiled, measurements) *
+                                              (fusion->total_weight / good_weight) : 0.0;
+        }
+    }
+}
+
+/**
+ * Quality fusion in one pass against the unscreened total-only flow and
+ * a separate screening pass, with about 2% of paths failing screening
+ */
+static int bench_quality(int argc, char **argv)
+{
+    if (argc > 2) {
+        return 2;
+    }
+
+    size_t num_frames = (argc > 1) ? strtoul(argv[1], NULL, 10) : 2000000;
+    const uint32_t path_counts[] = { 4, 18 };
+    const QualityThresholds thresholds = { 10.0f, 60.0f, 0.5f };
+    int status = 0;
+
+    for (size_t c = 0; c < sizeof(path_counts) / sizeof(path_counts[0]) && status == 0; c++) {
+        FlowMeterConfig *config = bench_config(path_counts[c], 0.5);
+        PathMeasurement *frames = config ? bench_frames(config, num_frames) : NULL;
+        size_t num_measurements = num_frames * path_counts[c];
+        QualifiedMeasurement *qualified = malloc(num_measurements * sizeof(QualifiedMeasurement));
+        double *flows = calloc(num_frames, sizeof(double));
+        uint32_t *masks = calloc(num_frames, sizeof(uint32_t));
+        QualityFusion fusion;
+
+        if (!frames || !qualified || !flows || !masks ||
+            quality_fusion_init(&fusion, config, &thresholds) != 0) {
+            status = 1;
+        } else {
+            uint64_t noise = 0x9e3779b97f4a7c15ull;
+            for (size_t m = 0; m < num_measurements; m++) {
+                noise ^= noise << 13;
+                noise ^= noise >> 7;
+                noise ^= noise << 17;
+                qualified[m].times = frames[m];
+                qualified[m].snr_db = (noise % 100 < 2) ? 3.0f : 30.0f;
+                qualified[m].gain_db = 40.0f;
+                qualified[m].correlation = 0.9f;
+                qualified[m].reserved = 0.0f;
+            }
+
+            /* Fault the output pages in so both variants start warm */
+            memset(flows, 0, num_frames * sizeof(double));
+            memset(masks, 0, num_frames * sizeof(uint32_t));
+
+            double start = now_seconds();
+            calculate_flow_batch(&fusion.compiled, frames, num_frames, flows, NULL, 0);
+            double plain = now_seconds() - start;
+
+            start = now_seconds();
+            screen_then_fuse(&fusion, qualified, num_frames, frames, flows, masks);
+            double two_pass = now_seconds() - start;
+            double reference = flows[num_frames - 1];
+
+            start = now_seconds();
+            quality_fusion_batch(&fusion, qualified, num_frames, flows, masks);
+            double fused = now_seconds() - start;
+
+            size_t degraded = 0;
+            for (size_t f = 0; f < num_frames; f++) {
+                degraded += masks[f] != 0;
+            }
+
+            printf("  %2u paths, %4.1f%% frames degraded (%s weights)%s\n",
+                   path_counts[c], 100.0 * (double)degraded / (double)num_frames,
+                   fusion.mode_coeffs ? "table" : "rescaled",
+                   fabs(flows[num_frames - 1] - reference) <= 1e-12 * fabs(reference) ?
+                   "" : " MISMATCH");
+            printf("    unscreened     %10.0f frames/s\n", (double)num_frames / plain);
+            printf("    screen + fuse  %10.0f frames/s\n", (double)num_frames / two_pass);
+            printf("    single pass    %10.0f frames/s (%.2fx two-pass)\n",
+                   (double)num_frames / fused, two_pass / fused);
+            quality_fusion_free(&fusion);
+        }
+
+        free(masks);
+        free(flows);
+        free(qualified);
+        free(frames);
+        free_config(config);
+    }
+
+    return status;
+}
+
+/* ---- Thermal compensation ---- */
+
+typedef struct {
+    const ThermalCompensation *thermal;
+    volatile int stop;   /* Set by the updating thread */
+    uint64_t reads;      /* Coefficient sets read */
+    uint64_t retries;    /* Reads repeated after thermal_read_retry() */
+    uint64_t torn;       /* Mixed coefficient sets accepted as consistent */
+} ThermalReader;
+
+/**
+ * Read coefficient sets slowly enough to span updates; a set is torn when
+ * the paths do not share one expansion factor
+ */
+static void* thermal_reader(void *arg)
+{
+    ThermalReader *reader = arg;
+    const CompiledConfig *reference = &reader->thermal->reference;
+    volatile double sink = 0.0;
+
+    while (!reader->stop) {
+        uint64_t sequence;
+        const CompiledConfig *config = thermal_read_begin(reader->thermal, &sequence);
+        double ratio = config->flow_coeff[0] / reference->flow_coeff[0];
+        int mixed = 0;
+
+        for (uint32_t i = 1; i < config->num_paths; i++) {
+            for (int n = 0; n < 2000; n++) {
+                sink += 1e-9;
+            }
+            mixed |= fabs(config->flow_coeff[i] / reference->flow_coeff[i] / ratio - 1.0) >
+                     1e-12;
+        }
+
+        reader->reads++;
+        if (thermal_read_retry(reader->thermal, config, sequence)) {
+            reader->retries++;
+        } else if (mixed) {
+            reader->torn++;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Batches with a temperature ramp from 20 to 150 °C reported before every
+ * batch, against the same batches with fixed coefficients
+ */
+static int bench_thermal(int argc, char **argv)
+{
+    if (argc > 2) {
+        return 2;
+    }
+
+    size_t num_frames = (argc > 1) ? strtoul(argv[1], NULL, 10) : 4000000;
+    const size_t batch_frames = 4096;
+    FlowMeterConfig *config = create_4path_config(0.5);
+    PathMeasurement *frames = config ? bench_frames(config, num_frames) : NULL;
+    double *flows = calloc(num_frames, sizeof(double));
+    CompiledConfig compiled;
+    ThermalCompensation thermal;
+    int status = 0;
+
+    if (!frames || !flows || flowmeter_compile(config, &compiled) != 0) {
+        free(flows);
+        free(frames);
+        free_config(config);
+        return 1;
+    }
+
+    if (thermal_init(&thermal, config, THERMAL_ALPHA_CARBON_STEEL, 20.0, 0.5) != 0) {
+        status = 1;
+    } else {
+        memset(flows, 0, num_frames * sizeof(double));  /* Fault pages in */
+
+        double start = now_seconds();
+        for (size_t f = 0; f < num_frames; f += batch_frames) {
+            size_t n = (num_frames - f < batch_frames) ? num_frames - f : batch_frames;
+            calculate_flow_batch(&compiled, &frames[f * config->num_paths], n,
+                                 &flows[f], NULL, 0);
+        }
+        double fixed = now_seconds() - start;
+        double uncompensated = flows[num_frames - 1];
+
+        start = now_seconds();
+        for (size_t f = 0; f < num_frames; f += batch_frames) {
+            size_t n = (num_frames - f < batch_frames) ? num_frames - f : batch_frames;
+            thermal_update(&thermal, 20.0 + 130.0 * (double)(f + n) / (double)num_frames);
+
+            const CompiledConfig *active;
+            uint64_t sequence;
+            do {
+                active = thermal_read_begin(&thermal, &sequence);
+                calculate_flow_batch(active, &frames[f * config->num_paths], n,
+                                     &flows[f], NULL, 0);
+            } while (thermal_read_retry(&thermal, active, sequence));
+        }
+        double compensated = now_seconds() - start;
+
+        /* Geometry expanded explicitly and compiled from scratch */
+        double s = 1.0 + THERMAL_ALPHA_CARBON_STEEL * (thermal.applied_temperature - 20.0);
+        FlowMeterConfig *expanded = create_4path_config(0.5 * s);
+        CompiledConfig expanded_compiled;
+        double exact = 0.0;
+        if (expanded && flowmeter_compile(expanded, &expanded_compiled) == 0) {
+            exact = compiled_flow_rate(&expanded_compiled,
+                                       &frames[(num_frames - 1) * config->num_paths]);
+            flowmeter_compiled_free(&expanded_compiled);
+        }
+        free_config(expanded);
+
+        printf("  fixed geometry  %10.0f frames/s\n", (double)num_frames / fixed);
+        printf("  compensated     %10.0f frames/s (%.2fx), %llu recomputes\n",
+               (double)num_frames / compensated, fixed / compensated,
+               (unsigned long long)thermal.recomputes);
+        printf("  Flow at %.1f °C: %+.3f%% vs fixed geometry, %.1e from recompiled\n",
+               thermal.applied_temperature,
+               100.0 * (flows[num_frames - 1] / uncompensated - 1.0),
+               fabs(flows[num_frames - 1] - exact) / fabs(exact));
+
+        /* A reader holding each config across updates cycling through four
+         * temperatures, so every refill changes the buffer's coefficients */
+        ThermalReader reader = { &thermal, 0, 0, 0, 0 };
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, thermal_reader, &reader) == 0) {
+            const double cycle[4] = { 60.0, 100.0, 150.0, 20.0 };
+            struct timespec pause = { 0, 20000 };
+            for (int k = 0; k < 20000; k++) {
+                thermal_update(&thermal, cycle[k % 4]);
+                if (k % 16 == 0) {
+                    nanosleep(&pause, NULL);
+                }
+            }
+            reader.stop = 1;
+            pthread_join(thread, NULL);
+            printf("  concurrent reader: %llu reads, %llu retried, %llu torn\n",
+                   (unsigned long long)reader.reads, (unsigned long long)reader.retries,
+                   (unsigned long long)reader.torn);
+            status = reader.torn ? 1 : 0;
+        }
+        thermal_free(&thermal);
+    }
+
+    flowmeter_compiled_free(&compiled);
+    free(flows);
+    free(frames);
+    free_config(config);
+    return status;
+}
+
+/* ---- Sound-speed profile ---- */
+
+/**
+ * Flow with the sound-speed profile against flow alone. Frames are
+ * generated from a sound speed of 1480 + 30 p m/s (stratified, 4%
+ * across the section) in the first half and uniform 1480 m/s in the
+ * second; every 50th frame has path 0 in a gas layer at 1000 m/s.
+ */
+static int bench_sound_speed(int argc, char **argv)
+{
+    if (argc > 2) {
+        return 2;
+    }
+
+    size_t num_frames = (argc > 1) ? strtoul(argv[1], NULL, 10) : 2000000;
+    const uint32_t path_counts[] = { 4, 18 };
+    int status = 0;
+
+    for (size_t c = 0; c < sizeof(path_counts) / sizeof(path_counts[0]) && status == 0; c++) {
+        FlowMeterConfig *config = bench_config(path_counts[c], 0.5);
+        uint32_t num_paths = path_counts[c];
+        PathMeasurement *frames = malloc(num_frames * num_paths * sizeof(PathMeasurement));
+        SoundSpeedProfile *profiles = calloc(num_frames, sizeof(SoundSpeedProfile));
+        double *flows = calloc(num_frames, sizeof(double));
+        CompiledConfig compiled;
+        SoundSpeedModel model;
+
+        if (!config || !frames || !profiles || !flows ||
+            flowmeter_compile(config, &compiled) != 0) {
+            status = 1;
+        } else if (sound_speed_init(&model, config, 0.02, 0.1) != 0) {
+            flowmeter_compiled_free(&compiled);
+            status = 1;
+        } else {
+            /* 1/t_down - 1/t_up = v / velocity_scale, 1/t_up + 1/t_down = 2c / L */
+            for (size_t f = 0; f < num_frames; f++) {
+                double velocity = 2.0 + sin((double)f * 1e-3);
+                for (uint32_t i = 0; i < num_paths; i++) {
+                    double p = config->paths[i].position;
+                    double speed = (f < num_frames / 2) ? 1480.0 + 30.0 * p : 1480.0;
+                    if (i == 0 && f % 50 == 0) {
+                        speed = 1000.0;
+                    }
+                    double sum = 2.0 * speed / config->paths[i].length;
+                    double difference = velocity / compiled.velocity_scale[i];
+                    frames[f * num_paths + i].t_upstream = 2.0 / (sum - difference);
+                    frames[f * num_paths + i].t_downstream = 2.0 / (sum + difference);
+                }
+            }
+
+            /* Fault the output pages in so both variants start warm */
+            memset(flows, 0, num_frames * sizeof(double));
+            memset(profiles, 0, num_frames * sizeof(SoundSpeedProfile));
+
+            double start = now_seconds();
+            calculate_flow_batch(&compiled, frames, num_frames, flows, NULL, 0);
+            double plain = now_seconds() - start;
+
+            start = now_seconds();
+            sound_speed_batch(&model, &compiled, frames, num_frames, flows, profiles);
+            double profiled = now_seconds() - start;
+
+            size_t counts[2][2] = { { 0, 0 }, { 0, 0 } };
+            double gradient = 0.0;
+            for (size_t f = 0; f < num_frames; f++) {
+                int half = f >= num_frames / 2;
+                counts[half][0] += (profiles[f].flags & SOUND_SPEED_STRATIFIED) != 0;
+                counts[half][1] += (profiles[f].flags & SOUND_SPEED_GAS) != 0;
+                gradient += (half == 0 && f % 50 != 0) ? profiles[f].coeffs[1] : 0.0;
+            }
+
+            printf("  %2u paths (degree %u fit): flow only %10.0f frames/s, "
+                   "with profile %10.0f frames/s (%.2fx)\n",
+                   num_paths, model.degree, (double)num_frames / plain,
+                   (double)num_frames / profiled, plain / profiled);
+            printf("    stratified half: %5.1f%% flagged stratified, %4.1f%% gas, "
+                   "mean gradient %.1f m/s\n",
+                   200.0 * (double)counts[0][0] / (double)num_frames,
+                   200.0 * (double)counts[0][1] / (double)num_frames,
+                   gradient / (double)(num_frames / 2 - num_frames / 100));
+            printf("    uniform half:    %5.1f%% flagged stratified, %4.1f%% gas\n",
+                   200.0 * (double)counts[1][0] / (double)num_frames,
+                   200.0 * (double)counts[1][1] / (double)num_frames);
+
+            sound_speed_free(&model);
+            flowmeter_compiled_free(&compiled);
+        }
+
+        free(flows);
+        free(profiles);
+        free(frames);
+        free_config(config);
+    }
+
+    return status;
+}
+
+/* ---- Tomographic reconstruction ---- */
+
+/**
+ * Axial velocity of a developed turbulent profile (1/7 power law, mean
+ * 1 m/s at the centreline scale), optionally skewed across x as behind
+ * a bend; x and y are normalized to the radius
+ */
+static double bench_profile(double x, double y, double skew)
+{
+    double r = sqrt(x * x + y * y);
+    return (r >= 1.0) ? 0.0 : 1.2 * pow(1.0 - r, 1.0 / 7.0) * (1.0 + skew * x);
+}
+
+/**
+ * 18-path meter with chords in three orientations: reconstructed flow
+ * against the weighted sum for symmetric and skewed profiles, and the
+ * cost per frame with and without the field
+ */
+static int bench_tomography(int argc, char **argv)
+{
+    if (argc > 2) {
+        return 2;
+    }
+
+    size_t num_frames = (argc > 1) ? strtoul(argv[1], NULL, 10) : 100000;
+    const uint32_t num_paths = 18;
+    FlowMeterConfig *config = bench_config(num_paths, 0.5);
+    double orientations[18];
+    Tomography tomography;
+
+    for (uint32_t i = 0; i < num_paths; i++) {
+        orientations[i] = (double)(i % 3) * M_PI / 3.0;
+    }
+
+    if (!config || tomography_init(&tomography, config, orientations, 16, 1e-4) != 0) {
+        free_config(config);
+        return 1;
+    }
+
+    printf("  %u paths, %u pixels\n", num_paths, tomography.num_pixels);
+
+    PathMeasurement *frames = malloc(num_frames * num_paths * sizeof(PathMeasurement));
+    double *fields = malloc(num_frames * tomography.num_pixels * sizeof(double));
+    double *flows = malloc(num_frames * sizeof(double));
+    int status = 0;
+
+    if (!frames || !fields || !flows) {
+        status = 1;
+    } else {
+        const double skews[] = { 0.0, 0.3 };
+        const double radius = 0.25;
+
+        for (int k = 0; k < 2; k++) {
+            /* Reference flow by midpoint integration over a fine grid */
+            double exact = 0.0;
+            for (int a = 0; a < 1000; a++) {
+                for (int b = 0; b < 1000; b++) {
+                    exact += bench_profile((a + 0.5) / 500.0 - 1.0, (b + 0.5) / 500.0 - 1.0,
+                                           skews[k]);
+                }
+            }
+            exact *= (2.0 / 1000.0) * (2.0 / 1000.0) * radius * radius;
+
+            /* Chord means of the profile turned into transit times at 1480 m/s */
+            PathMeasurement measurements[18];
+            for (uint32_t i = 0; i < num_paths; i++) {
+                double p = config->paths[i].position;
+                double half = sqrt(1.0 - p * p);
+                double dx = cos(orientations[i]), dy = sin(orientations[i]);
+                double mean = 0.0;
+                for (int n = 0; n < 2000; n++) {
+                    double t = half * ((n + 0.5) / 1000.0 - 1.0);
+                    mean += bench_profile(-p * dy + t * dx, p * dx + t * dy, skews[k]) / 2000.0;
+                }
+                double sum = 2.0 * 1480.0 / config->paths[i].length;
+                double difference = mean / tomography.compiled.velocity_scale[i];
+                measurements[i].t_upstream = 2.0 / (sum - difference);
+                measurements[i].t_downstream = 2.0 / (sum + difference);
+            }
+
+            double tomographic = tomography_frame(&tomography, measurements, NULL);
+            double weighted = compiled_flow_rate(&tomography.compiled, measurements);
+            printf("  %s profile: weighted sum %+.2f%%, tomography %+.2f%% vs exact\n",
+                   k ? "skewed   " : "symmetric", 100.0 * (weighted / exact - 1.0),
+                   100.0 * (tomographic / exact - 1.0));
+
+            for (size_t f = k * (num_frames / 2); f < (k + 1) * (num_frames / 2); f++) {
+                memcpy(&frames[f * num_paths], measurements, sizeof(measurements));
+            }
+        }
+        for (size_t f = 2 * (num_frames / 2); f < num_frames; f++) {
+            memcpy(&frames[f * num_paths], frames, num_paths * sizeof(PathMeasurement));
+        }
+
+        /* Fault the output pages in so every variant starts warm */
+        memset(fields, 0, num_frames * tomography.num_pixels * sizeof(double));
+        memset(flows, 0, num_frames * sizeof(double));
+
+        double start = now_seconds();
+        for (size_t f = 0; f < num_frames; f++) {
+            flows[f] = tomography_frame(&tomography, &frames[f * num_paths],
+                                        &fields[f * tomography.num_pixels]);
+        }
+        double single = now_seconds() - start;
+        double reference = fields[(num_frames - 1) * tomography.num_pixels + 100];
+
+        start = now_seconds();
+        tomography_batch(&tomography, frames, num_frames, fields, flows);
+        double blocked = now_seconds() - start;
+
+        start = now_seconds();
+        tomography_batch(&tomography, frames, num_frames, NULL, flows);
+        double flow_only = now_seconds() - start;
+
+        printf("  field + flow, per frame %10.0f frames/s\n", (double)num_frames / single);
+        printf("  field + flow, blocked   %10.0f frames/s (%.2fx)%s\n",
+               (double)num_frames / blocked, single / blocked,
+               fabs(fields[(num_frames - 1) * tomography.num_pixels + 100] - reference) <=
+               1e-12 * fabs(reference) ? "" : " MISMATCH");
+        printf("  flow only, blocked      %10.0f frames/s\n", (double)num_frames / flow_only);
+    }
+
+    free(flows);
+    free(fields);
+    free(frames);
+    tomography_free(&tomography);
+    free_config(config);
+    return status;
+}
+
+/* ---- Partially filled pipe ---- */
+
+/**
+ * 8-path meter with the level sweeping from empty to full and a uniform
+ * 1.5 m/s velocity; paths above the surface have no signal. Flow with a
+ * level sensor and with the level inferred from the paths, against the
+ * full-pipe kernel.
+ */
+static int bench_partial(int argc, char **argv)
+{
+    if (argc > 2) {
+        return 2;
+    }
+
+    size_t num_frames = (argc > 1) ? strtoul(argv[1], NULL, 10) : 2000000;
+    const uint32_t num_paths = 8;
+    FlowMeterConfig *config = bench_config(num_paths, 1.0);
+    PathMeasurement *frames = malloc(num_frames * num_paths * sizeof(PathMeasurement));
+    double *levels = malloc(num_frames * sizeof(double));
+    double *flows = calloc(num_frames, sizeof(double));
+    PartialFill fill;
+    int status = 0;
+
+    if (!config || !frames || !levels || !flows || partial_fill_init(&fill, config, 0) != 0) {
+        free(flows);
+        free(levels);
+        free(frames);
+        free_config(config);
+        return 1;
+    }
+
+    for (size_t f = 0; f < num_frames; f++) {
+        levels[f] = (double)(f % 1000) / 999.0;
+        for (uint32_t i = 0; i < num_paths; i++) {
+            PathMeasurement *m = &frames[f * num_paths + i];
+            if (fill.heights[i] < 2.0 * levels[f] - 1.0) {
+                double sum = 2.0 * 1480.0 / config->paths[i].length;
+                double difference = 1.5 / fill.levels[0].velocity_scale[i];
+                m->t_upstream = 2.0 / (sum - difference);
+                m->t_downstream = 2.0 / (sum + difference);
+            } else {
+                m->t_upstream = 0.0;
+                m->t_downstream = 0.0;
+            }
+        }
+    }
+
+    CompiledConfig full;
+    if (flowmeter_compile(config, &full) != 0) {
+        status = 1;
+    } else {
+        double start = now_seconds();
+        calculate_flow_batch(&full, frames, num_frames, flows, NULL, 0);
+        double full_time = now_seconds() - start;
+
+        double worst[2] = { 0.0, 0.0 }, mean[2] = { 0.0, 0.0 };
+        double elapsed[2];
+
+        for (int mode = 0; mode < 2; mode++) {
+            start = now_seconds();
+            for (size_t f = 0; f < num_frames; f++) {
+                const PathMeasurement *measurements = &frames[f * num_paths];
+                if (mode == 0) {
+                    flows[f] = partial_fill_flow(&fill, levels[f], measurements);
+                } else {
+                    double level = partial_fill_infer(&fill, measurements);
+                    flows[f] = compiled_flow_rate(partial_fill_select(&fill, level), measurements);
+                }
+            }
+            elapsed[mode] = now_seconds() - start;
+
+            /*
+             * Error relative to the full-pipe flow, so near-empty pipes do
+             * not dominate; levels below the lowest path measure nothing
+             */
+            double full_flow = 1.5 * partial_fill_wetted_area(1.0, 1.0);
+            size_t counted = 0;
+            for (size_t f = 0; f < 1000 && f < num_frames; f++) {
+                if (2.0 * levels[f] - 1.0 <= fill.heights[0]) {
+                    continue;
+                }
+                double exact = 1.5 * partial_fill_wetted_area(1.0, levels[f]);
+                double error = fabs(flows[f] - exact) / full_flow;
+                worst[mode] = error > worst[mode] ? error : worst[mode];
+                mean[mode] += error;
+                counted++;
+            }
+            mean[mode] /= (double)(counted ? counted : 1);
+        }
+
+        printf("  full-pipe kernel   %10.0f frames/s\n", (double)num_frames / full_time);
+        printf("  level sensor       %10.0f frames/s, error mean %.3f%% max %.2f%% of full flow\n",
+               (double)num_frames / elapsed[0], 100.0 * mean[0], 100.0 * worst[0]);
+        printf("  level from paths   %10.0f frames/s, error mean %.3f%% max %.2f%% of full flow\n",
+               (double)num_frames / elapsed[1], 100.0 * mean[1], 100.0 * worst[1]);
+        flowmeter_compiled_free(&full);
+    }
+
+    partial_fill_free(&fill);
+    free(flows);
+    free(levels);
+    free(frames);
+    free_config(config);
+    return status;
+}
+
+/* ---- Conduit cross-sections ---- */
+
+/**
+ * 8-path meter on a rectangular culvert and two polygonal channels:
+ * compiled flow for uniform forward and reverse velocities against the
+ * analytic velocity x area, and the batch rate on each section
+ */
+static int bench_conduit(int argc, char **argv)
+{
+    if (argc > 2) {
+        return 2;
+    }
+
+    size_t num_frames = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+    const uint32_t num_paths = 8;
+    FlowMeterConfig *config = bench_config(num_paths, 1.0);
+    PathMeasurement *frames = malloc(num_frames * num_paths * sizeof(PathMeasurement));
+    double *flows = malloc(num_frames * sizeof(double));
+
+    /* Trapezoid counter-clockwise, house section clockwise */
+    static const double trapezoid[] = { 0.0, 0.0, 1.0, 0.0, 2.0, 1.0, -1.0, 1.0 };
+    static const double house[] = { 0.0, 0.0, 0.0, 1.0, 1.0, 1.6, 2.0, 1.0, 2.0, 0.0 };
+    const struct {
+        const char *name;
+        ConduitShape shape;
+        double area;
+    } sections[] = {
+        { "rectangle 2.0 x 1.2", { CONDUIT_RECTANGLE, 0.0, 2.0, 1.2, NULL, 0 }, 2.4 },
+        { "trapezoid 1.0/3.0 x 1.0", { CONDUIT_POLYGON, 0.0, 0.0, 0.0, trapezoid, 4 }, 2.0 },
+        { "house 2.0 x 1.6", { CONDUIT_POLYGON, 0.0, 0.0, 0.0, house, 5 }, 2.6 },
+    };
+    const double velocities[] = { 1.5, -0.8 };
+    int status = 0;
+
+    if (!config || !frames || !flows) {
+        free(flows);
+        free(frames);
+        free_config(config);
+        return 1;
+    }
+
+    for (size_t s = 0; s < sizeof(sections) / sizeof(sections[0]) && status == 0; s++) {
+        CompiledConfig compiled;
+        if (conduit_compile(config, &sections[s].shape, &compiled) != 0) {
+            status = 1;
+            break;
+        }
+
+        /* Uniform velocity turned into transit times at 1480 m/s */
+        double worst = 0.0;
+        for (int k = 0; k < 2; k++) {
+            PathMeasurement measurements[8];
+            for (uint32_t i = 0; i < num_paths; i++) {
+                double sum = 2.0 * 1480.0 / config->paths[i].length;
+                double difference = velocities[k] / compiled.velocity_scale[i];
+                measurements[i].t_upstream = 2.0 / (sum - difference);
+                measurements[i].t_downstream = 2.0 / (sum + difference);
+            }
+
+            double exact = velocities[k] * sections[s].area;
+            double error = fabs(compiled_flow_rate(&compiled, measurements) / exact - 1.0);
+            worst = error > worst ? error : worst;
+
+            for (size_t f = k * (num_frames / 2); f < (k + 1) * (num_frames / 2); f++) {
+                memcpy(&frames[f * num_paths], measurements, sizeof(measurements));
+            }
+        }
+        for (size_t f = 2 * (num_frames / 2); f < num_frames; f++) {
+            memcpy(&frames[f * num_paths], frames, num_paths * sizeof(PathMeasurement));
+        }
+
+        double start = now_seconds();
+        calculate_flow_batch(&compiled, frames, num_frames, flows, NULL, 0);
+        double elapsed = now_seconds() - start;
+
+        int match = worst <= 1e-12 && fabs(compiled.area - sections[s].area) <= 1e-12;
+        printf("  %-24s %10.0f frames/s, flow error %.1e vs analytic%s\n",
+               sections[s].name, (double)num_frames / elapsed, worst,
+               match ? "" : " MISMATCH");
+        status = match ? 0 : 1;
+        flowmeter_compiled_free(&compiled);
+    }
+
+    free(flows);
+    free(frames);
+    free_config(config);
+    return status;
+}
+
+/**
+ * Uniform deviate in (0, 1) from a xorshift64 state
+ */
+static double bench_uniform(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return ((double)(*state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+/**
+ * A transmitter with a 32-bit 1 MHz counter running 40 ppm fast, drifting
+ * a further ±5 ppm, sending a frame every 10 ms over a link with 20 ms
+ * latency, exponential jitter and occasional 200 ms stalls. The counter
+ * wraps every 72 minutes and the device reboots 60% of the way through.
+ */
+static int bench_clock(int argc, char **argv)
+{
+    if (argc > 2) {
+        return 2;
+    }
+
+    size_t num_frames = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+    const double period_ns = 10e6;
+    const double latency_ns = 20e6;
+    const double jitter_ns = 2e6;
+    uint64_t *ticks = malloc(num_frames * sizeof(uint64_t));
+    uint64_t *receive = malloc(num_frames * sizeof(uint64_t));
+    uint64_t *mapped = malloc(num_frames * sizeof(uint64_t));
+    double *sent = malloc(num_frames * sizeof(double));
+    ClockModel model;
+
+    if (!ticks || !receive || !mapped || !sent ||
+        clock_model_init(&model, 1e6, 32, 2000.0, 50e6) != 0) {
+        free(ticks);
+        free(receive);
+        free(mapped);
+        free(sent);
+        return 1;
+    }
+
+    /* Device counter integrates its drifting rate; the reboot restarts it */
+    uint64_t rng = 0x9e3779b97f4a7c15ULL;
+    size_t reboot = num_frames * 3 / 5;
+    double counter = 123456789.0;
+    for (size_t f = 0; f < num_frames; f++) {
+        double t = (double)f * period_ns;
+        double ppm = 40.0 + 5.0 * sin(t / 3.6e12 * 6.283185307179586);
+        if (f == reboot) {
+            counter = 0.0;
+        }
+        sent[f] = t;
+        ticks[f] = (uint64_t)counter & 0xffffffffULL;
+        double delay = latency_ns - jitter_ns * log(bench_uniform(&rng));
+        if (bench_uniform(&rng) < 0.001) {
+            delay += 200e6;
+        }
+        receive[f] = (uint64_t)(1e15 + t + delay);
+        counter += period_ns * 1e-3 * (1.0 + ppm * 1e-6);
+    }
+
+    memset(mapped, 0, num_frames * sizeof(uint64_t));  /* Fault pages in */
+
+    /* Fit on every frame and map it, as ingest would */
+    int resyncs_seen = 0;
+    double start = now_seconds();
+    for (size_t f = 0; f < num_frames; f++) {
+        if (clock_model_observe(&model, ticks[f], receive[f]) == CLOCK_SAMPLE_RESYNC) {
+            resyncs_seen++;
+        }
+        mapped[f] = clock_model_to_server(&model, ticks[f]);
+    }
+    double fitted = now_seconds() - start;
+
+    /*
+     * Error against send time plus the mean latency, skipping warm-up after
+     * the start and the reboot, next to using the receive time directly
+     */
+    const size_t settle = 2000;
+    double sum = 0.0, sum_sq = 0.0, worst = 0.0, raw_sq = 0.0;
+    size_t counted = 0;
+    for (size_t f = 0; f < num_frames; f++) {
+        if (f < settle || (f >= reboot && f < reboot + settle)) {
+            continue;
+        }
+        double truth = 1e15 + sent[f] + latency_ns + jitter_ns;
+        double error = (double)mapped[f] - truth;
+        double raw = (double)receive[f] - truth;
+        sum += error;
+        sum_sq += error * error;
+        raw_sq += raw * raw;
+        worst = fmax(worst, fabs(error));
+        counted++;
+    }
+
+    /* Mapping alone, against the final model, over the frames since reboot */
+    start = now_seconds();
+    clock_model_map(&model, &ticks[reboot], num_frames - reboot, &mapped[reboot]);
+    double mapping = now_seconds() - start;
+
+    printf("  observe + map   %8.1f ns/frame\n", fitted * 1e9 / (double)num_frames);
+    printf("  map only        %8.1f ns/frame\n",
+           mapping * 1e9 / (double)(num_frames - reboot));
+    printf("  %llu outliers ignored, %d resyncs, fitted rate %+.2f ppm\n",
+           (unsigned long long)model.outliers, resyncs_seen,
+           (1e3 / model.ns_per_tick - 1.0) * 1e6);
+    if (counted > 0) {
+        double mean = sum / (double)counted;
+        printf("  Mapped time error: mean %+.1f us, rms %.1f us, max %.1f us "
+               "(receive time rms %.1f us)\n",
+               mean * 1e-3, sqrt(sum_sq / (double)counted - mean * mean) * 1e-3,
+               worst * 1e-3, sqrt(raw_sq / (double)counted) * 1e-3);
+    }
+
+    free(ticks);
+    free(receive);
+    free(mapped);
+    free(sent);
+    return 0;
+}
+
+/**
+ * Wire encoding of a 4-path meter sampled by a 10 ps TDC: sound speed
+ * drifting slowly, per-path turbulence of about 1% (turbulent) or 0.1%
+ * (steady) of a 2 m/s flow and ±150 ps of timing noise, against 16 bytes
+ * per path of raw doubles
+ */
+static int bench_wire(int argc, char **argv)
+{
+    if (argc > 2) {
+        return 2;
+    }
+
+    size_t num_frames = (argc > 1) ? strtoul(argv[1], NULL, 10) : 2000000;
+    const double tick = 1e-11;
+    FlowMeterConfig *config = create_4path_config(0.5);
+    uint32_t num_paths = config ? config->num_paths : 0;
+    PathMeasurement *frames = malloc(num_frames * num_paths * sizeof(PathMeasurement));
+    PathMeasurement *decoded = malloc(num_frames * num_paths * sizeof(PathMeasurement));
+    uint8_t *encoded = malloc(wire_encode_bound(num_paths, num_frames));
+    CompiledConfig compiled;
+    WireEncoder encoder;
+    WireDecoder decoder;
+    int status = 0;
+
+    if (!frames || !decoded || !encoded || num_frames == 0 ||
+        flowmeter_compile(config, &compiled) != 0) {
+        free(encoded);
+        free(decoded);
+        free(frames);
+        free_config(config);
+        return 1;
+    }
+
+    /* Turbulence innovations of ±0.02 and ±0.002 m/s per frame */
+    const double innovations[] = { 0.04, 0.004 };
+    for (int k = 0; k < 2 && status == 0; k++) {
+        uint64_t rng = 0x2545f4914f6cdd1dULL;
+        double turbulence[FLOWMETER_MAX_PATHS] = { 0.0 };
+        for (size_t f = 0; f < num_frames; f++) {
+            double sound_speed = 1480.0 + 2.0 * sin((double)f * 1e-5);
+            for (uint32_t i = 0; i < num_paths; i++) {
+                turbulence[i] = 0.9 * turbulence[i] +
+                                innovations[k] * (bench_uniform(&rng) - 0.5);
+                double sum = 2.0 * sound_speed / config->paths[i].length;
+                double difference = (2.0 + turbulence[i]) / compiled.velocity_scale[i];
+                double up = 2.0 / (sum - difference) + 3e-10 * (bench_uniform(&rng) - 0.5);
+                double down = 2.0 / (sum + difference) + 3e-10 * (bench_uniform(&rng) - 0.5);
+                frames[f * num_paths + i].t_upstream = round(up / tick) * tick;
+                frames[f * num_paths + i].t_downstream = round(down / tick) * tick;
+            }
+        }
+
+        if (wire_encoder_init(&encoder, num_paths, tick, 256) != 0 ||
+            wire_decoder_init(&decoder, num_paths, tick) != 0) {
+            status = 1;
+            break;
+        }
+        memset(decoded, 0, num_frames * num_paths * sizeof(PathMeasurement));  /* Fault pages in */
+
+        double start = now_seconds();
+        size_t bytes = wire_encode(&encoder, frames, num_frames, encoded);
+        double encoding = now_seconds() - start;
+
+        size_t count = 0, consumed = 0;
+        start = now_seconds();
+        int result = wire_decode(&decoder, encoded, bytes, decoded, num_frames,
+                                 &count, &consumed);
+        double decoding = now_seconds() - start;
+
+        size_t mismatches = 0;
+        for (size_t n = 0; n < count * num_paths; n++) {
+            mismatches += llround(frames[n].t_upstream / tick) !=
+                          llround(decoded[n].t_upstream / tick);
+            mismatches += llround(frames[n].t_downstream / tick) !=
+                          llround(decoded[n].t_downstream / tick);
+        }
+
+        double per_path = (double)bytes / (double)(num_frames * num_paths);
+        printf("  %s flow: %.2f bytes per path-frame, %.1fx smaller than raw doubles\n",
+               k ? "steady   " : "turbulent", per_path,
+               (double)sizeof(PathMeasurement) / per_path);
+        printf("    encode %6.1f ns/frame, decode %6.1f ns/frame (%.0f MB/s of wire data)\n",
+               encoding * 1e9 / (double)num_frames, decoding * 1e9 / (double)num_frames,
+               (double)bytes / decoding * 1e-6);
+        printf("    %zu of %zu frames decoded, %zu tick mismatches%s\n", count, num_frames,
+               mismatches, result != 0 ? ", malformed input" : "");
+        if (result != 0 || count != num_frames || mismatches != 0) {
+            status = 1;
+        }
+    }
+
+    flowmeter_compiled_free(&compiled);
+    free(encoded);
+    free(decoded);
+    free(frames);
+    free_config(config);
+    return status;
+}
+
+/**
+ * A 100 Hz frame stream over a lossy link: 1% single losses, 3%
+ * duplicates delivered a few frames late, 1% adjacent swaps and a
+ * 40-frame outage every 50000 frames. Totals of the raw stream and of
+ * the deduplicated, gap-filled stream against the transmitted one.
+ */
+static int bench_sequence(int argc, char **argv)
+{
+    if (argc > 2) {
+        return 2;
+    }
+
+    size_t num_frames = (argc > 1) ? strtoul(argv[1], NULL, 10) : 2000000;
+    const double dt = 0.01;
+    uint64_t *sequences = malloc(2 * num_frames * sizeof(uint64_t));
+    double *flows = malloc(2 * num_frames * sizeof(double));
+    SequenceTracker tracker;
+
+    if (!sequences || !flows || num_frames == 0 || sequence_tracker_init(&tracker, 8) != 0) {
+        free(sequences);
+        free(flows);
+        return 1;
+    }
+
+    /* Delivery order, built by the link model */
+    uint64_t rng = 0x853c49e6748fea9bULL;
+    double sent_total = 0.0;
+    size_t delivered = 0;
+    for (size_t f = 0; f < num_frames; f++) {
+        double flow = 0.2 + 0.1 * sin((double)f * 2e-3);
+        sent_total += flow * dt;
+        if (f % 50000 >= 25000 && f % 50000 < 25040) {
+            continue;
+        }
+        if (bench_uniform(&rng) < 0.01) {
+            continue;
+        }
+        sequences[delivered] = f;
+        flows[delivered++] = flow;
+        if (bench_uniform(&rng) < 0.01 && delivered >= 2) {
+            uint64_t s = sequences[delivered - 1];
+            double q = flows[delivered - 1];
+            sequences[delivered - 1] = sequences[delivered - 2];
+            flows[delivered - 1] = flows[delivered - 2];
+            sequences[delivered - 2] = s;
+            flows[delivered - 2] = q;
+        }
+        if (bench_uniform(&rng) < 0.03 && delivered >= 4) {
+            sequences[delivered] = sequences[delivered - 4];
+            flows[delivered] = flows[delivered - 4];
+            delivered++;
+        }
+    }
+
+    double raw_total = 0.0;
+    for (size_t k = 0; k < delivered; k++) {
+        raw_total += flows[k] * dt;
+    }
+
+    double fill[8];
+    double total = 0.0;
+    double start = now_seconds();
+    for (size_t k = 0; k < delivered; k++) {
+        uint32_t num_fill;
+        int result = sequence_tracker_flow(&tracker, sequences[k], flows[k], fill, &num_fill);
+        if (result >= SEQUENCE_DUPLICATE) {
+            continue;
+        }
+        for (uint32_t n = 0; n < num_fill; n++) {
+            total += fill[n] * dt;
+        }
+        total += flows[k] * dt;
+    }
+    double elapsed = now_seconds() - start;
+
+    printf("  %zu frames sent, %zu delivered\n", num_frames, delivered);
+    printf("  %.1f ns/frame\n", elapsed * 1e9 / (double)delivered);
+    printf("  %llu duplicates, %llu late, %llu filled, %llu long gaps (%llu frames)\n",
+           (unsigned long long)tracker.duplicates, (unsigned long long)tracker.late,
+           (unsigned long long)tracker.filled, (unsigned long long)tracker.gaps,
+           (unsigned long long)tracker.missing);
+    printf("  Total error: raw stream %+.3f%%, deduplicated and filled %+.4f%%\n",
+           100.0 * (raw_total / sent_total - 1.0), 100.0 * (total / sent_total - 1.0));
+
+    free(sequences);
+    free(flows);
+    return 0;
+}
+
+/* qsort helper for medians */
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * 200 meters 1 km apart on one line, 100 Hz flow series, every pair up
+ * to 10 km apart correlated over 1024-sample windows. A burst at
+ * 100.35 km sends a step of ±2% (decaying with distance, 1000 m/s) over
+ * flow noise of ±0.33% and a slow oscillation of ±3%.
+ */
+static int bench_leak(int argc, char **argv)
+{
+    if (argc > 3) {
+        return 2;
+    }
+
+    uint32_t runs = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : 20;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t threads = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 10)
+                                  : (cpus > 0 ? (uint32_t)cpus : 1);
+    const uint32_t num_meters = 200, window = 1024, reach = 10;
+    const double fs = 100.0, wave_speed = 1000.0, burst_position = 100350.0;
+    LeakPair *pairs = malloc(num_meters * reach * sizeof(LeakPair));
+    LeakEstimate *estimates = malloc(num_meters * reach * sizeof(LeakEstimate));
+    double *samples = malloc((size_t)num_meters * window * sizeof(double));
+    const double **series = malloc(num_meters * sizeof(double *));
+    double *positions = malloc(num_meters * reach * sizeof(double));
+    LeakLocator locator;
+    uint32_t num_pairs = 0;
+
+    if (!pairs || !estimates || !samples || !series || !positions || runs == 0) {
+        free(pairs);
+        free(estimates);
+        free(samples);
+        free(series);
+        free(positions);
+        return 1;
+    }
+
+    for (uint32_t a = 0; a < num_meters; a++) {
+        for (uint32_t b = a + 1; b < num_meters && b <= a + reach; b++) {
+            LeakPair pair = { a, b, 1000.0 * a, 1000.0 * b, wave_speed };
+            pairs[num_pairs++] = pair;
+        }
+    }
+
+    uint64_t rng = 0xda942042e4dd58b5ULL;
+    for (uint32_t m = 0; m < num_meters; m++) {
+        double x = 1000.0 * m;
+        double distance = fabs(x - burst_position);
+        double step = (x < burst_position ? 0.006 : -0.006) * exp(-distance / 20000.0);
+        double arrival = 3.0 + distance / wave_speed;
+        for (uint32_t n = 0; n < window; n++) {
+            double t = (double)n / fs;
+            samples[(size_t)m * window + n] =
+                0.3 + 0.01 * sin(t * 0.3 + m) + 0.002 * (bench_uniform(&rng) - 0.5) +
+                step * 0.5 * (1.0 + tanh((t - arrival) / 0.05));
+        }
+        series[m] = &samples[(size_t)m * window];
+    }
+
+    if (leak_locator_init(&locator, pairs, num_pairs, window, 16, fs, 0.3, threads) != 0) {
+        free(pairs);
+        free(estimates);
+        free(samples);
+        free(series);
+        free(positions);
+        return 1;
+    }
+
+    double start = now_seconds();
+    for (uint32_t r = 0; r < runs; r++) {
+        leak_locator_run(&locator, series, estimates);
+    }
+    double elapsed = (now_seconds() - start) / (double)runs;
+
+    uint32_t located = 0;
+    for (uint32_t p = 0; p < num_pairs; p++) {
+        if (estimates[p].located) {
+            positions[located++] = estimates[p].position;
+        }
+    }
+
+    printf("  %u meters, %u pairs, %u-sample windows, %u threads\n",
+           num_meters, num_pairs, window, locator.num_threads);
+    printf("  %.2f ms per run (%.0f pairs/s), window covers %.2f s\n",
+           elapsed * 1e3, (double)num_pairs / elapsed, (double)window / fs);
+    if (located > 0) {
+        qsort(positions, located, sizeof(double), compare_doubles);
+        double median = positions[located / 2];
+        uint32_t close = 0;
+        for (uint32_t k = 0; k < located; k++) {
+            close += fabs(positions[k] - burst_position) < 100.0;
+        }
+        printf("  %u pairs located the burst (%u within 100 m): median %.1f m, error %+.1f m\n",
+               located, close, median, median - burst_position);
+    } else {
+        printf("  Burst not located\n");
+    }
+
+    leak_locator_free(&locator);
+    free(pairs);
+    free(estimates);
+    free(samples);
+    free(series);
+    free(positions);
+    return 0;
+}
+
+/* ---- Transient detection ---- */
+
+/* Approximately Gaussian deviate with unit variance (sum of four uniforms) */
+static double bench_noise(uint64_t *state)
+{
+    double sum = bench_uniform(state) + bench_uniform(state) +
+                 bench_uniform(state) + bench_uniform(state);
+    return (sum - 2.0) * sqrt(3.0);
+}
+
+/**
+ * A 4-path meter sampled at 2 kHz with 0.3 ns timing jitter and 1 cm/s
+ * turbulence. Every 50 s a transient starts, alternating between water
+ * hammer (a 4 Hz flow oscillation of 0.3 m/s decaying over 0.8 s) and
+ * cavitation (sound speed falling 120 m/s for 0.4 s, with 100 ns spikes
+ * on 2% of the frames).
+ */
+static int bench_transient(int argc, char **argv)
+{
+    if (argc > 2) {
+        return 2;
+    }
+
+    size_t num_frames = (argc > 1) ? strtoul(argv[1], NULL, 10) : 2000000;
+    const size_t chunk = 256;
+    const double frame_us = 500.0, period = 50.0;
+    FlowMeterConfig *config = bench_config(4, 0.5);
+    PathMeasurement *frames = malloc(num_frames * 4 * sizeof(PathMeasurement));
+    uint64_t *timestamps = malloc(num_frames * sizeof(uint64_t));
+    double *flows = malloc(num_frames * sizeof(double));
+    TransientEvent *events = malloc(4096 * sizeof(TransientEvent));
+    TransientLimits limits = { 4.0, 50.0, 8.0, 0.5, 64.0, 16, 32 };
+    TransientDetector detector;
+    CompiledConfig compiled;
+    int status = 0;
+
+    if (!config || !frames || !timestamps || !flows || !events || num_frames == 0 ||
+        flowmeter_compile(config, &compiled) != 0) {
+        free_config(config);
+        free(frames);
+        free(timestamps);
+        free(flows);
+        free(events);
+        return 1;
+    }
+
+    uint64_t rng = 0x9e3779b97f4a7c15ULL;
+    for (size_t f = 0; f < num_frames; f++) {
+        double t = (double)f * frame_us * 1e-6;
+        double since = fmod(t, period) - 0.5 * period;
+        int cavitation = ((uint64_t)(t / period)) % 2 == 1;
+        double velocity = 2.0 + 0.2 * sin(t * 0.05) + 0.01 * bench_noise(&rng);
+        double speed = 1480.0 + 0.5 * sin(t * 0.01);
+        double spike = 0.0;
+
+        if (since >= 0.0 && !cavitation && since < 6.0) {
+            double swing = exp(-since / 0.8) * sin(2.0 * M_PI * 4.0 * since);
+            velocity += 0.3 * swing;
+            speed += 0.2 * swing;
+        } else if (since >= 0.0 && cavitation) {
+            double drop = 120.0 * (1.0 - exp(-since / 0.005));
+            if (since >= 0.4) {
+                drop = 120.0 * (1.0 - exp(-0.4 / 0.005)) * exp(-(since - 0.4) / 0.05);
+            } else if (bench_uniform(&rng) < 0.02) {
+                spike = 100e-9;
+            }
+            speed -= drop;
+        }
+
+        timestamps[f] = (uint64_t)((double)f * frame_us);
+        for (uint32_t i = 0; i < 4; i++) {
+            double sum = 2.0 * speed / config->paths[i].length;
+            double difference = velocity / compiled.velocity_scale[i];
+            PathMeasurement *measurement = &frames[f * 4 + i];
+            measurement->t_upstream = 2.0 / (sum - difference) + 0.3e-9 * bench_noise(&rng);
+            measurement->t_downstream = 2.0 / (sum + difference) + 0.3e-9 * bench_noise(&rng);
+            if (spike > 0.0 && i == (f % 4)) {
+                measurement->t_downstream += (bench_uniform(&rng) < 0.5) ? spike : -spike;
+            }
+        }
+    }
+
+    memset(flows, 0, num_frames * sizeof(double));
+    double start = now_seconds();
+    calculate_flow_batch(&compiled, frames, num_frames, flows, NULL, 0);
+    double plain = now_seconds() - start;
+
+    size_t num_events = 0;
+    if (transient_detector_init(&detector, config, &limits) != 0) {
+        status = 1;
+    } else {
+        start = now_seconds();
+        for (size_t f = 0; f < num_frames; f += chunk) {
+            size_t n = (num_frames - f < chunk) ? num_frames - f : chunk;
+            size_t written = 0;
+            transient_detector_process(&detector, &frames[f * 4], &timestamps[f], n,
+                                       &events[num_events], 4096 - num_events, &written);
+            num_events += written;
+        }
+        double detecting = now_seconds() - start;
+
+        size_t injected[2] = { 0, 0 }, detected[2] = { 0, 0 }, correct[2] = { 0, 0 };
+        double latency[2] = { 0.0, 0.0 }, worst[2] = { 0.0, 0.0 };
+        size_t false_events = 0;
+        for (size_t k = 0; (double)k * period + 0.5 * period < (double)num_frames * frame_us * 1e-6; k++) {
+            injected[k % 2]++;
+        }
+        for (size_t e = 0; e < num_events; e++) {
+            double t = (double)events[e].timestamp_us * 1e-6;
+            double since = fmod(t, period) - 0.5 * period;
+            int k = (int)(((uint64_t)(t / period)) % 2);
+            if (since >= -0.002 && since < 0.1) {
+                double late = since * 1e6;
+                detected[k]++;
+                correct[k] += events[e].kind == (k ? TRANSIENT_CAVITATION : TRANSIENT_HAMMER);
+                latency[k] += late;
+                worst[k] = late > worst[k] ? late : worst[k];
+            } else {
+                false_events++;
+            }
+        }
+
+        printf("  %zu frames at %.0f Hz, 4 paths, %zu-frame chunks\n",
+               num_frames, 1e6 / frame_us, chunk);
+        printf("  flow only %.1f ns/frame, transient detection %.1f ns/frame "
+               "(%.3f%% of a core per meter)\n",
+               plain * 1e9 / (double)num_frames, detecting * 1e9 / (double)num_frames,
+               100.0 * detecting / ((double)num_frames * frame_us * 1e-6));
+        for (int k = 0; k < 2; k++) {
+            printf("  %-10s %zu/%zu detected, %zu classified correctly, onset "
+                   "%.0f µs after start on average (worst %.0f µs)\n",
+                   k ? "cavitation" : "hammer", detected[k], injected[k], correct[k],
+                   detected[k] ? latency[k] / (double)detected[k] : 0.0, worst[k]);
+        }
+        printf("  %zu false events, %llu blocks\n", false_events,
+               (unsigned long long)detector.blocks);
+    }
+
+    flowmeter_compiled_free(&compiled);
+    free_config(config);
+    free(frames);
+    free(timestamps);
+    free(flows);
+    free(events);
+    return status;
+}
+
+/* ---- Redundant meter fusion ---- */
+
+/**
+ * Pairs of 4-path meters in series, reporting once a second at their
+ * own phase. Meter A has 0.5% noise and meter B 1%. From halfway through,
+ * every 100th pair loses a path on meter B (its velocity reads 60% low),
+ * the next pair's meter A drifts 3% with an unchanged profile, and the
+ * pair after that loses meter A's stream.
+ */
+static int bench_fusion(int argc, char **argv)
+{
+    if (argc > 3) {
+        return 2;
+    }
+
+    uint32_t num_pairs = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : 10000;
+    uint32_t num_ticks = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 10) : 600;
+    const double area = M_PI * 0.25 * 0.25;
+    const double shape[4] = { 0.92, 1.04, 1.04, 0.92 };
+    uint32_t *num_paths = malloc(2 * (size_t)num_pairs * sizeof(uint32_t));
+    double *phases = malloc(2 * (size_t)num_pairs * sizeof(double));
+    double *flows = malloc((size_t)num_pairs * sizeof(double));
+    uint32_t *status = malloc((size_t)num_pairs * sizeof(uint32_t));
+    FusionLimits limits = { 5.0, 0.005, 1e-6, 0.1, 0.05, 30.0, 3.0, 5 };
+    FusionEngine engine;
+
+    if (!num_paths || !phases || !flows || !status || num_pairs == 0 ||
+        num_ticks < 4) {
+        free(num_paths);
+        free(phases);
+        free(flows);
+        free(status);
+        return 1;
+    }
+
+    uint64_t rng = 0x2545f4914f6cdd1dULL;
+    for (size_t m = 0; m < 2 * (size_t)num_pairs; m++) {
+        num_paths[m] = 4;
+        phases[m] = 0.9 * bench_uniform(&rng);
+    }
+
+    if (fusion_engine_init(&engine, num_pairs, num_paths, &limits) != 0) {
+        free(num_paths);
+        free(phases);
+        free(flows);
+        free(status);
+        return 1;
+    }
+
+    /* Squared errors of healthy pairs: fused, A alone, B alone */
+    double errors[3] = { 0.0, 0.0, 0.0 };
+    size_t samples = 0, false_flags = 0;
+    size_t flagged[3] = { 0, 0, 0 }, faulty[3] = { 0, 0, 0 };
+    double push_time = 0.0, tick_time = 0.0;
+    uint32_t half = num_ticks / 2;
+
+    for (uint32_t k = 0; k < num_ticks; k++) {
+        double start = now_seconds();
+        double generate = 0.0;
+        for (uint32_t side = 0; side < 2; side++) {
+            for (uint32_t p = 0; p < num_pairs; p++) {
+                size_t m = (size_t)side * num_pairs + p;
+                int kind = (k >= half) ? (int)(p % 100) : 0;
+                if (kind == 3 && side == 0) {
+                    continue;
+                }
+
+                double g0 = now_seconds();
+                double t = (double)k + phases[m];
+                double mean = 1.0 + 0.1 * sin(2.0 * M_PI * t / 600.0 + p);
+                double noise = side ? 0.02 : 0.01;
+                double velocities[4];
+                double flow = 0.0;
+                for (uint32_t i = 0; i < 4; i++) {
+                    velocities[i] = mean * shape[i] * (1.0 + noise * bench_noise(&rng));
+                    if (kind == 1 && side == 1 && i == 2) {
+                        velocities[i] *= 0.6;
+                    }
+                    flow += 0.25 * area * velocities[i];
+                }
+                if (kind == 2 && side == 0) {
+                    flow *= 1.03;
+                }
+                FlowResult result = { velocities, flow };
+                generate += now_seconds() - g0;
+
+                fusion_push(&engine, p, side, (uint64_t)(t * 1e9), &result);
+            }
+        }
+        push_time += now_seconds() - start - generate;
+
+        start = now_seconds();
+        fusion_tick(&engine, (uint64_t)k * 1000000000ULL, flows, NULL, status);
+        tick_time += now_seconds() - start;
+
+        if (k < 60) {
+            continue;
+        }
+        for (uint32_t p = 0; p < num_pairs; p++) {
+            double expected = area * 0.98 * (1.0 + 0.1 * sin(2.0 * M_PI * k / 600.0 + p));
+            int kind = (int)(p % 100);
+            if (kind >= 1 && kind <= 3) {
+                if (k == num_ticks - 1) {
+                    uint32_t want = (kind == 1) ? FUSION_B_FAULT :
+                                    (kind == 2) ? FUSION_UNRESOLVED : FUSION_A_STALE;
+                    faulty[kind - 1]++;
+                    flagged[kind - 1] += (status[p] & want) != 0;
+                }
+                continue;
+            }
+            false_flags += (status[p] & (FUSION_A_FAULT | FUSION_B_FAULT |
+                                         FUSION_UNRESOLVED)) != 0;
+            errors[0] += (flows[p] - expected) * (flows[p] - expected);
+            errors[1] += (engine.aligned[p] - expected) * (engine.aligned[p] - expected);
+            errors[2] += (engine.aligned[num_pairs + p] - expected) *
+                         (engine.aligned[num_pairs + p] - expected);
+            samples++;
+        }
+    }
+
+    double nominal = area * 0.98;
+    printf("  %u pairs, %u ticks\n", num_pairs, num_ticks);
+    printf("  push %.1f ns/result, tick %.1f ns/pair\n",
+           push_time * 1e9 / (2.0 * num_pairs * num_ticks),
+           tick_time * 1e9 / ((double)num_pairs * num_ticks));
+    if (samples > 0) {
+        printf("  healthy pairs rms error: fused %.3f%%, A alone %.3f%%, B alone %.3f%%\n",
+               100.0 * sqrt(errors[0] / (double)samples) / nominal,
+               100.0 * sqrt(errors[1] / (double)samples) / nominal,
+               100.0 * sqrt(errors[2] / (double)samples) / nominal);
+    } else {
+        printf("  healthy pairs rms error: no healthy pair ticks after the "
+               "60-tick warm-up\n");
+    }
+    printf("  %zu false fault flags over %zu pair ticks\n", false_flags, samples);
+    printf("  failed path on B: %zu/%zu isolated, drift on A: %zu/%zu unresolved, "
+           "lost A: %zu/%zu stale\n", flagged[0], faulty[0], flagged[1], faulty[1],
+           flagged[2], faulty[2]);
+
+    fusion_engine_free(&engine);
+    free(num_paths);
+    free(phases);
+    free(flows);
+    free(status);
+    return 0;
+}
+
+/* CPU time of the calling thread in seconds */
+static double thread_cpu_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Receive one emulated transmission with a given read strategy and print
+ * the reader's cost. chunk limits the bytes per read(), 0 for the whole
+ * free buffer.
+ */
+static int serial_run(const char *name, uint32_t baud, uint64_t num_frames, uint32_t vmin,
+                      uint32_t vtime, size_t chunk)
+{
+    const uint32_t num_paths = 4;
+    PathMeasurement frames[256 * 4];
+    SerialEmulator emulator;
+    SerialPort port;
+
+    if (serial_emulator_start(&emulator, num_paths, baud, num_frames, 0.001) != 0) {
+        return -1;
+    }
+    if (serial_port_open(&port, emulator.slave_path, 0, num_paths,
+                         SERIAL_EMULATOR_TICK) != 0 ||
+        serial_configure(port.fd, 0, vmin, vtime) != 0) {
+        serial_emulator_stop(&emulator);
+        return -1;
+    }
+
+    double checksum = 0.0;
+    double wall = now_seconds();
+    double cpu = thread_cpu_seconds();
+    for (;;) {
+        size_t space, count;
+        uint8_t *buffer = serial_decoder_space(&port.decoder, &space);
+        ssize_t received = read(port.fd, buffer, (chunk && chunk < space) ? chunk : space);
+        port.reads++;
+        if (received <= 0) {
+            break;
+        }
+        serial_decoder_commit(&port.decoder, (size_t)received);
+        port.bytes += (uint64_t)received;
+        while ((count = serial_decode(&port.decoder, frames, NULL, 256)) > 0) {
+            for (size_t k = 0; k < count * num_paths; k++) {
+                checksum += frames[k].t_upstream - frames[k].t_downstream;
+            }
+        }
+    }
+    cpu = thread_cpu_seconds() - cpu;
+    wall = now_seconds() - wall;
+    serial_emulator_stop(&emulator);
+
+    const SerialDecoder *decoder = &port.decoder;
+    printf("  %-22s %9.0f frames/CPU-s  %6.2f reads/frame  %5.1f%% CPU  "
+           "%llu/%llu corrupted dropped\n",
+           name, (double)decoder->frames / cpu, (double)port.reads / (double)decoder->frames,
+           100.0 * cpu / wall,
+           (unsigned long long)(emulator.frames_sent - decoder->frames),
+           (unsigned long long)emulator.corrupted);
+    if (!(checksum > 0.0)) {
+        printf("  unexpected transit times\n");
+    }
+
+    serial_port_close(&port);
+    return 0;
+}
+
+static int bench_serial(int argc, char **argv)
+{
+    if (argc > 3) {
+        return 2;
+    }
+
+    uint64_t num_frames = (argc > 1) ? strtoull(argv[1], NULL, 10) : 200000;
+    uint64_t paced_frames = (argc > 2) ? strtoull(argv[2], NULL, 10) : 5000;
+    static const struct {
+        const char *name;
+        uint32_t vmin;
+        uint32_t vtime;
+        size_t chunk;
+    } modes[] = {
+        { "byte reads", 1, 0, 1 },
+        { "VMIN=1", 1, 0, 0 },
+        { "VMIN=64 VTIME=1", 64, 1, 0 },
+        { "VMIN=255 VTIME=1", 255, 1, 0 },
+    };
+
+    if (num_frames == 0 || paced_frames == 0) {
+        return 1;
+    }
+
+    printf("  4-path frames (%zu bytes), 0.1%% corrupted\n", serial_frame_size(4));
+    printf("  Unpaced, %llu frames:\n", (unsigned long long)num_frames);
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        if (serial_run(modes[m].name, 0, num_frames, modes[m].vmin, modes[m].vtime,
+                       modes[m].chunk) != 0) {
+            return 1;
+        }
+    }
+    printf("  Paced at 921600 baud, %llu frames:\n", (unsigned long long)paced_frames);
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        if (serial_run(modes[m].name, 921600, paced_frames, modes[m].vmin, modes[m].vtime,
+                       modes[m].chunk) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    MqttPublisher *publisher;
+    uint32_t thread;
+    uint32_t num_threads;
+    uint32_t num_meters;
+    uint32_t num_groups;
+    uint32_t ticks;
+    int bulk;
+    double cpu;
+    uint64_t waits;
+} MqttBenchWorker;
+
+/*
+ * Compute thread: publish a result per meter per tick for its groups,
+ * one call per result or per group, backing off 50 µs whenever the pool
+ * is full so that every result is sent
+ */
+static void* mqtt_bench_worker(void *arg)
+{
+    MqttBenchWorker *worker = arg;
+    size_t per_group = worker->num_meters / worker->num_groups + 1;
+    uint64_t *timestamps = malloc(per_group * sizeof(uint64_t));
+    uint32_t *meters = malloc(per_group * sizeof(uint32_t));
+    double *flows = malloc(per_group * sizeof(double));
+    double velocities[4] = { 1.0, 1.0, 1.0, 1.0 };
+    struct timespec pause = { 0, 50000 };
+    double cpu = thread_cpu_seconds();
+
+    for (uint32_t k = 0; k < worker->ticks && timestamps && meters && flows; k++) {
+        uint64_t timestamp_ns = 1700000000000000000ULL + (uint64_t)k * 1000000000ULL;
+        for (uint32_t g = worker->thread; g < worker->num_groups; g += worker->num_threads) {
+            size_t count = 0;
+            for (uint32_t m = g; m < worker->num_meters; m += worker->num_groups) {
+                FlowResult result = { velocities, 0.05 + 1e-6 * (double)(m % 1000) + 1e-9 * k };
+                if (!worker->bulk) {
+                    while (mqtt_publish(worker->publisher, g, timestamp_ns, m, &result) == 1) {
+                        nanosleep(&pause, NULL);
+                        worker->waits++;
+                    }
+                    continue;
+                }
+                timestamps[count] = timestamp_ns;
+                meters[count] = m;
+                flows[count++] = result.volumetric_flow;
+            }
+
+            size_t done = 0;
+            while (done < count) {
+                done += mqtt_publish_flows(worker->publisher, g, count - done,
+                                           timestamps + done, meters + done, flows + done);
+                if (done < count) {
+                    nanosleep(&pause, NULL);
+                    worker->waits++;
+                }
+            }
+        }
+    }
+
+    worker->cpu = thread_cpu_seconds() - cpu;
+    free(timestamps);
+    free(meters);
+    free(flows);
+    return NULL;
+}
+
+/*
+ * Publish num_meters x ticks results from four compute threads to the
+ * test broker and print the cost. Groups are meter ID modulo num_groups,
+ * and each thread owns every fourth group.
+ */
+static int mqtt_run(const char *name, uint32_t num_meters, uint32_t ticks,
+                    uint32_t max_records, int bulk, uint32_t disconnect_every)
+{
+    enum { NUM_THREADS = 4 };
+    const uint32_t num_groups = 100;
+    MqttBroker broker;
+    MqttPublisher publisher;
+    MqttBenchWorker workers[NUM_THREADS];
+    pthread_t threads[NUM_THREADS];
+
+    if (mqtt_broker_start(&broker, disconnect_every) != 0) {
+        return -1;
+    }
+
+    MqttConfig config = { "127.0.0.1", broker.port, "flowbench", "flow", num_groups,
+                          max_records, 50, 64, 1024, 30 };
+    if (max_records == 1) {
+        config.max_inflight = 1024;
+        config.queue_batches = 8192;
+    }
+    if (mqtt_publisher_start(&publisher, &config) != 0) {
+        mqtt_broker_stop(&broker);
+        return -1;
+    }
+
+    double start = now_seconds();
+    uint32_t started = 0;
+    for (; started < NUM_THREADS; started++) {
+        MqttBenchWorker worker = { &publisher, started, NUM_THREADS, num_meters, num_groups,
+                                   ticks, bulk, 0.0, 0 };
+        workers[started] = worker;
+        if (pthread_create(&threads[started], NULL, mqtt_bench_worker,
+                           &workers[started]) != 0) {
+            break;
+        }
+    }
+
+    double compute_cpu = 0.0;
+    uint64_t waits = 0;
+    for (uint32_t t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+        compute_cpu += workers[t].cpu;
+        waits += workers[t].waits;
+    }
+    int flushed = mqtt_publisher_flush(&publisher, 30000);
+    double elapsed = now_seconds() - start;
+
+    clockid_t clock;
+    struct timespec ts = { 0, 0 };
+    if (pthread_getcpuclockid(publisher.thread, &clock) == 0) {
+        clock_gettime(clock, &ts);
+    }
+    double network_cpu = (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+
+    mqtt_publisher_stop(&publisher);
+    mqtt_broker_stop(&broker);
+
+    double results = (double)num_meters * ticks;
+    printf("  %-22s %6.1f ns/result compute, %6.1f ns/result network thread, "
+           "%5.2f M results/s\n", name, compute_cpu * 1e9 / results,
+           network_cpu * 1e9 / results, results / elapsed * 1e-6);
+    printf("  %-22s %llu publishes in %llu sends, %.1f wire bytes/result, "
+           "%llu connections\n", "", (unsigned long long)publisher.publishes,
+           (unsigned long long)publisher.sends, (double)publisher.bytes_sent / results,
+           (unsigned long long)broker.connections);
+    printf("  %-22s %llu/%.0f results delivered, %llu full-pool waits, %llu duplicate and "
+           "%llu missing batches%s\n", "", (unsigned long long)broker.records, results,
+           (unsigned long long)waits, (unsigned long long)broker.duplicates,
+           (unsigned long long)broker.missing, flushed ? ", flush timed out" : "");
+    return started == NUM_THREADS ? 0 : -1;
+}
+
+static int bench_mqtt(int argc, char **argv)
+{
+    if (argc > 3) {
+        return 2;
+    }
+
+    uint32_t num_meters = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : 10000;
+    uint32_t ticks = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 10) : 100;
+    if (num_meters == 0 || ticks == 0) {
+        return 1;
+    }
+
+    printf("  %u meters in 100 groups, %u results each, 4 compute threads\n",
+           num_meters, ticks);
+    if (mqtt_run("message per result", num_meters, ticks, 1, 0, 0) != 0 ||
+        mqtt_run("batches of 1024", num_meters, ticks, 1024, 0, 0) != 0 ||
+        mqtt_run("... call per group", num_meters, ticks, 1024, 1, 0) != 0 ||
+        mqtt_run("... broker drops link", num_meters, ticks, 1024, 1, 100) != 0) {
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Write one of three overlapping collector logs: each holds about 80% of
+ * the frames, every 997th frame differs per log (a conflict), and log 1
+ * is written in reverse blocks of 1000 frames
+ */
+static int merge_write_log(const char *filename, uint32_t log, uint32_t frames)
+{
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        return -1;
+    }
+
+    fprintf(file, "timestamp,meter,path,t_up,t_down\n");
+    uint32_t blocks = (frames + 999) / 1000;
+    for (uint32_t b = 0; b < blocks; b++) {
+        uint32_t block = log == 1 ? blocks - 1 - b : b;
+        for (uint32_t k = block * 1000; k < frames && k < (block + 1) * 1000; k++) {
+            uint64_t state = ((uint64_t)k << 8 | log) * 0x9E3779B97F4A7C15ull + 1;
+            if (bench_uniform(&state) >= 0.8) {
+                continue;
+            }
+            double skew = (k % 997 == log) ? 1e-12 * (log + 1) : 0.0;
+            for (uint32_t p = 0; p < 4; p++) {
+                fprintf(file, "%u.%06u,%u,%u,%.10e,%.10e\n", 1700000000 + k / 50000,
+                        (k / 50) % 1000 * 1000, k % 50, p, 1.0e-4 + p * 1e-7 + skew,
+                        1.0e-4 + p * 1e-7 - 2e-8);
+            }
+        }
+    }
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+/*
+ * FNV-1a hash of a file's contents
+ */
+static uint64_t merge_file_hash(const char *filename)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    unsigned char buffer[1 << 16];
+    size_t n;
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        return 0;
+    }
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            hash = (hash ^ buffer[i]) * 0x100000001b3ull;
+        }
+    }
+    fclose(file);
+    return hash;
+}
+
+/*
+ * Merge three overlapping logs with conflicts under several thread
+ * counts and memory budgets; every capture must be byte-identical and
+ * report the same duplicate and conflict counts
+ */
+static int bench_merge(int argc, char **argv)
+{
+    if (argc > 2) {
+        return 2;
+    }
+
+    uint32_t frames = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : 200000;
+    const char *dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    char names[3][4096], output[4096];
+    const char *inputs[3];
+    static const struct {
+        uint32_t threads;
+        size_t memory;
+    } configs[] = { { 1, 0 }, { 3, 100000 }, { 2, 1 << 20 }, { 3, 40000 }, { 1, 300000 } };
+    if (frames == 0) {
+        return 1;
+    }
+
+    for (uint32_t l = 0; l < 3; l++) {
+        snprintf(names[l], sizeof(names[l]), "%s/flowbench-merge-%u.csv", dir, l);
+        inputs[l] = names[l];
+        if (merge_write_log(names[l], l, frames) != 0) {
+            fprintf(stderr, "Error: cannot write %s\n", names[l]);
+            return 1;
+        }
+    }
+    snprintf(output, sizeof(output), "%s/flowbench-merge.cap", dir);
+
+    uint64_t reference = 0;
+    CaptureMergeStats first;
+    int status = 0;
+    printf("  %u frames, three logs with 80%% coverage each\n", frames);
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]) && status == 0; c++) {
+        CaptureMergeOptions options = { 4, configs[c].threads, configs[c].memory, dir };
+        CaptureMergeStats stats;
+        double start = now_seconds();
+        if (capture_merge(inputs, 3, output, &options, &stats) != 0) {
+            fprintf(stderr, "Error: merge failed\n");
+            status = 1;
+            break;
+        }
+        double elapsed = now_seconds() - start;
+        uint64_t hash = merge_file_hash(output);
+        if (c == 0) {
+            reference = hash;
+            first = stats;
+        }
+        int same = hash == reference && stats.duplicates == first.duplicates &&
+                   stats.conflicts == first.conflicts &&
+                   stats.records_written == first.records_written;
+        printf("  %u threads, %7zu kB budget: %6.0f ms, %4llu runs, %llu written, "
+               "%llu duplicates, %llu conflicts, %s\n", configs[c].threads,
+               (configs[c].memory ? configs[c].memory : CAPTURE_MERGE_DEFAULT_MEMORY) >> 10,
+               elapsed * 1e3, (unsigned long long)stats.runs,
+               (unsigned long long)stats.records_written,
+               (unsigned long long)stats.duplicates, (unsigned long long)stats.conflicts,
+               same ? "identical" : "DIFFERENT");
+        if (!same) {
+            status = 1;
+        }
+    }
+
+    for (uint32_t l = 0; l < 3; l++) {
+        unlink(names[l]);
+    }
+    unlink(output);
+    return status;
+}
+
+/*
+ * Send one GET on a keep-alive connection and read the whole chunked
+ * response. Returns the response size in bytes, or -1 on an error or a
+ * status other than 200.
+ */
+static long query_fetch(int fd, const char *target, char *buffer, size_t size)
+{
+    static const char terminator[] = "\r\n0\r\n\r\n";
+    const size_t tail_size = sizeof(terminator) - 1;
+    char tail[sizeof(terminator) - 1];
+    int length = snprintf(buffer, size, "GET %s HTTP/1.1\r\nHost: flowbench\r\n\r\n", target);
+    long total = 0;
+
+    if (length <= 0 || (size_t)length >= size ||
+        send(fd, buffer, (size_t)length, MSG_NOSIGNAL) != length) {
+        return -1;
+    }
+
+    memset(tail, 0, sizeof(tail));
+    for (;;) {
+        ssize_t n = recv(fd, buffer, size, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        if (total == 0 && (n < 12 || memcmp(buffer, "HTTP/1.1 200", 12) != 0)) {
+            return -1;
+        }
+        total += n;
+
+        /* The response ends with the last chunk */
+        if ((size_t)n >= tail_size) {
+            memcpy(tail, buffer + n - tail_size, tail_size);
+        } else {
+            memmove(tail, tail + n, tail_size - (size_t)n);
+            memcpy(tail + tail_size - (size_t)n, buffer, (size_t)n);
+        }
+        if (memcmp(tail, terminator, tail_size) == 0) {
+            return total;
+        }
+    }
+}
+
+/*
+ * Time repeated queries of one kind; %u in the pattern is replaced by a
+ * random meter ID or group, %llu pairs by a random week
+ */
+static int query_time(const char *name, int fd, const char *pattern, uint32_t range,
+                      int week, uint64_t start_ns, uint32_t runs, uint64_t *state)
+{
+    char target[256];
+    char *buffer = malloc(1 << 16);
+    double *latency = malloc(runs * sizeof(double));
+    double bytes = 0.0;
+
+    if (!buffer || !latency) {
+        free(buffer);
+        free(latency);
+        return -1;
+    }
+
+    for (uint32_t r = 0; r < runs; r++) {
+        uint32_t id = (uint32_t)(bench_uniform(state) * range);
+        if (week) {
+            const uint64_t week_ns = 7ull * 86400 * 1000000000ull;
+            uint64_t from = start_ns + (uint64_t)(bench_uniform(state) * 358.0 * 86400.0) *
+                                       1000000000ull;
+            snprintf(target, sizeof(target), pattern, id, (unsigned long long)from,
+                     (unsigned long long)(from + week_ns));
+        } else {
+            snprintf(target, sizeof(target), pattern, id);
+        }
+
+        double begin = now_seconds();
+        long size = query_fetch(fd, target, buffer, 1 << 16);
+        latency[r] = now_seconds() - begin;
+        if (size < 0) {
+            fprintf(stderr, "Query failed: %s\n", target);
+            free(buffer);
+            free(latency);
+            return -1;
+        }
+        bytes += (double)size;
+    }
+
+    qsort(latency, runs, sizeof(double), compare_doubles);
+    printf("  %-30s median %9.1f us, p99 %9.1f us, %9.0f bytes\n", name,
+           latency[runs / 2] * 1e6, latency[(size_t)(runs * 0.99)] * 1e6, bytes / runs);
+    free(buffer);
+    free(latency);
+    return 0;
+}
+
+/*
+ * Open a keep-alive client connection to a local port
+ */
+static int query_connect(uint16_t port)
+{
+    struct sockaddr_in address;
+    int one = 1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * A year of hourly results for num_meters meters in 100 groups, rolled
+ * up to days, served over HTTP. Latency is measured from a keep-alive
+ * client in the same process, on a warm page cache. Group queries run
+ * against one server with three scan threads and one without.
+ */
+static int bench_query(int argc, char **argv)
+{
+    if (argc > 3) {
+        return 2;
+    }
+
+    uint32_t num_meters = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : 10000;
+    const char *filename = (argc > 2) ? argv[2] : "/tmp/flowbench.roll";
+    const uint32_t num_groups = 100;
+    const uint32_t hours = 8760;
+    const uint64_t start_ns = 1735689600ull * 1000000000ull;
+    const uint64_t widths[2] = { 3600ull * 1000000000ull, 86400ull * 1000000000ull };
+    if (num_meters < num_groups) {
+        return 1;
+    }
+
+    RollupMeter *meters = malloc(num_meters * sizeof(RollupMeter));
+    double *factor = malloc(hours * sizeof(double));
+    if (!meters || !factor) {
+        free(meters);
+        free(factor);
+        return 1;
+    }
+    for (uint32_t i = 0; i < num_meters; i++) {
+        meters[i].meter_id = i;
+        meters[i].group = i % num_groups;
+    }
+    /* Seasonal and daily demand cycles */
+    for (uint32_t h = 0; h < hours; h++) {
+        factor[h] = (1.0 + 0.3 * sin(2.0 * M_PI * h / hours)) *
+                    (1.0 + 0.2 * sin(2.0 * M_PI * (h % 24) / 24.0));
+    }
+
+    RollupWriter writer;
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    double begin = now_seconds();
+    if (rollup_writer_open(&writer, filename, meters, num_meters, start_ns,
+                           start_ns + hours * widths[0], widths, 2) != 0) {
+        fprintf(stderr, "Error: cannot create %s\n", filename);
+        free(meters);
+        free(factor);
+        return 1;
+    }
+    for (uint32_t i = 0; i < num_meters; i++) {
+        double base = 0.01 + 0.1 * bench_uniform(&state);
+        for (uint32_t h = 0; h < hours; h++) {
+            double mean = base * factor[h] * (1.0 + 0.05 * bench_noise(&state));
+            RollupStats stats = { 3600, mean * 3600.0, mean * 0.8, mean * 1.2 };
+            rollup_writer_add_stats(&writer, i, start_ns + h * widths[0], &stats);
+        }
+    }
+    int closed = rollup_writer_close(&writer);
+    double build = now_seconds() - begin;
+    free(meters);
+    free(factor);
+
+    RollupFile store;
+    if (closed != 0 || rollup_open(filename, &store) != 0) {
+        fprintf(stderr, "Error: cannot build %s\n", filename);
+        unlink(filename);
+        return 1;
+    }
+    printf("  %u meters in %u groups, %u hours of results each, hour and day levels\n",
+           num_meters, num_groups, hours);
+    printf("  store of %.2f GB built in %.1f s\n", (double)store.size / 1e9, build);
+
+    QueryServer parallel, serial;
+    int status = 1;
+    if (query_server_start(&parallel, &store, NULL, 0, 1, 3) != 0) {
+        rollup_close(&store);
+        unlink(filename);
+        return 1;
+    }
+    if (query_server_start(&serial, &store, NULL, 0, 1, 0) != 0) {
+        query_server_stop(&parallel);
+        rollup_close(&store);
+        unlink(filename);
+        return 1;
+    }
+
+    int fd = query_connect(parallel.port);
+    int serial_fd = query_connect(serial.port);
+    if (fd >= 0 && serial_fd >= 0 &&
+        query_time("meter: year aggregate", fd, "/aggregate?meter=%u", num_meters, 0,
+                   start_ns, 2000, &state) == 0 &&
+        query_time("... hourly buckets only", fd, "/aggregate?meter=%u&max_level=0",
+                   num_meters, 0, start_ns, 2000, &state) == 0 &&
+        query_time("... with p50 and p99", fd,
+                   "/aggregate?meter=%u&stats=count,mean,p50,p99", num_meters, 0,
+                   start_ns, 2000, &state) == 0 &&
+        query_time("meter: week aggregate", fd, "/aggregate?meter=%u&from=%llu&to=%llu",
+                   num_meters, 1, start_ns, 2000, &state) == 0 &&
+        query_time("meter: 1000-point series", fd, "/series?meter=%u&points=1000",
+                   num_meters, 0, start_ns, 500, &state) == 0 &&
+        query_time("meter: year of days", fd, "/range?meter=%u&level=1", num_meters, 0,
+                   start_ns, 500, &state) == 0 &&
+        query_time("meter: year of hours", fd, "/range?meter=%u", num_meters, 0,
+                   start_ns, 200, &state) == 0 &&
+        query_time("group: year aggregate", fd, "/aggregate?group=%u", num_groups, 0,
+                   start_ns, 500, &state) == 0 &&
+        query_time("... no scan threads", serial_fd, "/aggregate?group=%u", num_groups, 0,
+                   start_ns, 500, &state) == 0 &&
+        query_time("... hourly buckets only", fd, "/aggregate?group=%u&max_level=0",
+                   num_groups, 0, start_ns, 100, &state) == 0 &&
+        query_time("group: with p50 and p99", fd,
+                   "/aggregate?group=%u&stats=count,mean,p50,p99", num_groups, 0,
+                   start_ns, 100, &state) == 0 &&
+        query_time("... no scan threads", serial_fd,
+                   "/aggregate?group=%u&stats=count,mean,p50,p99", num_groups, 0,
+                   start_ns, 100, &state) == 0 &&
+        query_time("group: 365-point series", fd, "/series?group=%u&points=365",
+                   num_groups, 0, start_ns, 100, &state) == 0 &&
+        query_time("... no scan threads", serial_fd, "/series?group=%u&points=365",
+                   num_groups, 0, start_ns, 100, &state) == 0) {
+        status = 0;
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (serial_fd >= 0) {
+        close(serial_fd);
+    }
+    query_server_stop(&serial);
+    query_server_stop(&parallel);
+    rollup_close(&store);
+    unlink(filename);
+    return status;
+}
+
+static const BenchCommand benchmarks[] = {
+    { "csv", "[size_mb] [file]", bench_csv },
+    { "results", "[count]", bench_results },
+    { "pipeline", "[frames]", bench_pipeline },
+    { "jit", "[frames]", bench_jit },
+    { "lazy", "[frames]", bench_lazy },
+    { "incremental", "[frames]", bench_incremental },
+    { "quality", "[frames]", bench_quality },
+    { "thermal", "[frames]", bench_thermal },
+    { "soundspeed", "[frames]", bench_sound_speed },
+    { "tomography", "[frames]", bench_tomography },
+    { "partial", "[frames]", bench_partial },
+    { "conduit", "[frames]", bench_conduit },
+    { "clock", "[frames]", bench_clock },
+    { "wire", "[frames]", bench_wire },
+    { "sequence", "[frames]", bench_sequence },
+    { "merge", "[frames]", bench_merge },
+    { "leak", "[runs] [threads]", bench_leak },
+    { "transient", "[frames]", bench_transient },
+    { "fusion", "[pairs] [ticks]", bench_fusion },
+    { "serial", "[frames] [paced_frames]", bench_serial },
+    { "mqtt", "[meters] [results]", bench_mqtt },
+    { "query", "[meters] [file]", bench_query },
+};
+
+static void print_usage(void)
+{
+    fprintf(stderr, "Usage: flowbench <benchmark> [arguments...]\n\nBenchmarks:\n");
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        fprintf(stderr, "  %-16s %s\n", benchmarks[i].name, benchmarks[i].usage);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        print_usage();
+        return 2;
+    }
+
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        if (strcmp(argv[1], benchmarks[i].name) == 0) {
+            int status = benchmarks[i].run(argc - 1, argv + 1);
+            if (status == 2) {
+                fprintf(stderr, "Usage: flowbench %s %s\n",
+                        benchmarks[i].name, benchmarks[i].usage);
+            }
+            return status;
+        }
+    }
+
+    print_usage();
+    return 2;
+}
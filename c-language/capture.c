@@ -0,0 +1,291 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "capture.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CAPTURE_ALIGN 64u
+#define CAPTURE_DEFAULT_BUFFER (1u << 20)
+
+static uint64_t align_up(uint64_t value)
+{
+    return (value + CAPTURE_ALIGN - 1) & ~(uint64_t)(CAPTURE_ALIGN - 1);
+}
+
+/**
+ * Write a byte range, retrying partial writes
+ */
+static int write_all(int fd, const void *data, size_t size)
+{
+    const unsigned char *p = data;
+
+    while (size > 0) {
+        ssize_t written = write(fd, p, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += written;
+        size -= (size_t)written;
+    }
+    return 0;
+}
+
+static int writer_flush(CaptureWriter *writer)
+{
+    if (writer->used > 0 && write_all(writer->fd, writer->buffer, writer->used) != 0) {
+        writer->error = 1;
+    }
+    writer->used = 0;
+    return writer->error ? -1 : 0;
+}
+
+/**
+ * Create a capture file
+ */
+int capture_writer_open(CaptureWriter *writer, const char *filename,
+                        uint32_t paths_per_record, size_t buffer_size)
+{
+    if (!writer || !filename || paths_per_record > FLOWMETER_MAX_PATHS) {
+        return -1;
+    }
+
+    memset(writer, 0, sizeof(*writer));
+    writer->paths_per_record = paths_per_record;
+    writer->record_size = capture_record_size(paths_per_record);
+    writer->capacity = buffer_size ? buffer_size : CAPTURE_DEFAULT_BUFFER;
+    if (writer->capacity < writer->record_size) {
+        writer->capacity = writer->record_size;
+    }
+
+    writer->buffer = malloc(writer->capacity);
+    if (!writer->buffer) {
+        return -1;
+    }
+
+    writer->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        free(writer->buffer);
+        return -1;
+    }
+
+    /* Header placeholder, rewritten on close */
+    memset(writer->buffer, 0, align_up(sizeof(CaptureHeader)));
+    writer->used = align_up(sizeof(CaptureHeader));
+    return 0;
+}
+
+/**
+ * Append a record; keys must be strictly increasing
+ */
+int capture_writer_append(CaptureWriter *writer, const CaptureRecordHeader *record)
+{
+    if (writer->error || record->num_paths > writer->paths_per_record) {
+        return -1;
+    }
+
+    CaptureIndexEntry *last = writer->num_meters ? &writer->index[writer->num_meters - 1] : NULL;
+    if (last && (record->meter_id < last->meter_id ||
+                 (record->meter_id == last->meter_id &&
+                  record->timestamp_ns <= last->last_timestamp_ns))) {
+        return -1;
+    }
+
+    if (!last || record->meter_id != last->meter_id) {
+        if (writer->num_meters == writer->index_capacity) {
+            uint32_t capacity = writer->index_capacity ? 2 * writer->index_capacity : 64;
+            CaptureIndexEntry *index = realloc(writer->index, capacity * sizeof(*index));
+            if (!index) {
+                writer->error = 1;
+                return -1;
+            }
+            writer->index = index;
+            writer->index_capacity = capacity;
+        }
+        last = &writer->index[writer->num_meters++];
+        memset(last, 0, sizeof(*last));
+        last->meter_id = record->meter_id;
+        last->first_record = writer->num_records;
+        last->first_timestamp_ns = record->timestamp_ns;
+    }
+    last->num_records++;
+    last->last_timestamp_ns = record->timestamp_ns;
+
+    if (writer->capacity - writer->used < writer->record_size && writer_flush(writer) != 0) {
+        return -1;
+    }
+    memcpy(writer->buffer + writer->used, record, writer->record_size);
+    writer->used += writer->record_size;
+    writer->num_records++;
+    return 0;
+}
+
+/**
+ * Write the index and header and close the file
+ */
+int capture_writer_close(CaptureWriter *writer)
+{
+    uint64_t records_offset = align_up(sizeof(CaptureHeader));
+    uint64_t index_offset = align_up(records_offset + writer->num_records * writer->record_size);
+    uint64_t records_end = records_offset + writer->num_records * writer->record_size;
+    static const unsigned char zeros[CAPTURE_ALIGN];
+
+    writer_flush(writer);
+    if (!writer->error &&
+        (write_all(writer->fd, zeros, (size_t)(index_offset - records_end)) != 0 ||
+         write_all(writer->fd, writer->index,
+                   writer->num_meters * sizeof(CaptureIndexEntry)) != 0)) {
+        writer->error = 1;
+    }
+
+    CaptureHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = CAPTURE_VERSION;
+    header.paths_per_record = writer->paths_per_record;
+    header.file_size = index_offset + writer->num_meters * sizeof(CaptureIndexEntry);
+    header.num_records = writer->num_records;
+    header.records_offset = records_offset;
+    header.index_offset = index_offset;
+    header.num_meters = writer->num_meters;
+
+    if (!writer->error && pwrite(writer->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        writer->error = 1;
+    }
+    if (close(writer->fd) != 0) {
+        writer->error = 1;
+    }
+
+    free(writer->buffer);
+    free(writer->index);
+    writer->buffer = NULL;
+    writer->index = NULL;
+    return writer->error ? -1 : 0;
+}
+
+/**
+ * Map a capture file and validate its header and section bounds
+ */
+int capture_open(const char *filename, CaptureFile *capture)
+{
+    if (!filename || !capture) {
+        return -1;
+    }
+
+    memset(capture, 0, sizeof(*capture));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(CaptureHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)info.st_size;
+    void *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+
+    const CaptureHeader *header = base;
+    size_t record_size = capture_record_size(header->paths_per_record);
+    int valid = memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) == 0 &&
+                header->version == CAPTURE_VERSION &&
+                header->paths_per_record <= FLOWMETER_MAX_PATHS &&
+                header->file_size == size &&
+                header->records_offset % CAPTURE_ALIGN == 0 &&
+                header->index_offset % CAPTURE_ALIGN == 0 &&
+                header->records_offset <= header->index_offset &&
+                header->num_records <= (header->index_offset - header->records_offset) / record_size &&
+                header->index_offset <= size &&
+                header->num_meters <= (size - header->index_offset) / sizeof(CaptureIndexEntry);
+    if (!valid) {
+        munmap(base, size);
+        return -1;
+    }
+
+    const unsigned char *bytes = base;
+    capture->base = base;
+    capture->size = size;
+    capture->header = header;
+    capture->records = bytes + header->records_offset;
+    capture->record_size = record_size;
+    capture->index = (const CaptureIndexEntry *)(bytes + header->index_offset);
+
+    return 0;
+}
+
+/**
+ * Unmap a capture file
+ */
+void capture_close(CaptureFile *capture)
+{
+    if (capture && capture->base) {
+        munmap(capture->base, capture->size);
+        memset(capture, 0, sizeof(*capture));
+    }
+}
+
+/**
+ * Find a meter in the index
+ */
+const CaptureIndexEntry *capture_find_meter(const CaptureFile *capture, uint32_t meter_id)
+{
+    uint32_t low = 0;
+    uint32_t high = capture->header->num_meters;
+
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (capture->index[mid].meter_id < meter_id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if (low == capture->header->num_meters || capture->index[low].meter_id != meter_id) {
+        return NULL;
+    }
+
+    /* Entries are checked on use so that opening stays O(1) */
+    const CaptureIndexEntry *entry = &capture->index[low];
+    uint64_t num_records = capture->header->num_records;
+    if (entry->first_record > num_records ||
+        entry->num_records > num_records - entry->first_record) {
+        return NULL;
+    }
+    return entry;
+}
+
+/**
+ * First record of a meter at or after a timestamp
+ */
+uint64_t capture_seek(const CaptureFile *capture, const CaptureIndexEntry *entry,
+                      uint64_t timestamp_ns)
+{
+    uint64_t low = entry->first_record;
+    uint64_t high = entry->first_record + entry->num_records;
+
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (capture_record(capture, mid)->timestamp_ns < timestamp_ns) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
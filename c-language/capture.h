@@ -0,0 +1,194 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "flowmeter.h"
+#include <stddef.h>
+
+/*
+ * Indexed capture files for replay
+ *
+ * Transit-time frames sorted by (meter ID, timestamp) with unique keys,
+ * stored as fixed-size records so that any frame is addressable by
+ * index, plus a per-meter index giving each meter's contiguous record
+ * range and time span. A mapped capture replays a meter, or a time
+ * window of it, without scanning the rest of the file.
+ *
+ * File layout (native byte order, sections 64-byte aligned):
+ *   CaptureHeader
+ *   records: CaptureRecordHeader + PathMeasurement[paths_per_record]
+ *            (unused slots zero), num_records of them
+ *   CaptureIndexEntry[num_meters], sorted by meter ID
+ */
+
+#define CAPTURE_MAGIC "FMCAP\0\0\0"
+#define CAPTURE_VERSION 1u
+
+typedef struct {
+    char magic[8];              /* CAPTURE_MAGIC */
+    uint32_t version;           /* CAPTURE_VERSION */
+    uint32_t paths_per_record;  /* Measurement slots in every record */
+    uint64_t file_size;         /* Total file size in bytes */
+    uint64_t num_records;       /* Frames in the file */
+    uint64_t records_offset;    /* Offset of the first record */
+    uint64_t index_offset;      /* Offset of the meter index */
+    uint32_t num_meters;        /* Entries in the meter index */
+    uint32_t reserved;          /* Zero */
+} CaptureHeader;
+
+typedef struct {
+    uint64_t timestamp_ns;      /* Frame timestamp in nanoseconds */
+    uint32_t meter_id;          /* Meter ID */
+    uint32_t num_paths;         /* Valid measurement slots */
+} CaptureRecordHeader;
+
+typedef struct {
+    uint32_t meter_id;          /* Meter ID */
+    uint32_t reserved;          /* Zero */
+    uint64_t first_record;      /* Index of the meter's first record */
+    uint64_t num_records;       /* Records of this meter */
+    uint64_t first_timestamp_ns;
+    uint64_t last_timestamp_ns;
+} CaptureIndexEntry;
+
+/* A mapped capture; all pointers reference the read-only mapping */
+typedef struct {
+    void *base;                      /* Start of the mapping */
+    size_t size;                     /* Mapping size in bytes */
+    const CaptureHeader *header;
+    const unsigned char *records;    /* First record */
+    size_t record_size;              /* Bytes per record */
+    const CaptureIndexEntry *index;  /* Meter index */
+} CaptureFile;
+
+/* Buffered writer producing a capture file from records in key order */
+typedef struct {
+    int fd;                          /* Output file */
+    uint32_t paths_per_record;       /* Measurement slots per record */
+    size_t record_size;              /* Bytes per record */
+    unsigned char *buffer;           /* Output buffer */
+    size_t capacity;                 /* Buffer size in bytes */
+    size_t used;                     /* Bytes pending in the buffer */
+    uint64_t num_records;            /* Records appended */
+    CaptureIndexEntry *index;        /* Meter index being built */
+    uint32_t num_meters;             /* Entries in the index */
+    uint32_t index_capacity;         /* Allocated index entries */
+    int error;                       /* Sticky error */
+} CaptureWriter;
+
+/**
+ * Size of one record for a number of measurement slots
+ *
+ * @param paths_per_record Measurement slots per record
+ * @return Size in bytes
+ */
+static inline size_t capture_record_size(uint32_t paths_per_record)
+{
+    return sizeof(CaptureRecordHeader) + (size_t)paths_per_record * sizeof(PathMeasurement);
+}
+
+/**
+ * Order two records by (meter ID, timestamp)
+ *
+ * @param a First record
+ * @param b Second record
+ * @return Negative, zero or positive as a sorts before, with or after b
+ */
+static inline int capture_key_compare(const CaptureRecordHeader *a,
+                                      const CaptureRecordHeader *b)
+{
+    if (a->meter_id != b->meter_id) {
+        return a->meter_id < b->meter_id ? -1 : 1;
+    }
+    return (a->timestamp_ns > b->timestamp_ns) - (a->timestamp_ns < b->timestamp_ns);
+}
+
+/**
+ * Create a capture file
+ *
+ * @param writer Writer to initialize
+ * @param filename Output file path (truncated)
+ * @param paths_per_record Measurement slots per record (<= FLOWMETER_MAX_PATHS)
+ * @param buffer_size Output buffer size in bytes, 0 for the default (1 MiB)
+ * @return 0 on success, -1 on error
+ */
+int capture_writer_open(CaptureWriter *writer, const char *filename,
+                        uint32_t paths_per_record, size_t buffer_size);
+
+/**
+ * Append a record; keys must be strictly increasing
+ *
+ * @param writer Writer
+ * @param record Record of capture_record_size(paths_per_record) bytes
+ * @return 0 on success, -1 on error or out-of-order key
+ */
+int capture_writer_append(CaptureWriter *writer, const CaptureRecordHeader *record);
+
+/**
+ * Write the index and header and close the file
+ *
+ * @param writer Writer
+ * @return 0 on success, -1 if any write failed
+ */
+int capture_writer_close(CaptureWriter *writer);
+
+/**
+ * Map a capture file and validate its header and section bounds
+ *
+ * @param filename Capture file path
+ * @param capture Output mapping, release with capture_close()
+ * @return 0 on success, -1 on error
+ */
+int capture_open(const char *filename, CaptureFile *capture);
+
+/**
+ * Unmap a capture file
+ *
+ * @param capture Capture to release
+ */
+void capture_close(CaptureFile *capture);
+
+/**
+ * Find a meter in the index (binary search)
+ *
+ * @param capture Mapped capture
+ * @param meter_id Meter ID to look up
+ * @return Index entry, NULL if the meter has no records
+ */
+const CaptureIndexEntry *capture_find_meter(const CaptureFile *capture, uint32_t meter_id);
+
+/**
+ * First record of a meter at or after a timestamp (binary search)
+ *
+ * @param capture Mapped capture
+ * @param entry Index entry of the meter
+ * @param timestamp_ns Start of the replay window
+ * @return Record index, entry->first_record + entry->num_records if none
+ */
+uint64_t capture_seek(const CaptureFile *capture, const CaptureIndexEntry *entry,
+                      uint64_t timestamp_ns);
+
+/**
+ * Record by index
+ *
+ * @param capture Mapped capture
+ * @param record Record index (< num_records)
+ * @return Record header; its measurements follow it
+ */
+static inline const CaptureRecordHeader *capture_record(const CaptureFile *capture,
+                                                        uint64_t record)
+{
+    return (const CaptureRecordHeader *)(capture->records + record * capture->record_size);
+}
+
+/**
+ * Measurements of a record
+ *
+ * @param record Record header
+ * @return Array of num_paths measurements
+ */
+static inline const PathMeasurement *capture_measurements(const CaptureRecordHeader *record)
+{
+    return (const PathMeasurement *)(record + 1);
+}
+
+#endif /* CAPTURE_H */
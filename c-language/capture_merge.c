@@ -0,0 +1,585 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "capture_merge.h"
+#include "csv_ingest.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MERGE_BATCH_FRAMES 1024
+
+/* Sort key of a buffered record; 16 bytes so qsort moves little data */
+typedef struct {
+    uint64_t timestamp_ns;
+    uint32_t meter_id;
+    uint32_t slot;             /* Position in the record buffer */
+} MergeKey;
+
+/* A sorted run in an unlinked temporary file */
+typedef struct {
+    FILE *file;
+    uint64_t records;
+} MergeRun;
+
+typedef struct {
+    const char *const *inputs;
+    uint32_t num_inputs;
+    uint32_t next_input;       /* Next input to hand out */
+    uint32_t paths_per_record;
+    size_t record_size;
+    const char *temp_dir;
+    pthread_mutex_t lock;      /* Guards next_input, runs and stats */
+    MergeRun *runs;
+    uint32_t num_runs;
+    uint32_t runs_capacity;
+    CaptureMergeStats stats;
+    int error;
+} MergeShared;
+
+typedef struct {
+    MergeShared *shared;
+    size_t buffer_bytes;       /* Record and key budget of this worker */
+    unsigned char *records;
+    MergeKey *keys;
+    size_t capacity;           /* Records that fit the budget */
+    size_t count;              /* Records buffered */
+    CaptureMergeStats stats;   /* Folded into the shared stats at the end */
+    int error;
+} MergeWorker;
+
+/* Receives merged records in key order */
+typedef int (*MergeSink)(void *context, const CaptureRecordHeader *record);
+
+/* qsort helper: order keys by (meter ID, timestamp) */
+static int compare_keys(const void *a, const void *b)
+{
+    const MergeKey *ka = a;
+    const MergeKey *kb = b;
+
+    if (ka->meter_id != kb->meter_id) {
+        return ka->meter_id < kb->meter_id ? -1 : 1;
+    }
+    return (ka->timestamp_ns > kb->timestamp_ns) - (ka->timestamp_ns < kb->timestamp_ns);
+}
+
+/**
+ * Order the records of each run of equal keys by their bytes
+ *
+ * Conflicts are then settled by content (the smallest record is kept)
+ * and exact copies are adjacent, whatever the input order. Groups of
+ * equal keys are small, so insertion sort is enough.
+ */
+static void sort_equal_keys(MergeKey *keys, size_t count, const unsigned char *records,
+                            size_t record_size)
+{
+    size_t start = 0;
+
+    while (start < count) {
+        size_t end = start + 1;
+        while (end < count && keys[end].meter_id == keys[start].meter_id &&
+               keys[end].timestamp_ns == keys[start].timestamp_ns) {
+            end++;
+        }
+        for (size_t i = start + 1; i < end; i++) {
+            MergeKey key = keys[i];
+            const unsigned char *record = records + (size_t)key.slot * record_size;
+            size_t j = i;
+            while (j > start &&
+                   memcmp(records + (size_t)keys[j - 1].slot * record_size, record,
+                          record_size) > 0) {
+                keys[j] = keys[j - 1];
+                j--;
+            }
+            keys[j] = key;
+        }
+        start = end;
+    }
+}
+
+/**
+ * Compare a record with the previous one in (key, bytes) order: 1 if it
+ * should be passed on, 0 if it was counted as a duplicate or conflict
+ *
+ * Exact copies are always dropped. Other records of a key already seen
+ * are conflicts; they are dropped only when resolve is set (the final
+ * merge), so runs keep every distinct record and the counts do not
+ * depend on how the input was split into runs.
+ */
+static int merge_accept(const unsigned char *previous, int have_previous,
+                        const CaptureRecordHeader *record, size_t record_size, int resolve,
+                        CaptureMergeStats *stats)
+{
+    if (!have_previous ||
+        capture_key_compare((const CaptureRecordHeader *)previous, record) != 0) {
+        return 1;
+    }
+
+    if (memcmp(previous, record, record_size) == 0) {
+        stats->duplicates++;
+        return 0;
+    }
+    if (!resolve) {
+        return 1;
+    }
+    stats->conflicts++;
+    return 0;
+}
+
+/**
+ * Create an empty run file that disappears when closed
+ */
+static FILE *run_create(const char *temp_dir)
+{
+    char path[4096];
+    int length = snprintf(path, sizeof(path), "%s/flowmerge-XXXXXX",
+                          temp_dir ? temp_dir : "/tmp");
+    if (length < 0 || (size_t)length >= sizeof(path)) {
+        return NULL;
+    }
+
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return NULL;
+    }
+    unlink(path);
+
+    FILE *file = fdopen(fd, "w+b");
+    if (!file) {
+        close(fd);
+    }
+    return file;
+}
+
+static int run_add(MergeShared *shared, FILE *file, uint64_t records)
+{
+    if (shared->num_runs == shared->runs_capacity) {
+        uint32_t capacity = shared->runs_capacity ? 2 * shared->runs_capacity : 16;
+        MergeRun *runs = realloc(shared->runs, capacity * sizeof(*runs));
+        if (!runs) {
+            return -1;
+        }
+        shared->runs = runs;
+        shared->runs_capacity = capacity;
+    }
+
+    shared->runs[shared->num_runs].file = file;
+    shared->runs[shared->num_runs].records = records;
+    shared->num_runs++;
+    return 0;
+}
+
+/**
+ * Sort a worker's buffer, drop exact copies and spill it as a run
+ */
+static int worker_spill(MergeWorker *worker)
+{
+    MergeShared *shared = worker->shared;
+    size_t record_size = shared->record_size;
+
+    if (worker->count == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < worker->count; i++) {
+        const CaptureRecordHeader *record =
+            (const CaptureRecordHeader *)(worker->records + i * record_size);
+        worker->keys[i].timestamp_ns = record->timestamp_ns;
+        worker->keys[i].meter_id = record->meter_id;
+        worker->keys[i].slot = (uint32_t)i;
+    }
+    qsort(worker->keys, worker->count, sizeof(MergeKey), compare_keys);
+    sort_equal_keys(worker->keys, worker->count, worker->records, record_size);
+
+    FILE *file = run_create(shared->temp_dir);
+    if (!file) {
+        return -1;
+    }
+
+    const unsigned char *last = NULL;
+    uint64_t written = 0;
+    for (size_t i = 0; i < worker->count; i++) {
+        const unsigned char *record = worker->records + worker->keys[i].slot * record_size;
+        if (!merge_accept(last, last != NULL, (const CaptureRecordHeader *)record,
+                          record_size, 0, &worker->stats)) {
+            continue;
+        }
+        if (fwrite(record, record_size, 1, file) != 1) {
+            fclose(file);
+            return -1;
+        }
+        last = record;
+        written++;
+    }
+
+    if (fflush(file) != 0) {
+        fclose(file);
+        return -1;
+    }
+
+    pthread_mutex_lock(&shared->lock);
+    int status = run_add(shared, file, written);
+    shared->stats.runs++;
+    pthread_mutex_unlock(&shared->lock);
+    if (status != 0) {
+        fclose(file);
+        return -1;
+    }
+
+    worker->count = 0;
+    return 0;
+}
+
+/**
+ * CSV batch handler: copy frames into the worker's buffer
+ */
+static int worker_handler(void *context, const CsvFrameBatch *batch)
+{
+    MergeWorker *worker = context;
+    uint32_t paths_per_record = worker->shared->paths_per_record;
+    size_t record_size = worker->shared->record_size;
+
+    for (uint32_t f = 0; f < batch->num_frames; f++) {
+        worker->stats.frames_read++;
+        if (batch->num_paths[f] > paths_per_record) {
+            worker->stats.frames_dropped++;
+            continue;
+        }
+
+        if (worker->count == worker->capacity && worker_spill(worker) != 0) {
+            worker->error = 1;
+            return -1;
+        }
+
+        unsigned char *slot = worker->records + worker->count * record_size;
+        CaptureRecordHeader *record = (CaptureRecordHeader *)slot;
+        PathMeasurement *measurements = (PathMeasurement *)(record + 1);
+        uint32_t num_paths = batch->num_paths[f];
+
+        memset(slot, 0, record_size);
+        record->timestamp_ns = batch->timestamps_ns[f];
+        record->meter_id = batch->meter_ids[f];
+        record->num_paths = num_paths;
+        memcpy(measurements, &batch->measurements[(size_t)f * FLOWMETER_MAX_PATHS],
+               num_paths * sizeof(PathMeasurement));
+        worker->count++;
+    }
+
+    return 0;
+}
+
+/**
+ * Phase 1 worker: parse inputs from the shared queue into sorted runs
+ */
+static void *worker_main(void *argument)
+{
+    MergeWorker *worker = argument;
+    MergeShared *shared = worker->shared;
+    size_t per_record = shared->record_size + sizeof(MergeKey);
+
+    worker->capacity = worker->buffer_bytes / per_record;
+    if (worker->capacity == 0) {
+        worker->capacity = 1;
+    }
+    if (worker->capacity > UINT32_MAX) {
+        worker->capacity = UINT32_MAX;
+    }
+    worker->records = malloc(worker->capacity * shared->record_size);
+    worker->keys = malloc(worker->capacity * sizeof(MergeKey));
+    if (!worker->records || !worker->keys) {
+        worker->error = 1;
+    }
+
+    while (!worker->error) {
+        pthread_mutex_lock(&shared->lock);
+        uint32_t input = shared->error ? shared->num_inputs : shared->next_input;
+        if (input < shared->num_inputs) {
+            shared->next_input++;
+        }
+        pthread_mutex_unlock(&shared->lock);
+        if (input >= shared->num_inputs) {
+            break;
+        }
+
+        CsvIngest ingest;
+        if (csv_ingest_init(&ingest, MERGE_BATCH_FRAMES, worker_handler, worker) != 0) {
+            worker->error = 1;
+            break;
+        }
+        if (csv_ingest_file(&ingest, shared->inputs[input]) != 0 ||
+            csv_ingest_finish(&ingest) != 0) {
+            worker->error = 1;
+        }
+        worker->stats.rows_rejected += ingest.rows_rejected;
+        csv_ingest_free(&ingest);
+    }
+
+    if (!worker->error && worker_spill(worker) != 0) {
+        worker->error = 1;
+    }
+
+    free(worker->records);
+    free(worker->keys);
+
+    pthread_mutex_lock(&shared->lock);
+    shared->stats.frames_read += worker->stats.frames_read;
+    shared->stats.frames_dropped += worker->stats.frames_dropped;
+    shared->stats.rows_rejected += worker->stats.rows_rejected;
+    shared->stats.duplicates += worker->stats.duplicates;
+    shared->stats.conflicts += worker->stats.conflicts;
+    shared->error |= worker->error;
+    pthread_mutex_unlock(&shared->lock);
+    return NULL;
+}
+
+/**
+ * Order run heads by key, then by bytes
+ */
+static int head_compare(const unsigned char *heads, uint32_t a, uint32_t b,
+                        size_t record_size)
+{
+    const unsigned char *x = heads + (size_t)a * record_size;
+    const unsigned char *y = heads + (size_t)b * record_size;
+    int order = capture_key_compare((const CaptureRecordHeader *)x,
+                                    (const CaptureRecordHeader *)y);
+    return order != 0 ? order : memcmp(x, y, record_size);
+}
+
+/**
+ * Restore the heap property downwards from position i
+ */
+static void heap_sift_down(uint32_t *heap, uint32_t size, uint32_t i,
+                           const unsigned char *heads, size_t record_size)
+{
+    for (;;) {
+        uint32_t smallest = i;
+        uint32_t left = 2 * i + 1;
+        uint32_t right = left + 1;
+
+        if (left < size && head_compare(heads, heap[left], heap[smallest], record_size) < 0) {
+            smallest = left;
+        }
+        if (right < size && head_compare(heads, heap[right], heap[smallest], record_size) < 0) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+
+        uint32_t swap = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = swap;
+        i = smallest;
+    }
+}
+
+/**
+ * k-way merge of runs into a sink through a binary heap of run heads
+ *
+ * Records come out in (key, bytes) order, so each is checked against the
+ * previous one only. Conflicts are settled when resolve is set. The runs
+ * are closed.
+ */
+static int merge_runs(MergeRun *runs, uint32_t num_runs, size_t record_size,
+                      size_t memory_limit, int resolve, MergeSink sink, void *context,
+                      CaptureMergeStats *stats)
+{
+    size_t read_buffer = memory_limit / (num_runs ? num_runs : 1);
+
+    unsigned char *heads = malloc(((size_t)num_runs + 1) * record_size);
+    uint32_t *heap = malloc(((size_t)num_runs + 1) * sizeof(uint32_t));
+    char **buffers = calloc(num_runs + 1, sizeof(char *));
+    unsigned char *last = heads ? heads + (size_t)num_runs * record_size : NULL;
+    int status = (heads && heap && buffers) ? 0 : -1;
+    uint32_t size = 0;
+
+    for (uint32_t r = 0; r < num_runs && status == 0; r++) {
+        buffers[r] = malloc(read_buffer);
+        if (!buffers[r] || fseek(runs[r].file, 0, SEEK_SET) != 0 ||
+            setvbuf(runs[r].file, buffers[r], _IOFBF, read_buffer) != 0) {
+            status = -1;
+            break;
+        }
+        if (fread(heads + (size_t)r * record_size, record_size, 1, runs[r].file) == 1) {
+            heap[size++] = r;
+        }
+    }
+
+    /* Heap order; equal heads are identical records, so ties need no rule */
+    for (uint32_t i = size / 2; i-- > 0 && status == 0;) {
+        heap_sift_down(heap, size, i, heads, record_size);
+    }
+
+    int have_last = 0;
+    while (size > 0 && status == 0) {
+        uint32_t r = heap[0];
+        const CaptureRecordHeader *record =
+            (const CaptureRecordHeader *)(heads + (size_t)r * record_size);
+
+        if (merge_accept(last, have_last, record, record_size, resolve, stats) &&
+            sink(context, record) != 0) {
+            status = -1;
+            break;
+        }
+        memcpy(last, record, record_size);
+        have_last = 1;
+
+        if (fread(heads + (size_t)r * record_size, record_size, 1, runs[r].file) != 1) {
+            heap[0] = heap[--size];
+        }
+        heap_sift_down(heap, size, 0, heads, record_size);
+    }
+
+    for (uint32_t r = 0; r < num_runs; r++) {
+        if (ferror(runs[r].file)) {
+            status = -1;
+        }
+        fclose(runs[r].file);
+        runs[r].file = NULL;
+        if (buffers) {
+            free(buffers[r]);
+        }
+    }
+
+    free(buffers);
+    free(heap);
+    free(heads);
+    return status;
+}
+
+typedef struct {
+    FILE *file;
+    size_t record_size;
+    uint64_t records;
+} RunSink;
+
+static int run_sink(void *context, const CaptureRecordHeader *record)
+{
+    RunSink *sink = context;
+    sink->records++;
+    return fwrite(record, sink->record_size, 1, sink->file) == 1 ? 0 : -1;
+}
+
+static int capture_sink(void *context, const CaptureRecordHeader *record)
+{
+    return capture_writer_append(context, record);
+}
+
+/**
+ * Merge CSV logs into an indexed capture file
+ */
+int capture_merge(const char *const *inputs, uint32_t num_inputs, const char *output,
+                  const CaptureMergeOptions *options, CaptureMergeStats *stats)
+{
+    if ((!inputs && num_inputs > 0) || !output || !options ||
+        options->paths_per_record > FLOWMETER_MAX_PATHS) {
+        return -1;
+    }
+
+    size_t memory_limit = options->memory_limit ? options->memory_limit
+                                                : CAPTURE_MERGE_DEFAULT_MEMORY;
+
+    /* Fan-in that leaves every merged run its minimum read buffer */
+    size_t fan_in = memory_limit / CAPTURE_MERGE_MIN_READ_BUFFER;
+    if (fan_in < 2) {
+        return -1;
+    }
+    if (fan_in > CAPTURE_MERGE_FANIN) {
+        fan_in = CAPTURE_MERGE_FANIN;
+    }
+
+    MergeShared shared;
+    memset(&shared, 0, sizeof(shared));
+    shared.inputs = inputs;
+    shared.num_inputs = num_inputs;
+    shared.paths_per_record = options->paths_per_record;
+    shared.record_size = capture_record_size(options->paths_per_record);
+    shared.temp_dir = options->temp_dir;
+    if (pthread_mutex_init(&shared.lock, NULL) != 0) {
+        return -1;
+    }
+
+    /* Phase 1: sorted runs, one worker per thread */
+    uint32_t num_threads = options->num_threads ? options->num_threads : 1;
+    if (num_threads > num_inputs) {
+        num_threads = num_inputs ? num_inputs : 1;
+    }
+
+    MergeWorker *workers = calloc(num_threads, sizeof(MergeWorker));
+    pthread_t *threads = calloc(num_threads, sizeof(pthread_t));
+    int status = (workers && threads) ? 0 : -1;
+
+    if (status == 0) {
+        uint32_t started = 0;
+        for (uint32_t t = 0; t < num_threads; t++) {
+            workers[t].shared = &shared;
+            workers[t].buffer_bytes = memory_limit / num_threads;
+        }
+        for (uint32_t t = 1; t < num_threads; t++) {
+            if (pthread_create(&threads[t], NULL, worker_main, &workers[t]) != 0) {
+                break;
+            }
+            started = t;
+        }
+        worker_main(&workers[0]);
+        for (uint32_t t = 1; t <= started; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        /* Workers that failed to start leave their inputs to the others */
+        status = shared.error ? -1 : 0;
+    }
+    free(threads);
+    free(workers);
+
+    /* Phase 2: narrow the runs to one merge's fan-in, then write the capture */
+    while (status == 0 && shared.num_runs > fan_in) {
+        RunSink sink = { run_create(shared.temp_dir), shared.record_size, 0 };
+        if (!sink.file) {
+            status = -1;
+            break;
+        }
+        status = merge_runs(shared.runs, (uint32_t)fan_in, shared.record_size,
+                            memory_limit, 0, run_sink, &sink, &shared.stats);
+        if (status == 0 && fflush(sink.file) != 0) {
+            status = -1;
+        }
+        memmove(shared.runs, shared.runs + fan_in,
+                (shared.num_runs - fan_in) * sizeof(MergeRun));
+        shared.num_runs -= (uint32_t)fan_in;
+        shared.runs[shared.num_runs].file = sink.file;
+        shared.runs[shared.num_runs].records = sink.records;
+        shared.num_runs++;
+        shared.stats.merge_passes++;
+    }
+
+    if (status == 0) {
+        CaptureWriter writer;
+        if (capture_writer_open(&writer, output, options->paths_per_record, 0) != 0) {
+            status = -1;
+        } else {
+            status = merge_runs(shared.runs, shared.num_runs, shared.record_size,
+                                memory_limit, 1, capture_sink, &writer,
+                                &shared.stats);
+            shared.num_runs = 0;
+            shared.stats.records_written = writer.num_records;
+            shared.stats.merge_passes++;
+            if (capture_writer_close(&writer) != 0) {
+                status = -1;
+            }
+        }
+    }
+
+    for (uint32_t r = 0; r < shared.num_runs; r++) {
+        if (shared.runs[r].file) {
+            fclose(shared.runs[r].file);
+        }
+    }
+    free(shared.runs);
+    pthread_mutex_destroy(&shared.lock);
+
+    if (stats) {
+        *stats = shared.stats;
+    }
+    return status;
+}
@@ -0,0 +1,70 @@
+#ifndef CAPTURE_MERGE_H
+#define CAPTURE_MERGE_H
+
+#include "capture.h"
+
+/*
+ * External merge of transit-time logs into one indexed capture
+ *
+ * Redundant collectors log overlapping, out-of-order frames to separate
+ * CSV files (csv_ingest.h format). The merge runs in two phases:
+ *
+ *   1. Run generation: worker threads take input files from a shared
+ *      queue, parse them into a fixed memory budget, sort each full
+ *      buffer by (meter ID, timestamp), drop exact copies and spill it
+ *      to an unlinked temporary run file.
+ *   2. k-way merge: runs are merged through a binary heap, at most
+ *      CAPTURE_MERGE_FANIN at a time and no more than the budget gives
+ *      a CAPTURE_MERGE_MIN_READ_BUFFER each (wider merges go through
+ *      intermediate runs), straight into a CaptureWriter.
+ *
+ * Frames with equal keys and identical contents are duplicates; equal
+ * keys with different contents are conflicts. Of a conflict, the frame
+ * whose record bytes compare smallest is kept. Records with equal keys
+ * are ordered by their bytes, so the capture and the counts do not
+ * depend on input order, thread count or memory budget. Memory use
+ * stays near memory_limit whatever the input size.
+ */
+
+/* Most runs merged in one pass */
+#define CAPTURE_MERGE_FANIN 64
+
+/* Smallest read buffer per merged run; memory_limit must cover two */
+#define CAPTURE_MERGE_MIN_READ_BUFFER ((size_t)4 << 10)
+
+/* Buffer budget used when memory_limit is 0 */
+#define CAPTURE_MERGE_DEFAULT_MEMORY ((size_t)256 << 20)
+
+typedef struct {
+    uint32_t paths_per_record;  /* Measurement slots per record (<= FLOWMETER_MAX_PATHS) */
+    uint32_t num_threads;       /* Run generation threads, 0 for one */
+    size_t memory_limit;        /* Bytes for record buffers across all threads, 0 for the default */
+    const char *temp_dir;       /* Directory for run files, NULL for /tmp */
+} CaptureMergeOptions;
+
+typedef struct {
+    uint64_t frames_read;       /* Frames parsed from the inputs */
+    uint64_t frames_dropped;    /* Frames with more paths than slots */
+    uint64_t rows_rejected;     /* Malformed CSV rows */
+    uint64_t duplicates;        /* Copies of a frame already seen, removed */
+    uint64_t conflicts;         /* Other distinct frames of a kept key, removed */
+    uint64_t runs;              /* Sorted runs spilled in phase 1 */
+    uint32_t merge_passes;      /* Merge passes including the final one */
+    uint64_t records_written;   /* Records in the output capture */
+} CaptureMergeStats;
+
+/**
+ * Merge CSV logs into an indexed capture file
+ *
+ * @param inputs CSV file paths
+ * @param num_inputs Number of inputs
+ * @param output Output capture file path
+ * @param options Merge options
+ * @param stats Output statistics (may be NULL)
+ * @return 0 on success, -1 on error (including a memory_limit below
+ *         2 * CAPTURE_MERGE_MIN_READ_BUFFER)
+ */
+int capture_merge(const char *const *inputs, uint32_t num_inputs, const char *output,
+                  const CaptureMergeOptions *options, CaptureMergeStats *stats);
+
+#endif /* CAPTURE_MERGE_H */
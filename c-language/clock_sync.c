@@ -0,0 +1,123 @@
+#include "clock_sync.h"
+#include <math.h>
+#include <string.h>
+
+/**
+ * Move the anchor to a sample and restart the fit from it alone
+ */
+static void clock_anchor(ClockModel *model, uint64_t device_ticks, uint64_t receive_ns)
+{
+    model->anchor_ticks = device_ticks;
+    model->anchor_server_ns = receive_ns;
+    model->offset_ns = 0.0;
+    model->ns_per_tick = model->prior_ns_per_tick;
+    model->sum_w = 1.0;
+    model->sum_x = model->sum_y = model->sum_xx = model->sum_xy = 0.0;
+    model->outlier_run = 0;
+}
+
+/**
+ * Initialize a clock model with no samples
+ */
+int clock_model_init(ClockModel *model, double tick_hz, uint32_t counter_bits,
+                     double half_life, double reset_threshold_ns)
+{
+    if (!model || !(tick_hz > 0.0) || !isfinite(tick_hz) ||
+        counter_bits < 8 || counter_bits > 64 ||
+        !(half_life > 0.0) || !(reset_threshold_ns > 0.0)) {
+        return -1;
+    }
+
+    memset(model, 0, sizeof(*model));
+    model->nominal_ns_per_tick = 1e9 / tick_hz;
+    model->prior_ns_per_tick = model->nominal_ns_per_tick;
+    model->ns_per_tick = model->nominal_ns_per_tick;
+    model->counter_sign = (uint64_t)1 << (counter_bits - 1);
+    model->counter_mask = model->counter_sign | (model->counter_sign - 1);
+    model->decay = exp2(-1.0 / half_life);
+    model->reset_threshold_ns = reset_threshold_ns;
+    model->prior_weight = tick_hz * tick_hz;
+
+    return 0;
+}
+
+/**
+ * Add a (device ticks, receive time) sample
+ */
+int clock_model_observe(ClockModel *model, uint64_t device_ticks, uint64_t receive_ns)
+{
+    if (model->samples++ == 0) {
+        clock_anchor(model, device_ticks, receive_ns);
+        return CLOCK_SAMPLE_ACCEPTED;
+    }
+
+    double x = (double)clock_model_delta(model, device_ticks);
+    double y = (double)(int64_t)(receive_ns - model->anchor_server_ns);
+    double residual = y - (model->offset_ns + model->ns_per_tick * x);
+
+    if (fabs(residual) > model->reset_threshold_ns) {
+        if (++model->outlier_run < CLOCK_RESET_OUTLIERS) {
+            model->outliers++;
+            return CLOCK_SAMPLE_OUTLIER;
+        }
+        /* The oscillator survives a reset, so keep its rate as the prior */
+        model->prior_ns_per_tick = model->ns_per_tick;
+        model->resyncs++;
+        clock_anchor(model, device_ticks, receive_ns);
+        return CLOCK_SAMPLE_RESYNC;
+    }
+    model->outlier_run = 0;
+
+    /* Shift the sums so the new sample sits at the origin */
+    double w = model->sum_w;
+    double sx = model->sum_x;
+    double sy = model->sum_y;
+    double sxx = model->sum_xx - 2.0 * x * sx + x * x * w;
+    double sxy = model->sum_xy - x * sy - y * sx + x * y * w;
+    sx -= x * w;
+    sy -= y * w;
+
+    /* Fade old samples and add the new one at (0, 0) */
+    double decay = model->decay;
+    w = w * decay + 1.0;
+    sx *= decay;
+    sy *= decay;
+    sxx *= decay;
+    sxy *= decay;
+
+    model->sum_w = w;
+    model->sum_x = sx;
+    model->sum_y = sy;
+    model->sum_xx = sxx;
+    model->sum_xy = sxy;
+    model->anchor_ticks = device_ticks;
+    model->anchor_server_ns = receive_ns;
+
+    /*
+     * Weighted least squares, with the prior rate counting as one sample
+     * a second from the centroid so that a short history cannot swing
+     * the slope
+     */
+    double mean_x = sx / w;
+    double mean_y = sy / w;
+    double cxx = sxx - mean_x * sx;
+    double cxy = sxy - mean_x * sy;
+    double slope = (cxy + model->prior_weight * model->prior_ns_per_tick) /
+                   (cxx + model->prior_weight);
+
+    model->ns_per_tick = slope;
+    model->offset_ns = mean_y - slope * mean_x;
+
+    return CLOCK_SAMPLE_ACCEPTED;
+}
+
+/**
+ * Map a batch of device timestamps to server time
+ */
+void clock_model_map(const ClockModel *model, const uint64_t *device_ticks,
+                     size_t count, uint64_t *server_ns)
+{
+    for (size_t i = 0; i < count; i++) {
+        server_ns[i] = clock_model_to_server(model, device_ticks[i]);
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Results of clock_model_observe() */
+#define CLOCK_SAMPLE_ACCEPTED 0  /* Sample added to the fit */
+#define CLOCK_SAMPLE_OUTLIER  1  /* Sample far from the fit, ignored */
+#define CLOCK_SAMPLE_RESYNC   2  /* Device clock reset, model re-anchored */
+
+/* Consecutive outliers taken as a device clock reset */
+#define CLOCK_RESET_OUTLIERS 3
+
+/*
+ * Transmitter clock model
+ *
+ * A transmitter stamps frames with a free-running tick counter of
+ * counter_bits bits. Its oscillator runs at nominal rate plus a drift of
+ * tens of ppm, so device time maps to server time as
+ *
+ *   server = anchor_server + offset + ns_per_tick * (ticks - anchor_ticks)
+ *
+ * fitted by exponentially weighted least squares over (device ticks,
+ * receive time) samples. The anchor moves to every accepted sample so
+ * the regression sums stay small; old samples fade with the configured
+ * half-life, letting the fit follow temperature-driven drift.
+ *
+ * Mapping a frame takes the tick difference to the anchor modulo the
+ * counter width, which unwraps counters that wrapped up to half a period
+ * away from the last sample. A sample far from the fit is ignored unless
+ * CLOCK_RESET_OUTLIERS arrive in a row, which is taken as a device
+ * reset: the model re-anchors on the latest sample and keeps its drift
+ * estimate, so no history needs reprocessing.
+ *
+ * Receive times include the transport latency, so mapped times are send
+ * times plus the mean latency; only the latency jitter averages out.
+ */
+typedef struct {
+    /* Configuration */
+    double nominal_ns_per_tick;  /* 1e9 / nominal tick rate */
+    uint64_t counter_mask;       /* 2^counter_bits - 1 */
+    uint64_t counter_sign;       /* 2^(counter_bits - 1) */
+    double decay;                /* Per-sample weight decay */
+    double reset_threshold_ns;   /* Residual that counts as an outlier */
+    double prior_ns_per_tick;    /* Rate the fit is pulled towards */
+    double prior_weight;         /* Strength of the prior, in ticks^2 */
+
+    /* Published mapping */
+    uint64_t anchor_ticks;       /* Raw counter value of the anchor sample */
+    uint64_t anchor_server_ns;   /* Receive time of the anchor sample */
+    double offset_ns;            /* Fitted server time at the anchor, relative */
+    double ns_per_tick;          /* Fitted tick period */
+
+    /* Weighted sums relative to the anchor: x in ticks, y in ns */
+    double sum_w, sum_x, sum_y, sum_xx, sum_xy;
+
+    /* Statistics */
+    uint64_t samples;            /* Samples observed */
+    uint32_t outlier_run;        /* Consecutive outliers so far */
+    uint64_t outliers;           /* Samples ignored as outliers */
+    uint64_t resyncs;            /* Device resets handled */
+} ClockModel;
+
+/**
+ * Initialize a clock model with no samples
+ *
+ * @param model Model to initialize
+ * @param tick_hz Nominal tick rate of the device counter
+ * @param counter_bits Width of the device counter (8 to 64)
+ * @param half_life Samples after which a sample's weight has halved
+ * @param reset_threshold_ns Residual beyond which a sample is an outlier
+ * @return 0 on success, -1 on error
+ */
+int clock_model_init(ClockModel *model, double tick_hz, uint32_t counter_bits,
+                     double half_life, double reset_threshold_ns);
+
+/**
+ * Add a (device ticks, receive time) sample
+ *
+ * @param model Clock model
+ * @param device_ticks Raw device counter value
+ * @param receive_ns Server receive time in ns
+ * @return CLOCK_SAMPLE_ACCEPTED, CLOCK_SAMPLE_OUTLIER or CLOCK_SAMPLE_RESYNC
+ */
+int clock_model_observe(ClockModel *model, uint64_t device_ticks, uint64_t receive_ns);
+
+/**
+ * Signed tick difference from the anchor, modulo the counter width
+ *
+ * @param model Clock model
+ * @param device_ticks Raw device counter value
+ * @return Ticks since the anchor sample (negative if before it)
+ */
+static inline int64_t clock_model_delta(const ClockModel *model, uint64_t device_ticks)
+{
+    /* Sign-extend the wrapped difference: (d ^ s) - s */
+    uint64_t wrapped = (device_ticks - model->anchor_ticks) & model->counter_mask;
+    return (int64_t)((wrapped ^ model->counter_sign) - model->counter_sign);
+}
+
+/**
+ * Map a device timestamp to server time
+ *
+ * @param model Clock model with at least one sample
+ * @param device_ticks Raw device counter value
+ * @return Server time in ns
+ */
+static inline uint64_t clock_model_to_server(const ClockModel *model, uint64_t device_ticks)
+{
+    double delta = (double)clock_model_delta(model, device_ticks);
+    return model->anchor_server_ns + (int64_t)(model->offset_ns + model->ns_per_tick * delta);
+}
+
+/**
+ * Map a batch of device timestamps to server time
+ *
+ * @param model Clock model with at least one sample
+ * @param device_ticks Raw device counter values
+ * @param count Number of timestamps
+ * @param server_ns Output server times in ns (may alias device_ticks)
+ */
+void clock_model_map(const ClockModel *model, const uint64_t *device_ticks,
+                     size_t count, uint64_t *server_ns);
+
+#endif /* CLOCK_SYNC_H */
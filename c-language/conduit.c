@@ -0,0 +1,205 @@
+#include "conduit.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Lowest and highest vertex of a polygon
+ */
+static void polygon_extent(const ConduitShape *shape, double *bottom, double *top)
+{
+    *bottom = *top = shape->vertices[1];
+    for (uint32_t v = 1; v < shape->num_vertices; v++) {
+        double y = shape->vertices[2 * v + 1];
+        *bottom = (y < *bottom) ? y : *bottom;
+        *top = (y > *top) ? y : *top;
+    }
+}
+
+/**
+ * Area of a polygon clipped to y <= level (shoelace formula over the
+ * polygon with the part above the line cut away)
+ */
+static double polygon_area_below(const ConduitShape *shape, double level)
+{
+    double area = 0.0;
+    double first_x = 0.0, first_y = 0.0, last_x = 0.0, last_y = 0.0;
+    int have_point = 0;
+
+    for (uint32_t v = 0; v < shape->num_vertices; v++) {
+        uint32_t w = (v + 1 == shape->num_vertices) ? 0 : v + 1;
+        double x0 = shape->vertices[2 * v], y0 = shape->vertices[2 * v + 1];
+        double x1 = shape->vertices[2 * w], y1 = shape->vertices[2 * w + 1];
+        double points[2][2];
+        int num_points = 0;
+
+        /* Sutherland-Hodgman against one half-plane: emit the clipped edge */
+        if (y0 <= level) {
+            points[num_points][0] = x0;
+            points[num_points][1] = y0;
+            num_points++;
+        }
+        if ((y0 <= level) != (y1 <= level)) {
+            double t = (level - y0) / (y1 - y0);
+            points[num_points][0] = x0 + t * (x1 - x0);
+            points[num_points][1] = level;
+            num_points++;
+        }
+
+        for (int p = 0; p < num_points; p++) {
+            if (have_point) {
+                area += last_x * points[p][1] - points[p][0] * last_y;
+            } else {
+                first_x = points[p][0];
+                first_y = points[p][1];
+                have_point = 1;
+            }
+            last_x = points[p][0];
+            last_y = points[p][1];
+        }
+    }
+
+    if (have_point) {
+        area += last_x * first_y - first_x * last_y;
+    }
+    return fabs(area) / 2.0;
+}
+
+/**
+ * Vertical extent of a conduit
+ */
+double conduit_height(const ConduitShape *shape)
+{
+    if (!shape) {
+        return -1.0;
+    }
+
+    switch (shape->type) {
+    case CONDUIT_CIRCLE:
+        return (shape->diameter > 0.0) ? shape->diameter : -1.0;
+    case CONDUIT_RECTANGLE:
+        return (shape->width > 0.0 && shape->height > 0.0) ? shape->height : -1.0;
+    case CONDUIT_POLYGON: {
+        if (!shape->vertices || shape->num_vertices < 3) {
+            return -1.0;
+        }
+        double bottom, top;
+        polygon_extent(shape, &bottom, &top);
+        return (top > bottom) ? top - bottom : -1.0;
+    }
+    }
+
+    return -1.0;
+}
+
+/**
+ * Area of the part of a conduit below a height
+ */
+double conduit_area_below(const ConduitShape *shape, double height)
+{
+    double extent = conduit_height(shape);
+    if (extent <= 0.0 || height <= 0.0) {
+        return 0.0;
+    }
+    if (height > extent) {
+        height = extent;
+    }
+
+    switch (shape->type) {
+    case CONDUIT_CIRCLE: {
+        /* Circular segment: r² (y √(1 - y²) + asin(y) + π/2), y normalized */
+        double radius = shape->diameter / 2.0;
+        double y = height / radius - 1.0;
+        return radius * radius * (y * sqrt(1.0 - y * y) + asin(y) + M_PI / 2.0);
+    }
+    case CONDUIT_RECTANGLE:
+        return shape->width * height;
+    case CONDUIT_POLYGON: {
+        double bottom, top;
+        polygon_extent(shape, &bottom, &top);
+        return polygon_area_below(shape, bottom + height);
+    }
+    }
+
+    return 0.0;
+}
+
+/**
+ * Cross-sectional area of a conduit
+ */
+double conduit_area(const ConduitShape *shape)
+{
+    double extent = conduit_height(shape);
+    return (extent > 0.0) ? conduit_area_below(shape, extent) : -1.0;
+}
+
+/**
+ * Precompute per-path coefficients for a conduit
+ *
+ * Band boundaries lie halfway between consecutive distinct path heights;
+ * paths at the same height share their band equally.
+ */
+int conduit_compile(const FlowMeterConfig *config, const ConduitShape *shape,
+                    CompiledConfig *compiled)
+{
+    if (!config || !shape || !compiled || !config->paths) {
+        return -1;
+    }
+
+    double extent = conduit_height(shape);
+    if (extent <= 0.0) {
+        return -1;
+    }
+
+    if (shape->type == CONDUIT_CIRCLE) {
+        FlowMeterConfig circular = *config;
+        circular.pipe_diameter = shape->diameter;
+        return flowmeter_compile(&circular, compiled);
+    }
+
+    /* Velocity scales are the circular ones; only the flow coefficients change */
+    CompiledConfig circular;
+    if (flowmeter_compile(config, &circular) != 0) {
+        return -1;
+    }
+
+    uint32_t num_paths = config->num_paths;
+    double *storage = malloc(2 * num_paths * sizeof(double));
+    if (!storage) {
+        flowmeter_compiled_free(&circular);
+        return -1;
+    }
+
+    double *velocity_scale = storage;
+    double *flow_coeff = storage + num_paths;
+    memcpy(velocity_scale, circular.velocity_scale, num_paths * sizeof(double));
+    flowmeter_compiled_free(&circular);
+
+    for (uint32_t i = 0; i < num_paths; i++) {
+        double height = config->paths[i].position;
+        double below = -1.0, above = 1.0;
+        uint32_t shared = 0;
+
+        for (uint32_t j = 0; j < num_paths; j++) {
+            double other = config->paths[j].position;
+            below = (other < height && other > below) ? other : below;
+            above = (other > height && other < above) ? other : above;
+            shared += (other == height);
+        }
+
+        /* Band edges: midpoints to the neighbours, or the section walls */
+        double lower = (below > -1.0) ? 0.5 * (below + height) : -1.0;
+        double upper = (above < 1.0) ? 0.5 * (above + height) : 1.0;
+        double band = conduit_area_below(shape, 0.5 * (upper + 1.0) * extent) -
+                      conduit_area_below(shape, 0.5 * (lower + 1.0) * extent);
+
+        flow_coeff[i] = band / (double)shared * velocity_scale[i];
+    }
+
+    compiled->num_paths = num_paths;
+    compiled->velocity_scale = velocity_scale;
+    compiled->flow_coeff = flow_coeff;
+    compiled->storage = storage;
+    compiled->area = conduit_area(shape);
+    return 0;
+}
@@ -0,0 +1,76 @@
+#ifndef CONDUIT_H
+#define CONDUIT_H
+
+#include "flowmeter.h"
+#include <stdint.h>
+
+/*
+ * Conduit cross-sections
+ *
+ * A FlowMeterConfig describes a circular pipe. For other sections the
+ * shape is given separately and conduit_compile() produces an ordinary
+ * CompiledConfig, so frames run through the same kernels at the same
+ * cost. Path positions are normalized to the vertical extent of the
+ * section (-1 at the bottom, +1 at the top) and paths are horizontal
+ * chords. Each path's velocity stands for the horizontal band of the
+ * section between the midpoints to its neighbours:
+ *
+ *   flow_coeff_i = band_area_i * velocity_scale_i,   Σ band_area_i = area
+ *
+ * with band areas integrated exactly from the section's width profile.
+ * Circular sections keep the configured quadrature weights and compile
+ * exactly like flowmeter_compile().
+ */
+
+typedef enum {
+    CONDUIT_CIRCLE,     /* Full circular pipe of the given diameter */
+    CONDUIT_RECTANGLE,  /* Rectangular culvert or channel */
+    CONDUIT_POLYGON     /* Arbitrary simple polygon */
+} ConduitType;
+
+typedef struct {
+    ConduitType type;
+    double diameter;          /* CONDUIT_CIRCLE: diameter in m */
+    double width, height;     /* CONDUIT_RECTANGLE: inside dimensions in m */
+    const double *vertices;   /* CONDUIT_POLYGON: x, y pairs in m, either winding */
+    uint32_t num_vertices;    /* CONDUIT_POLYGON: number of vertices (>= 3) */
+} ConduitShape;
+
+/**
+ * Cross-sectional area of a conduit
+ *
+ * @param shape Conduit shape
+ * @return Area in m², or -1 for an invalid shape
+ */
+double conduit_area(const ConduitShape *shape);
+
+/**
+ * Area of the part of a conduit below a height
+ *
+ * @param shape Conduit shape
+ * @param height Height above the bottom of the section in m
+ * @return Area in m² (0 below the bottom, the full area above the top)
+ */
+double conduit_area_below(const ConduitShape *shape, double height);
+
+/**
+ * Vertical extent of a conduit
+ *
+ * @param shape Conduit shape
+ * @return Height from bottom to top in m, or -1 for an invalid shape
+ */
+double conduit_height(const ConduitShape *shape);
+
+/**
+ * Precompute per-path coefficients for a conduit
+ *
+ * @param config Path configuration (pipe_diameter is ignored unless the
+ *               shape is circular)
+ * @param shape Conduit shape
+ * @param compiled Output structure, release with flowmeter_compiled_free()
+ * @return 0 on success, -1 on error
+ */
+int conduit_compile(const FlowMeterConfig *config, const ConduitShape *shape,
+                    CompiledConfig *compiled);
+
+#endif /* CONDUIT_H */
@@ -0,0 +1,514 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "csv_ingest.h"
+#include <fcntl.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define CSV_FIELDS 5
+#define CSV_BLOCK 64
+
+/* Powers of ten that are exact in double precision */
+static const double exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * Bitmask of ',' and '\n' positions in a 64-byte block
+ */
+static inline uint64_t delimiter_mask(const char *block)
+{
+#if defined(__SSE2__)
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    uint64_t mask = 0;
+
+    for (int i = 0; i < CSV_BLOCK / 16; i++) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(block + 16 * i));
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(bytes, comma),
+                                    _mm_cmpeq_epi8(bytes, newline));
+        mask |= (uint64_t)(uint32_t)_mm_movemask_epi8(hits) << (16 * i);
+    }
+
+    return mask;
+#else
+    uint64_t mask = 0;
+
+    for (int i = 0; i < CSV_BLOCK; i++) {
+        mask |= (uint64_t)(block[i] == ',' || block[i] == '\n') << i;
+    }
+
+    return mask;
+#endif
+}
+
+/**
+ * Index of the lowest set bit (mask must be non-zero)
+ */
+static inline unsigned lowest_bit(uint64_t mask)
+{
+#if defined(__GNUC__)
+    return (unsigned)__builtin_ctzll(mask);
+#else
+    unsigned bit = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+static inline int is_digit(char c)
+{
+    return (unsigned)(c - '0') < 10u;
+}
+
+/**
+ * Parse an unsigned 32-bit integer occupying exactly [start, end)
+ */
+static int parse_uint32(const char *start, const char *end, uint32_t *value)
+{
+    uint64_t result = 0;
+
+    if (start == end || end - start > 10) {
+        return -1;
+    }
+
+    for (const char *p = start; p < end; p++) {
+        if (!is_digit(*p)) {
+            return -1;
+        }
+        result = result * 10 + (uint64_t)(*p - '0');
+    }
+
+    if (result > UINT32_MAX) {
+        return -1;
+    }
+
+    *value = (uint32_t)result;
+    return 0;
+}
+
+/**
+ * Parse decimal seconds into integer nanoseconds, exactly
+ *
+ * Digits beyond nanosecond resolution are truncated.
+ */
+static int parse_timestamp_ns(const char *start, const char *end, uint64_t *value)
+{
+    const char *p = start;
+    uint64_t seconds = 0;
+    uint64_t nanoseconds = 0;
+    int integer_digits = 0;
+
+    while (p < end && is_digit(*p)) {
+        if (++integer_digits > 10) {
+            return -1;
+        }
+        seconds = seconds * 10 + (uint64_t)(*p++ - '0');
+    }
+
+    if (p < end && *p == '.') {
+        uint64_t scale = 100000000;
+        p++;
+        while (p < end && is_digit(*p)) {
+            nanoseconds += (uint64_t)(*p++ - '0') * scale;
+            scale /= 10;
+        }
+    }
+
+    if (p != end || integer_digits == 0) {
+        return -1;
+    }
+
+    *value = seconds * 1000000000ull + nanoseconds;
+    return 0;
+}
+
+/**
+ * Parse a decimal floating-point number occupying exactly [start, end)
+ *
+ * Fast path: with at most 19 significant digits, a mantissa m <= 2^53 and
+ * a decimal exponent |e| <= 22, both m and 10^|e| are exact doubles, so
+ * a single IEEE multiply or divide gives the correctly rounded result.
+ * Everything else goes through strtod().
+ */
+int csv_parse_double(const char *start, const char *end, double *value)
+{
+    const char *p = start;
+    int negative = 0;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    int digits = 0;
+    int truncated = 0;
+
+    while (p < end && is_digit(*p)) {
+        if (significant < 19) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            significant += (mantissa != 0);
+        } else {
+            exponent++;
+            truncated |= (*p != '0');
+        }
+        digits++;
+        p++;
+    }
+
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && is_digit(*p)) {
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                significant += (mantissa != 0);
+                exponent--;
+            } else {
+                truncated |= (*p != '0');
+            }
+            digits++;
+            p++;
+        }
+    }
+
+    if (digits == 0) {
+        return -1;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        int exponent_negative = 0;
+        int exponent_value = 0;
+        const char *exponent_start;
+
+        p++;
+        if (p < end && (*p == '-' || *p == '+')) {
+            exponent_negative = (*p == '-');
+            p++;
+        }
+        exponent_start = p;
+        while (p < end && is_digit(*p)) {
+            if (exponent_value < 10000) {
+                exponent_value = exponent_value * 10 + (*p - '0');
+            }
+            p++;
+        }
+        if (p == exponent_start) {
+            return -1;
+        }
+        exponent += exponent_negative ? -exponent_value : exponent_value;
+    }
+
+    if (p != end) {
+        return -1;
+    }
+
+#if FLT_EVAL_METHOD == 0
+    if (!truncated && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        double result = (double)mantissa;
+        if (exponent < 0) {
+            result /= exact_powers_of_ten[-exponent];
+        } else {
+            result *= exact_powers_of_ten[exponent];
+        }
+        *value = negative ? -result : result;
+        return 0;
+    }
+#endif
+
+    char text[64];
+    size_t length = (size_t)(end - start);
+    char *parse_end;
+
+    if (length >= sizeof(text)) {
+        return -1;
+    }
+    memcpy(text, start, length);
+    text[length] = '\0';
+
+    *value = strtod(text, &parse_end);
+    return (parse_end == text + length) ? 0 : -1;
+}
+
+/**
+ * Hand the current batch to the handler and start a new one
+ */
+static int flush_batch(CsvIngest *ingest)
+{
+    if (ingest->batch.num_frames == 0 || ingest->stopped) {
+        return ingest->stopped ? -1 : 0;
+    }
+
+    ingest->frames += ingest->batch.num_frames;
+    if (ingest->handler(ingest->context, &ingest->batch) != 0) {
+        ingest->stopped = 1;
+    }
+    ingest->batch.num_frames = 0;
+
+    return ingest->stopped ? -1 : 0;
+}
+
+/**
+ * Close the open frame, flushing the batch when it is full
+ */
+static int close_frame(CsvIngest *ingest)
+{
+    if (!ingest->frame_open) {
+        return 0;
+    }
+
+    ingest->frame_open = 0;
+    ingest->batch.num_frames++;
+
+    if (ingest->batch.num_frames == ingest->capacity) {
+        return flush_batch(ingest);
+    }
+
+    return 0;
+}
+
+/**
+ * Parse one row given the positions of its comma delimiters
+ */
+static int process_row(CsvIngest *ingest, const char *row_start, const char *row_end,
+                       const char *const *commas, uint32_t num_commas)
+{
+    if (row_end > row_start && row_end[-1] == '\r') {
+        row_end--;
+    }
+
+    if (num_commas != CSV_FIELDS - 1) {
+        /* Blank lines are not errors */
+        ingest->rows_rejected += (row_end != row_start || num_commas != 0);
+        return 0;
+    }
+
+    uint64_t timestamp_ns;
+    uint32_t meter_id;
+    uint32_t path;
+    PathMeasurement measurement;
+
+    if (parse_timestamp_ns(row_start, commas[0], &timestamp_ns) != 0 ||
+        parse_uint32(commas[0] + 1, commas[1], &meter_id) != 0 ||
+        parse_uint32(commas[1] + 1, commas[2], &path) != 0 ||
+        path >= FLOWMETER_MAX_PATHS ||
+        csv_parse_double(commas[2] + 1, commas[3], &measurement.t_upstream) != 0 ||
+        csv_parse_double(commas[3] + 1, row_end, &measurement.t_downstream) != 0) {
+        ingest->rows_rejected++;
+        return 0;
+    }
+
+    CsvFrameBatch *batch = &ingest->batch;
+    uint32_t frame = batch->num_frames;
+
+    if (ingest->frame_open &&
+        (batch->timestamps_ns[frame] != timestamp_ns || batch->meter_ids[frame] != meter_id)) {
+        if (close_frame(ingest) != 0) {
+            return -1;
+        }
+        frame = batch->num_frames;
+    }
+
+    PathMeasurement *slots = &batch->measurements[(size_t)frame * FLOWMETER_MAX_PATHS];
+
+    if (!ingest->frame_open) {
+        ingest->frame_open = 1;
+        batch->timestamps_ns[frame] = timestamp_ns;
+        batch->meter_ids[frame] = meter_id;
+        batch->num_paths[frame] = 0;
+        memset(slots, 0, FLOWMETER_MAX_PATHS * sizeof(PathMeasurement));
+    }
+
+    slots[path] = measurement;
+    if (path >= batch->num_paths[frame]) {
+        batch->num_paths[frame] = path + 1;
+    }
+    ingest->rows++;
+
+    return 0;
+}
+
+/**
+ * Initialize an ingest state
+ */
+int csv_ingest_init(CsvIngest *ingest, uint32_t batch_frames,
+                    CsvBatchHandler handler, void *context)
+{
+    if (!ingest || !handler || batch_frames == 0) {
+        return -1;
+    }
+
+    memset(ingest, 0, sizeof(*ingest));
+    ingest->handler = handler;
+    ingest->context = context;
+    ingest->capacity = batch_frames;
+
+    ingest->batch.timestamps_ns = malloc(batch_frames * sizeof(uint64_t));
+    ingest->batch.meter_ids = malloc(batch_frames * sizeof(uint32_t));
+    ingest->batch.num_paths = malloc(batch_frames * sizeof(uint32_t));
+    ingest->batch.measurements = malloc((size_t)batch_frames * FLOWMETER_MAX_PATHS *
+                                        sizeof(PathMeasurement));
+    if (!ingest->batch.timestamps_ns || !ingest->batch.meter_ids ||
+        !ingest->batch.num_paths || !ingest->batch.measurements) {
+        csv_ingest_free(ingest);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Parse a buffer of complete rows
+ */
+int csv_ingest_buffer(CsvIngest *ingest, const char *data, size_t size)
+{
+    if (!ingest || (!data && size > 0)) {
+        return -1;
+    }
+
+    if (ingest->stopped) {
+        return -1;
+    }
+
+    size_t offset = 0;
+
+    /* Skip a header line at the very start of the input */
+    if (ingest->bytes == 0 && size > 0 && !is_digit(data[0]) && data[0] != '.') {
+        while (offset < size && data[offset] != '\n') {
+            offset++;
+        }
+        offset = (offset < size) ? offset + 1 : size;
+    }
+    ingest->bytes += size;
+
+    const char *row_start = data + offset;
+    const char *commas[CSV_FIELDS + 1];
+    uint32_t num_commas = 0;
+    char tail[CSV_BLOCK];
+
+    while (offset < size) {
+        size_t block_size = size - offset;
+        uint64_t mask;
+
+        if (block_size >= CSV_BLOCK) {
+            mask = delimiter_mask(data + offset);
+            block_size = CSV_BLOCK;
+        } else {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, data + offset, block_size);
+            mask = delimiter_mask(tail);
+        }
+
+        while (mask) {
+            const char *position = data + offset + lowest_bit(mask);
+            mask &= mask - 1;
+
+            if (*position == ',') {
+                if (num_commas < CSV_FIELDS) {
+                    commas[num_commas] = position;
+                }
+                num_commas++;
+            } else {
+                if (process_row(ingest, row_start, position, commas, num_commas) != 0) {
+                    return -1;
+                }
+                row_start = position + 1;
+                num_commas = 0;
+            }
+        }
+
+        offset += block_size;
+    }
+
+    /* Final row without a trailing newline */
+    if (row_start < data + size) {
+        if (process_row(ingest, row_start, data + size, commas, num_commas) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Parse a whole file (memory-mapped)
+ */
+int csv_ingest_file(CsvIngest *ingest, const char *filename)
+{
+    if (!ingest || !filename) {
+        return -1;
+    }
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)info.st_size;
+    if (size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+
+    int status = csv_ingest_buffer(ingest, data, size);
+
+    munmap(data, size);
+    return status;
+}
+
+/**
+ * Deliver the open frame and any partial batch
+ */
+int csv_ingest_finish(CsvIngest *ingest)
+{
+    if (!ingest) {
+        return -1;
+    }
+
+    if (close_frame(ingest) != 0) {
+        return -1;
+    }
+
+    return flush_batch(ingest);
+}
+
+/**
+ * Free ingest buffers
+ */
+void csv_ingest_free(CsvIngest *ingest)
+{
+    if (ingest) {
+        free(ingest->batch.timestamps_ns);
+        free(ingest->batch.meter_ids);
+        free(ingest->batch.num_paths);
+        free(ingest->batch.measurements);
+        memset(&ingest->batch, 0, sizeof(ingest->batch));
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef CSV_INGEST_H
+#define CSV_INGEST_H
+
+#include "flowmeter.h"
+#include <stddef.h>
+
+/*
+ * CSV ingest for legacy transit-time logs
+ *
+ * Each row is "timestamp,meter,path,t_up,t_down" with the timestamp in
+ * decimal seconds, a numeric meter ID, a 0-based path index and the two
+ * transit times in seconds. Consecutive rows with the same timestamp and
+ * meter form one frame; frames are delivered to a handler in batches.
+ *
+ * Delimiters are located 64 bytes at a time with SSE2 compares (scalar
+ * fallback elsewhere). Numbers use an exact fast path (Clinger's
+ * algorithm) and fall back to strtod() only for inputs outside it.
+ * Quoted fields are not supported; a leading non-numeric header line is
+ * skipped, other malformed rows are counted and skipped.
+ */
+
+/* A batch of frames; frame i has num_paths[i] measurements starting at
+ * measurements + i * FLOWMETER_MAX_PATHS. Missing paths are zero. */
+typedef struct {
+    uint32_t num_frames;          /* Frames in this batch */
+    uint64_t *timestamps_ns;      /* Frame timestamps in nanoseconds */
+    uint32_t *meter_ids;          /* Meter ID of each frame */
+    uint32_t *num_paths;          /* Highest path index + 1 of each frame */
+    PathMeasurement *measurements;
+} CsvFrameBatch;
+
+/**
+ * Batch handler
+ *
+ * @param context User context passed to csv_ingest_init()
+ * @param batch Batch of frames, valid only during the call
+ * @return 0 to continue, non-zero to stop ingest
+ */
+typedef int (*CsvBatchHandler)(void *context, const CsvFrameBatch *batch);
+
+typedef struct {
+    CsvBatchHandler handler;  /* Called for every full batch */
+    void *context;            /* Passed to the handler */
+    uint32_t capacity;        /* Frames per batch */
+    CsvFrameBatch batch;      /* Batch being filled */
+    int frame_open;           /* A frame is being assembled */
+    int stopped;              /* Handler asked to stop */
+    uint64_t rows;            /* Rows accepted */
+    uint64_t rows_rejected;   /* Malformed rows skipped */
+    uint64_t frames;          /* Frames delivered */
+    uint64_t bytes;           /* Input bytes scanned */
+} CsvIngest;
+
+/**
+ * Initialize an ingest state
+ *
+ * @param ingest State to initialize
+ * @param batch_frames Frames per batch (> 0)
+ * @param handler Batch handler
+ * @param context User context for the handler
+ * @return 0 on success, -1 on error
+ */
+int csv_ingest_init(CsvIngest *ingest, uint32_t batch_frames,
+                    CsvBatchHandler handler, void *context);
+
+/**
+ * Parse a buffer of complete rows (the last row may lack a newline)
+ *
+ * A frame is kept open across calls, so a log may be fed in pieces as
+ * long as each piece ends on a row boundary.
+ *
+ * @param ingest Ingest state
+ * @param data CSV text
+ * @param size Size of the text in bytes
+ * @return 0 on success, -1 if the handler stopped ingest
+ */
+int csv_ingest_buffer(CsvIngest *ingest, const char *data, size_t size);
+
+/**
+ * Parse a whole file (memory-mapped)
+ *
+ * @param ingest Ingest state
+ * @param filename CSV file path
+ * @return 0 on success, -1 on error
+ */
+int csv_ingest_file(CsvIngest *ingest, const char *filename);
+
+/**
+ * Deliver the open frame and any partial batch
+ *
+ * @param ingest Ingest state
+ * @return 0 on success, -1 if the handler stopped ingest
+ */
+int csv_ingest_finish(CsvIngest *ingest);
+
+/**
+ * Free ingest buffers
+ *
+ * @param ingest Ingest state
+ */
+void csv_ingest_free(CsvIngest *ingest);
+
+/**
+ * Parse a decimal floating-point number occupying exactly [start, end)
+ *
+ * @param start First character
+ * @param end One past the last character
+ * @param value Output value
+ * @return 0 on success, -1 if the text is not a complete number
+ */
+int csv_parse_double(const char *start, const char *end, double *value);
+
+#endif /* CSV_INGEST_H */
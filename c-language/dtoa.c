@@ -0,0 +1,383 @@
+#include "dtoa.h"
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Grisu2 after Loitsch, "Printing Floating-Point Numbers Quickly and
+ * Accurately with Integers" (PLDI 2010). All arithmetic is on 64-bit
+ * "do-it-yourself" floating-point values f * 2^e.
+ */
+
+typedef struct {
+    uint64_t f;  /* Significand */
+    int e;       /* Binary exponent */
+} DiyFp;
+
+typedef struct {
+    uint64_t f;  /* Normalized significand of 10^k */
+    int e;       /* Binary exponent */
+    int k;       /* Decimal exponent */
+} CachedPower;
+
+/* Normalized 10^k for k = -300, -292, ..., 324 (generated, round-to-nearest) */
+static const CachedPower cached_powers[] = {
+    { 0xAB70FE17C79AC6CAULL, -1060, -300 },
+    { 0xFF77B1FCBEBCDC4FULL, -1034, -292 },
+    { 0xBE5691EF416BD60CULL, -1007, -284 },
+    { 0x8DD01FAD907FFC3CULL,  -980, -276 },
+    { 0xD3515C2831559A83ULL,  -954, -268 },
+    { 0x9D71AC8FADA6C9B5ULL,  -927, -260 },
+    { 0xEA9C227723EE8BCBULL,  -901, -252 },
+    { 0xAECC49914078536DULL,  -874, -244 },
+    { 0x823C12795DB6CE57ULL,  -847, -236 },
+    { 0xC21094364DFB5637ULL,  -821, -228 },
+    { 0x9096EA6F3848984FULL,  -794, -220 },
+    { 0xD77485CB25823AC7ULL,  -768, -212 },
+    { 0xA086CFCD97BF97F4ULL,  -741, -204 },
+    { 0xEF340A98172AACE5ULL,  -715, -196 },
+    { 0xB23867FB2A35B28EULL,  -688, -188 },
+    { 0x84C8D4DFD2C63F3BULL,  -661, -180 },
+    { 0xC5DD44271AD3CDBAULL,  -635, -172 },
+    { 0x936B9FCEBB25C996ULL,  -608, -164 },
+    { 0xDBAC6C247D62A584ULL,  -582, -156 },
+    { 0xA3AB66580D5FDAF6ULL,  -555, -148 },
+    { 0xF3E2F893DEC3F126ULL,  -529, -140 },
+    { 0xB5B5ADA8AAFF80B8ULL,  -502, -132 },
+    { 0x87625F056C7C4A8BULL,  -475, -124 },
+    { 0xC9BCFF6034C13053ULL,  -449, -116 },
+    { 0x964E858C91BA2655ULL,  -422, -108 },
+    { 0xDFF9772470297EBDULL,  -396, -100 },
+    { 0xA6DFBD9FB8E5B88FULL,  -369,  -92 },
+    { 0xF8A95FCF88747D94ULL,  -343,  -84 },
+    { 0xB94470938FA89BCFULL,  -316,  -76 },
+    { 0x8A08F0F8BF0F156BULL,  -289,  -68 },
+    { 0xCDB02555653131B6ULL,  -263,  -60 },
+    { 0x993FE2C6D07B7FACULL,  -236,  -52 },
+    { 0xE45C10C42A2B3B06ULL,  -210,  -44 },
+    { 0xAA242499697392D3ULL,  -183,  -36 },
+    { 0xFD87B5F28300CA0EULL,  -157,  -28 },
+    { 0xBCE5086492111AEBULL,  -130,  -20 },
+    { 0x8CBCCC096F5088CCULL,  -103,  -12 },
+    { 0xD1B71758E219652CULL,   -77,   -4 },
+    { 0x9C40000000000000ULL,   -50,    4 },
+    { 0xE8D4A51000000000ULL,   -24,   12 },
+    { 0xAD78EBC5AC620000ULL,     3,   20 },
+    { 0x813F3978F8940984ULL,    30,   28 },
+    { 0xC097CE7BC90715B3ULL,    56,   36 },
+    { 0x8F7E32CE7BEA5C70ULL,    83,   44 },
+    { 0xD5D238A4ABE98068ULL,   109,   52 },
+    { 0x9F4F2726179A2245ULL,   136,   60 },
+    { 0xED63A231D4C4FB27ULL,   162,   68 },
+    { 0xB0DE65388CC8ADA8ULL,   189,   76 },
+    { 0x83C7088E1AAB65DBULL,   216,   84 },
+    { 0xC45D1DF942711D9AULL,   242,   92 },
+    { 0x924D692CA61BE758ULL,   269,  100 },
+    { 0xDA01EE641A708DEAULL,   295,  108 },
+    { 0xA26DA3999AEF774AULL,   322,  116 },
+    { 0xF209787BB47D6B85ULL,   348,  124 },
+    { 0xB454E4A179DD1877ULL,   375,  132 },
+    { 0x865B86925B9BC5C2ULL,   402,  140 },
+    { 0xC83553C5C8965D3DULL,   428,  148 },
+    { 0x952AB45CFA97A0B3ULL,   455,  156 },
+    { 0xDE469FBD99A05FE3ULL,   481,  164 },
+    { 0xA59BC234DB398C25ULL,   508,  172 },
+    { 0xF6C69A72A3989F5CULL,   534,  180 },
+    { 0xB7DCBF5354E9BECEULL,   561,  188 },
+    { 0x88FCF317F22241E2ULL,   588,  196 },
+    { 0xCC20CE9BD35C78A5ULL,   614,  204 },
+    { 0x98165AF37B2153DFULL,   641,  212 },
+    { 0xE2A0B5DC971F303AULL,   667,  220 },
+    { 0xA8D9D1535CE3B396ULL,   694,  228 },
+    { 0xFB9B7CD9A4A7443CULL,   720,  236 },
+    { 0xBB764C4CA7A44410ULL,   747,  244 },
+    { 0x8BAB8EEFB6409C1AULL,   774,  252 },
+    { 0xD01FEF10A657842CULL,   800,  260 },
+    { 0x9B10A4E5E9913129ULL,   827,  268 },
+    { 0xE7109BFBA19C0C9DULL,   853,  276 },
+    { 0xAC2820D9623BF429ULL,   880,  284 },
+    { 0x80444B5E7AA7CF85ULL,   907,  292 },
+    { 0xBF21E44003ACDD2DULL,   933,  300 },
+    { 0x8E679C2F5E44FF8FULL,   960,  308 },
+    { 0xD433179D9C8CB841ULL,   986,  316 },
+    { 0x9E19DB92B4E31BA9ULL,  1013,  324 },
+};
+
+#define CACHED_POWERS_MIN_K (-300)
+#define CACHED_POWERS_STEP 8
+
+/* Target range of the scaled binary exponent */
+#define GRISU_ALPHA (-60)
+#define GRISU_GAMMA (-32)
+
+static DiyFp diy_sub(DiyFp x, DiyFp y)
+{
+    DiyFp result = { x.f - y.f, x.e };
+    return result;
+}
+
+/**
+ * Product of two DiyFp, keeping the rounded upper 64 bits
+ */
+static DiyFp diy_mul(DiyFp x, DiyFp y)
+{
+    const uint64_t mask32 = 0xFFFFFFFFu;
+    uint64_t a = x.f >> 32, b = x.f & mask32;
+    uint64_t c = y.f >> 32, d = y.f & mask32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t middle = (bd >> 32) + (ad & mask32) + (bc & mask32) + (1u << 31);
+    DiyFp result = { ac + (ad >> 32) + (bc >> 32) + (middle >> 32), x.e + y.e + 64 };
+
+    return result;
+}
+
+static DiyFp diy_normalize(DiyFp x)
+{
+    while (!(x.f & (1ull << 63))) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+/**
+ * Split a positive finite double into v and its normalized neighbourhood
+ * boundaries m- and m+ (which share m+'s exponent)
+ */
+static void diy_from_double(double value, DiyFp *v, DiyFp *minus, DiyFp *plus)
+{
+    const uint64_t hidden_bit = 1ull << 52;
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint64_t significand = bits & (hidden_bit - 1);
+    int biased_exponent = (int)(bits >> 52) & 0x7FF;
+
+    if (biased_exponent != 0) {
+        v->f = significand + hidden_bit;
+        v->e = biased_exponent - 1075;
+    } else {
+        v->f = significand;
+        v->e = -1074;
+    }
+
+    DiyFp upper = { (v->f << 1) + 1, v->e - 1 };
+    upper = diy_normalize(upper);
+
+    /* The gap below a power of two is half the gap above it */
+    DiyFp lower;
+    if (v->f == hidden_bit && biased_exponent > 1) {
+        lower.f = (v->f << 2) - 1;
+        lower.e = v->e - 2;
+    } else {
+        lower.f = (v->f << 1) - 1;
+        lower.e = v->e - 1;
+    }
+    lower.f <<= lower.e - upper.e;
+    lower.e = upper.e;
+
+    *plus = upper;
+    *minus = lower;
+}
+
+/**
+ * Cached power c such that GRISU_ALPHA <= c.e + e + 64 <= GRISU_GAMMA
+ */
+static const CachedPower *cached_power_for(int e)
+{
+    /* k = ceil((alpha - e - 1) * log10(2)) */
+    int f = GRISU_ALPHA - e - 1;
+    int k = (f * 78913) / (1 << 18) + (f > 0);
+    int index = (-CACHED_POWERS_MIN_K + k + (CACHED_POWERS_STEP - 1)) / CACHED_POWERS_STEP;
+
+    return &cached_powers[index];
+}
+
+/**
+ * Number of decimal digits of n (n < 10^10), and the largest power of
+ * ten not above n
+ */
+static int largest_pow10(uint32_t n, uint32_t *pow10)
+{
+    static const uint32_t powers[] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+    };
+    int digits = 10;
+
+    while (digits > 1 && n < powers[digits - 1]) {
+        digits--;
+    }
+    *pow10 = powers[digits - 1];
+
+    return digits;
+}
+
+/**
+ * Move the last digit towards w while staying inside the rounding interval
+ */
+static void grisu_round(char *digits, int length, uint64_t dist, uint64_t delta,
+                        uint64_t rest, uint64_t ten_k)
+{
+    while (rest < dist && delta - rest >= ten_k &&
+           (rest + ten_k < dist || dist - rest > rest + ten_k - dist)) {
+        digits[length - 1]--;
+        rest += ten_k;
+    }
+}
+
+/**
+ * Generate the digits of w inside [m-, m+]; value = digits * 10^exponent
+ */
+static int grisu_digits(char *digits, int *exponent, DiyFp minus, DiyFp w, DiyFp plus)
+{
+    uint64_t delta = diy_sub(plus, minus).f;
+    uint64_t dist = diy_sub(plus, w).f;
+    DiyFp one = { 1ull << -plus.e, plus.e };
+
+    uint32_t p1 = (uint32_t)(plus.f >> -one.e);
+    uint64_t p2 = plus.f & (one.f - 1);
+    uint32_t pow10;
+    int n = largest_pow10(p1, &pow10);
+    int length = 0;
+
+    while (n > 0) {
+        digits[length++] = (char)('0' + p1 / pow10);
+        p1 %= pow10;
+        n--;
+
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *exponent += n;
+            grisu_round(digits, length, dist, delta, rest, (uint64_t)pow10 << -one.e);
+            return length;
+        }
+        pow10 /= 10;
+    }
+
+    int m = 0;
+    for (;;) {
+        p2 *= 10;
+        digits[length++] = (char)('0' + (p2 >> -one.e));
+        p2 &= one.f - 1;
+        m++;
+        delta *= 10;
+        dist *= 10;
+        if (p2 <= delta) {
+            break;
+        }
+    }
+
+    *exponent -= m;
+    grisu_round(digits, length, dist, delta, p2, one.f);
+    return length;
+}
+
+/**
+ * Write digits * 10^exponent in plain or scientific notation
+ */
+static size_t format_digits(char *out, const char *digits, int length, int exponent)
+{
+    /* value = 0.d1d2...dn * 10^point */
+    int point = length + exponent;
+    char *p = out;
+
+    if (length <= point && point <= 15) {
+        memcpy(p, digits, (size_t)length);
+        memset(p + length, '0', (size_t)(point - length));
+        return (size_t)point;
+    }
+
+    if (0 < point && point <= 15) {
+        memcpy(p, digits, (size_t)point);
+        p[point] = '.';
+        memcpy(p + point + 1, digits + point, (size_t)(length - point));
+        return (size_t)length + 1;
+    }
+
+    if (-4 < point && point <= 0) {
+        p[0] = '0';
+        p[1] = '.';
+        memset(p + 2, '0', (size_t)-point);
+        memcpy(p + 2 - point, digits, (size_t)length);
+        return (size_t)(2 - point + length);
+    }
+
+    *p++ = digits[0];
+    if (length > 1) {
+        *p++ = '.';
+        memcpy(p, digits + 1, (size_t)(length - 1));
+        p += length - 1;
+    }
+
+    int e = point - 1;
+    *p++ = 'e';
+    if (e < 0) {
+        *p++ = '-';
+        e = -e;
+    }
+    if (e >= 100) {
+        *p++ = (char)('0' + e / 100);
+        e %= 100;
+        *p++ = (char)('0' + e / 10);
+    } else if (e >= 10) {
+        *p++ = (char)('0' + e / 10);
+    } else {
+        *p++ = '0';
+    }
+    *p++ = (char)('0' + e % 10);
+
+    return (size_t)(p - out);
+}
+
+/**
+ * Format a double with the fewest digits that round-trip
+ */
+size_t dtoa_shortest(double value, char *buffer)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    char *p = buffer;
+    int negative = (int)(bits >> 63);
+    int biased_exponent = (int)(bits >> 52) & 0x7FF;
+
+    if (biased_exponent == 0x7FF) {
+        if (bits & ((1ull << 52) - 1)) {
+            memcpy(buffer, "nan", 3);
+            return 3;
+        }
+        if (negative) {
+            *p++ = '-';
+        }
+        memcpy(p, "inf", 3);
+        return (size_t)(p - buffer) + 3;
+    }
+
+    if (negative) {
+        *p++ = '-';
+        value = -value;
+    }
+
+    if (value == 0.0) {
+        *p++ = '0';
+        return (size_t)(p - buffer);
+    }
+
+    DiyFp v, minus, plus;
+    diy_from_double(value, &v, &minus, &plus);
+
+    const CachedPower *cached = cached_power_for(plus.e);
+    DiyFp c = { cached->f, cached->e };
+    DiyFp w = diy_mul(diy_normalize(v), c);
+    DiyFp w_minus = diy_mul(minus, c);
+    DiyFp w_plus = diy_mul(plus, c);
+
+    /* Shrink the interval by one unit to absorb the multiplication error */
+    w_minus.f++;
+    w_plus.f--;
+
+    char digits[20];
+    int exponent = -cached->k;
+    int length = grisu_digits(digits, &exponent, w_minus, w, w_plus);
+
+    return (size_t)(p - buffer) + format_digits(p, digits, length, exponent);
+}
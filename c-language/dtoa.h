@@ -0,0 +1,24 @@
+#ifndef DTOA_H
+#define DTOA_H
+
+#include <stddef.h>
+
+/* Minimum buffer size for dtoa_shortest() */
+#define DTOA_BUFFER_SIZE 32
+
+/**
+ * Format a double with the fewest digits that round-trip
+ *
+ * Uses Grisu2: the output always parses back to the same double, and is
+ * the shortest such representation for all but ~0.1% of inputs (those get
+ * one extra digit). Plain decimal notation is used for magnitudes in
+ * [1e-4, 1e15), scientific notation ("1.5e-07") otherwise. NaN and infinity
+ * are written as "nan", "inf" and "-inf". No terminating NUL is written.
+ *
+ * @param value Value to format
+ * @param buffer Output buffer of at least DTOA_BUFFER_SIZE bytes
+ * @return Number of characters written
+ */
+size_t dtoa_shortest(double value, char *buffer);
+
+#endif /* DTOA_H */
@@ -0,0 +1,192 @@
+#include "fleet.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Append an empty meter entry, growing the arrays as needed
+ */
+static FlowMeterConfig* fleet_append(FleetConfig *fleet, uint32_t *capacity,
+                                     uint32_t meter_id)
+{
+    if (fleet->num_meters == *capacity) {
+        uint32_t new_capacity = *capacity ? *capacity * 2 : 64;
+        uint32_t *ids = realloc(fleet->meter_ids, new_capacity * sizeof(uint32_t));
+        if (!ids) {
+            return NULL;
+        }
+        fleet->meter_ids = ids;
+
+        FlowMeterConfig *configs = realloc(fleet->configs,
+                                           new_capacity * sizeof(FlowMeterConfig));
+        if (!configs) {
+            return NULL;
+        }
+        fleet->configs = configs;
+        *capacity = new_capacity;
+    }
+
+    FlowMeterConfig *config = &fleet->configs[fleet->num_meters];
+    memset(config, 0, sizeof(*config));
+    fleet->meter_ids[fleet->num_meters] = meter_id;
+    fleet->num_meters++;
+
+    return config;
+}
+
+/**
+ * Copy the paths of a standard layout into a fleet entry
+ */
+static int fleet_use_layout(FlowMeterConfig *config, const char *layout)
+{
+    FlowMeterConfig *standard;
+
+    if (strcmp(layout, "2path") == 0) {
+        standard = create_2path_config(config->pipe_diameter);
+    } else if (strcmp(layout, "4path") == 0) {
+        standard = create_4path_config(config->pipe_diameter);
+    } else {
+        return -1;
+    }
+
+    if (!standard) {
+        return -1;
+    }
+
+    /* Take ownership of the paths array */
+    config->num_paths = standard->num_paths;
+    config->paths = standard->paths;
+    free(standard);
+
+    return 0;
+}
+
+/**
+ * Load a fleet from a text configuration file
+ */
+int fleet_load_text(const char *filename, FleetConfig *fleet)
+{
+    if (!filename || !fleet) {
+        return -1;
+    }
+
+    memset(fleet, 0, sizeof(*fleet));
+
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open fleet file %s\n", filename);
+        return -1;
+    }
+
+    char line[256];
+    unsigned line_number = 0;
+    uint32_t capacity = 0;
+    FlowMeterConfig *current = NULL;
+    int has_layout = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        char keyword[16];
+        if (sscanf(line, "%15s", keyword) != 1) {
+            continue;  /* Blank line */
+        }
+
+        if (strcmp(keyword, "meter") == 0) {
+            unsigned long meter_id;
+            double diameter;
+            char layout[16] = "";
+
+            int fields = sscanf(line, "%*s %lu %lf %15s", &meter_id, &diameter, layout);
+            if (fields < 2 || !(diameter > 0) || meter_id > UINT32_MAX) {
+                fprintf(stderr, "Error: %s:%u: invalid meter line\n",
+                        filename, line_number);
+                goto fail;
+            }
+
+            current = fleet_append(fleet, &capacity, (uint32_t)meter_id);
+            if (!current) {
+                fprintf(stderr, "Error: Out of memory loading fleet\n");
+                goto fail;
+            }
+            current->pipe_diameter = diameter;
+
+            has_layout = (fields == 3);
+            if (has_layout && fleet_use_layout(current, layout) != 0) {
+                fprintf(stderr, "Error: %s:%u: unknown layout '%s'\n",
+                        filename, line_number, layout);
+                goto fail;
+            }
+        } else if (strcmp(keyword, "path") == 0) {
+            AcousticPath path;
+            double angle_deg;
+
+            if (!current || has_layout) {
+                fprintf(stderr, "Error: %s:%u: path without a custom meter\n",
+                        filename, line_number);
+                goto fail;
+            }
+
+            if (sscanf(line, "%*s %lf %lf %lf %lf", &path.position, &angle_deg,
+                       &path.length, &path.weight) != 4) {
+                fprintf(stderr, "Error: %s:%u: invalid path line\n",
+                        filename, line_number);
+                goto fail;
+            }
+            path.angle = angle_deg * M_PI / 180.0;
+
+            AcousticPath *paths = realloc(current->paths,
+                                          (current->num_paths + 1) * sizeof(AcousticPath));
+            if (!paths) {
+                fprintf(stderr, "Error: Out of memory loading fleet\n");
+                goto fail;
+            }
+            paths[current->num_paths] = path;
+            current->paths = paths;
+            current->num_paths++;
+        } else {
+            fprintf(stderr, "Error: %s:%u: unknown directive '%s'\n",
+                    filename, line_number, keyword);
+            goto fail;
+        }
+    }
+
+    fclose(file);
+
+    for (uint32_t i = 0; i < fleet->num_meters; i++) {
+        if (fleet->configs[i].num_paths == 0) {
+            fprintf(stderr, "Error: %s: meter %u has no paths\n",
+                    filename, fleet->meter_ids[i]);
+            fleet_free(fleet);
+            return -1;
+        }
+    }
+
+    return 0;
+
+fail:
+    fclose(file);
+    fleet_free(fleet);
+    return -1;
+}
+
+/**
+ * Free all memory owned by a fleet
+ */
+void fleet_free(FleetConfig *fleet)
+{
+    if (fleet) {
+        for (uint32_t i = 0; i < fleet->num_meters; i++) {
+            free(fleet->configs[i].paths);
+        }
+        free(fleet->configs);
+        free(fleet->meter_ids);
+        memset(fleet, 0, sizeof(*fleet));
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include "flowmeter.h"
+
+/*
+ * A fleet is a set of meters, each identified by a numeric meter ID
+ * with its own FlowMeterConfig.
+ *
+ * Text format, one directive per line ('#' starts a comment):
+ *
+ *   meter <id> <diameter_m> [2path|4path]
+ *   path <position> <angle_deg> <length_m> <weight>
+ *
+ * A meter line with a layout name uses the standard 2- or 4-path
+ * configuration. Without one, the following path lines define its paths.
+ */
+typedef struct {
+    uint32_t num_meters;      /* Number of meters in the fleet */
+    uint32_t *meter_ids;      /* Meter ID for each entry */
+    FlowMeterConfig *configs; /* Configuration for each entry */
+} FleetConfig;
+
+/**
+ * Load a fleet from a text configuration file
+ *
+ * @param filename Path to the fleet file
+ * @param fleet Output fleet, release with fleet_free()
+ * @return 0 on success, -1 on error (a message is printed to stderr)
+ */
+int fleet_load_text(const char *filename, FleetConfig *fleet);
+
+/**
+ * Free all memory owned by a fleet
+ *
+ * @param fleet Fleet to release
+ */
+void fleet_free(FleetConfig *fleet);
+
+#endif /* FLEET_H */
@@ -128,3 +128,242 @@ void flowmeter_result_free(FlowResult *result)
         free(result);
     }
 }
+
+/**
+ * Precompute per-path coefficients for a configuration
+ *
+ * velocity_scale_i = L_i / (2 * sin(θ_i))
+ * flow_coeff_i     = (π * D² / 4) * w_i * velocity_scale_i
+ */
+int flowmeter_compile(const FlowMeterConfig *config, CompiledConfig *compiled)
+{
+    if (!config || !compiled) {
+        return -1;
+    }
+
+    if (config->num_paths == 0 || !config->paths) {
+        return -1;
+    }
+
+    double *storage = malloc(2 * config->num_paths * sizeof(double));
+    if (!storage) {
+        return -1;
+    }
+
+    double *velocity_scale = storage;
+    double *flow_coeff = storage + config->num_paths;
+
+    double radius = config->pipe_diameter / 2.0;
+    double area = M_PI * radius * radius;
+
+    for (uint32_t i = 0; i < config->num_paths; i++) {
+        double sin_theta = sin(config->paths[i].angle);
+
+        /* A zero angle has no axial sensitivity; the path contributes 0 */
+        velocity_scale[i] = (sin_theta == 0) ? 0.0 :
+                            config->paths[i].length / (2.0 * sin_theta);
+        flow_coeff[i] = area * config->paths[i].weight * velocity_scale[i];
+    }
+
+    compiled->num_paths = config->num_paths;
+    compiled->area = area;
+    compiled->velocity_scale = velocity_scale;
+    compiled->flow_coeff = flow_coeff;
+    compiled->storage = storage;
+
+    return 0;
+}
+
+/**
+ * Free coefficient storage owned by a CompiledConfig
+ */
+void flowmeter_compiled_free(CompiledConfig *compiled)
+{
+    if (compiled) {
+        free(compiled->storage);
+        compiled->storage = NULL;
+        compiled->velocity_scale = NULL;
+        compiled->flow_coeff = NULL;
+        compiled->num_paths = 0;
+    }
+}
+
+/**
+ * Calculate volumetric flow rate using precomputed coefficients
+ */
+int calculate_flow_rate_compiled(const CompiledConfig *compiled,
+                                 const PathMeasurement *measurements,
+                                 FlowResult *result)
+{
+    if (!compiled || !measurements || !result) {
+        return -1;
+    }
+
+    if (compiled->num_paths == 0 || !compiled->flow_coeff) {
+        return -1;
+    }
+
+    result->path_velocities = malloc(compiled->num_paths * sizeof(double));
+    if (!result->path_velocities) {
+        return -1;
+    }
+
+    double flow = 0.0;
+    for (uint32_t i = 0; i < compiled->num_paths; i++) {
+        double term = path_transit_term(&measurements[i]);
+        result->path_velocities[i] = compiled->velocity_scale[i] * term;
+        flow += compiled->flow_coeff[i] * term;
+    }
+
+    result->volumetric_flow = flow;
+
+    return 0;
+}
+
+/**
+ * Materialize per-path velocities using precomputed coefficients
+ */
+int calculate_path_velocities_compiled(const CompiledConfig *compiled,
+                                       const PathMeasurement *measurements,
+                                       double *velocities)
+{
+    if (!compiled || !measurements || !velocities || !compiled->velocity_scale) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < compiled->num_paths; i++) {
+        velocities[i] = compiled->velocity_scale[i] * path_transit_term(&measurements[i]);
+    }
+
+    return 0;
+}
+
+/**
+ * Calculate volumetric flow for a batch of frames
+ *
+ * The total-only loop touches the measurements and one output double per
+ * frame; velocities cost a further num_paths writes per sampled frame.
+ */
+int calculate_flow_batch(const CompiledConfig *compiled,
+                         const PathMeasurement *frames, size_t num_frames,
+                         double *flows, double *velocities,
+                         size_t velocity_interval)
+{
+    if (!compiled || !frames || !flows) {
+        return -1;
+    }
+
+    if (compiled->num_paths == 0 || !compiled->flow_coeff) {
+        return -1;
+    }
+
+    if (!velocities) {
+        velocity_interval = 0;
+    }
+
+    uint32_t num_paths = compiled->num_paths;
+    size_t next_sample = velocity_interval ? 0 : num_frames;
+
+    for (size_t f = 0; f < num_frames; f++) {
+        const PathMeasurement *measurements = &frames[f * num_paths];
+
+        flows[f] = compiled_flow_rate(compiled, measurements);
+
+        if (f == next_sample) {
+            calculate_path_velocities_compiled(compiled, measurements, velocities);
+            velocities += num_paths;
+            next_sample += velocity_interval;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Initialize a 2-path flow meter configuration
+ * Typical 45-degree diagonal paths for quick measurement
+ */
+FlowMeterConfig* create_2path_config(double pipe_diameter)
+{
+    FlowMeterConfig *config = malloc(sizeof(FlowMeterConfig));
+    if (!config) return NULL;
+
+    config->pipe_diameter = pipe_diameter;
+    config->num_paths = 2;
+    config->paths = malloc(2 * sizeof(AcousticPath));
+    if (!config->paths) {
+        free(config);
+        return NULL;
+    }
+
+    /* Path 1: 45-degree angle from center, positive offset */
+    config->paths[0].position = 0.25;
+    config->paths[0].angle = M_PI / 4.0;  /* 45 degrees */
+    config->paths[0].length = pipe_diameter / sin(M_PI / 4.0);
+    config->paths[0].weight = 0.5;
+
+    /* Path 2: 45-degree angle from center, negative offset (opposite side) */
+    config->paths[1].position = -0.25;
+    config->paths[1].angle = M_PI / 4.0;
+    config->paths[1].length = pipe_diameter / sin(M_PI / 4.0);
+    config->paths[1].weight = 0.5;
+
+    return config;
+}
+
+/**
+ * Initialize a 4-path flow meter configuration
+ * Mix of 60-degree and 45-degree paths for improved accuracy
+ */
+FlowMeterConfig* create_4path_config(double pipe_diameter)
+{
+    FlowMeterConfig *config = malloc(sizeof(FlowMeterConfig));
+    if (!config) return NULL;
+
+    config->pipe_diameter = pipe_diameter;
+    config->num_paths = 4;
+    config->paths = malloc(4 * sizeof(AcousticPath));
+    if (!config->paths) {
+        free(config);
+        return NULL;
+    }
+
+    /* Path 1: 60-degree angle, position 0.35D */
+    config->paths[0].position = 0.35;
+    config->paths[0].angle = M_PI / 3.0;  /* 60 degrees */
+    config->paths[0].length = pipe_diameter / sin(M_PI / 3.0);
+    config->paths[0].weight = 0.25;
+
+    /* Path 2: 60-degree angle, position -0.35D (opposite side) */
+    config->paths[1].position = -0.35;
+    config->paths[1].angle = M_PI / 3.0;
+    config->paths[1].length = pipe_diameter / sin(M_PI / 3.0);
+    config->paths[1].weight = 0.25;
+
+    /* Path 3: 45-degree angle, position 0.15D */
+    config->paths[2].position = 0.15;
+    config->paths[2].angle = M_PI / 4.0;  /* 45 degrees */
+    config->paths[2].length = pipe_diameter / sin(M_PI / 4.0);
+    config->paths[2].weight = 0.25;
+
+    /* Path 4: 45-degree angle, position -0.15D (opposite side) */
+    config->paths[3].position = -0.15;
+    config->paths[3].angle = M_PI / 4.0;
+    config->paths[3].length = pipe_diameter / sin(M_PI / 4.0);
+    config->paths[3].weight = 0.25;
+
+    return config;
+}
+
+/**
+ * Free flow meter configuration
+ */
+void free_config(FlowMeterConfig *config)
+{
+    if (config) {
+        if (config->paths) {
+            free(config->paths);
+        }
+        free(config);
+    }
+}
@@ -1,8 +1,17 @@
 #ifndef FLOWMETER_H
 #define FLOWMETER_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+/* M_PI is not part of strict C99 <math.h> */
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* Upper bound on paths per meter for fixed-size per-frame buffers */
+#define FLOWMETER_MAX_PATHS 32
+
 /* Structure to represent a single acoustic path */
 typedef struct {
     double position;        /* Position on pipe diameter (normalized: -1 to 1) */
@@ -30,6 +39,56 @@ typedef struct {
     double volumetric_flow;   /* Total volumetric flow rate (m³/s) */
 } FlowResult;
 
+/*
+ * Derived per-path coefficients, computed once per configuration
+ *
+ * Folding geometry, weight and area together reduces the flow rate to
+ * Q = Σ flow_coeff_i * Δt_i / (t_up_i * t_down_i).
+ */
+typedef struct {
+    uint32_t num_paths;           /* Number of acoustic paths */
+    double area;                  /* Cross-sectional area in m² */
+    const double *velocity_scale; /* L / (2 * sin(θ)) per path, 0 if θ = 0 */
+    const double *flow_coeff;     /* area * w * velocity_scale per path */
+    double *storage;              /* Owned coefficient storage, NULL for views */
+} CompiledConfig;
+
+/**
+ * Transit-time term Δt / (t_up * t_down) of a single path measurement
+ *
+ * Returns 0 for non-positive transit times, matching
+ * calculate_path_velocity(). Written as a select so it compiles branch-free.
+ */
+static inline double path_transit_term(const PathMeasurement *measurement)
+{
+    double t_up = measurement->t_upstream;
+    double t_down = measurement->t_downstream;
+    int valid = (t_up > 0.0) & (t_down > 0.0);
+    double term = (t_up - t_down) / (t_up * t_down);
+
+    return valid ? term : 0.0;
+}
+
+/**
+ * Volumetric flow of one frame from precomputed coefficients
+ *
+ * Total-only form of calculate_flow_rate_compiled(): a dot product of
+ * flow coefficients with transit terms that writes no per-path output.
+ *
+ * @param compiled Compiled configuration
+ * @param measurements Array of measurements (one per path)
+ * @return Volumetric flow rate (m³/s)
+ */
+static inline double compiled_flow_rate(const CompiledConfig *compiled,
+                                        const PathMeasurement *measurements)
+{
+    double flow = 0.0;
+    for (uint32_t i = 0; i < compiled->num_paths; i++) {
+        flow += compiled->flow_coeff[i] * path_transit_term(&measurements[i]);
+    }
+    return flow;
+}
+
 /* Function declarations */
 
 /**
@@ -71,4 +130,97 @@ FlowResult* flowmeter_process(const FlowMeterConfig *config,
  */
 void flowmeter_result_free(FlowResult *result);
 
+/**
+ * Precompute per-path coefficients for a configuration
+ *
+ * @param config Flow meter configuration
+ * @param compiled Output structure, release with flowmeter_compiled_free()
+ * @return 0 on success, -1 on error
+ */
+int flowmeter_compile(const FlowMeterConfig *config, CompiledConfig *compiled);
+
+/**
+ * Free coefficient storage owned by a CompiledConfig
+ *
+ * @param compiled Compiled configuration (views are left untouched)
+ */
+void flowmeter_compiled_free(CompiledConfig *compiled);
+
+/**
+ * Calculate volumetric flow rate using precomputed coefficients
+ *
+ * Same result as calculate_flow_rate() without per-frame trigonometry.
+ *
+ * @param compiled Compiled configuration
+ * @param measurements Array of measurements (one per path)
+ * @param result Output structure for flow calculation results
+ * @return 0 on success, -1 on error
+ */
+int calculate_flow_rate_compiled(const CompiledConfig *compiled,
+                                 const PathMeasurement *measurements,
+                                 FlowResult *result);
+
+/**
+ * Materialize per-path velocities using precomputed coefficients
+ *
+ * Companion to compiled_flow_rate() for callers that need velocities
+ * only for some frames.
+ *
+ * @param compiled Compiled configuration
+ * @param measurements Array of measurements (one per path)
+ * @param velocities Output array of compiled->num_paths velocities (m/s)
+ * @return 0 on success, -1 on error
+ */
+int calculate_path_velocities_compiled(const CompiledConfig *compiled,
+                                       const PathMeasurement *measurements,
+                                       double *velocities);
+
+/**
+ * Calculate volumetric flow for a batch of frames
+ *
+ * Frames are stored frame-major, compiled->num_paths measurements each.
+ * Only totals are written unless velocities are requested: with a
+ * non-zero velocity_interval, frames 0, k, 2k, ... also have their path
+ * velocities written to consecutive rows of the velocities array.
+ *
+ * @param compiled Compiled configuration
+ * @param frames Measurements of num_frames frames
+ * @param num_frames Number of frames
+ * @param flows Output array of num_frames flow rates (m³/s)
+ * @param velocities Output rows of num_paths velocities, one per sampled
+ *                   frame (ceil(num_frames / k) rows), or NULL
+ * @param velocity_interval Sample every k-th frame's velocities, 0 for none
+ * @return 0 on success, -1 on error
+ */
+int calculate_flow_batch(const CompiledConfig *compiled,
+                         const PathMeasurement *frames, size_t num_frames,
+                         double *flows, double *velocities,
+                         size_t velocity_interval);
+
+/**
+ * Initialize a 2-path flow meter configuration
+ * Typical 45-degree diagonal paths for quick measurement
+ *
+ * @param pipe_diameter Pipe diameter in meters
+ * @return New configuration (free with free_config()), NULL on error
+ */
+FlowMeterConfig* create_2path_config(double pipe_diameter);
+
+/**
+ * Initialize a 4-path flow meter configuration
+ * Mix of 60-degree and 45-degree paths for improved accuracy
+ *
+ * @param pipe_diameter Pipe diameter in meters
+ * @return New configuration (free with free_config()), NULL on error
+ */
+FlowMeterConfig* create_4path_config(double pipe_diameter);
+
+/**
+ * Free flow meter configuration
+ *
+ * @param config Configuration created by create_2path_config() or
+ *               create_4path_config()
+ */
+void free_config(FlowMeterConfig *config);
+
 #endif /* FLOWMETER_H */
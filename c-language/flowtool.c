@@ -0,0 +1,855 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "flowmeter.h"
+#include "capture.h"
+#include "capture_merge.h"
+#include "csv_ingest.h"
+#include "fleet.h"
+#include "packed.h"
+#include "query.h"
+#include "result_writer.h"
+#include "rollup.h"
+#include "serial.h"
+#include "snapshot.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * flowtool - command line utilities around the flow meter library
+ *
+ * Usage: flowtool <command> [arguments...]
+ */
+
+typedef struct {
+    const char *name;                  /* Command name */
+    const char *usage;                 /* Argument summary */
+    int (*run)(int argc, char **argv); /* argv[0] is the command name */
+} ToolCommand;
+
+/**
+ * Compile a fleet text file into a binary snapshot
+ */
+static int command_snapshot(int argc, char **argv)
+{
+    if (argc != 3) {
+        return 2;
+    }
+
+    FleetConfig fleet;
+    if (fleet_load_text(argv[1], &fleet) != 0) {
+        return 1;
+    }
+
+    int status = snapshot_write(argv[2], &fleet);
+    if (status != 0) {
+        fprintf(stderr, "Error: Failed to write snapshot %s\n", argv[2]);
+    } else {
+        printf("Compiled %u meters into %s\n", fleet.num_meters, argv[2]);
+    }
+
+    fleet_free(&fleet);
+    return status == 0 ? 0 : 1;
+}
+
+/**
+ * Print a summary of a snapshot, or one meter of it
+ */
+static int command_snapshot_info(int argc, char **argv)
+{
+    if (argc != 2 && argc != 3) {
+        return 2;
+    }
+
+    FleetSnapshot snapshot;
+    if (snapshot_open(argv[1], &snapshot) != 0) {
+        fprintf(stderr, "Error: %s is not a valid snapshot\n", argv[1]);
+        return 1;
+    }
+
+    int status = 0;
+    if (snapshot_verify(&snapshot) != 0) {
+        fprintf(stderr, "Error: %s checksum mismatch\n", argv[1]);
+        status = 1;
+    } else if (argc == 2) {
+        printf("Snapshot version %u\n", snapshot.header->version);
+        printf("  Meters: %u\n", snapshot.header->num_meters);
+        printf("  Paths: %u\n", snapshot.header->total_paths);
+        printf("  Size: %llu bytes\n", (unsigned long long)snapshot.size);
+    } else {
+        int64_t index = snapshot_find_meter(&snapshot, (uint32_t)strtoul(argv[2], NULL, 10));
+        CompiledConfig compiled;
+
+        if (index < 0 || snapshot_meter_view(&snapshot, (uint32_t)index, NULL, &compiled) != 0) {
+            fprintf(stderr, "Error: Meter %s not found\n", argv[2]);
+            status = 1;
+        } else {
+            printf("Meter %s: diameter %.4f m, area %.6f m², %u paths\n", argv[2],
+                   snapshot.meters[index].pipe_diameter, compiled.area,
+                   compiled.num_paths);
+            for (uint32_t i = 0; i < compiled.num_paths; i++) {
+                printf("  Path %u: velocity scale %.6f m, flow coefficient %.6e m³\n",
+                       i + 1, compiled.velocity_scale[i], compiled.flow_coeff[i]);
+            }
+        }
+    }
+
+    snapshot_close(&snapshot);
+    return status;
+}
+
+/**
+ * Pack a fleet and report memory footprint and flow accuracy
+ *
+ * Accuracy is checked against calculate_flow_rate() on synthetic
+ * measurements for every meter.
+ */
+static int command_pack_info(int argc, char **argv)
+{
+    if (argc != 2) {
+        return 2;
+    }
+
+    FleetConfig fleet;
+    if (fleet_load_text(argv[1], &fleet) != 0) {
+        return 1;
+    }
+
+    PackedFleet packed;
+    if (packed_fleet_build(fleet.configs, fleet.num_meters, &packed) != 0) {
+        fprintf(stderr, "Error: Failed to pack fleet\n");
+        fleet_free(&fleet);
+        return 1;
+    }
+
+    double max_error = 0.0;
+    for (uint32_t m = 0; m < fleet.num_meters; m++) {
+        const FlowMeterConfig *config = &fleet.configs[m];
+        PathMeasurement *measurements = malloc(config->num_paths * sizeof(PathMeasurement));
+        FlowResult result;
+
+        if (!measurements) {
+            break;
+        }
+        for (uint32_t i = 0; i < config->num_paths; i++) {
+            /* ~2 m/s in water over the path */
+            double t = config->paths[i].length / 1480.0;
+            measurements[i].t_upstream = t * (1.0 + 1.35e-3 * (1 + i % 3));
+            measurements[i].t_downstream = t;
+        }
+        if (calculate_flow_rate(config, measurements, &result) == 0) {
+            double packed_flow = packed_flow_rate(&packed, m, measurements);
+            double error = fabs(packed_flow - result.volumetric_flow) /
+                           fabs(result.volumetric_flow);
+            if (error > max_error) {
+                max_error = error;
+            }
+            free(result.path_velocities);
+        }
+        free(measurements);
+    }
+
+    size_t unpacked_bytes = fleet_config_bytes(fleet.configs, fleet.num_meters);
+    printf("Meters: %u\n", packed.num_meters);
+    printf("Distinct path layouts: %u\n", packed.num_layouts);
+    printf("Distinct pipe diameters: %u\n", packed.num_diameters);
+    printf("Unpacked config data: %zu bytes\n", unpacked_bytes);
+    printf("Packed config data: %zu bytes (%.1fx smaller)\n", packed.bytes,
+           (double)unpacked_bytes / (double)packed.bytes);
+    printf("Max relative flow error: %.2e\n", max_error);
+
+    packed_fleet_free(&packed);
+    fleet_free(&fleet);
+    return 0;
+}
+
+/* Per-meter accumulators for the csv command, indexed like the snapshot */
+typedef struct {
+    const FleetSnapshot *snapshot;
+    uint64_t *frames;
+    double *flow_sum;
+    ResultWriter *writer;  /* Per-frame output, NULL for a summary only */
+    uint64_t unknown_frames;
+    uint64_t failed_frames;
+} CsvFlowContext;
+
+/**
+ * Compute the flow of every frame in a CSV batch
+ */
+static int csv_flow_handler(void *context, const CsvFrameBatch *batch)
+{
+    CsvFlowContext *flow = context;
+    uint32_t last_meter_id = UINT32_MAX;
+    int64_t index = -1;
+    CompiledConfig compiled;
+
+    for (uint32_t f = 0; f < batch->num_frames; f++) {
+        if (batch->meter_ids[f] != last_meter_id || index < 0) {
+            last_meter_id = batch->meter_ids[f];
+            index = snapshot_find_meter(flow->snapshot, last_meter_id);
+            if (index >= 0) {
+                snapshot_meter_view(flow->snapshot, (uint32_t)index, NULL, &compiled);
+            }
+        }
+
+        if (index < 0) {
+            flow->unknown_frames++;
+            continue;
+        }
+
+        const PathMeasurement *measurements =
+            &batch->measurements[(size_t)f * FLOWMETER_MAX_PATHS];
+        if (batch->num_paths[f] > compiled.num_paths ||
+            compiled.num_paths > FLOWMETER_MAX_PATHS) {
+            flow->failed_frames++;
+            continue;
+        }
+
+        /* The summary needs only totals; velocities are for per-frame output */
+        double velocities[FLOWMETER_MAX_PATHS];
+        FlowResult result = { NULL, compiled_flow_rate(&compiled, measurements) };
+
+        flow->frames[index]++;
+        flow->flow_sum[index] += result.volumetric_flow;
+
+        if (flow->writer) {
+            result.path_velocities = velocities;
+            calculate_path_velocities_compiled(&compiled, measurements, velocities);
+            if (result_writer_append(flow->writer, batch->timestamps_ns[f],
+                                     batch->meter_ids[f], &result,
+                                     compiled.num_paths) != 0) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Recompute flow from a CSV transit-time log using a fleet snapshot
+ *
+ * Prints a per-meter summary, or with a format argument streams every
+ * result to stdout in that format.
+ */
+static int command_csv(int argc, char **argv)
+{
+    ResultFormat format = RESULT_FORMAT_JSONL;
+
+    if (argc != 3 && argc != 4) {
+        return 2;
+    }
+    if (argc == 4 && result_format_parse(argv[3], &format) != 0) {
+        return 2;
+    }
+
+    FleetSnapshot snapshot;
+    if (snapshot_open(argv[1], &snapshot) != 0) {
+        fprintf(stderr, "Error: %s is not a valid snapshot\n", argv[1]);
+        return 1;
+    }
+
+    uint32_t num_meters = snapshot.header->num_meters;
+    CsvFlowContext flow = { &snapshot, NULL, NULL, NULL, 0, 0 };
+    flow.frames = calloc(num_meters, sizeof(uint64_t));
+    flow.flow_sum = calloc(num_meters, sizeof(double));
+
+    ResultWriter writer;
+    if (argc == 4) {
+        if (result_writer_open(&writer, fileno(stdout), format,
+                               FLOWMETER_MAX_PATHS, 0) != 0) {
+            free(flow.frames);
+            free(flow.flow_sum);
+            snapshot_close(&snapshot);
+            return 1;
+        }
+        flow.writer = &writer;
+    }
+
+    CsvIngest ingest;
+    int status = 1;
+
+    if (flow.frames && flow.flow_sum &&
+        csv_ingest_init(&ingest, 4096, csv_flow_handler, &flow) == 0) {
+        if (csv_ingest_file(&ingest, argv[2]) == 0 && csv_ingest_finish(&ingest) == 0) {
+            status = 0;
+        } else {
+            fprintf(stderr, "Error: Failed to process %s\n", argv[2]);
+        }
+
+        if (status == 0 && flow.writer) {
+            fprintf(stderr, "Rows: %llu (%llu rejected), frames: %llu "
+                    "(%llu unknown meter, %llu failed)\n",
+                    (unsigned long long)ingest.rows,
+                    (unsigned long long)ingest.rows_rejected,
+                    (unsigned long long)ingest.frames,
+                    (unsigned long long)flow.unknown_frames,
+                    (unsigned long long)flow.failed_frames);
+        } else if (status == 0) {
+            printf("Rows: %llu (%llu rejected)\n", (unsigned long long)ingest.rows,
+                   (unsigned long long)ingest.rows_rejected);
+            printf("Frames: %llu (%llu unknown meter, %llu failed)\n",
+                   (unsigned long long)ingest.frames,
+                   (unsigned long long)flow.unknown_frames,
+                   (unsigned long long)flow.failed_frames);
+            for (uint32_t m = 0; m < num_meters; m++) {
+                if (flow.frames[m] > 0) {
+                    printf("  Meter %u: %llu frames, mean flow %.6f m³/s\n",
+                           snapshot.meters[m].meter_id, (unsigned long long)flow.frames[m],
+                           flow.flow_sum[m] / (double)flow.frames[m]);
+                }
+            }
+        }
+        csv_ingest_free(&ingest);
+    }
+
+    if (flow.writer && result_writer_close(&writer) != 0) {
+        status = 1;
+    }
+
+    free(flow.frames);
+    free(flow.flow_sum);
+    snapshot_close(&snapshot);
+    return status;
+}
+
+/**
+ * Merge overlapping CSV logs into one indexed capture
+ *
+ * Runs are generated on every online CPU within the default memory
+ * budget; temporary runs go to $TMPDIR or /tmp.
+ */
+static int command_merge(int argc, char **argv)
+{
+    if (argc < 4) {
+        return 2;
+    }
+
+    char *end;
+    unsigned long paths = strtoul(argv[2], &end, 10);
+    if (*end != '\0' || paths == 0 || paths > FLOWMETER_MAX_PATHS) {
+        return 2;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    CaptureMergeOptions options = { (uint32_t)paths, cpus > 0 ? (uint32_t)cpus : 1, 0,
+                                    getenv("TMPDIR") };
+    CaptureMergeStats stats;
+
+    if (capture_merge((const char *const *)&argv[3], (uint32_t)(argc - 3), argv[1],
+                      &options, &stats) != 0) {
+        fprintf(stderr, "Error: Failed to merge into %s\n", argv[1]);
+        return 1;
+    }
+
+    printf("Frames: %llu read, %llu written\n", (unsigned long long)stats.frames_read,
+           (unsigned long long)stats.records_written);
+    printf("  Duplicates: %llu, conflicts: %llu, too many paths: %llu, rejected rows: %llu\n",
+           (unsigned long long)stats.duplicates, (unsigned long long)stats.conflicts,
+           (unsigned long long)stats.frames_dropped, (unsigned long long)stats.rows_rejected);
+    printf("  Runs: %llu, merge passes: %u\n", (unsigned long long)stats.runs,
+           stats.merge_passes);
+    return 0;
+}
+
+/**
+ * Print a summary of a capture, or the frames of one meter
+ */
+static int command_capture_info(int argc, char **argv)
+{
+    if (argc != 2 && argc != 3) {
+        return 2;
+    }
+
+    CaptureFile capture;
+    if (capture_open(argv[1], &capture) != 0) {
+        fprintf(stderr, "Error: %s is not a valid capture\n", argv[1]);
+        return 1;
+    }
+
+    int status = 0;
+    if (argc == 2) {
+        printf("Capture version %u\n", capture.header->version);
+        printf("  Frames: %llu\n", (unsigned long long)capture.header->num_records);
+        printf("  Meters: %u\n", capture.header->num_meters);
+        printf("  Paths per record: %u\n", capture.header->paths_per_record);
+        printf("  Size: %llu bytes\n", (unsigned long long)capture.size);
+    } else {
+        const CaptureIndexEntry *entry =
+            capture_find_meter(&capture, (uint32_t)strtoul(argv[2], NULL, 10));
+        if (!entry) {
+            fprintf(stderr, "Error: Meter %s not found\n", argv[2]);
+            status = 1;
+        } else {
+            printf("Meter %s: %llu frames from %llu to %llu ns\n", argv[2],
+                   (unsigned long long)entry->num_records,
+                   (unsigned long long)entry->first_timestamp_ns,
+                   (unsigned long long)entry->last_timestamp_ns);
+        }
+    }
+
+    capture_close(&capture);
+    return status;
+}
+
+/**
+ * Emulate a multi-path transmitter on a pseudo-terminal
+ *
+ * Prints the slave device path, then sends frames until the frame limit
+ * is reached or, without a limit, until stdin is closed.
+ */
+static int command_serial_emulate(int argc, char **argv)
+{
+    if (argc < 3 || argc > 5) {
+        return 2;
+    }
+
+    uint32_t num_paths = (uint32_t)strtoul(argv[1], NULL, 10);
+    uint32_t baud = (uint32_t)strtoul(argv[2], NULL, 10);
+    uint64_t max_frames = (argc > 3) ? strtoull(argv[3], NULL, 10) : 0;
+    double corrupt_rate = (argc > 4) ? strtod(argv[4], NULL) : 0.0;
+
+    SerialEmulator emulator;
+    if (serial_emulator_start(&emulator, num_paths, baud, max_frames, corrupt_rate) != 0) {
+        fprintf(stderr, "Error: Failed to start the emulator\n");
+        return 1;
+    }
+
+    printf("%s\n", emulator.slave_path);
+    fflush(stdout);
+
+    if (max_frames > 0) {
+        serial_emulator_wait(&emulator);
+    } else {
+        while (getchar() != EOF) {
+        }
+    }
+    serial_emulator_stop(&emulator);
+
+    fprintf(stderr, "Sent %llu frames (%llu bytes, %llu corrupted)\n",
+            (unsigned long long)emulator.frames_sent, (unsigned long long)emulator.bytes_sent,
+            (unsigned long long)emulator.corrupted);
+    return 0;
+}
+
+/**
+ * Compute the flow of one meter from its transmitter's serial line
+ *
+ * Streams every result to stdout, stamped with the receive time, until
+ * the line hangs up.
+ */
+static int command_serial_read(int argc, char **argv)
+{
+    ResultFormat format = RESULT_FORMAT_JSONL;
+
+    if (argc != 6 && argc != 7) {
+        return 2;
+    }
+    if (argc == 7 && result_format_parse(argv[6], &format) != 0) {
+        return 2;
+    }
+
+    FleetSnapshot snapshot;
+    if (snapshot_open(argv[1], &snapshot) != 0) {
+        fprintf(stderr, "Error: %s is not a valid snapshot\n", argv[1]);
+        return 1;
+    }
+
+    uint32_t meter_id = (uint32_t)strtoul(argv[2], NULL, 10);
+    int64_t index = snapshot_find_meter(&snapshot, meter_id);
+    CompiledConfig compiled;
+    if (index < 0 || snapshot_meter_view(&snapshot, (uint32_t)index, NULL, &compiled) != 0) {
+        fprintf(stderr, "Error: Meter %s not found\n", argv[2]);
+        snapshot_close(&snapshot);
+        return 1;
+    }
+
+    SerialPort port;
+    if (serial_port_open(&port, argv[3], (uint32_t)strtoul(argv[4], NULL, 10),
+                         compiled.num_paths, strtod(argv[5], NULL)) != 0) {
+        fprintf(stderr, "Error: Failed to open %s\n", argv[3]);
+        snapshot_close(&snapshot);
+        return 1;
+    }
+
+    ResultWriter writer;
+    if (result_writer_open(&writer, fileno(stdout), format, compiled.num_paths, 0) != 0) {
+        serial_port_close(&port);
+        snapshot_close(&snapshot);
+        return 1;
+    }
+
+    PathMeasurement *frames = malloc(256 * (size_t)compiled.num_paths * sizeof(PathMeasurement));
+    double velocities[FLOWMETER_MAX_PATHS];
+    int status = frames ? 0 : -1;
+
+    while (status == 0) {
+        size_t count;
+        status = serial_port_read(&port, frames, NULL, 256, &count);
+
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        uint64_t timestamp_ns = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+
+        for (size_t f = 0; f < count && status == 0; f++) {
+            const PathMeasurement *measurements = &frames[f * compiled.num_paths];
+            FlowResult result = { velocities, compiled_flow_rate(&compiled, measurements) };
+            calculate_path_velocities_compiled(&compiled, measurements, velocities);
+            if (result_writer_append(&writer, timestamp_ns, meter_id, &result,
+                                     compiled.num_paths) != 0) {
+                status = -1;
+            }
+        }
+    }
+
+    if (status < 0) {
+        fprintf(stderr, "Error: Failed to read %s\n", argv[3]);
+    }
+    if (result_writer_close(&writer) != 0) {
+        status = -1;
+    }
+
+    const SerialDecoder *decoder = &port.decoder;
+    fprintf(stderr, "Frames: %llu, bytes: %llu in %llu reads, %llu CRC errors, "
+            "%llu bytes skipped\n", (unsigned long long)decoder->frames,
+            (unsigned long long)port.bytes, (unsigned long long)port.reads,
+            (unsigned long long)decoder->crc_errors, (unsigned long long)decoder->skipped);
+
+    free(frames);
+    serial_port_close(&port);
+    snapshot_close(&snapshot);
+    return status < 0 ? 1 : 0;
+}
+
+/* Meters and time span found in result files */
+typedef struct {
+    uint32_t *ids;              /* Meter IDs, sorted and unique once scanned */
+    size_t count;
+    size_t capacity;
+    uint64_t first_ns;          /* Earliest timestamp */
+    uint64_t last_ns;           /* Latest timestamp */
+} ResultScan;
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Call visit for every record of binary result files
+ *
+ * @return 0 on success, -1 if a file is unreadable, not a result file
+ *         or visit fails
+ */
+static int read_result_files(char **files, int count,
+                             int (*visit)(void *context, const ResultRecordHeader *record),
+                             void *context)
+{
+    enum { BLOCK_RECORDS = 4096 };
+
+    for (int f = 0; f < count; f++) {
+        ResultFileHeader header;
+        FILE *file = fopen(files[f], "rb");
+        if (!file) {
+            fprintf(stderr, "Error: Cannot open %s\n", files[f]);
+            return -1;
+        }
+        if (fread(&header, sizeof(header), 1, file) != 1 ||
+            memcmp(header.magic, RESULT_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != RESULT_FILE_VERSION ||
+            header.paths_per_record > FLOWMETER_MAX_PATHS) {
+            fprintf(stderr, "Error: %s is not a binary result file\n", files[f]);
+            fclose(file);
+            return -1;
+        }
+
+        size_t record_size = sizeof(ResultRecordHeader) +
+                             header.paths_per_record * sizeof(double);
+        unsigned char *block = malloc(record_size * BLOCK_RECORDS);
+        size_t n;
+        int status = block ? 0 : -1;
+        while (status == 0 && (n = fread(block, record_size, BLOCK_RECORDS, file)) > 0) {
+            for (size_t i = 0; i < n && status == 0; i++) {
+                ResultRecordHeader record;
+                memcpy(&record, block + i * record_size, sizeof(record));
+                status = visit(context, &record);
+            }
+        }
+        free(block);
+        fclose(file);
+        if (status != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * First pass: collect meter IDs and the time span
+ */
+static int scan_result(void *context, const ResultRecordHeader *record)
+{
+    ResultScan *scan = context;
+
+    if (scan->count == 0 || scan->ids[scan->count - 1] != record->meter_id) {
+        if (scan->count == scan->capacity) {
+            size_t capacity = scan->capacity ? scan->capacity * 2 : 1024;
+            uint32_t *ids = realloc(scan->ids, capacity * sizeof(uint32_t));
+            if (!ids) {
+                return -1;
+            }
+            scan->ids = ids;
+            scan->capacity = capacity;
+        }
+        scan->ids[scan->count++] = record->meter_id;
+    }
+    if (record->timestamp_ns < scan->first_ns) {
+        scan->first_ns = record->timestamp_ns;
+    }
+    if (record->timestamp_ns > scan->last_ns) {
+        scan->last_ns = record->timestamp_ns;
+    }
+    return 0;
+}
+
+/**
+ * Second pass: add each result to its bucket; the writer counts and
+ * skips non-finite flows (from fusion, for example)
+ */
+static int add_result(void *context, const ResultRecordHeader *record)
+{
+    RollupWriter *writer = context;
+    int64_t index = rollup_find_meter(writer->meters, writer->header->num_meters,
+                                      record->meter_id);
+    if (index < 0) {
+        return -1;
+    }
+    return rollup_writer_add(writer, (uint32_t)index, record->timestamp_ns,
+                             record->volumetric_flow) < 0 ? -1 : 0;
+}
+
+/**
+ * Assign groups from "meter_id group" lines; meters not listed stay in
+ * group 0
+ */
+static int read_groups(const char *filename, RollupMeter *meters, uint32_t num_meters)
+{
+    FILE *file = fopen(filename, "r");
+    char line[256];
+    int line_number = 0;
+
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open %s\n", filename);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        unsigned long meter_id, group;
+        char extra;
+        line_number++;
+        if (line[strspn(line, " \t\r\n")] == '\0' || line[strspn(line, " \t")] == '#') {
+            continue;
+        }
+        int fields = sscanf(line, "%lu %lu %c", &meter_id, &group, &extra);
+        if (fields != 2 && !(fields == 3 && extra == '#')) {
+            fprintf(stderr, "Error: %s:%d: expected \"meter_id group\"\n", filename,
+                    line_number);
+            fclose(file);
+            return -1;
+        }
+        int64_t index = rollup_find_meter(meters, num_meters, (uint32_t)meter_id);
+        if (index >= 0) {
+            meters[index].group = (uint32_t)group;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+/**
+ * Build a rollup store from binary result files
+ *
+ * Bucket widths are given in seconds, finest first, for example
+ * 60,3600,86400. The grid starts at a whole coarsest bucket.
+ */
+static int command_rollup(int argc, char **argv)
+{
+    uint64_t widths[ROLLUP_MAX_LEVELS];
+    uint32_t num_levels = 0;
+
+    if (argc < 5) {
+        return 2;
+    }
+    for (char *text = argv[2]; ; text++) {
+        char *end;
+        unsigned long long seconds = strtoull(text, &end, 10);
+        if (end == text || seconds == 0 || num_levels == ROLLUP_MAX_LEVELS ||
+            (*end != ',' && *end != '\0')) {
+            return 2;
+        }
+        widths[num_levels++] = seconds * 1000000000ull;
+        text = end;
+        if (*end == '\0') {
+            break;
+        }
+    }
+
+    ResultScan scan = { NULL, 0, 0, UINT64_MAX, 0 };
+    if (read_result_files(&argv[4], argc - 4, scan_result, &scan) != 0) {
+        free(scan.ids);
+        return 1;
+    }
+    if (scan.count == 0) {
+        fprintf(stderr, "Error: No results\n");
+        free(scan.ids);
+        return 1;
+    }
+
+    qsort(scan.ids, scan.count, sizeof(uint32_t), compare_u32);
+    size_t unique = 0;
+    for (size_t i = 0; i < scan.count; i++) {
+        if (unique == 0 || scan.ids[i] != scan.ids[unique - 1]) {
+            scan.ids[unique++] = scan.ids[i];
+        }
+    }
+    RollupMeter *meters = calloc(unique, sizeof(RollupMeter));
+    if (!meters) {
+        free(scan.ids);
+        return 1;
+    }
+    for (size_t i = 0; i < unique; i++) {
+        meters[i].meter_id = scan.ids[i];
+    }
+    free(scan.ids);
+    if (strcmp(argv[3], "-") != 0 && read_groups(argv[3], meters, (uint32_t)unique) != 0) {
+        free(meters);
+        return 1;
+    }
+
+    uint64_t coarsest = widths[num_levels - 1];
+    uint64_t start_ns = scan.first_ns / coarsest * coarsest;
+    RollupWriter writer;
+    if (rollup_writer_open(&writer, argv[1], meters, (uint32_t)unique, start_ns,
+                           scan.last_ns + 1, widths, num_levels) != 0) {
+        fprintf(stderr, "Error: Cannot create %s (widths must be multiples)\n", argv[1]);
+        free(meters);
+        return 1;
+    }
+    free(meters);
+
+    int status = read_result_files(&argv[4], argc - 4, add_result, &writer);
+    uint64_t rejected = writer.rejected;
+    if (rollup_writer_close(&writer) != 0 || status != 0) {
+        fprintf(stderr, "Error: Failed to write %s\n", argv[1]);
+        return 1;
+    }
+
+    RollupFile store;
+    if (rollup_open(argv[1], &store) != 0) {
+        fprintf(stderr, "Error: %s is not a valid store\n", argv[1]);
+        return 1;
+    }
+    printf("Store: %u meters in %u groups, %llu bytes\n", store.header->num_meters,
+           store.header->num_groups, (unsigned long long)store.size);
+    printf("  Rejected: %llu results without a finite flow\n", (unsigned long long)rejected);
+    for (uint32_t l = 0; l < store.header->num_levels; l++) {
+        printf("  Level %u: %llu s buckets, %llu per meter\n", l,
+               (unsigned long long)(store.header->width_ns[l] / 1000000000ull),
+               (unsigned long long)store.header->buckets[l]);
+    }
+    rollup_close(&store);
+    return 0;
+}
+
+/**
+ * Serve a rollup store over HTTP until stdin is closed
+ */
+static int command_serve(int argc, char **argv)
+{
+    if (argc < 3 || argc > 5) {
+        return 2;
+    }
+
+    char *end;
+    unsigned long port = strtoul(argv[2], &end, 10);
+    uint32_t threads = (argc > 3) ? (uint32_t)strtoul(argv[3], NULL, 10) : 4;
+    const char *address = (argc > 4) ? argv[4] : NULL;
+    if (*end != '\0' || port > 65535 || threads == 0) {
+        return 2;
+    }
+
+    RollupFile store;
+    if (rollup_open(argv[1], &store) != 0) {
+        fprintf(stderr, "Error: %s is not a valid store\n", argv[1]);
+        return 1;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    QueryServer server;
+    if (query_server_start(&server, &store, address, (uint16_t)port, threads,
+                           cpus > 1 ? (uint32_t)(cpus - 1) : 0) != 0) {
+        fprintf(stderr, "Error: Cannot listen on port %lu\n", port);
+        rollup_close(&store);
+        return 1;
+    }
+
+    printf("Serving %u meters on %s:%u\n", store.header->num_meters,
+           address ? address : "127.0.0.1", server.port);
+    fflush(stdout);
+    while (getchar() != EOF) {
+    }
+
+    query_server_stop(&server);
+    fprintf(stderr, "Answered %llu requests (%llu errors)\n",
+            (unsigned long long)server.requests, (unsigned long long)server.errors);
+    rollup_close(&store);
+    return 0;
+}
+
+static const ToolCommand commands[] = {
+    { "snapshot", "<fleet.txt> <out.snap>", command_snapshot },
+    { "snapshot-info", "<file.snap> [meter_id]", command_snapshot_info },
+    { "pack-info", "<fleet.txt>", command_pack_info },
+    { "csv", "<fleet.snap> <log.csv> [jsonl|csv|binary]", command_csv },
+    { "merge", "<out.cap> <paths> <log.csv>...", command_merge },
+    { "capture-info", "<file.cap> [meter_id]", command_capture_info },
+    { "serial-emulate", "<paths> <baud> [frames] [corrupt_rate]", command_serial_emulate },
+    { "serial-read", "<fleet.snap> <meter_id> <device> <baud> <tick> [jsonl|csv|binary]",
+      command_serial_read },
+    { "rollup", "<out.roll> <widths_s> <groups.txt|-> <results.bin>...", command_rollup },
+    { "serve", "<store.roll> <port> [threads] [address]", command_serve },
+};
+
+static void print_usage(void)
+{
+    fprintf(stderr, "Usage: flowtool <command> [arguments...]\n\nCommands:\n");
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        fprintf(stderr, "  %-16s %s\n", commands[i].name, commands[i].usage);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        print_usage();
+        return 2;
+    }
+
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        if (strcmp(argv[1], commands[i].name) == 0) {
+            int status = commands[i].run(argc - 1, argv + 1);
+            if (status == 2) {
+                fprintf(stderr, "Usage: flowtool %s %s\n",
+                        commands[i].name, commands[i].usage);
+            }
+            return status;
+        }
+    }
+
+    print_usage();
+    return 2;
+}
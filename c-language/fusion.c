@@ -0,0 +1,387 @@
+#include "fusion.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Per-meter double arrays carved from the storage block */
+#define FUSION_METER_ARRAYS 8
+
+/**
+ * Create an engine for a fleet of meter pairs
+ */
+int fusion_engine_init(FusionEngine *engine, uint32_t num_pairs, const uint32_t *num_paths,
+                       const FusionLimits *limits)
+{
+    if (!engine || num_pairs == 0 || !num_paths || !limits || !(limits->sigmas > 0.0) ||
+        !(limits->tolerance >= 0.0) || !(limits->noise_floor > 0.0) ||
+        !(limits->profile_limit > 0.0) || !(limits->min_velocity >= 0.0) ||
+        !(limits->half_life > 0.0) || !(limits->max_age > 0.0) || limits->persistence == 0) {
+        return -1;
+    }
+
+    size_t num_meters = 2 * (size_t)num_pairs;
+    uint32_t max_paths = 1;
+    for (size_t m = 0; m < num_meters; m++) {
+        if (num_paths[m] > FLOWMETER_MAX_PATHS) {
+            return -1;
+        }
+        max_paths = num_paths[m] > max_paths ? num_paths[m] : max_paths;
+    }
+
+    memset(engine, 0, sizeof(*engine));
+    engine->num_pairs = num_pairs;
+    engine->max_paths = max_paths;
+    engine->limits = *limits;
+    engine->decay = pow(0.5, 1.0 / limits->half_life);
+    engine->bias_scale2 = (1.0 - engine->decay) / (1.0 + engine->decay);
+    engine->num_paths = malloc(num_meters * sizeof(uint32_t));
+    engine->samples = calloc(num_meters, sizeof(uint64_t));
+    engine->has_profile = calloc(num_meters, sizeof(uint8_t));
+    engine->storage = calloc(num_meters * (FUSION_METER_ARRAYS + max_paths) + 2 * (size_t)num_pairs,
+                             sizeof(double));
+    if (!engine->num_paths || !engine->samples || !engine->has_profile || !engine->storage) {
+        fusion_engine_free(engine);
+        return -1;
+    }
+
+    memcpy(engine->num_paths, num_paths, num_meters * sizeof(uint32_t));
+    engine->time0 = engine->storage;
+    engine->flow0 = engine->time0 + num_meters;
+    engine->time1 = engine->flow0 + num_meters;
+    engine->flow1 = engine->time1 + num_meters;
+    engine->noise = engine->flow1 + num_meters;
+    engine->score = engine->noise + num_meters;
+    engine->aligned = engine->score + num_meters;
+    engine->variance = engine->aligned + num_meters;
+    engine->profile = engine->variance + num_meters;
+    engine->bias = engine->profile + num_meters * max_paths;
+    engine->run = engine->bias + num_pairs;
+
+    /* No sample yet: every stream starts stale */
+    for (size_t m = 0; m < num_meters; m++) {
+        engine->time0[m] = -INFINITY;
+        engine->time1[m] = -INFINITY;
+    }
+
+    return 0;
+}
+
+/**
+ * Record a result from one meter
+ *
+ * The profile is scored against the learned one before learning from
+ * it, and only samples within the limit are learned, so a failed path
+ * is not absorbed.
+ */
+int fusion_push(FusionEngine *engine, uint32_t pair, uint32_t side, uint64_t timestamp_ns,
+                const FlowResult *result)
+{
+    if (!engine || !engine->storage || pair >= engine->num_pairs || side > FUSION_SIDE_B ||
+        !result) {
+        return -1;
+    }
+
+    if (!engine->has_epoch) {
+        engine->epoch_ns = timestamp_ns;
+        engine->has_epoch = 1;
+    }
+
+    size_t m = (size_t)side * engine->num_pairs + pair;
+    double decay = engine->decay;
+    double time = (double)(int64_t)(timestamp_ns - engine->epoch_ns) * 1e-9;
+    double flow = result->volumetric_flow;
+
+    if (engine->samples[m] == 0) {
+        engine->time0[m] = time;
+        engine->flow0[m] = flow;
+    } else {
+        double step = flow - engine->flow1[m];
+        double square = 0.5 * step * step;
+        engine->noise[m] = (engine->samples[m] == 1) ? square :
+                           decay * engine->noise[m] + (1.0 - decay) * square;
+        engine->time0[m] = engine->time1[m];
+        engine->flow0[m] = engine->flow1[m];
+    }
+    engine->time1[m] = time;
+    engine->flow1[m] = flow;
+    engine->samples[m]++;
+
+    uint32_t num_paths = engine->num_paths[m];
+    if (!result->path_velocities || num_paths == 0) {
+        return 0;
+    }
+
+    double mean = 0.0;
+    for (uint32_t i = 0; i < num_paths; i++) {
+        mean += result->path_velocities[i];
+    }
+    mean /= (double)num_paths;
+    if (!(fabs(mean) > engine->limits.min_velocity)) {
+        return 0;
+    }
+
+    double *profile = &engine->profile[m * engine->max_paths];
+    double shape[FLOWMETER_MAX_PATHS];
+    double deviation = 0.0;
+    for (uint32_t i = 0; i < num_paths; i++) {
+        shape[i] = result->path_velocities[i] / mean;
+        double d = fabs(shape[i] - profile[i]);
+        deviation = d > deviation ? d : deviation;
+    }
+
+    if (!engine->has_profile[m]) {
+        memcpy(profile, shape, num_paths * sizeof(double));
+        engine->has_profile[m] = 1;
+        deviation = 0.0;
+    } else if (deviation <= engine->limits.profile_limit) {
+        for (uint32_t i = 0; i < num_paths; i++) {
+            profile[i] = decay * profile[i] + (1.0 - decay) * shape[i];
+        }
+    }
+    engine->score[m] = deviation;
+    return 0;
+}
+
+/**
+ * Decide and fuse one pair (scalar path)
+ */
+static void fuse_pair(FusionEngine *engine, size_t p, double time, double *flows,
+                      double *sigmas, uint32_t *status)
+{
+    const FusionLimits *limits = &engine->limits;
+    size_t b = engine->num_pairs + p;
+    double decay = engine->decay;
+    double qa = engine->aligned[p];
+    double qb = engine->aligned[b];
+    double va = engine->variance[p];
+    double vb = engine->variance[b];
+    int stale_a = !(time - engine->time1[p] <= limits->max_age);
+    int stale_b = !(time - engine->time1[b] <= limits->max_age);
+    double noise_limit = limits->sigmas * limits->sigmas * (va + vb);  /* Squared */
+    double allowed = limits->tolerance * 0.5 * (fabs(qa) + fabs(qb));
+    int disagree = 0;
+
+    if (!stale_a && !stale_b) {
+        double difference = qa - qb;
+        double bias = engine->bias[p];
+        bias = (engine->run[p] == 0.0 && bias == 0.0) ? difference :
+               decay * bias + (1.0 - decay) * difference;
+        engine->bias[p] = bias;
+        double step_excess = fabs(difference) - allowed;
+        double bias_excess = fabs(bias) - allowed;
+        disagree = (step_excess > 0.0 && step_excess * step_excess > noise_limit) ||
+                   (bias_excess > 0.0 &&
+                    bias_excess * bias_excess > noise_limit * engine->bias_scale2);
+    }
+
+    engine->run[p] = disagree ? engine->run[p] + 1.0 : 0.0;
+    int persistent = engine->run[p] >= (double)limits->persistence;
+    int suspect_a = engine->score[p] > limits->profile_limit;
+    int suspect_b = engine->score[b] > limits->profile_limit;
+    int fault_a = persistent && suspect_a && !suspect_b;
+    int fault_b = persistent && suspect_b && !suspect_a;
+    int use_a = !stale_a && !fault_a;
+    int use_b = !stale_b && !fault_b;
+
+    /* Inverse-variance weights scaled by va * vb: one division per pair */
+    double ka = use_a ? (use_b ? vb : 1.0) : 0.0;
+    double kb = use_b ? (use_a ? va : 1.0) : 0.0;
+    double inverse = (use_a || use_b) ? 1.0 / (ka + kb) : 0.0;
+    flows[p] = (use_a || use_b) ? (ka * qa + kb * qb) * inverse : NAN;
+    if (sigmas) {
+        double fused_variance = (ka * va + kb * vb) * inverse * ((use_a && use_b) ? 0.5 : 1.0);
+        sigmas[p] = (use_a || use_b) ? sqrt(fused_variance) : INFINITY;
+    }
+    if (status) {
+        status[p] = (stale_a ? FUSION_A_STALE : 0u) | (stale_b ? FUSION_B_STALE : 0u) |
+                    (disagree ? FUSION_DISAGREE : 0u) | (fault_a ? FUSION_A_FAULT : 0u) |
+                    (fault_b ? FUSION_B_FAULT : 0u) |
+                    ((persistent && !fault_a && !fault_b) ? FUSION_UNRESOLVED : 0u);
+    }
+}
+
+#if defined(__SSE2__)
+/* Lanes of a as a where mask is set, b elsewhere */
+static inline __m128d select_pd(__m128d mask, __m128d a, __m128d b)
+{
+    return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+/* Flag in the lanes where mask is set, as 64-bit integers */
+static inline __m128i flag_lanes(__m128d mask, uint32_t flag)
+{
+    return _mm_and_si128(_mm_castpd_si128(mask), _mm_set1_epi64x(flag));
+}
+
+/**
+ * Decide and fuse pairs p and p + 1, the same computation as
+ * fuse_pair() on masks
+ */
+static void fuse_pairs_sse2(FusionEngine *engine, size_t p, double time, double *flows,
+                            double *sigmas, uint32_t *status)
+{
+    const FusionLimits *limits = &engine->limits;
+    size_t b = engine->num_pairs + p;
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d magnitude = _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffLL));
+    const __m128d decay = _mm_set1_pd(engine->decay);
+
+    __m128d qa = _mm_loadu_pd(&engine->aligned[p]);
+    __m128d qb = _mm_loadu_pd(&engine->aligned[b]);
+    __m128d va = _mm_loadu_pd(&engine->variance[p]);
+    __m128d vb = _mm_loadu_pd(&engine->variance[b]);
+    __m128d now = _mm_set1_pd(time);
+    __m128d max_age = _mm_set1_pd(limits->max_age);
+    __m128d stale_a = _mm_cmpnle_pd(_mm_sub_pd(now, _mm_loadu_pd(&engine->time1[p])), max_age);
+    __m128d stale_b = _mm_cmpnle_pd(_mm_sub_pd(now, _mm_loadu_pd(&engine->time1[b])), max_age);
+    __m128d all = _mm_cmpeq_pd(zero, zero);
+    __m128d fresh = _mm_andnot_pd(_mm_or_pd(stale_a, stale_b), all);
+    __m128d noise_limit = _mm_mul_pd(_mm_set1_pd(limits->sigmas * limits->sigmas),
+                                _mm_add_pd(va, vb));
+    __m128d allowed = _mm_mul_pd(_mm_set1_pd(0.5 * limits->tolerance),
+                                 _mm_add_pd(_mm_and_pd(qa, magnitude), _mm_and_pd(qb, magnitude)));
+
+    __m128d difference = _mm_sub_pd(qa, qb);
+    __m128d bias = _mm_loadu_pd(&engine->bias[p]);
+    __m128d run = _mm_loadu_pd(&engine->run[p]);
+    __m128d first = _mm_and_pd(_mm_cmpeq_pd(run, zero), _mm_cmpeq_pd(bias, zero));
+    __m128d averaged = _mm_add_pd(_mm_mul_pd(decay, bias),
+                                  _mm_mul_pd(_mm_sub_pd(one, decay), difference));
+    bias = select_pd(fresh, select_pd(first, difference, averaged), bias);
+    _mm_storeu_pd(&engine->bias[p], bias);
+
+    __m128d step_excess = _mm_sub_pd(_mm_and_pd(difference, magnitude), allowed);
+    __m128d bias_excess = _mm_sub_pd(_mm_and_pd(bias, magnitude), allowed);
+    __m128d step_over = _mm_and_pd(_mm_cmpgt_pd(step_excess, zero),
+                                   _mm_cmpgt_pd(_mm_mul_pd(step_excess, step_excess), noise_limit));
+    __m128d bias_limit = _mm_mul_pd(noise_limit, _mm_set1_pd(engine->bias_scale2));
+    __m128d bias_over = _mm_and_pd(_mm_cmpgt_pd(bias_excess, zero),
+                                   _mm_cmpgt_pd(_mm_mul_pd(bias_excess, bias_excess), bias_limit));
+    __m128d disagree = _mm_and_pd(fresh, _mm_or_pd(step_over, bias_over));
+    run = _mm_and_pd(disagree, _mm_add_pd(run, one));
+    _mm_storeu_pd(&engine->run[p], run);
+
+    __m128d persistent = _mm_cmpge_pd(run, _mm_set1_pd((double)limits->persistence));
+    __m128d profile_limit = _mm_set1_pd(limits->profile_limit);
+    __m128d suspect_a = _mm_cmpgt_pd(_mm_loadu_pd(&engine->score[p]), profile_limit);
+    __m128d suspect_b = _mm_cmpgt_pd(_mm_loadu_pd(&engine->score[b]), profile_limit);
+    __m128d fault_a = _mm_and_pd(persistent, _mm_andnot_pd(suspect_b, suspect_a));
+    __m128d fault_b = _mm_and_pd(persistent, _mm_andnot_pd(suspect_a, suspect_b));
+    __m128d use_a = _mm_andnot_pd(_mm_or_pd(stale_a, fault_a), all);
+    __m128d use_b = _mm_andnot_pd(_mm_or_pd(stale_b, fault_b), all);
+    __m128d both = _mm_and_pd(use_a, use_b);
+    __m128d usable = _mm_or_pd(use_a, use_b);
+
+    __m128d ka = _mm_and_pd(use_a, select_pd(use_b, vb, one));
+    __m128d kb = _mm_and_pd(use_b, select_pd(use_a, va, one));
+    __m128d inverse = _mm_div_pd(one, select_pd(usable, _mm_add_pd(ka, kb), one));
+    __m128d fused = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(ka, qa), _mm_mul_pd(kb, qb)), inverse);
+    _mm_storeu_pd(&flows[p], select_pd(usable, fused, _mm_set1_pd(NAN)));
+    if (sigmas) {
+        __m128d fused_variance = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(ka, va), _mm_mul_pd(kb, vb)),
+                                            inverse);
+        fused_variance = _mm_mul_pd(fused_variance, select_pd(both, _mm_set1_pd(0.5), one));
+        _mm_storeu_pd(&sigmas[p], select_pd(usable, _mm_sqrt_pd(fused_variance),
+                                            _mm_set1_pd(INFINITY)));
+    }
+    if (status) {
+        __m128d unresolved = _mm_andnot_pd(_mm_or_pd(fault_a, fault_b), persistent);
+        __m128i flags = _mm_or_si128(
+            _mm_or_si128(flag_lanes(stale_a, FUSION_A_STALE), flag_lanes(stale_b, FUSION_B_STALE)),
+            _mm_or_si128(_mm_or_si128(flag_lanes(disagree, FUSION_DISAGREE),
+                                      flag_lanes(fault_a, FUSION_A_FAULT)),
+                         _mm_or_si128(flag_lanes(fault_b, FUSION_B_FAULT),
+                                      flag_lanes(unresolved, FUSION_UNRESOLVED))));
+        status[p] = (uint32_t)_mm_cvtsi128_si32(flags);
+        status[p + 1] = (uint32_t)_mm_cvtsi128_si32(_mm_shuffle_epi32(flags, 2));
+    }
+}
+#endif
+
+/**
+ * Fuse every pair at one tick time
+ *
+ * The first pass aligns every stream and applies the noise floor, the
+ * second updates the biases and makes the per-pair decisions. Both run
+ * on contiguous arrays two lanes at a time with SSE2, with selects on
+ * masks in place of branches. The compiler keeps the scalar selects as
+ * branches, since comparisons may trap.
+ */
+int fusion_tick(FusionEngine *engine, uint64_t tick_ns, double *flows, double *sigmas,
+                uint32_t *status)
+{
+    if (!engine || !engine->storage || !flows) {
+        return -1;
+    }
+
+    size_t num_pairs = engine->num_pairs;
+    size_t num_meters = 2 * num_pairs;
+    double time = (double)(int64_t)(tick_ns - engine->epoch_ns) * 1e-9;
+    double floor = engine->limits.noise_floor * engine->limits.noise_floor;
+    const double *time0 = engine->time0;
+    const double *time1 = engine->time1;
+    const double *flow0 = engine->flow0;
+    const double *flow1 = engine->flow1;
+    const double *noise = engine->noise;
+    double *aligned = engine->aligned;
+    double *variance = engine->variance;
+
+    size_t m = 0;
+#if defined(__SSE2__)
+    const __m128d now = _mm_set1_pd(time);
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d lowest = _mm_set1_pd(floor);
+    for (; m + 2 <= num_meters; m += 2) {
+        __m128d start = _mm_loadu_pd(&time0[m]);
+        __m128d span = _mm_sub_pd(_mm_loadu_pd(&time1[m]), start);
+        __m128d valid = _mm_cmpgt_pd(span, zero);
+        __m128d u = _mm_div_pd(_mm_sub_pd(now, start), select_pd(valid, span, one));
+        u = _mm_min_pd(_mm_max_pd(select_pd(valid, u, one), zero), one);
+        __m128d q0 = _mm_loadu_pd(&flow0[m]);
+        __m128d q1 = _mm_loadu_pd(&flow1[m]);
+        _mm_storeu_pd(&aligned[m], _mm_add_pd(q0, _mm_mul_pd(u, _mm_sub_pd(q1, q0))));
+        _mm_storeu_pd(&variance[m], _mm_max_pd(_mm_loadu_pd(&noise[m]), lowest));
+    }
+#endif
+    for (; m < num_meters; m++) {
+        double span = time1[m] - time0[m];
+        double u = (span > 0.0) ? (time - time0[m]) / span : 1.0;
+        u = (u < 0.0) ? 0.0 : (u > 1.0 ? 1.0 : u);
+        aligned[m] = flow0[m] + u * (flow1[m] - flow0[m]);
+        variance[m] = (noise[m] > floor) ? noise[m] : floor;
+    }
+
+    size_t p = 0;
+#if defined(__SSE2__)
+    for (; p + 2 <= num_pairs; p += 2) {
+        fuse_pairs_sse2(engine, p, time, flows, sigmas, status);
+    }
+#endif
+    for (; p < num_pairs; p++) {
+        fuse_pair(engine, p, time, flows, sigmas, status);
+    }
+
+    return 0;
+}
+
+/**
+ * Free memory owned by an engine
+ */
+void fusion_engine_free(FusionEngine *engine)
+{
+    if (!engine) {
+        return;
+    }
+
+    free(engine->num_paths);
+    free(engine->samples);
+    free(engine->has_profile);
+    free(engine->storage);
+    memset(engine, 0, sizeof(*engine));
+}
@@ -0,0 +1,149 @@
+#ifndef FUSION_H
+#define FUSION_H
+
+#include "flowmeter.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Sides of a pair */
+#define FUSION_SIDE_A 0u
+#define FUSION_SIDE_B 1u
+
+/* Status flags of a fused flow */
+#define FUSION_A_STALE    0x01u  /* Meter A has no sample within max_age */
+#define FUSION_B_STALE    0x02u  /* Meter B has no sample within max_age */
+#define FUSION_DISAGREE   0x04u  /* Flows differ beyond the combined limit */
+#define FUSION_A_FAULT    0x08u  /* Persistent disagreement blamed on meter A */
+#define FUSION_B_FAULT    0x10u  /* Persistent disagreement blamed on meter B */
+#define FUSION_UNRESOLVED 0x20u  /* Persistent disagreement, neither meter blamed */
+
+/*
+ * Fusion of redundant meters installed in series
+ *
+ * Both meters of a pair measure the same flow. Each meter pushes its
+ * FlowResults as they arrive. On every tick, the engine aligns each
+ * stream to the tick time. It interpolates linearly between the
+ * stream's two latest samples, and holds the latest sample after them.
+ * Running ticks one reporting interval behind real time therefore gives
+ * pure interpolation.
+ *
+ * Each meter's noise variance is tracked as half the mean squared
+ * increment between its samples, with a floor of noise_floor². The
+ * healthy streams of a pair are fused by inverse-variance weighting:
+ *
+ *   Q = (Q_A / σ_A² + Q_B / σ_B²) / (1 / σ_A² + 1 / σ_B²)
+ *   σ² = 1 / (1 / σ_A² + 1 / σ_B²)
+ *
+ * The streams disagree when
+ *
+ *   |Q_A - Q_B| > sigmas * sqrt(σ_A² + σ_B²) + tolerance * (|Q_A| + |Q_B|) / 2
+ *
+ * or when the running mean of Q_A - Q_B (the pair's bias, averaged with
+ * the same half-life) exceeds the same limit with sqrt(σ_A² + σ_B²)
+ * scaled down to the standard deviation of that mean. The first test
+ * catches large steps at once, the second a drift well inside the
+ * noise of single samples.
+ *
+ * The path velocities are the cross-check that isolates the fault. Each
+ * meter learns its normalized velocity profile v_i / mean(v), and scores
+ * each sample by the largest deviation from it. A failing transducer or
+ * a fouled path moves the profile of its own meter only. After
+ * persistence disagreeing ticks in a row, the engine acts on the scores.
+ * If exactly one meter's score is over profile_limit, that meter is
+ * blamed and the pair reports the other meter alone. Otherwise the pair
+ * stays fused and is flagged unresolved. A stale stream is dropped
+ * without a check.
+ *
+ * State is kept as arrays over pairs, so that the tick runs as one
+ * vectorizable pass over the fleet. Meter A of pair p is meter p and
+ * meter B is meter num_pairs + p.
+ */
+typedef struct {
+    double sigmas;            /* Combined standard deviations that count as disagreement */
+    double tolerance;         /* Relative flow difference always accepted */
+    double noise_floor;       /* Lowest flow standard deviation in m³/s */
+    double profile_limit;     /* Profile deviation that marks a meter suspect */
+    double min_velocity;      /* Mean path velocity below which profiles are not scored */
+    double half_life;         /* Noise and profile averaging half-life in samples */
+    double max_age;           /* Seconds without a sample after which a stream is stale */
+    uint32_t persistence;     /* Disagreeing ticks in a row before isolating a fault */
+} FusionLimits;
+
+typedef struct {
+    uint32_t num_pairs;       /* Meter pairs */
+    uint32_t max_paths;       /* Profile stride per meter */
+    FusionLimits limits;      /* Detection limits */
+    double decay;             /* Weight kept per sample by the running averages */
+    double bias_scale2;       /* Variance of the running bias per unit noise variance */
+    uint64_t epoch_ns;        /* Time origin of the stored sample times */
+    int has_epoch;            /* Set by the first push */
+
+    /* Per meter, 2 * num_pairs entries */
+    uint32_t *num_paths;      /* Paths of each meter */
+    uint64_t *samples;        /* Samples pushed */
+    double *time0;            /* Previous sample time in s since the epoch */
+    double *flow0;            /* Previous sample flow in m³/s */
+    double *time1;            /* Latest sample time */
+    double *flow1;            /* Latest sample flow */
+    double *noise;            /* Running half mean squared increment in (m³/s)² */
+    double *score;            /* Latest profile deviation */
+    double *profile;          /* Learned profile, max_paths per meter */
+    uint8_t *has_profile;     /* Profile learned */
+    double *aligned;          /* Scratch: flow aligned to the latest tick */
+    double *variance;         /* Scratch: noise variance with the floor applied */
+
+    /* Per pair */
+    double *bias;             /* Running mean of Q_A - Q_B in m³/s */
+    double *run;              /* Disagreeing ticks in a row (a double to share the lanes) */
+    double *storage;          /* Owned double storage */
+} FusionEngine;
+
+/**
+ * Create an engine for a fleet of meter pairs
+ *
+ * @param engine Output structure, release with fusion_engine_free()
+ * @param num_pairs Number of pairs
+ * @param num_paths Paths of each meter (2 * num_pairs entries, meters A
+ *                  first), each at most FLOWMETER_MAX_PATHS
+ * @param limits Detection limits
+ * @return 0 on success, -1 on error
+ */
+int fusion_engine_init(FusionEngine *engine, uint32_t num_pairs, const uint32_t *num_paths,
+                       const FusionLimits *limits);
+
+/**
+ * Record a result from one meter
+ *
+ * @param engine Fusion engine
+ * @param pair Pair index
+ * @param side FUSION_SIDE_A or FUSION_SIDE_B
+ * @param timestamp_ns Result time in nanoseconds, increasing per meter
+ * @param result Flow and path velocities (path_velocities may be NULL,
+ *               which leaves the profile score unchanged)
+ * @return 0 on success, -1 on error
+ */
+int fusion_push(FusionEngine *engine, uint32_t pair, uint32_t side, uint64_t timestamp_ns,
+                const FlowResult *result);
+
+/**
+ * Fuse every pair at one tick time
+ *
+ * @param engine Fusion engine
+ * @param tick_ns Tick time in nanoseconds
+ * @param flows Output fused flow per pair in m³/s (NAN when neither
+ *              meter can be used)
+ * @param sigmas Output standard deviation per pair in m³/s, or NULL
+ * @param status Output FUSION_* flags per pair, or NULL
+ * @return 0 on success, -1 on error
+ */
+int fusion_tick(FusionEngine *engine, uint64_t tick_ns, double *flows, double *sigmas,
+                uint32_t *status);
+
+/**
+ * Free memory owned by an engine
+ *
+ * @param engine Fusion engine
+ */
+void fusion_engine_free(FusionEngine *engine);
+
+#endif /* FUSION_H */
@@ -0,0 +1,446 @@
+#define _DEFAULT_SOURCE
+
+#include "jit.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__unix__) && !defined(FLOWMETER_NO_JIT)
+#define JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Portable kernel body; inlined with a constant path count into the
+ * specialized kernels so the path loop is unrolled
+ */
+static inline void portable_body(const FlowKernel *kernel, const PathMeasurement *frames,
+                                 size_t num_frames, double *flows,
+                                 const uint32_t num_paths)
+{
+    const double *coeffs = kernel->coeffs;
+    const double offset = kernel->offset;
+
+    for (size_t f = 0; f < num_frames; f++) {
+        const PathMeasurement *frame = &frames[f * num_paths];
+        double flow = 0.0;
+
+        for (uint32_t i = 0; i < num_paths; i++) {
+            flow += coeffs[i] * path_transit_term(&frame[i]);
+        }
+        flows[f] = flow + offset;
+    }
+}
+
+static void portable_kernel(const FlowKernel *kernel, const PathMeasurement *frames,
+                            size_t num_frames, double *flows)
+{
+    portable_body(kernel, frames, num_frames, flows, kernel->num_paths);
+}
+
+#define SPECIALIZED_KERNEL(n)                                                  \
+    static void specialized_kernel_##n(const FlowKernel *kernel,               \
+                                       const PathMeasurement *frames,          \
+                                       size_t num_frames, double *flows)       \
+    {                                                                          \
+        portable_body(kernel, frames, num_frames, flows, n##u);                \
+    }
+
+SPECIALIZED_KERNEL(1) SPECIALIZED_KERNEL(2) SPECIALIZED_KERNEL(3) SPECIALIZED_KERNEL(4)
+SPECIALIZED_KERNEL(5) SPECIALIZED_KERNEL(6) SPECIALIZED_KERNEL(7) SPECIALIZED_KERNEL(8)
+
+static const FlowKernelFunction specialized_kernels[9] = {
+    portable_kernel,
+    specialized_kernel_1, specialized_kernel_2, specialized_kernel_3,
+    specialized_kernel_4, specialized_kernel_5, specialized_kernel_6,
+    specialized_kernel_7, specialized_kernel_8
+};
+
+#if defined(JIT_X86_64)
+
+/* Growable byte buffer for instruction encoding */
+typedef struct {
+    uint8_t *bytes;
+    size_t size;
+    size_t capacity;
+} CodeBuffer;
+
+static void emit(CodeBuffer *buffer, const uint8_t *bytes, size_t count)
+{
+    if (buffer->size + count <= buffer->capacity) {
+        memcpy(buffer->bytes + buffer->size, bytes, count);
+    }
+    buffer->size += count;
+}
+
+static void emit_u32(CodeBuffer *buffer, uint32_t value)
+{
+    uint8_t bytes[4] = {
+        (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)
+    };
+    emit(buffer, bytes, 4);
+}
+
+/* Scalar double op with register operands: prefix 0F opcode /r */
+static void emit_sse_rr(CodeBuffer *buffer, uint8_t prefix, uint8_t opcode,
+                        int dst, int src)
+{
+    uint8_t bytes[4] = { prefix, 0x0F, opcode, (uint8_t)(0xC0 | (dst << 3) | src) };
+    emit(buffer, bytes, 4);
+}
+
+/* movsd xmm, [rsi + disp32] */
+static void emit_load_rsi(CodeBuffer *buffer, int dst, uint32_t displacement)
+{
+    uint8_t bytes[4] = { 0xF2, 0x0F, 0x10, (uint8_t)(0x80 | (dst << 3) | 6) };
+    emit(buffer, bytes, 4);
+    emit_u32(buffer, displacement);
+}
+
+/* mov rax, imm64; movq xmm, rax */
+static void emit_load_constant(CodeBuffer *buffer, int dst, double value)
+{
+    uint64_t bits;
+    uint8_t mov_rax[2] = { 0x48, 0xB8 };
+    uint8_t movq[5] = { 0x66, 0x48, 0x0F, 0x6E, (uint8_t)(0xC0 | (dst << 3)) };
+
+    memcpy(&bits, &value, sizeof(bits));
+    emit(buffer, mov_rax, 2);
+    emit_u32(buffer, (uint32_t)bits);
+    emit_u32(buffer, (uint32_t)(bits >> 32));
+    emit(buffer, movq, 5);
+}
+
+#define OP_MOVAPD 0x28
+#define OP_ANDPD  0x54
+#define OP_XORPD  0x57
+#define OP_ADDSD  0x58
+#define OP_MULSD  0x59
+#define OP_SUBSD  0x5C
+#define OP_DIVSD  0x5E
+
+/**
+ * Emit the kernel for void f(kernel, frames, num_frames, flows) under the
+ * System V ABI: rdi = kernel (unused), rsi = frames, rdx = num_frames,
+ * rcx = flows. Registers: xmm0 accumulator, xmm7 zero.
+ */
+static void emit_kernel(CodeBuffer *buffer, const FlowKernel *kernel)
+{
+    static const uint8_t test_rdx[] = { 0x48, 0x85, 0xD2 };
+    static const uint8_t jz_rel32[] = { 0x0F, 0x84 };
+    static const uint8_t add_rsi_imm32[] = { 0x48, 0x81, 0xC6 };
+    static const uint8_t add_rcx_8[] = { 0x48, 0x83, 0xC1, 0x08 };
+    static const uint8_t dec_rdx[] = { 0x48, 0xFF, 0xCA };
+    static const uint8_t jnz_rel32[] = { 0x0F, 0x85 };
+    static const uint8_t store_rcx[] = { 0xF2, 0x0F, 0x11, 0x01 };
+    static const uint8_t cmpltsd_suffix = 0x01;
+    static const uint8_t ret = 0xC3;
+
+    emit(buffer, test_rdx, sizeof(test_rdx));
+    emit(buffer, jz_rel32, sizeof(jz_rel32));
+    size_t exit_patch = buffer->size;
+    emit_u32(buffer, 0);
+
+    emit_sse_rr(buffer, 0x66, OP_XORPD, 7, 7);
+
+    size_t loop_start = buffer->size;
+    emit_sse_rr(buffer, 0x66, OP_XORPD, 0, 0);
+
+    /* Every path and the offset are emitted even when their coefficient is
+     * zero, so NaN and inf terms and signed zeros propagate exactly as in
+     * the portable kernels */
+    for (uint32_t i = 0; i < kernel->num_paths; i++) {
+        uint32_t base = i * (uint32_t)sizeof(PathMeasurement);
+        emit_load_rsi(buffer, 1, base);                        /* t_up */
+        emit_load_rsi(buffer, 2, base + (uint32_t)sizeof(double)); /* t_down */
+        emit_sse_rr(buffer, 0x66, OP_MOVAPD, 3, 1);
+        emit_sse_rr(buffer, 0xF2, OP_SUBSD, 3, 2);             /* Δt */
+        emit_sse_rr(buffer, 0x66, OP_MOVAPD, 4, 1);
+        emit_sse_rr(buffer, 0xF2, OP_MULSD, 4, 2);             /* t_up * t_down */
+        emit_sse_rr(buffer, 0xF2, OP_DIVSD, 3, 4);             /* term */
+
+        /* Mask the term to zero unless 0 < t_up and 0 < t_down */
+        emit_sse_rr(buffer, 0x66, OP_MOVAPD, 5, 7);
+        emit_sse_rr(buffer, 0xF2, 0xC2, 5, 1);
+        emit(buffer, &cmpltsd_suffix, 1);
+        emit_sse_rr(buffer, 0x66, OP_MOVAPD, 6, 7);
+        emit_sse_rr(buffer, 0xF2, 0xC2, 6, 2);
+        emit(buffer, &cmpltsd_suffix, 1);
+        emit_sse_rr(buffer, 0x66, OP_ANDPD, 5, 6);
+        emit_sse_rr(buffer, 0x66, OP_ANDPD, 3, 5);
+
+        emit_load_constant(buffer, 4, kernel->coeffs[i]);
+        emit_sse_rr(buffer, 0xF2, OP_MULSD, 3, 4);
+        emit_sse_rr(buffer, 0xF2, OP_ADDSD, 0, 3);
+    }
+
+    emit_load_constant(buffer, 4, kernel->offset);
+    emit_sse_rr(buffer, 0xF2, OP_ADDSD, 0, 4);
+
+    emit(buffer, store_rcx, sizeof(store_rcx));
+    emit(buffer, add_rsi_imm32, sizeof(add_rsi_imm32));
+    emit_u32(buffer, kernel->num_paths * (uint32_t)sizeof(PathMeasurement));
+    emit(buffer, add_rcx_8, sizeof(add_rcx_8));
+    emit(buffer, dec_rdx, sizeof(dec_rdx));
+    emit(buffer, jnz_rel32, sizeof(jnz_rel32));
+    emit_u32(buffer, (uint32_t)(int32_t)((int64_t)loop_start - (int64_t)(buffer->size + 4)));
+
+    size_t exit_target = buffer->size;
+    emit(buffer, &ret, 1);
+
+    if (buffer->size <= buffer->capacity) {
+        uint32_t rel = (uint32_t)(exit_target - (exit_patch + 4));
+        memcpy(buffer->bytes + exit_patch, &rel, sizeof(rel));
+    }
+}
+
+/**
+ * Generate machine code into a fresh mapping, then make it read+execute
+ */
+static int build_native(FlowKernel *kernel)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    if (page <= 0) {
+        return -1;
+    }
+
+    /* Size pass, then emit into the mapping */
+    CodeBuffer sizing = { NULL, 0, 0 };
+    emit_kernel(&sizing, kernel);
+
+    size_t mapping_size = (sizing.size + (size_t)page - 1) & ~((size_t)page - 1);
+    void *code = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        return -1;
+    }
+
+    CodeBuffer buffer = { code, 0, mapping_size };
+    emit_kernel(&buffer, kernel);
+
+    if (buffer.size != sizing.size || mprotect(code, mapping_size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, mapping_size);
+        return -1;
+    }
+
+    kernel->code = code;
+    kernel->code_size = mapping_size;
+    /* Object-to-function pointer conversion is POSIX (dlsym relies on it) */
+    *(void **)&kernel->function = code;
+    kernel->native = 1;
+
+    return 0;
+}
+
+#endif /* JIT_X86_64 */
+
+/**
+ * 64-bit FNV-1a, continuing from a previous hash
+ */
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+/**
+ * Hash of the kernel's defining values
+ */
+static uint64_t kernel_hash(uint32_t num_paths, const double *coeffs, double offset)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    hash = fnv1a(hash, &num_paths, sizeof(num_paths));
+    hash = fnv1a(hash, coeffs, num_paths * sizeof(double));
+    hash = fnv1a(hash, &offset, sizeof(offset));
+
+    return hash;
+}
+
+/**
+ * Build a kernel for one compiled configuration
+ */
+int flow_kernel_build(const CompiledConfig *compiled, double gain, double offset,
+                      int allow_native, FlowKernel *kernel)
+{
+    if (!compiled || !kernel || compiled->num_paths == 0 || !compiled->flow_coeff) {
+        return -1;
+    }
+
+    memset(kernel, 0, sizeof(*kernel));
+
+    kernel->coeffs = malloc(compiled->num_paths * sizeof(double));
+    if (!kernel->coeffs) {
+        return -1;
+    }
+
+    /* Hash as we fold; same value as kernel_hash() over the array */
+    uint32_t num_paths = compiled->num_paths;
+    uint64_t hash = fnv1a(0xcbf29ce484222325ull, &num_paths, sizeof(num_paths));
+    for (uint32_t i = 0; i < num_paths; i++) {
+        double coeff = gain * compiled->flow_coeff[i];
+        kernel->coeffs[i] = coeff;
+        hash = fnv1a(hash, &coeff, sizeof(coeff));
+    }
+    kernel->num_paths = num_paths;
+    kernel->offset = offset;
+    kernel->hash = fnv1a(hash, &offset, sizeof(offset));
+    kernel->function = (kernel->num_paths <= 8) ?
+                       specialized_kernels[kernel->num_paths] : portable_kernel;
+
+#if defined(JIT_X86_64)
+    if (allow_native) {
+        build_native(kernel);  /* Keeps the portable kernel on failure */
+    }
+#else
+    (void)allow_native;
+#endif
+
+    return 0;
+}
+
+/**
+ * Free a kernel's coefficients and code
+ */
+void flow_kernel_free(FlowKernel *kernel)
+{
+    if (kernel) {
+#if defined(JIT_X86_64)
+        if (kernel->code) {
+            munmap(kernel->code, kernel->code_size);
+        }
+#endif
+        free(kernel->coeffs);
+        memset(kernel, 0, sizeof(*kernel));
+    }
+}
+
+/**
+ * Initialize an empty kernel cache
+ */
+int flow_kernel_cache_init(FlowKernelCache *cache, int allow_native)
+{
+    if (!cache) {
+        return -1;
+    }
+
+    cache->capacity = 64;
+    cache->count = 0;
+    cache->allow_native = allow_native;
+    cache->entries = calloc(cache->capacity, sizeof(FlowKernel *));
+
+    return cache->entries ? 0 : -1;
+}
+
+/**
+ * Insert a kernel without checking for duplicates or load
+ */
+static void cache_insert(FlowKernel **entries, size_t capacity, FlowKernel *kernel)
+{
+    size_t slot = kernel->hash & (capacity - 1);
+
+    while (entries[slot]) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    entries[slot] = kernel;
+}
+
+/**
+ * Get the kernel for a configuration, building it on first use
+ */
+const FlowKernel* flow_kernel_cache_get(FlowKernelCache *cache,
+                                        const CompiledConfig *compiled,
+                                        double gain, double offset)
+{
+    if (!cache || !cache->entries || !compiled || compiled->num_paths == 0 ||
+        !compiled->flow_coeff) {
+        return NULL;
+    }
+
+    double coeffs[FLOWMETER_MAX_PATHS];
+    double *folded = coeffs;
+    if (compiled->num_paths > FLOWMETER_MAX_PATHS) {
+        folded = malloc(compiled->num_paths * sizeof(double));
+        if (!folded) {
+            return NULL;
+        }
+    }
+    for (uint32_t i = 0; i < compiled->num_paths; i++) {
+        folded[i] = gain * compiled->flow_coeff[i];
+    }
+
+    uint64_t hash = kernel_hash(compiled->num_paths, folded, offset);
+    size_t slot = hash & (cache->capacity - 1);
+    FlowKernel *found = NULL;
+
+    while (cache->entries[slot]) {
+        FlowKernel *entry = cache->entries[slot];
+        if (entry->hash == hash && entry->num_paths == compiled->num_paths &&
+            memcmp(&entry->offset, &offset, sizeof(offset)) == 0 &&
+            memcmp(entry->coeffs, folded, compiled->num_paths * sizeof(double)) == 0) {
+            found = entry;
+            break;
+        }
+        slot = (slot + 1) & (cache->capacity - 1);
+    }
+
+    if (folded != coeffs) {
+        free(folded);
+    }
+    if (found) {
+        return found;
+    }
+
+    /* Keep the load factor at or below one half */
+    if (2 * (cache->count + 1) > cache->capacity) {
+        size_t capacity = cache->capacity * 2;
+        FlowKernel **entries = calloc(capacity, sizeof(FlowKernel *));
+        if (!entries) {
+            return NULL;
+        }
+        for (size_t i = 0; i < cache->capacity; i++) {
+            if (cache->entries[i]) {
+                cache_insert(entries, capacity, cache->entries[i]);
+            }
+        }
+        free(cache->entries);
+        cache->entries = entries;
+        cache->capacity = capacity;
+    }
+
+    FlowKernel *kernel = malloc(sizeof(FlowKernel));
+    if (!kernel) {
+        return NULL;
+    }
+    if (flow_kernel_build(compiled, gain, offset, cache->allow_native, kernel) != 0) {
+        free(kernel);
+        return NULL;
+    }
+
+    cache_insert(cache->entries, cache->capacity, kernel);
+    cache->count++;
+
+    return kernel;
+}
+
+/**
+ * Free all cached kernels
+ */
+void flow_kernel_cache_free(FlowKernelCache *cache)
+{
+    if (cache && cache->entries) {
+        for (size_t i = 0; i < cache->capacity; i++) {
+            if (cache->entries[i]) {
+                flow_kernel_free(cache->entries[i]);
+                free(cache->entries[i]);
+            }
+        }
+        free(cache->entries);
+        memset(cache, 0, sizeof(*cache));
+    }
+}
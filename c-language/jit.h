@@ -0,0 +1,114 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "flowmeter.h"
+#include <stddef.h>
+
+/*
+ * Per-configuration flow kernels
+ *
+ * A kernel computes Q = gain * Σ flow_coeff_i * Δt_i / (t_up_i * t_down_i)
+ * + offset for a batch of frames of one meter configuration.
+ *
+ * On x86-64 a kernel can be generated as machine code: the path loop is
+ * fully unrolled and the coefficients are folded in as 64-bit immediates,
+ * so no configuration data is loaded per frame. Elsewhere, or when native
+ * code is disabled or cannot be mapped executable, the portable fallback
+ * is a C kernel specialized at build time for 1-8 paths (loop unrolled,
+ * coefficients loaded from memory), or a generic loop above that.
+ *
+ * Kernels are cached by a hash of their coefficients, so meters with the
+ * same geometry share one kernel. Each native kernel occupies its own
+ * read+execute page. The cache is not thread-safe; build kernels during
+ * setup and run them from any thread.
+ */
+
+typedef struct FlowKernel FlowKernel;
+
+typedef void (*FlowKernelFunction)(const FlowKernel *kernel,
+                                   const PathMeasurement *frames,
+                                   size_t num_frames, double *flows);
+
+struct FlowKernel {
+    FlowKernelFunction function;  /* Entry point */
+    int native;                   /* 1 for generated machine code */
+    uint64_t hash;                /* Hash of num_paths, coefficients, offset */
+    uint32_t num_paths;           /* Paths per frame */
+    double offset;                /* Calibration offset (m³/s) */
+    double *coeffs;               /* gain * flow_coeff per path */
+    void *code;                   /* Executable mapping, NULL if not native */
+    size_t code_size;             /* Size of the mapping */
+};
+
+typedef struct {
+    FlowKernel **entries;  /* Open-addressing table, NULL = empty */
+    size_t capacity;       /* Table size (power of two) */
+    size_t count;          /* Kernels in the table */
+    int allow_native;      /* Generate machine code when possible */
+} FlowKernelCache;
+
+/**
+ * Build a kernel for one compiled configuration
+ *
+ * @param compiled Compiled configuration
+ * @param gain Calibration gain folded into the coefficients
+ * @param offset Calibration offset added to every flow (m³/s)
+ * @param allow_native Generate machine code if the platform supports it
+ * @param kernel Output kernel, release with flow_kernel_free()
+ * @return 0 on success, -1 on error
+ */
+int flow_kernel_build(const CompiledConfig *compiled, double gain, double offset,
+                      int allow_native, FlowKernel *kernel);
+
+/**
+ * Free a kernel's coefficients and code
+ *
+ * @param kernel Kernel to release
+ */
+void flow_kernel_free(FlowKernel *kernel);
+
+/**
+ * Run a kernel over a batch of frames
+ *
+ * @param kernel Kernel
+ * @param frames num_frames * num_paths measurements, frame-major
+ * @param num_frames Number of frames
+ * @param flows Output flow per frame (m³/s)
+ */
+static inline void flow_kernel_run(const FlowKernel *kernel,
+                                   const PathMeasurement *frames,
+                                   size_t num_frames, double *flows)
+{
+    kernel->function(kernel, frames, num_frames, flows);
+}
+
+/**
+ * Initialize an empty kernel cache
+ *
+ * @param cache Cache to initialize
+ * @param allow_native Generate machine code when possible
+ * @return 0 on success, -1 on error
+ */
+int flow_kernel_cache_init(FlowKernelCache *cache, int allow_native);
+
+/**
+ * Get the kernel for a configuration, building it on first use
+ *
+ * @param cache Kernel cache
+ * @param compiled Compiled configuration
+ * @param gain Calibration gain
+ * @param offset Calibration offset (m³/s)
+ * @return Kernel owned by the cache, NULL on error
+ */
+const FlowKernel* flow_kernel_cache_get(FlowKernelCache *cache,
+                                        const CompiledConfig *compiled,
+                                        double gain, double offset);
+
+/**
+ * Free all cached kernels
+ *
+ * @param cache Cache to release
+ */
+void flow_kernel_cache_free(FlowKernelCache *cache);
+
+#endif /* JIT_H */
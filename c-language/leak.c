@@ -0,0 +1,404 @@
+#include "leak.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/**
+ * In-place radix-2 complex FFT over interleaved (re, im) pairs; the
+ * inverse is unnormalized
+ */
+static void leak_fft(const LeakLocator *locator, double *data, int inverse)
+{
+    uint32_t n = locator->fft_size;
+    const double *twiddles = locator->twiddles;
+    double sign = inverse ? -1.0 : 1.0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t j = locator->bit_reverse[i];
+        if (i < j) {
+            double re = data[2 * i], im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+
+    for (uint32_t length = 2; length <= n; length <<= 1) {
+        uint32_t half = length / 2;
+        uint32_t stride = n / length;
+        for (uint32_t start = 0; start < n; start += length) {
+            double *a = data + 2 * start;
+            double *b = a + 2 * half;
+            for (uint32_t k = 0; k < half; k++) {
+                double wr = twiddles[2 * k * stride];
+                double wi = sign * twiddles[2 * k * stride + 1];
+                double tr = b[2 * k] * wr - b[2 * k + 1] * wi;
+                double ti = b[2 * k] * wi + b[2 * k + 1] * wr;
+                b[2 * k] = a[2 * k] - tr;
+                b[2 * k + 1] = a[2 * k + 1] - ti;
+                a[2 * k] += tr;
+                a[2 * k + 1] += ti;
+            }
+        }
+    }
+}
+
+/**
+ * Differenced, mean-removed window of one series into the real or
+ * imaginary lanes of buffer; returns its energy
+ */
+static double leak_load(const LeakLocator *locator, const double *series,
+                        double *buffer, int lane)
+{
+    uint32_t window = locator->window;
+    uint32_t span = locator->span;
+    double mean = 0.0, energy = 0.0;
+
+    if (!series) {
+        return 0.0;
+    }
+
+    for (uint32_t n = 0; n + span < window; n++) {
+        mean += series[n + span] - series[n];
+    }
+    mean /= (double)(window - span);
+    for (uint32_t n = 0; n + span < window; n++) {
+        double d = series[n + span] - series[n] - mean;
+        buffer[2 * n + lane] = d;
+        energy += d * d;
+    }
+    return energy;
+}
+
+/**
+ * Phase 1 item: spectra of meters 2g and 2g + 1 from one complex FFT
+ */
+static void leak_spectra(LeakLocator *locator, uint32_t group, double *buffer)
+{
+    uint32_t n = locator->fft_size;
+    uint32_t m0 = 2 * group;
+    uint32_t m1 = m0 + 1;
+
+    memset(buffer, 0, 2 * (size_t)n * sizeof(double));
+    locator->energies[m0] = leak_load(locator, locator->series[m0], buffer, 0);
+    if (m1 < locator->num_meters) {
+        locator->energies[m1] = leak_load(locator, locator->series[m1], buffer, 1);
+    }
+    leak_fft(locator, buffer, 0);
+
+    /* X0[k] = (Z[k] + conj(Z[-k])) / 2, X1[k] = (Z[k] - conj(Z[-k])) / 2i */
+    double *x0 = locator->spectra + 2 * (size_t)n * m0;
+    double *x1 = (m1 < locator->num_meters) ? x0 + 2 * (size_t)n : NULL;
+    for (uint32_t k = 0; k < n; k++) {
+        uint32_t r = (n - k) & (n - 1);
+        double zr = buffer[2 * k], zi = buffer[2 * k + 1];
+        double cr = buffer[2 * r], ci = -buffer[2 * r + 1];
+        x0[2 * k] = 0.5 * (zr + cr);
+        x0[2 * k + 1] = 0.5 * (zi + ci);
+        if (x1) {
+            x1[2 * k] = 0.5 * (zi - ci);
+            x1[2 * k + 1] = -0.5 * (zr - cr);
+        }
+    }
+}
+
+/**
+ * Peak of |correlation| within a pair's lag range, read from one lane of
+ * an inverse-transformed buffer
+ */
+static void leak_peak(const LeakLocator *locator, const LeakPair *pair,
+                      const double *buffer, int lane, LeakEstimate *estimate)
+{
+    uint32_t n = locator->fft_size;
+    double fs = locator->sample_rate;
+    double distance = pair->position_b - pair->position_a;
+    double lag_limit = ceil(distance / pair->wave_speed * fs) + 1.0;
+    int32_t limit = (lag_limit < (double)(locator->window - 2)) ? (int32_t)lag_limit
+                                                                : (int32_t)locator->window - 2;
+    int32_t best = 0;
+    double best_value = 0.0;
+
+    for (int32_t lag = -limit; lag <= limit; lag++) {
+        double value = fabs(buffer[2 * ((uint32_t)lag & (n - 1)) + lane]);
+        if (value > best_value) {
+            best_value = value;
+            best = lag;
+        }
+    }
+
+    /* Parabolic refinement on the signed values around the peak */
+    double center = buffer[2 * ((uint32_t)best & (n - 1)) + lane];
+    double sign = center < 0.0 ? -1.0 : 1.0;
+    double left = sign * buffer[2 * ((uint32_t)(best - 1) & (n - 1)) + lane];
+    double right = sign * buffer[2 * ((uint32_t)(best + 1) & (n - 1)) + lane];
+    double curvature = left - 2.0 * sign * center + right;
+    double offset = (curvature < 0.0) ? 0.5 * (left - right) / curvature : 0.0;
+    if (fabs(offset) > 0.5) {
+        offset = 0.0;
+    }
+
+    double energy = locator->energies[pair->meter_a] * locator->energies[pair->meter_b];
+    /* Peaks within half a span of zero lag's mirror are the meters themselves */
+    double margin = pair->wave_speed * (0.5 * (double)locator->span + 1.0) / fs;
+
+    estimate->delay = ((double)best + offset) / fs;
+    estimate->correlation = energy > 0.0 ? best_value / (double)n / sqrt(energy) : 0.0;
+    estimate->position = 0.5 * (pair->position_a + pair->position_b -
+                                pair->wave_speed * estimate->delay);
+    estimate->located = estimate->correlation >= locator->min_correlation &&
+                        estimate->position > pair->position_a + margin &&
+                        estimate->position < pair->position_b - margin;
+}
+
+/**
+ * Phase 2 item: pairs 2g and 2g + 1, whose cross-spectra are real-signal
+ * transforms and so share one inverse FFT
+ */
+static void leak_correlate(LeakLocator *locator, uint32_t group, double *buffer)
+{
+    uint32_t n = locator->fft_size;
+    uint32_t p0 = 2 * group;
+    uint32_t p1 = p0 + 1;
+    int two = p1 < locator->num_pairs;
+
+    memset(buffer, 0, 2 * (size_t)n * sizeof(double));
+    for (int j = 0; j <= two; j++) {
+        const LeakPair *pair = &locator->pairs[p0 + (uint32_t)j];
+        const double *a = locator->spectra + 2 * (size_t)n * pair->meter_a;
+        const double *b = locator->spectra + 2 * (size_t)n * pair->meter_b;
+        for (uint32_t k = 0; k < n; k++) {
+            /* conj(A) * B, added as is (j = 0) or times i (j = 1) */
+            double re = a[2 * k] * b[2 * k] + a[2 * k + 1] * b[2 * k + 1];
+            double im = a[2 * k] * b[2 * k + 1] - a[2 * k + 1] * b[2 * k];
+            buffer[2 * k] += j ? -im : re;
+            buffer[2 * k + 1] += j ? re : im;
+        }
+    }
+
+    leak_fft(locator, buffer, 1);
+    leak_peak(locator, &locator->pairs[p0], buffer, 0, &locator->estimates[p0]);
+    if (two) {
+        leak_peak(locator, &locator->pairs[p1], buffer, 1, &locator->estimates[p1]);
+    }
+}
+
+/**
+ * Claim and process items of the current dispatch until none are left
+ */
+static void leak_work(LeakLocator *locator, double *buffer)
+{
+    for (;;) {
+        uint32_t item = __atomic_fetch_add(&locator->next, 1, __ATOMIC_RELAXED);
+        if (item >= locator->count) {
+            return;
+        }
+        if (locator->phase == 1) {
+            leak_spectra(locator, item, buffer);
+        } else {
+            leak_correlate(locator, item, buffer);
+        }
+    }
+}
+
+static void *leak_worker_main(void *argument)
+{
+    LeakWorker *worker = argument;
+    LeakLocator *locator = worker->locator;
+
+    for (;;) {
+        pthread_mutex_lock(&locator->lock);
+        while (locator->generation == worker->generation && !locator->shutdown) {
+            pthread_cond_wait(&locator->start, &locator->lock);
+        }
+        if (locator->shutdown) {
+            pthread_mutex_unlock(&locator->lock);
+            return NULL;
+        }
+        worker->generation = locator->generation;
+        pthread_mutex_unlock(&locator->lock);
+
+        leak_work(locator, worker->scratch);
+
+        pthread_mutex_lock(&locator->lock);
+        if (--locator->active == 0) {
+            pthread_cond_signal(&locator->done);
+        }
+        pthread_mutex_unlock(&locator->lock);
+    }
+}
+
+/**
+ * Run one phase across the pool, the calling thread included
+ */
+static void leak_dispatch(LeakLocator *locator, int phase, uint32_t count)
+{
+    pthread_mutex_lock(&locator->lock);
+    locator->phase = phase;
+    locator->count = count;
+    locator->next = 0;
+    locator->active = locator->num_threads - 1;
+    locator->generation++;
+    pthread_cond_broadcast(&locator->start);
+    pthread_mutex_unlock(&locator->lock);
+
+    leak_work(locator, locator->workers[0].scratch);
+
+    pthread_mutex_lock(&locator->lock);
+    while (locator->active > 0) {
+        pthread_cond_wait(&locator->done, &locator->lock);
+    }
+    pthread_mutex_unlock(&locator->lock);
+}
+
+/**
+ * Build the FFT plan, buffers and thread pool
+ */
+int leak_locator_init(LeakLocator *locator, const LeakPair *pairs, uint32_t num_pairs,
+                      uint32_t window, uint32_t span, double sample_rate,
+                      double min_correlation, uint32_t num_threads)
+{
+    if (!locator || (!pairs && num_pairs > 0) || window < 8 || (window & (window - 1)) ||
+        window > (1u << 24) || span == 0 || span > window / 2 ||
+        !(sample_rate > 0.0) || !(min_correlation >= 0.0)) {
+        return -1;
+    }
+
+    memset(locator, 0, sizeof(*locator));
+    for (uint32_t p = 0; p < num_pairs; p++) {
+        if (!(pairs[p].position_b > pairs[p].position_a) || !(pairs[p].wave_speed > 0.0)) {
+            return -1;
+        }
+        uint32_t highest = pairs[p].meter_a > pairs[p].meter_b ? pairs[p].meter_a
+                                                                 : pairs[p].meter_b;
+        if (highest >= locator->num_meters) {
+            locator->num_meters = highest + 1;
+        }
+    }
+
+    uint32_t n = 2 * window;
+    uint32_t threads = num_threads ? num_threads : 1;
+    locator->window = window;
+    locator->span = span;
+    locator->fft_size = n;
+    locator->sample_rate = sample_rate;
+    locator->min_correlation = min_correlation;
+    locator->num_pairs = num_pairs;
+
+    locator->pairs = malloc((num_pairs ? num_pairs : 1) * sizeof(LeakPair));
+    locator->twiddles = malloc(n * sizeof(double));
+    locator->bit_reverse = malloc(n * sizeof(uint32_t));
+    locator->spectra = malloc(2 * (size_t)n * (locator->num_meters + 1) * sizeof(double));
+    locator->energies = calloc(locator->num_meters + 1, sizeof(double));
+    locator->workers = calloc(threads, sizeof(LeakWorker));
+    int status = (locator->pairs && locator->twiddles && locator->bit_reverse &&
+                  locator->spectra && locator->energies && locator->workers) ? 0 : -1;
+    for (uint32_t t = 0; t < threads && status == 0; t++) {
+        locator->workers[t].locator = locator;
+        locator->workers[t].scratch = malloc(2 * (size_t)n * sizeof(double));
+        status = locator->workers[t].scratch ? 0 : -1;
+    }
+    if (status != 0) {
+        if (locator->workers) {
+            for (uint32_t t = 0; t < threads; t++) {
+                free(locator->workers[t].scratch);
+            }
+        }
+        leak_locator_free(locator);
+        return -1;
+    }
+    if (num_pairs > 0) {
+        memcpy(locator->pairs, pairs, num_pairs * sizeof(LeakPair));
+    }
+
+    for (uint32_t k = 0; k < n / 2; k++) {
+        locator->twiddles[2 * k] = cos(-2.0 * M_PI * (double)k / (double)n);
+        locator->twiddles[2 * k + 1] = sin(-2.0 * M_PI * (double)k / (double)n);
+    }
+    uint32_t bits = 0;
+    while ((1u << bits) < n) {
+        bits++;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t reversed = 0;
+        for (uint32_t b = 0; b < bits; b++) {
+            reversed |= ((i >> b) & 1u) << (bits - 1 - b);
+        }
+        locator->bit_reverse[i] = reversed;
+    }
+
+    /* The pool exists once num_threads is set; a thread that fails to
+     * start shrinks it */
+    pthread_mutex_init(&locator->lock, NULL);
+    pthread_cond_init(&locator->start, NULL);
+    pthread_cond_init(&locator->done, NULL);
+    locator->num_threads = 1;
+    for (uint32_t t = 1; t < threads; t++) {
+        if (pthread_create(&locator->workers[t].thread, NULL,
+                           leak_worker_main, &locator->workers[t]) != 0) {
+            break;
+        }
+        locator->num_threads = t + 1;
+    }
+    for (uint32_t t = locator->num_threads; t < threads; t++) {
+        free(locator->workers[t].scratch);
+        locator->workers[t].scratch = NULL;
+    }
+
+    return 0;
+}
+
+/**
+ * Correlate every pair over the latest window
+ */
+int leak_locator_run(LeakLocator *locator, const double *const *series,
+                     LeakEstimate *estimates)
+{
+    if (!locator || !series || (!estimates && locator->num_pairs > 0)) {
+        return -1;
+    }
+
+    locator->series = series;
+    locator->estimates = estimates;
+    leak_dispatch(locator, 1, (locator->num_meters + 1) / 2);
+    leak_dispatch(locator, 2, (locator->num_pairs + 1) / 2);
+    return 0;
+}
+
+/**
+ * Stop the thread pool and free the locator
+ */
+void leak_locator_free(LeakLocator *locator)
+{
+    if (!locator) {
+        return;
+    }
+
+    if (locator->workers && locator->num_threads > 0) {
+        pthread_mutex_lock(&locator->lock);
+        locator->shutdown = 1;
+        pthread_cond_broadcast(&locator->start);
+        pthread_mutex_unlock(&locator->lock);
+        for (uint32_t t = 1; t < locator->num_threads; t++) {
+            pthread_join(locator->workers[t].thread, NULL);
+        }
+        for (uint32_t t = 0; t < locator->num_threads; t++) {
+            free(locator->workers[t].scratch);
+        }
+        pthread_cond_destroy(&locator->start);
+        pthread_cond_destroy(&locator->done);
+        pthread_mutex_destroy(&locator->lock);
+    }
+
+    free(locator->workers);
+    free(locator->energies);
+    free(locator->spectra);
+    free(locator->bit_reverse);
+    free(locator->twiddles);
+    free(locator->pairs);
+    memset(locator, 0, sizeof(*locator));
+}
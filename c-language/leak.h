@@ -0,0 +1,129 @@
+#ifndef LEAK_H
+#define LEAK_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Cross-meter transient correlation for leak and burst localization
+ *
+ * A burst sends a flow transient along the pipeline at the pressure wave
+ * speed a, so it reaches meters A and B (at distances x_A < x_B along the
+ * line) with a delay d = t_B - t_A, which places the event at
+ *
+ *   x = (x_A + x_B - a * d) / 2
+ *
+ * Delays come from the cross-correlation of each meter's flow series
+ * over the latest window. Each series is differenced over span samples,
+ * x[n + span] - x[n]. This band-pass turns a step into a pulse about
+ * span samples wide and removes slow trends. A span near the transient's
+ * rise time keeps most of its energy while averaging out sample noise.
+ * The differenced series are zero-padded to twice the window for a
+ * linear correlation. Per run:
+ *
+ *   1. Each meter's spectrum is computed once, two meters per complex
+ *      FFT (one as the real part, one as the imaginary part).
+ *   2. Each pair multiplies two spectra, runs one inverse FFT and
+ *      searches |correlation| within the lags the pair's distance
+ *      allows, refining the peak by parabolic interpolation.
+ *
+ * Both phases are split across a persistent thread pool with per-thread
+ * scratch buffers; the FFT plan (twiddles and bit reversal) is built
+ * once and shared.
+ */
+
+typedef struct {
+    uint32_t meter_a;          /* Upstream meter (index into the series) */
+    uint32_t meter_b;          /* Downstream meter */
+    double position_a;         /* Distance of meter A along the line in m */
+    double position_b;         /* Distance of meter B along the line in m (> position_a) */
+    double wave_speed;         /* Transient propagation speed in m/s */
+} LeakPair;
+
+typedef struct {
+    double delay;              /* t_B - t_A in seconds */
+    double correlation;        /* Normalized |correlation| at the peak, 0 to 1 */
+    double position;           /* Event position along the line in m */
+    int located;               /* Correlation above threshold and event between the meters */
+} LeakEstimate;
+
+typedef struct LeakLocator LeakLocator;
+
+/* Per-thread state of the pool */
+typedef struct {
+    LeakLocator *locator;
+    double *scratch;           /* One complex FFT buffer */
+    pthread_t thread;
+    uint64_t generation;       /* Last dispatch handled */
+} LeakWorker;
+
+struct LeakLocator {
+    uint32_t window;           /* Samples per window (power of two) */
+    uint32_t span;             /* Differencing span in samples */
+    uint32_t fft_size;         /* 2 * window */
+    double sample_rate;        /* Samples per second */
+    double min_correlation;    /* Threshold for located */
+    uint32_t num_meters;       /* Highest meter index in the pairs + 1 */
+    uint32_t num_pairs;
+    LeakPair *pairs;           /* Owned copy of the pairs */
+    double *twiddles;          /* fft_size / 2 complex roots of unity */
+    uint32_t *bit_reverse;     /* Bit-reversal permutation */
+    double *spectra;           /* Per-meter spectra, fft_size complex each */
+    double *energies;          /* Per-meter energy of the differenced window */
+
+    /* Thread pool */
+    uint32_t num_threads;      /* Including the calling thread */
+    LeakWorker *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t start;      /* Signals a new dispatch */
+    pthread_cond_t done;       /* Signals the last worker finishing */
+    uint64_t generation;       /* Dispatch counter */
+    uint32_t active;           /* Workers still busy with the dispatch */
+    int shutdown;
+
+    /* Current dispatch */
+    int phase;                 /* 1: meter spectra, 2: pair correlations */
+    uint32_t count;            /* Items in the dispatch */
+    uint32_t next;             /* Next item to claim (atomic) */
+    const double *const *series;
+    LeakEstimate *estimates;
+};
+
+/**
+ * Build the FFT plan, buffers and thread pool
+ *
+ * @param locator Locator to initialize
+ * @param pairs Meter pairs to correlate
+ * @param num_pairs Number of pairs
+ * @param window Samples per correlation window (power of two, >= 8)
+ * @param span Differencing span in samples (1 to window / 2)
+ * @param sample_rate Samples per second of every series
+ * @param min_correlation Normalized correlation required to locate (0 to 1)
+ * @param num_threads Threads including the caller, 0 for one
+ * @return 0 on success, -1 on error
+ */
+int leak_locator_init(LeakLocator *locator, const LeakPair *pairs, uint32_t num_pairs,
+                      uint32_t window, uint32_t span, double sample_rate,
+                      double min_correlation, uint32_t num_threads);
+
+/**
+ * Correlate every pair over the latest window
+ *
+ * @param locator Locator
+ * @param series Per-meter pointers to the latest window samples of flow,
+ *               time-aligned across meters
+ * @param estimates Output estimates (num_pairs)
+ * @return 0 on success, -1 on error
+ */
+int leak_locator_run(LeakLocator *locator, const double *const *series,
+                     LeakEstimate *estimates);
+
+/**
+ * Stop the thread pool and free the locator
+ *
+ * @param locator Locator to release
+ */
+void leak_locator_free(LeakLocator *locator);
+
+#endif /* LEAK_H */
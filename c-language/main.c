@@ -3,95 +3,6 @@
 #include <stdlib.h>
 #include <math.h>
 
-/**
- * Initialize a 2-path flow meter configuration
- * Typical 45-degree diagonal paths for quick measurement
- */
-FlowMeterConfig* create_2path_config(double pipe_diameter)
-{
-    FlowMeterConfig *config = malloc(sizeof(FlowMeterConfig));
-    if (!config) return NULL;
-
-    config->pipe_diameter = pipe_diameter;
-    config->num_paths = 2;
-    config->paths = malloc(2 * sizeof(AcousticPath));
-    if (!config->paths) {
-        free(config);
-        return NULL;
-    }
-
-    /* Path 1: 45-degree angle from center, positive offset */
-    config->paths[0].position = 0.25;
-    config->paths[0].angle = M_PI / 4.0;  /* 45 degrees */
-    config->paths[0].length = pipe_diameter / sin(M_PI / 4.0);
-    config->paths[0].weight = 0.5;
-
-    /* Path 2: 45-degree angle from center, negative offset (opposite side) */
-    config->paths[1].position = -0.25;
-    config->paths[1].angle = M_PI / 4.0;
-    config->paths[1].length = pipe_diameter / sin(M_PI / 4.0);
-    config->paths[1].weight = 0.5;
-
-    return config;
-}
-
-/**
- * Initialize a 4-path flow meter configuration
- * Mix of 60-degree and 45-degree paths for improved accuracy
- */
-FlowMeterConfig* create_4path_config(double pipe_diameter)
-{
-    FlowMeterConfig *config = malloc(sizeof(FlowMeterConfig));
-    if (!config) return NULL;
-
-    config->pipe_diameter = pipe_diameter;
-    config->num_paths = 4;
-    config->paths = malloc(4 * sizeof(AcousticPath));
-    if (!config->paths) {
-        free(config);
-        return NULL;
-    }
-
-    /* Path 1: 60-degree angle, position 0.35D */
-    config->paths[0].position = 0.35;
-    config->paths[0].angle = M_PI / 3.0;  /* 60 degrees */
-    config->paths[0].length = pipe_diameter / sin(M_PI / 3.0);
-    config->paths[0].weight = 0.25;
-
-    /* Path 2: 60-degree angle, position -0.35D (opposite side) */
-    config->paths[1].position = -0.35;
-    config->paths[1].angle = M_PI / 3.0;
-    config->paths[1].length = pipe_diameter / sin(M_PI / 3.0);
-    config->paths[1].weight = 0.25;
-
-    /* Path 3: 45-degree angle, position 0.15D */
-    config->paths[2].position = 0.15;
-    config->paths[2].angle = M_PI / 4.0;  /* 45 degrees */
-    config->paths[2].length = pipe_diameter / sin(M_PI / 4.0);
-    config->paths[2].weight = 0.25;
-
-    /* Path 4: 45-degree angle, position -0.15D (opposite side) */
-    config->paths[3].position = -0.15;
-    config->paths[3].angle = M_PI / 4.0;
-    config->paths[3].length = pipe_diameter / sin(M_PI / 4.0);
-    config->paths[3].weight = 0.25;
-
-    return config;
-}
-
-/**
- * Free flow meter configuration
- */
-void free_config(FlowMeterConfig *config)
-{
-    if (config) {
-        if (config->paths) {
-            free(config->paths);
-        }
-        free(config);
-    }
-}
-
 /**
  * Print flow meter configuration details
  */
@@ -0,0 +1,58 @@
+#include "meter_state.h"
+#include <string.h>
+
+/**
+ * Initialize a meter state with every path at zero flow
+ */
+int meter_state_init(MeterState *state, const CompiledConfig *compiled,
+                     uint32_t renormalize_interval)
+{
+    if (!state || !compiled || !compiled->flow_coeff || !compiled->velocity_scale) {
+        return -1;
+    }
+
+    if (compiled->num_paths == 0 || compiled->num_paths > FLOWMETER_MAX_PATHS) {
+        return -1;
+    }
+
+    state->compiled = *compiled;
+    state->compiled.storage = NULL;
+    state->renormalize_interval = renormalize_interval ? renormalize_interval :
+                                  METER_STATE_DEFAULT_RENORMALIZE;
+    meter_state_reset(state);
+
+    return 0;
+}
+
+/**
+ * Set every path back to zero flow
+ */
+void meter_state_reset(MeterState *state)
+{
+    if (!state) {
+        return;
+    }
+
+    memset(state->terms, 0, sizeof(state->terms));
+    state->flow = 0.0;
+    state->updates = 0;
+}
+
+/**
+ * Recompute the total from the stored path terms
+ *
+ * Same summation order as compiled_flow_rate(), so a renormalized state
+ * matches a full recomputation of the same measurements exactly.
+ */
+double meter_state_renormalize(MeterState *state)
+{
+    double flow = 0.0;
+
+    for (uint32_t i = 0; i < state->compiled.num_paths; i++) {
+        flow += state->compiled.flow_coeff[i] * state->terms[i];
+    }
+
+    state->flow = flow;
+    state->updates = 0;
+    return flow;
+}
@@ -0,0 +1,90 @@
+#ifndef METER_STATE_H
+#define METER_STATE_H
+
+#include "flowmeter.h"
+#include <stdint.h>
+
+/* Updates between exact recomputations when no interval is given */
+#define METER_STATE_DEFAULT_RENORMALIZE 1024
+
+/*
+ * Incremental flow state for meters whose paths are fired one at a time
+ *
+ * Keeps the latest transit term of every path and the running sum
+ * Q = Σ flow_coeff_i * term_i, so a new measurement on one path updates
+ * the total in O(1) instead of recomputing all paths. Each update adds
+ * the difference of two contributions, which accumulates rounding error;
+ * the sum is recomputed exactly every renormalize_interval updates.
+ */
+typedef struct {
+    CompiledConfig compiled;             /* Coefficient view (not owned) */
+    double terms[FLOWMETER_MAX_PATHS];   /* Latest Δt / (t_up * t_down) per path */
+    double flow;                         /* Current volumetric flow in m³/s */
+    uint32_t updates;                    /* Updates since the last recomputation */
+    uint32_t renormalize_interval;       /* Updates between recomputations */
+} MeterState;
+
+/**
+ * Initialize a meter state with every path at zero flow
+ *
+ * @param state State to initialize
+ * @param compiled Compiled configuration; its coefficients must outlive
+ *                 the state
+ * @param renormalize_interval Updates between exact recomputations of the
+ *                             total, 0 for METER_STATE_DEFAULT_RENORMALIZE
+ * @return 0 on success, -1 on error (including more than
+ *         FLOWMETER_MAX_PATHS paths)
+ */
+int meter_state_init(MeterState *state, const CompiledConfig *compiled,
+                     uint32_t renormalize_interval);
+
+/**
+ * Set every path back to zero flow
+ *
+ * @param state State to reset
+ */
+void meter_state_reset(MeterState *state);
+
+/**
+ * Recompute the total from the stored path terms, discarding drift
+ *
+ * @param state State to renormalize
+ * @return Recomputed volumetric flow in m³/s
+ */
+double meter_state_renormalize(MeterState *state);
+
+/**
+ * Replace the measurement of one path and update the total in O(1)
+ *
+ * @param state Meter state
+ * @param path Path index (< compiled->num_paths, not checked)
+ * @param measurement New measurement for that path
+ * @return Current volumetric flow in m³/s
+ */
+static inline double meter_state_update(MeterState *state, uint32_t path,
+                                        const PathMeasurement *measurement)
+{
+    double term = path_transit_term(measurement);
+
+    state->flow += state->compiled.flow_coeff[path] * (term - state->terms[path]);
+    state->terms[path] = term;
+
+    if (++state->updates >= state->renormalize_interval) {
+        return meter_state_renormalize(state);
+    }
+    return state->flow;
+}
+
+/**
+ * Velocity of one path from its latest measurement
+ *
+ * @param state Meter state
+ * @param path Path index (< compiled->num_paths, not checked)
+ * @return Path velocity in m/s
+ */
+static inline double meter_state_path_velocity(const MeterState *state, uint32_t path)
+{
+    return state->compiled.velocity_scale[path] * state->terms[path];
+}
+
+#endif /* METER_STATE_H */
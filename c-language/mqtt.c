@@ -0,0 +1,1116 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "mqtt.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Slot states */
+#define SLOT_FREE   0u
+#define SLOT_OPEN   1u
+#define SLOT_QUEUED 2u
+#define SLOT_SENT   3u
+#define SLOT_ACKED  4u
+
+/* MQTT control packet types, in the high nibble of the first byte */
+#define PACKET_CONNECT    0x10u
+#define PACKET_CONNACK    0x20u
+#define PACKET_PUBLISH    0x30u
+#define PACKET_PUBACK     0x40u
+#define PACKET_PINGREQ    0xC0u
+#define PACKET_PINGRESP   0xD0u
+#define PACKET_DISCONNECT 0xE0u
+
+/* Reconnect backoff and connection timeouts in milliseconds */
+#define BACKOFF_MIN 100u
+#define BACKOFF_MAX 5000u
+#define CONNECT_TIMEOUT 3000u
+
+/* Largest packet the test broker accepts */
+#define BROKER_BUFFER (4u << 20)
+
+/**
+ * Monotonic time in milliseconds
+ */
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+static inline void store_le32(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+static inline uint32_t load_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+/**
+ * Append a LEB128 varint
+ */
+static inline size_t put_varint(uint8_t *out, uint64_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+/**
+ * Read a LEB128 varint, returning its length or 0 if truncated or too long
+ */
+static size_t get_varint(const uint8_t *data, size_t size, uint64_t *value)
+{
+    uint64_t result = 0;
+    for (size_t n = 0; n < size && n < 10; n++) {
+        result |= (uint64_t)(data[n] & 0x7F) << (7 * n);
+        if (!(data[n] & 0x80)) {
+            *value = result;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+static inline uint64_t zigzag(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/**
+ * Append an MQTT remaining length (at most four bytes)
+ */
+static size_t put_length(uint8_t *out, size_t length)
+{
+    size_t n = 0;
+    do {
+        uint8_t byte = (uint8_t)(length & 0x7F);
+        length >>= 7;
+        out[n++] = (uint8_t)(byte | (length ? 0x80 : 0));
+    } while (length && n < 4);
+    return n;
+}
+
+/**
+ * Parse a fixed header, returning its size, 0 if incomplete, or -1 if
+ * malformed
+ */
+static int get_fixed_header(const uint8_t *data, size_t size, size_t *length)
+{
+    size_t value = 0;
+    for (size_t n = 1; n < size && n <= 4; n++) {
+        value |= (size_t)(data[n] & 0x7F) << (7 * (n - 1));
+        if (!(data[n] & 0x80)) {
+            *length = value;
+            return (int)n + 1;
+        }
+    }
+    return size > 4 ? -1 : 0;
+}
+
+/**
+ * Encode the fixed part of a batch payload
+ */
+void mqtt_batch_header(uint8_t *out, uint32_t group, uint32_t sequence, uint32_t count,
+                       uint64_t base_timestamp_ns)
+{
+    out[0] = MQTT_PAYLOAD_VERSION;
+    store_le32(out + 1, group);
+    store_le32(out + 5, sequence);
+    store_le32(out + 9, count);
+    store_le32(out + 13, (uint32_t)base_timestamp_ns);
+    store_le32(out + 17, (uint32_t)(base_timestamp_ns >> 32));
+}
+
+/**
+ * Decode a batch payload
+ */
+int mqtt_batch_decode(const uint8_t *payload, size_t size, uint32_t *group,
+                      uint32_t *sequence, MqttRecord *records, size_t max_records,
+                      size_t *num_records)
+{
+    if (!payload || !group || !sequence || !num_records || size < MQTT_PAYLOAD_HEADER ||
+        payload[0] != MQTT_PAYLOAD_VERSION) {
+        return -1;
+    }
+
+    uint32_t count = load_le32(payload + 9);
+    if (records && count > max_records) {
+        return -1;
+    }
+
+    uint32_t meter = 0;
+    uint64_t timestamp = (uint64_t)load_le32(payload + 13) |
+                         ((uint64_t)load_le32(payload + 17) << 32);
+    size_t pos = MQTT_PAYLOAD_HEADER;
+
+    for (uint32_t r = 0; r < count; r++) {
+        uint64_t meter_change, time_change;
+        size_t n = get_varint(payload + pos, size - pos, &meter_change);
+        if (n == 0) {
+            return -1;
+        }
+        pos += n;
+        n = get_varint(payload + pos, size - pos, &time_change);
+        if (n == 0 || size - pos - n < 4) {
+            return -1;
+        }
+        pos += n;
+
+        meter += (uint32_t)unzigzag(meter_change);
+        timestamp += (uint64_t)unzigzag(time_change);
+        if (records) {
+            uint32_t bits = load_le32(payload + pos);
+            records[r].timestamp_ns = timestamp;
+            records[r].meter_id = meter;
+            memcpy(&records[r].flow, &bits, sizeof(bits));
+        }
+        pos += 4;
+    }
+
+    if (pos != size) {
+        return -1;
+    }
+
+    *group = load_le32(payload + 1);
+    *sequence = load_le32(payload + 5);
+    *num_records = count;
+    return 0;
+}
+
+/**
+ * Wake the network thread unless a wake-up is already pending
+ */
+static void publisher_wake(MqttPublisher *publisher)
+{
+    if (!__atomic_exchange_n(&publisher->woken, 1, __ATOMIC_ACQ_REL)) {
+        ssize_t written = write(publisher->wake[1], "", 1);
+        (void)written;
+    }
+}
+
+/**
+ * Queue a group's open batch for sending; the group's lock is held
+ */
+static void seal_batch(MqttPublisher *publisher, MqttGroup *group, uint32_t index, int wake)
+{
+    uint32_t slot = (uint32_t)group->slot;
+    store_le32(publisher->pool + slot * publisher->slot_size + 9, group->count);
+
+    pthread_mutex_lock(&publisher->lock);
+    publisher->slot_group[slot] = index;
+    publisher->slot_size_used[slot] = (uint32_t)group->size;
+    publisher->slot_records[slot] = group->count;
+    publisher->slot_state[slot] = SLOT_QUEUED;
+    publisher->ring[publisher->tail % publisher->config.queue_batches] = slot;
+    publisher->tail++;
+    publisher->batches++;
+    publisher->records += group->count;
+    pthread_mutex_unlock(&publisher->lock);
+
+    group->slot = -1;
+    if (wake) {
+        publisher_wake(publisher);
+    }
+}
+
+/**
+ * Seal batches that have waited linger_ms, or every open batch
+ */
+static void seal_stale(MqttPublisher *publisher, uint64_t now, int all)
+{
+    if (!all && publisher->config.linger_ms == 0) {
+        return;
+    }
+
+    for (uint32_t g = 0; g < publisher->config.num_groups; g++) {
+        MqttGroup *group = &publisher->groups[g];
+        pthread_mutex_lock(&group->lock);
+        if (group->slot >= 0 && group->count > 0 &&
+            (all || now - group->opened_ms >= publisher->config.linger_ms)) {
+            seal_batch(publisher, group, g, all);
+        }
+        pthread_mutex_unlock(&group->lock);
+    }
+}
+
+/**
+ * Give a group an open batch, returning -1 with the pool exhausted; the
+ * group's lock is held
+ */
+static int open_batch(MqttPublisher *publisher, MqttGroup *g, uint32_t group,
+                      uint64_t timestamp_ns)
+{
+    pthread_mutex_lock(&publisher->lock);
+    if (publisher->num_free > 0) {
+        g->slot = (int32_t)publisher->free_slots[--publisher->num_free];
+        publisher->slot_state[g->slot] = SLOT_OPEN;
+        publisher->slot_sent[g->slot] = 0;
+    }
+    pthread_mutex_unlock(&publisher->lock);
+
+    if (g->slot < 0) {
+        return -1;
+    }
+
+    mqtt_batch_header(publisher->pool + (size_t)g->slot * publisher->slot_size, group,
+                      g->sequence++, 0, timestamp_ns);
+    g->count = 0;
+    g->size = MQTT_PAYLOAD_HEADER;
+    g->last_meter = 0;
+    g->last_timestamp = timestamp_ns;
+    g->opened_ms = publisher->config.linger_ms ? now_ms() : 0;
+    return 0;
+}
+
+/**
+ * Append a record to a group's open batch, sealing it when full; the
+ * group's lock is held
+ */
+static inline void append_record(MqttPublisher *publisher, MqttGroup *g, uint32_t group,
+                                 uint64_t timestamp_ns, uint32_t meter_id, double flow)
+{
+    uint8_t *p = publisher->pool + (size_t)g->slot * publisher->slot_size + g->size;
+    float value = (float)flow;
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    size_t n = put_varint(p, zigzag((int64_t)meter_id - (int64_t)g->last_meter));
+    n += put_varint(p + n, zigzag((int64_t)(timestamp_ns - g->last_timestamp)));
+    store_le32(p + n, bits);
+    g->size += n + 4;
+    g->count++;
+    g->last_meter = meter_id;
+    g->last_timestamp = timestamp_ns;
+
+    if (g->count == publisher->config.max_records) {
+        seal_batch(publisher, g, group, 1);
+    }
+}
+
+/**
+ * Queue a result for publishing; never blocks on the network
+ */
+int mqtt_publish(MqttPublisher *publisher, uint32_t group, uint64_t timestamp_ns,
+                 uint32_t meter_id, const FlowResult *result)
+{
+    if (!publisher || !result || group >= publisher->config.num_groups) {
+        return -1;
+    }
+
+    MqttGroup *g = &publisher->groups[group];
+    pthread_mutex_lock(&g->lock);
+
+    if (g->slot < 0 && open_batch(publisher, g, group, timestamp_ns) != 0) {
+        pthread_mutex_unlock(&g->lock);
+        __atomic_add_fetch(&publisher->dropped, 1, __ATOMIC_RELAXED);
+        return 1;
+    }
+
+    append_record(publisher, g, group, timestamp_ns, meter_id, result->volumetric_flow);
+    pthread_mutex_unlock(&g->lock);
+    return 0;
+}
+
+/**
+ * Queue results of one group under a single lock
+ */
+size_t mqtt_publish_flows(MqttPublisher *publisher, uint32_t group, size_t count,
+                          const uint64_t *timestamps_ns, const uint32_t *meter_ids,
+                          const double *flows)
+{
+    if (!publisher || !timestamps_ns || !meter_ids || !flows ||
+        group >= publisher->config.num_groups) {
+        return 0;
+    }
+
+    MqttGroup *g = &publisher->groups[group];
+    size_t queued = 0;
+    pthread_mutex_lock(&g->lock);
+
+    while (queued < count) {
+        if (g->slot < 0 && open_batch(publisher, g, group, timestamps_ns[queued]) != 0) {
+            break;
+        }
+        append_record(publisher, g, group, timestamps_ns[queued], meter_ids[queued],
+                      flows[queued]);
+        queued++;
+    }
+
+    pthread_mutex_unlock(&g->lock);
+    if (queued < count) {
+        __atomic_add_fetch(&publisher->dropped, count - queued, __ATOMIC_RELAXED);
+    }
+    return queued;
+}
+
+/**
+ * Drop the connection; unacknowledged batches are sent again later
+ */
+static void publisher_disconnect(MqttPublisher *publisher)
+{
+    if (publisher->fd >= 0) {
+        close(publisher->fd);
+        publisher->fd = -1;
+        publisher->failures++;
+    }
+    publisher->out_start = publisher->out_end = 0;
+    publisher->in_used = 0;
+
+    pthread_mutex_lock(&publisher->lock);
+    publisher->next_send = publisher->head;
+    pthread_mutex_unlock(&publisher->lock);
+}
+
+/**
+ * Wait for an event on fd, giving up on timeout or stop
+ */
+static int wait_fd(MqttPublisher *publisher, int fd, short events, uint32_t timeout_ms)
+{
+    uint64_t deadline = now_ms() + timeout_ms;
+    while (!__atomic_load_n(&publisher->stop, __ATOMIC_RELAXED)) {
+        uint64_t now = now_ms();
+        if (now >= deadline) {
+            return -1;
+        }
+        struct pollfd pfd = { fd, events, 0 };
+        uint64_t slice = deadline - now < 100 ? deadline - now : 100;
+        int ready = poll(&pfd, 1, (int)slice);
+        if (ready > 0) {
+            return (pfd.revents & events) ? 0 : -1;
+        }
+        if (ready < 0 && errno != EINTR) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Connect, send CONNECT and wait for a successful CONNACK
+ */
+static int publisher_connect(MqttPublisher *publisher)
+{
+    struct addrinfo hints, *addresses = NULL;
+    char port[8];
+    int fd = -1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port, sizeof(port), "%u", (unsigned)publisher->config.port);
+    if (getaddrinfo(publisher->host, port, &hints, &addresses) != 0) {
+        return -1;
+    }
+
+    for (struct addrinfo *a = addresses; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+
+        int error = 0;
+        socklen_t length = sizeof(error);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        if ((connect(fd, a->ai_addr, a->ai_addrlen) != 0 &&
+             (errno != EINPROGRESS || wait_fd(publisher, fd, POLLOUT, CONNECT_TIMEOUT) != 0 ||
+              getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0))) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    /* CONNECT with a clean session; resends after a reconnect give QoS 1 */
+    uint8_t packet[2 + 4 + 10 + 2 + 256];
+    size_t id_length = strlen(publisher->config.client_id);
+    size_t length = 10 + 2 + id_length;
+    size_t n = 0;
+    packet[n++] = PACKET_CONNECT;
+    n += put_length(packet + n, length);
+    memcpy(packet + n, "\x00\x04MQTT\x04\x02", 8);
+    n += 8;
+    packet[n++] = (uint8_t)(publisher->config.keepalive_s >> 8);
+    packet[n++] = (uint8_t)publisher->config.keepalive_s;
+    packet[n++] = (uint8_t)(id_length >> 8);
+    packet[n++] = (uint8_t)id_length;
+    memcpy(packet + n, publisher->config.client_id, id_length);
+    n += id_length;
+
+    uint8_t connack[4];
+    size_t received = 0;
+    if (wait_fd(publisher, fd, POLLOUT, CONNECT_TIMEOUT) != 0 ||
+        send(fd, packet, n, MSG_NOSIGNAL) != (ssize_t)n) {
+        close(fd);
+        return -1;
+    }
+    while (received < sizeof(connack)) {
+        ssize_t got;
+        if (wait_fd(publisher, fd, POLLIN, CONNECT_TIMEOUT) != 0 ||
+            (got = recv(fd, connack + received, sizeof(connack) - received, 0)) <= 0) {
+            close(fd);
+            return -1;
+        }
+        received += (size_t)got;
+    }
+    if (connack[0] != PACKET_CONNACK || connack[1] != 2 || connack[3] != 0) {
+        close(fd);
+        return -1;
+    }
+
+    publisher->fd = fd;
+    publisher->out_start = publisher->out_end = 0;
+    publisher->in_used = 0;
+    publisher->connects++;
+    return 0;
+}
+
+/**
+ * Encode queued batches as PUBLISH packets, up to the in-flight limit
+ */
+static void fill_output(MqttPublisher *publisher)
+{
+    uint32_t capacity = publisher->config.queue_batches;
+
+    if (publisher->out_start > 0) {
+        memmove(publisher->out, publisher->out + publisher->out_start,
+                publisher->out_end - publisher->out_start);
+        publisher->out_end -= publisher->out_start;
+        publisher->out_start = 0;
+    }
+
+    pthread_mutex_lock(&publisher->lock);
+    while (publisher->next_send < publisher->tail &&
+           publisher->next_send - publisher->head < publisher->config.max_inflight) {
+        uint32_t slot = publisher->ring[publisher->next_send % capacity];
+        if (publisher->slot_state[slot] == SLOT_ACKED) {
+            publisher->next_send++;
+            continue;
+        }
+
+        const char *topic = publisher->topics + (size_t)publisher->slot_group[slot] *
+                                                MQTT_TOPIC_SIZE;
+        size_t topic_length = strlen(topic);
+        size_t payload = publisher->slot_size_used[slot];
+        size_t length = 2 + topic_length + 2 + payload;
+        if (publisher->out_size - publisher->out_end < 5 + length) {
+            break;
+        }
+
+        /* QoS 1; the packet identifier is the slot, unique while in flight */
+        uint8_t *p = publisher->out + publisher->out_end;
+        size_t n = 0;
+        uint16_t id = (uint16_t)(slot + 1);
+        p[n++] = (uint8_t)(PACKET_PUBLISH | 0x02 | (publisher->slot_sent[slot] ? 0x08 : 0));
+        n += put_length(p + n, length);
+        p[n++] = (uint8_t)(topic_length >> 8);
+        p[n++] = (uint8_t)topic_length;
+        memcpy(p + n, topic, topic_length);
+        n += topic_length;
+        p[n++] = (uint8_t)(id >> 8);
+        p[n++] = (uint8_t)id;
+        memcpy(p + n, publisher->pool + (size_t)slot * publisher->slot_size, payload);
+        n += payload;
+
+        publisher->out_end += n;
+        publisher->slot_state[slot] = SLOT_SENT;
+        publisher->slot_sent[slot] = 1;
+        publisher->publishes++;
+        publisher->next_send++;
+    }
+    pthread_mutex_unlock(&publisher->lock);
+}
+
+/**
+ * Mark a batch acknowledged and free the acknowledged prefix of the ring
+ */
+static void handle_puback(MqttPublisher *publisher, uint16_t id)
+{
+    uint32_t capacity = publisher->config.queue_batches;
+
+    pthread_mutex_lock(&publisher->lock);
+    if (id >= 1 && id <= capacity && publisher->slot_state[id - 1] == SLOT_SENT) {
+        publisher->slot_state[id - 1] = SLOT_ACKED;
+        publisher->acked++;
+        publisher->records_acked += publisher->slot_records[id - 1];
+    }
+
+    int freed = 0;
+    while (publisher->head < publisher->next_send) {
+        uint32_t slot = publisher->ring[publisher->head % capacity];
+        if (publisher->slot_state[slot] != SLOT_ACKED) {
+            break;
+        }
+        publisher->slot_state[slot] = SLOT_FREE;
+        publisher->free_slots[publisher->num_free++] = slot;
+        publisher->head++;
+        freed = 1;
+    }
+    if (freed) {
+        pthread_cond_broadcast(&publisher->drained);
+    }
+    pthread_mutex_unlock(&publisher->lock);
+}
+
+/**
+ * Read and handle packets from the broker
+ */
+static int publisher_receive(MqttPublisher *publisher)
+{
+    ssize_t got = recv(publisher->fd, publisher->in + publisher->in_used,
+                       sizeof(publisher->in) - publisher->in_used, 0);
+    if (got == 0 || (got < 0 && errno != EAGAIN && errno != EINTR)) {
+        return -1;
+    }
+    if (got < 0) {
+        return 0;
+    }
+    publisher->in_used += (size_t)got;
+
+    size_t pos = 0;
+    while (pos < publisher->in_used) {
+        size_t length;
+        int header = get_fixed_header(publisher->in + pos, publisher->in_used - pos, &length);
+        if (header < 0 || (header > 0 && header + length > sizeof(publisher->in))) {
+            return -1;
+        }
+        if (header == 0 || publisher->in_used - pos < header + length) {
+            break;
+        }
+
+        const uint8_t *packet = publisher->in + pos;
+        if ((packet[0] & 0xF0) == PACKET_PUBACK && length == 2) {
+            handle_puback(publisher, (uint16_t)((packet[2] << 8) | packet[3]));
+        }
+        pos += (size_t)header + length;
+    }
+
+    memmove(publisher->in, publisher->in + pos, publisher->in_used - pos);
+    publisher->in_used -= pos;
+    return 0;
+}
+
+/**
+ * Network thread
+ */
+static void* publisher_main(void *arg)
+{
+    MqttPublisher *publisher = arg;
+    uint32_t linger = publisher->config.linger_ms;
+    int tick = (linger == 0 || linger >= 200) ? 100 : linger < 2 ? 1 : (int)linger / 2;
+    uint64_t keepalive = (uint64_t)publisher->config.keepalive_s * 1000u;
+    uint64_t backoff = BACKOFF_MIN, retry_at = 0;
+    uint64_t last_send = 0, last_receive = 0;
+
+    while (!__atomic_load_n(&publisher->stop, __ATOMIC_RELAXED)) {
+        uint64_t now = now_ms();
+        struct pollfd fds[2] = { { publisher->wake[0], POLLIN, 0 }, { -1, 0, 0 } };
+
+        if (publisher->fd < 0 && now >= retry_at) {
+            if (publisher_connect(publisher) == 0) {
+                backoff = BACKOFF_MIN;
+                last_send = last_receive = now = now_ms();
+            } else {
+                publisher->failures++;
+                retry_at = now_ms() + backoff;
+                backoff = backoff * 2 > BACKOFF_MAX ? BACKOFF_MAX : backoff * 2;
+            }
+        }
+
+        seal_stale(publisher, now, 0);
+
+        int timeout = tick;
+        if (publisher->fd >= 0) {
+            fill_output(publisher);
+            if (keepalive && now - last_receive > 2 * keepalive) {
+                publisher_disconnect(publisher);
+                continue;
+            }
+            if (keepalive && now - last_send >= keepalive / 2 &&
+                publisher->out_end + 2 <= publisher->out_size) {
+                publisher->out[publisher->out_end++] = PACKET_PINGREQ;
+                publisher->out[publisher->out_end++] = 0;
+            }
+            fds[1].fd = publisher->fd;
+            fds[1].events = (short)(POLLIN |
+                                    (publisher->out_end > publisher->out_start ? POLLOUT : 0));
+        } else if (retry_at - now < (uint64_t)timeout) {
+            timeout = (int)(retry_at - now);
+        }
+
+        if (poll(fds, 2, timeout) < 0 && errno != EINTR) {
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            uint8_t drain[64];
+            __atomic_store_n(&publisher->woken, 0, __ATOMIC_RELEASE);
+            while (read(publisher->wake[0], drain, sizeof(drain)) == (ssize_t)sizeof(drain)) {
+            }
+        }
+        if (publisher->fd < 0) {
+            continue;
+        }
+
+        if (fds[1].revents & (POLLIN | POLLERR | POLLHUP)) {
+            if (publisher_receive(publisher) != 0) {
+                publisher_disconnect(publisher);
+                continue;
+            }
+            last_receive = now_ms();
+        }
+        if (publisher->out_end > publisher->out_start) {
+            ssize_t sent = send(publisher->fd, publisher->out + publisher->out_start,
+                                publisher->out_end - publisher->out_start,
+                                MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                publisher_disconnect(publisher);
+                continue;
+            }
+            if (sent > 0) {
+                publisher->out_start += (size_t)sent;
+                publisher->bytes_sent += (uint64_t)sent;
+                publisher->sends++;
+                last_send = now_ms();
+            }
+        }
+    }
+
+    if (publisher->fd >= 0) {
+        uint8_t disconnect[2] = { PACKET_DISCONNECT, 0 };
+        ssize_t sent = send(publisher->fd, disconnect, sizeof(disconnect), MSG_NOSIGNAL);
+        (void)sent;
+        close(publisher->fd);
+        publisher->fd = -1;
+    }
+    return NULL;
+}
+
+/**
+ * Free everything allocated by mqtt_publisher_start()
+ */
+static void publisher_free(MqttPublisher *publisher, uint32_t num_locks)
+{
+    for (uint32_t g = 0; g < num_locks; g++) {
+        pthread_mutex_destroy(&publisher->groups[g].lock);
+    }
+    free(publisher->host);
+    free(publisher->client_id);
+    free(publisher->topics);
+    free(publisher->groups);
+    free(publisher->pool);
+    free(publisher->slot_group);
+    free(publisher->slot_size_used);
+    free(publisher->slot_records);
+    free(publisher->slot_state);
+    free(publisher->slot_sent);
+    free(publisher->free_slots);
+    free(publisher->ring);
+    free(publisher->out);
+}
+
+/**
+ * Start a publisher and its network thread
+ */
+int mqtt_publisher_start(MqttPublisher *publisher, const MqttConfig *config)
+{
+    if (!publisher || !config || !config->host || !config->client_id ||
+        !config->topic_prefix || config->num_groups == 0 || config->max_records == 0 ||
+        config->max_inflight == 0 || config->queue_batches == 0 ||
+        config->queue_batches > 65535 || strlen(config->client_id) > 256 ||
+        strlen(config->topic_prefix) + 12 > MQTT_TOPIC_SIZE) {
+        return -1;
+    }
+
+    memset(publisher, 0, sizeof(*publisher));
+    publisher->config = *config;
+    publisher->fd = -1;
+    publisher->slot_size = MQTT_PAYLOAD_HEADER + (size_t)config->max_records * MQTT_RECORD_MAX;
+    publisher->out_size = 4 * (publisher->slot_size + 5 + 2 + MQTT_TOPIC_SIZE + 2);
+    if (publisher->out_size < (256u << 10)) {
+        publisher->out_size = 256u << 10;
+    }
+
+    uint32_t capacity = config->queue_batches;
+    publisher->host = malloc(strlen(config->host) + 1);
+    publisher->client_id = malloc(strlen(config->client_id) + 1);
+    publisher->topics = malloc((size_t)config->num_groups * MQTT_TOPIC_SIZE);
+    publisher->groups = calloc(config->num_groups, sizeof(MqttGroup));
+    publisher->pool = malloc((size_t)capacity * publisher->slot_size);
+    publisher->slot_group = calloc(capacity, sizeof(uint32_t));
+    publisher->slot_size_used = calloc(capacity, sizeof(uint32_t));
+    publisher->slot_records = calloc(capacity, sizeof(uint32_t));
+    publisher->slot_state = calloc(capacity, 1);
+    publisher->slot_sent = calloc(capacity, 1);
+    publisher->free_slots = malloc(capacity * sizeof(uint32_t));
+    publisher->ring = malloc(capacity * sizeof(uint32_t));
+    publisher->out = malloc(publisher->out_size);
+
+    if (!publisher->host || !publisher->client_id || !publisher->topics || !publisher->groups ||
+        !publisher->pool || !publisher->slot_group || !publisher->slot_size_used ||
+        !publisher->slot_records || !publisher->slot_state || !publisher->slot_sent ||
+        !publisher->free_slots || !publisher->ring || !publisher->out) {
+        publisher_free(publisher, 0);
+        return -1;
+    }
+
+    strcpy(publisher->host, config->host);
+    strcpy(publisher->client_id, config->client_id);
+    publisher->config.host = publisher->host;
+    publisher->config.client_id = publisher->client_id;
+    for (uint32_t g = 0; g < config->num_groups; g++) {
+        snprintf(publisher->topics + (size_t)g * MQTT_TOPIC_SIZE, MQTT_TOPIC_SIZE, "%s/%u",
+                 config->topic_prefix, g);
+    }
+    publisher->config.topic_prefix = NULL;
+
+    /* Free slots are taken from the top of the stack: lowest first */
+    for (uint32_t s = 0; s < capacity; s++) {
+        publisher->free_slots[s] = capacity - 1 - s;
+    }
+    publisher->num_free = capacity;
+
+    uint32_t locks = 0;
+    while (locks < config->num_groups &&
+           pthread_mutex_init(&publisher->groups[locks].lock, NULL) == 0) {
+        publisher->groups[locks++].slot = -1;
+    }
+    if (locks < config->num_groups) {
+        publisher_free(publisher, locks);
+        return -1;
+    }
+
+    if (pthread_mutex_init(&publisher->lock, NULL) != 0) {
+        publisher_free(publisher, locks);
+        return -1;
+    }
+    if (pthread_cond_init(&publisher->drained, NULL) != 0) {
+        pthread_mutex_destroy(&publisher->lock);
+        publisher_free(publisher, locks);
+        return -1;
+    }
+    if (pipe(publisher->wake) != 0) {
+        pthread_cond_destroy(&publisher->drained);
+        pthread_mutex_destroy(&publisher->lock);
+        publisher_free(publisher, locks);
+        return -1;
+    }
+    fcntl(publisher->wake[0], F_SETFL, fcntl(publisher->wake[0], F_GETFL) | O_NONBLOCK);
+    fcntl(publisher->wake[1], F_SETFL, fcntl(publisher->wake[1], F_GETFL) | O_NONBLOCK);
+
+    if (pthread_create(&publisher->thread, NULL, publisher_main, publisher) != 0) {
+        close(publisher->wake[0]);
+        close(publisher->wake[1]);
+        pthread_cond_destroy(&publisher->drained);
+        pthread_mutex_destroy(&publisher->lock);
+        publisher_free(publisher, locks);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Seal every open batch and wait until all batches are acknowledged
+ */
+int mqtt_publisher_flush(MqttPublisher *publisher, uint32_t timeout_ms)
+{
+    if (!publisher) {
+        return 1;
+    }
+
+    seal_stale(publisher, now_ms(), 1);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    int status = 0;
+    pthread_mutex_lock(&publisher->lock);
+    while (publisher->head < publisher->tail && status == 0) {
+        if (pthread_cond_timedwait(&publisher->drained, &publisher->lock, &deadline) != 0) {
+            status = publisher->head < publisher->tail;
+        }
+    }
+    pthread_mutex_unlock(&publisher->lock);
+    return status;
+}
+
+/**
+ * Stop the network thread, disconnect and free the publisher
+ */
+void mqtt_publisher_stop(MqttPublisher *publisher)
+{
+    if (!publisher || !publisher->groups) {
+        return;
+    }
+
+    __atomic_store_n(&publisher->stop, 1, __ATOMIC_RELAXED);
+    publisher_wake(publisher);
+    pthread_join(publisher->thread, NULL);
+
+    close(publisher->wake[0]);
+    close(publisher->wake[1]);
+    pthread_cond_destroy(&publisher->drained);
+    pthread_mutex_destroy(&publisher->lock);
+    publisher_free(publisher, publisher->config.num_groups);
+    publisher->groups = NULL;
+}
+
+/**
+ * Count a received batch against its group's sequence
+ */
+static void broker_batch(MqttBroker *broker, const uint8_t *payload, size_t size)
+{
+    uint32_t group, sequence;
+    size_t records;
+
+    if (mqtt_batch_decode(payload, size, &group, &sequence, NULL, 0, &records) != 0) {
+        broker->malformed++;
+        return;
+    }
+
+    if (group >= broker->num_groups) {
+        uint32_t count = group + 1 > 2 * broker->num_groups ? group + 1 : 2 * broker->num_groups;
+        uint32_t *expected = realloc(broker->expected, count * sizeof(uint32_t));
+        if (!expected) {
+            broker->malformed++;
+            return;
+        }
+        memset(expected + broker->num_groups, 0,
+               (count - broker->num_groups) * sizeof(uint32_t));
+        broker->expected = expected;
+        broker->num_groups = count;
+    }
+
+    if (sequence < broker->expected[group]) {
+        broker->duplicates++;
+        return;
+    }
+    broker->missing += sequence - broker->expected[group];
+    broker->expected[group] = sequence + 1;
+    broker->batches++;
+    broker->records += records;
+    broker->payload_bytes += size;
+}
+
+/**
+ * Handle the complete packets in a buffer, appending replies
+ *
+ * Returns the bytes consumed, or -1 to drop the connection at once.
+ */
+static ssize_t broker_packets(MqttBroker *broker, const uint8_t *data, size_t size,
+                              uint8_t *replies, size_t *num_replies, uint64_t *publishes)
+{
+    size_t pos = 0;
+
+    while (pos < size) {
+        size_t length;
+        int header = get_fixed_header(data + pos, size - pos, &length);
+        if (header < 0 || (header > 0 && header + length > BROKER_BUFFER)) {
+            return -1;
+        }
+        if (header == 0 || size - pos < header + length) {
+            break;
+        }
+
+        const uint8_t *packet = data + pos;
+        const uint8_t *body = packet + header;
+        uint8_t *reply = replies + *num_replies;
+
+        switch (packet[0] & 0xF0) {
+        case PACKET_CONNECT:
+            memcpy(reply, "\x20\x02\x00\x00", 4);
+            *num_replies += 4;
+            break;
+        case PACKET_PUBLISH: {
+            uint32_t qos = (packet[0] >> 1) & 3u;
+            size_t topic = length >= 2 ? ((size_t)body[0] << 8 | body[1]) : 0;
+            size_t skip = 2 + topic + (qos ? 2 : 0);
+            if (length < skip) {
+                return -1;
+            }
+            broker_batch(broker, body + skip, length - skip);
+            broker->publishes++;
+            (*publishes)++;
+            if (qos == 1) {
+                reply[0] = PACKET_PUBACK;
+                reply[1] = 2;
+                reply[2] = body[2 + topic];
+                reply[3] = body[3 + topic];
+                *num_replies += 4;
+            }
+            if (broker->disconnect_every && *publishes >= broker->disconnect_every) {
+                return -1;
+            }
+            break;
+        }
+        case PACKET_PINGREQ:
+            memcpy(reply, "\xD0\x00", 2);
+            *num_replies += 2;
+            break;
+        case PACKET_DISCONNECT:
+            return -1;
+        default:
+            break;
+        }
+        pos += (size_t)header + length;
+    }
+
+    return (ssize_t)pos;
+}
+
+/**
+ * Broker thread
+ */
+static void* broker_main(void *arg)
+{
+    MqttBroker *broker = arg;
+    uint8_t *buffer = malloc(BROKER_BUFFER);
+    /* The smallest packet, a PINGREQ, has the longest reply per byte */
+    uint8_t *replies = malloc(2 * BROKER_BUFFER);
+    size_t used = 0;
+    uint64_t publishes = 0;
+    int client = -1;
+
+    while (buffer && replies && !__atomic_load_n(&broker->stop, __ATOMIC_RELAXED)) {
+        struct pollfd fds[2] = { { broker->listener, POLLIN, 0 }, { client, POLLIN, 0 } };
+        if (poll(fds, 2, 100) <= 0) {
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int accepted = accept(broker->listener, NULL, NULL);
+            if (accepted >= 0) {
+                if (client >= 0) {
+                    close(client);
+                }
+                client = accepted;
+                used = 0;
+                publishes = 0;
+                broker->connections++;
+                continue;
+            }
+        }
+        if (client < 0 || !(fds[1].revents & (POLLIN | POLLERR | POLLHUP))) {
+            continue;
+        }
+
+        ssize_t got = recv(client, buffer + used, BROKER_BUFFER - used, 0);
+        size_t num_replies = 0;
+        ssize_t consumed = got > 0 ? broker_packets(broker, buffer, used + (size_t)got,
+                                                    replies, &num_replies, &publishes) : -1;
+        if (consumed < 0) {
+            close(client);
+            client = -1;
+            continue;
+        }
+
+        used += (size_t)got - (size_t)consumed;
+        memmove(buffer, buffer + consumed, used);
+        for (size_t sent = 0; sent < num_replies;) {
+            ssize_t n = send(client, replies + sent, num_replies - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                break;
+            }
+            sent += (size_t)n;
+        }
+    }
+
+    if (client >= 0) {
+        close(client);
+    }
+    free(buffer);
+    free(replies);
+    return NULL;
+}
+
+/**
+ * Start a test broker on a loopback port
+ */
+int mqtt_broker_start(MqttBroker *broker, uint32_t disconnect_every)
+{
+    if (!broker) {
+        return -1;
+    }
+
+    memset(broker, 0, sizeof(*broker));
+    broker->disconnect_every = disconnect_every;
+    broker->listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (broker->listener < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    int one = 1;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(broker->listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    if (bind(broker->listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(broker->listener, 4) != 0 ||
+        getsockname(broker->listener, (struct sockaddr*)&address, &length) != 0 ||
+        pthread_create(&broker->thread, NULL, broker_main, broker) != 0) {
+        close(broker->listener);
+        return -1;
+    }
+
+    broker->port = ntohs(address.sin_port);
+    return 0;
+}
+
+/**
+ * Stop and free a test broker
+ */
+void mqtt_broker_stop(MqttBroker *broker)
+{
+    if (!broker || broker->listener < 0) {
+        return;
+    }
+
+    __atomic_store_n(&broker->stop, 1, __ATOMIC_RELAXED);
+    pthread_join(broker->thread, NULL);
+    close(broker->listener);
+    free(broker->expected);
+    broker->listener = -1;
+    broker->expected = NULL;
+}
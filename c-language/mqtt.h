@@ -0,0 +1,278 @@
+#ifndef MQTT_H
+#define MQTT_H
+
+#include "flowmeter.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Batched MQTT 3.1.1 publisher
+ *
+ * Results are published per meter group. A message carries a batch of
+ * results in a compact binary payload (all values little-endian):
+ *
+ *   version (u8) | group (u32) | sequence (u32) | count (u32) |
+ *   base_timestamp_ns (u64) | count x record
+ *
+ *   record: meter_id change (zigzag varint) |
+ *           timestamp_ns change (zigzag varint) | flow (f32)
+ *
+ * Changes are from the previous record, or from meter 0 and the base
+ * timestamp for the first. A record from a meter in steady operation
+ * takes 7 to 10 bytes, against about 80 for a JSON message. The flow is
+ * rounded to single precision (6e-8 relative). The sequence counts the
+ * group's batches, so a consumer can drop the duplicates that QoS 1
+ * allows.
+ *
+ * Compute threads call mqtt_publish() or mqtt_publish_flows(), which
+ * only append to the group's open batch under the group's lock. A batch
+ * is sealed when full or after linger_ms (never on time if linger_ms is
+ * 0), and queued. One network thread owns the socket. It sends queued
+ * batches as QoS 1 PUBLISH packets, with up to max_inflight
+ * unacknowledged and several packets per send(), and frees each batch on
+ * its PUBACK. It connects without blocking and reconnects
+ * with exponential backoff. After a reconnect, it resends every
+ * unacknowledged batch with the DUP flag, in order. While the link is
+ * down, sealed batches wait in a pool of queue_batches slots. When the
+ * pool is exhausted, new results are dropped and counted instead of
+ * blocking the caller.
+ */
+
+#define MQTT_PAYLOAD_VERSION 1u
+#define MQTT_PAYLOAD_HEADER 21u
+
+/* Longest encoded record */
+#define MQTT_RECORD_MAX 19u
+
+/* Room for the topic of a group */
+#define MQTT_TOPIC_SIZE 64u
+
+typedef struct {
+    const char *host;         /* Broker host name or address */
+    uint16_t port;            /* Broker port */
+    const char *client_id;    /* MQTT client identifier */
+    const char *topic_prefix; /* Topics are <topic_prefix>/<group> */
+    uint32_t num_groups;      /* Meter groups */
+    uint32_t max_records;     /* Results per batch */
+    uint32_t linger_ms;       /* Longest a result waits in an open batch; 0 never
+                                 seals on time, batches go out only when full
+                                 or on mqtt_publisher_flush() */
+    uint32_t max_inflight;    /* Unacknowledged batches on the wire */
+    uint32_t queue_batches;   /* Batch slots, open, queued and in flight */
+    uint16_t keepalive_s;     /* MQTT keep-alive in seconds */
+} MqttConfig;
+
+/* One decoded result */
+typedef struct {
+    uint64_t timestamp_ns;    /* Result time in nanoseconds */
+    uint32_t meter_id;        /* Meter ID */
+    float flow;               /* Flow rate in m³/s */
+} MqttRecord;
+
+/* A group's batch being filled */
+typedef struct {
+    pthread_mutex_t lock;     /* Held by mqtt_publish() and the sealer */
+    int32_t slot;             /* Slot being filled, -1 for none */
+    uint32_t count;           /* Records in the slot */
+    size_t size;              /* Payload bytes in the slot */
+    uint32_t last_meter;      /* Meter of the previous record */
+    uint64_t last_timestamp;  /* Timestamp of the previous record */
+    uint64_t opened_ms;       /* When the batch got its first record */
+    uint32_t sequence;        /* Batches opened so far */
+} MqttGroup;
+
+typedef struct {
+    MqttConfig config;        /* Copy of the configuration */
+    char *host;               /* Owned copy of config.host */
+    char *client_id;          /* Owned copy of config.client_id */
+    char *topics;             /* MQTT_TOPIC_SIZE bytes per group */
+    MqttGroup *groups;        /* Open batch per group */
+
+    /* Batch pool, guarded by lock */
+    pthread_mutex_t lock;
+    pthread_cond_t drained;   /* Signalled when batches are acknowledged */
+    uint8_t *pool;            /* queue_batches slots of slot_size bytes */
+    size_t slot_size;         /* Payload capacity of a slot */
+    uint32_t *slot_group;     /* Group of each slot */
+    uint32_t *slot_size_used; /* Payload size of each sealed slot */
+    uint32_t *slot_records;   /* Records of each sealed slot */
+    uint8_t *slot_state;      /* Free, open, queued, sent or acknowledged */
+    uint8_t *slot_sent;       /* Slot was sent before (DUP on resend) */
+    uint32_t *free_slots;     /* Stack of free slots */
+    uint32_t num_free;        /* Entries in free_slots */
+    uint32_t *ring;           /* Sealed slots in order */
+    uint64_t head;            /* Oldest unacknowledged entry of ring */
+    uint64_t next_send;       /* Next entry of ring to send */
+    uint64_t tail;            /* End of ring */
+
+    /* Network thread */
+    int fd;                   /* Broker connection, -1 when down */
+    int wake[2];              /* Self-pipe that wakes the network thread */
+    int woken;                /* A wake byte is pending */
+    int stop;                 /* Set to stop the thread */
+    pthread_t thread;
+    uint8_t *out;             /* Encoded packets not yet sent */
+    size_t out_size;          /* Capacity of out */
+    size_t out_start;         /* First unsent byte */
+    size_t out_end;           /* End of encoded packets */
+    uint8_t in[512];          /* Partial packet from the broker */
+    size_t in_used;           /* Bytes in in */
+
+    /* Statistics */
+    uint64_t records;         /* Results in sealed batches */
+    uint64_t dropped;         /* Results dropped with the pool exhausted */
+    uint64_t batches;         /* Batches sealed */
+    uint64_t publishes;       /* PUBLISH packets sent, resends included */
+    uint64_t acked;           /* Batches acknowledged */
+    uint64_t records_acked;   /* Results in acknowledged batches */
+    uint64_t bytes_sent;      /* Bytes written to the socket */
+    uint64_t sends;           /* send() calls */
+    uint64_t connects;        /* Successful connections */
+    uint64_t failures;        /* Failed connection attempts and lost links */
+} MqttPublisher;
+
+/**
+ * Encode the fixed part of a batch payload
+ *
+ * @param out Output buffer of MQTT_PAYLOAD_HEADER bytes
+ * @param group Meter group
+ * @param sequence Batch sequence within the group
+ * @param count Number of records
+ * @param base_timestamp_ns Timestamp the first record is relative to
+ */
+void mqtt_batch_header(uint8_t *out, uint32_t group, uint32_t sequence, uint32_t count,
+                       uint64_t base_timestamp_ns);
+
+/**
+ * Decode a batch payload
+ *
+ * @param payload Payload bytes
+ * @param size Payload size
+ * @param group Output meter group
+ * @param sequence Output batch sequence
+ * @param records Output records, or NULL to only validate and count
+ * @param max_records Capacity of records
+ * @param num_records Output number of records in the batch
+ * @return 0 on success, -1 if the payload is malformed or records is
+ *         too small
+ */
+int mqtt_batch_decode(const uint8_t *payload, size_t size, uint32_t *group,
+                      uint32_t *sequence, MqttRecord *records, size_t max_records,
+                      size_t *num_records);
+
+/**
+ * Start a publisher and its network thread
+ *
+ * Returns at once; the connection is made in the background.
+ *
+ * @param publisher Output structure, release with mqtt_publisher_stop()
+ * @param config Publisher configuration
+ * @return 0 on success, -1 on error
+ */
+int mqtt_publisher_start(MqttPublisher *publisher, const MqttConfig *config);
+
+/**
+ * Queue a result for publishing; never blocks on the network
+ *
+ * Safe to call from several threads. Calls for the same group
+ * serialize on the group's lock.
+ *
+ * @param publisher MQTT publisher
+ * @param group Meter group
+ * @param timestamp_ns Result time in nanoseconds
+ * @param meter_id Meter ID
+ * @param result Flow result (only the flow is published)
+ * @return 0 when queued, 1 when dropped because the pool is exhausted,
+ *         -1 on error
+ */
+int mqtt_publish(MqttPublisher *publisher, uint32_t group, uint64_t timestamp_ns,
+                 uint32_t meter_id, const FlowResult *result);
+
+/**
+ * Queue results of one group under a single lock
+ *
+ * Equivalent to mqtt_publish() per result, for compute threads that
+ * produce a group's results together. Results that find the pool
+ * exhausted are dropped, from the first such result on.
+ *
+ * @param publisher MQTT publisher
+ * @param group Meter group
+ * @param count Number of results
+ * @param timestamps_ns Result times in nanoseconds
+ * @param meter_ids Meter IDs
+ * @param flows Flow rates in m³/s
+ * @return Number of results queued, the first ones of the arrays
+ */
+size_t mqtt_publish_flows(MqttPublisher *publisher, uint32_t group, size_t count,
+                          const uint64_t *timestamps_ns, const uint32_t *meter_ids,
+                          const double *flows);
+
+/**
+ * Seal every open batch and wait until all batches are acknowledged
+ *
+ * @param publisher MQTT publisher
+ * @param timeout_ms Longest wait in milliseconds
+ * @return 0 when everything is acknowledged, 1 on timeout
+ */
+int mqtt_publisher_flush(MqttPublisher *publisher, uint32_t timeout_ms);
+
+/**
+ * Stop the network thread, disconnect and free the publisher
+ *
+ * Batches not yet acknowledged are discarded; call
+ * mqtt_publisher_flush() first to deliver them.
+ *
+ * @param publisher MQTT publisher
+ */
+void mqtt_publisher_stop(MqttPublisher *publisher);
+
+/*
+ * Minimal MQTT broker for tests
+ *
+ * Listens on a loopback port and serves one client at a time. A new
+ * connection replaces the current one. It acknowledges CONNECT, QoS 1
+ * PUBLISH and PINGREQ, answering all packets of a read with one write,
+ * and discards the messages after decoding them. It counts duplicate and
+ * missing batches per group from the payload sequence. With
+ * disconnect_every set, it drops the connection once that many publishes
+ * have arrived on it, without acknowledging the publishes of its last
+ * read, to exercise reconnects and resends.
+ */
+typedef struct {
+    int listener;             /* Listening socket */
+    uint16_t port;            /* Port chosen by the system */
+    uint32_t disconnect_every; /* Publishes per connection, 0 for no limit */
+    int stop;                 /* Set to stop the thread */
+    pthread_t thread;
+
+    uint32_t *expected;       /* Next sequence per group */
+    uint32_t num_groups;      /* Entries in expected */
+
+    uint64_t connections;     /* Connections accepted */
+    uint64_t publishes;       /* PUBLISH packets received */
+    uint64_t batches;         /* Batches received for the first time */
+    uint64_t duplicates;      /* Batches received again */
+    uint64_t missing;         /* Batches skipped in a group's sequence */
+    uint64_t records;         /* Results in first-time batches */
+    uint64_t payload_bytes;   /* Payload bytes of first-time batches */
+    uint64_t malformed;       /* Payloads that failed to decode */
+} MqttBroker;
+
+/**
+ * Start a test broker on a loopback port
+ *
+ * @param broker Output structure, release with mqtt_broker_stop()
+ * @param disconnect_every Publishes per connection, 0 for no limit
+ * @return 0 on success, -1 on error
+ */
+int mqtt_broker_start(MqttBroker *broker, uint32_t disconnect_every);
+
+/**
+ * Stop and free a test broker
+ *
+ * @param broker Test broker
+ */
+void mqtt_broker_stop(MqttBroker *broker);
+
+#endif /* MQTT_H */
@@ -0,0 +1,226 @@
+#include "packed.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Hash a normalized layout (FNV-1a over the coefficient bits)
+ */
+static uint64_t layout_hash(const PackedPathCoeff *coeffs, uint32_t num_paths)
+{
+    const unsigned char *bytes = (const unsigned char *)coeffs;
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (size_t i = 0; i < num_paths * sizeof(PackedPathCoeff); i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash ^ num_paths;
+}
+
+/**
+ * Hash a diameter (FNV-1a over its bits)
+ */
+static uint64_t diameter_hash(double diameter)
+{
+    const unsigned char *bytes = (const unsigned char *)&diameter;
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (size_t i = 0; i < sizeof(diameter); i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+/**
+ * Normalize one configuration's paths into diameter-independent coefficients
+ */
+static void normalize_layout(const FlowMeterConfig *config, PackedPathCoeff *out)
+{
+    for (uint32_t i = 0; i < config->num_paths; i++) {
+        const AcousticPath *path = &config->paths[i];
+        double sin_theta = sin(path->angle);
+        double scale = (sin_theta == 0) ? 0.0 :
+                       (path->length / config->pipe_diameter) / (2.0 * sin_theta);
+
+        out[i].velocity_scale = scale;
+        out[i].flow_coeff = M_PI / 4.0 * path->weight * scale;
+    }
+}
+
+/**
+ * Build a packed fleet, deduplicating identical path layouts and diameters
+ *
+ * Two passes: the first normalizes every layout into scratch space and
+ * assigns layout and diameter indices through open-addressing hash
+ * tables, the second copies the tables into one right-sized block.
+ */
+int packed_fleet_build(const FlowMeterConfig *configs, uint32_t num_configs,
+                       PackedFleet *packed)
+{
+    if (!configs || !packed || num_configs == 0) {
+        return -1;
+    }
+
+    memset(packed, 0, sizeof(*packed));
+
+    size_t total_paths = 0;
+    for (uint32_t i = 0; i < num_configs; i++) {
+        if (configs[i].num_paths == 0 || !configs[i].paths ||
+            !(configs[i].pipe_diameter > 0)) {
+            return -1;
+        }
+        total_paths += configs[i].num_paths;
+    }
+    if (total_paths > UINT32_MAX) {
+        return -1;
+    }
+
+    /* Hash table sized to a power of two at least twice the meter count */
+    size_t table_size = 16;
+    while (table_size < 2 * (size_t)num_configs) {
+        table_size *= 2;
+    }
+
+    PackedPathCoeff *scratch = malloc(total_paths * sizeof(PackedPathCoeff));
+    PackedLayout *layouts = malloc(num_configs * sizeof(PackedLayout));
+    uint32_t *meter_layout = malloc(num_configs * sizeof(uint32_t));
+    uint32_t *table = malloc(table_size * sizeof(uint32_t));
+    double *diameters = malloc(num_configs * sizeof(double));
+    uint32_t *meter_diameter = malloc(num_configs * sizeof(uint32_t));
+    uint32_t *diameter_table = malloc(table_size * sizeof(uint32_t));
+    if (!scratch || !layouts || !meter_layout || !table || !diameters || !meter_diameter ||
+        !diameter_table) {
+        free(scratch);
+        free(layouts);
+        free(meter_layout);
+        free(table);
+        free(diameters);
+        free(meter_diameter);
+        free(diameter_table);
+        return -1;
+    }
+    memset(table, 0xff, table_size * sizeof(uint32_t));
+    memset(diameter_table, 0xff, table_size * sizeof(uint32_t));
+
+    uint32_t num_layouts = 0;
+    uint32_t num_coeffs = 0;
+    uint32_t num_diameters = 0;
+
+    for (uint32_t m = 0; m < num_configs; m++) {
+        PackedPathCoeff *candidate = &scratch[num_coeffs];
+        uint32_t num_paths = configs[m].num_paths;
+
+        normalize_layout(&configs[m], candidate);
+
+        size_t slot = layout_hash(candidate, num_paths) & (table_size - 1);
+        while (table[slot] != UINT32_MAX) {
+            const PackedLayout *existing = &layouts[table[slot]];
+            if (existing->num_paths == num_paths &&
+                memcmp(&scratch[existing->first_coeff], candidate,
+                       num_paths * sizeof(PackedPathCoeff)) == 0) {
+                break;
+            }
+            slot = (slot + 1) & (table_size - 1);
+        }
+
+        if (table[slot] == UINT32_MAX) {
+            /* New layout: keep the candidate where it was written */
+            layouts[num_layouts].first_coeff = num_coeffs;
+            layouts[num_layouts].num_paths = num_paths;
+            table[slot] = num_layouts++;
+            num_coeffs += num_paths;
+        }
+        meter_layout[m] = table[slot];
+
+        double diameter = configs[m].pipe_diameter;
+        slot = diameter_hash(diameter) & (table_size - 1);
+        while (diameter_table[slot] != UINT32_MAX &&
+               memcmp(&diameters[diameter_table[slot]], &diameter, sizeof(diameter)) != 0) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (diameter_table[slot] == UINT32_MAX) {
+            diameters[num_diameters] = diameter;
+            diameter_table[slot] = num_diameters++;
+        }
+        meter_diameter[m] = diameter_table[slot];
+    }
+    free(table);
+    free(diameter_table);
+
+    /* Double tables first so every table stays naturally aligned */
+    size_t coeffs_bytes = num_coeffs * sizeof(PackedPathCoeff);
+    size_t diameters_bytes = num_diameters * sizeof(double);
+    size_t meters_bytes = num_configs * sizeof(PackedMeter);
+    size_t layouts_bytes = num_layouts * sizeof(PackedLayout);
+    size_t bytes = coeffs_bytes + diameters_bytes + meters_bytes + layouts_bytes;
+    unsigned char *block = malloc(bytes);
+    if (!block) {
+        free(scratch);
+        free(layouts);
+        free(meter_layout);
+        free(diameters);
+        free(meter_diameter);
+        return -1;
+    }
+
+    packed->coeffs = (PackedPathCoeff *)block;
+    packed->diameters = (double *)(block + coeffs_bytes);
+    packed->meters = (PackedMeter *)(block + coeffs_bytes + diameters_bytes);
+    packed->layouts = (PackedLayout *)(block + coeffs_bytes + diameters_bytes + meters_bytes);
+
+    for (uint32_t m = 0; m < num_configs; m++) {
+        packed->meters[m].diameter = meter_diameter[m];
+        packed->meters[m].layout = meter_layout[m];
+    }
+    memcpy(packed->coeffs, scratch, coeffs_bytes);
+    memcpy(packed->diameters, diameters, diameters_bytes);
+    memcpy(packed->layouts, layouts, layouts_bytes);
+
+    packed->num_meters = num_configs;
+    packed->num_layouts = num_layouts;
+    packed->num_coeffs = num_coeffs;
+    packed->num_diameters = num_diameters;
+    packed->block = block;
+    packed->bytes = bytes;
+
+    free(scratch);
+    free(layouts);
+    free(meter_layout);
+    free(diameters);
+    free(meter_diameter);
+
+    return 0;
+}
+
+/**
+ * Free a packed fleet
+ */
+void packed_fleet_free(PackedFleet *packed)
+{
+    if (packed) {
+        free(packed->block);
+        memset(packed, 0, sizeof(*packed));
+    }
+}
+
+/**
+ * Heap footprint of unpacked configurations
+ */
+size_t fleet_config_bytes(const FlowMeterConfig *configs, uint32_t num_configs)
+{
+    size_t bytes = 0;
+
+    if (!configs) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < num_configs; i++) {
+        bytes += sizeof(FlowMeterConfig) + configs[i].num_paths * sizeof(AcousticPath);
+    }
+
+    return bytes;
+}
@@ -0,0 +1,127 @@
+#ifndef PACKED_H
+#define PACKED_H
+
+#include "flowmeter.h"
+#include "fleet.h"
+#include <stddef.h>
+
+/*
+ * Packed fleet representation for very large fleets
+ *
+ * Geometry is kept only in its derived, diameter-normalized form:
+ *
+ *   velocity_i = D * velocity_scale_i * Δt_i / (t_up_i * t_down_i)
+ *   Q          = D³ * Σ flow_coeff_i * Δt_i / (t_up_i * t_down_i)
+ *
+ * which makes the path coefficients independent of pipe size, so meters
+ * sharing a path layout share one copy of it. Diameters are shared the
+ * same way, since fleets use a handful of nominal pipe sizes. Everything
+ * stays in double, so flows match calculate_flow_rate() to rounding.
+ * Meters, diameters, layouts and coefficients live in one contiguous
+ * allocation.
+ */
+
+typedef struct {
+    double velocity_scale; /* (L / D) / (2 * sin(θ)) */
+    double flow_coeff;     /* (π / 4) * w * velocity_scale */
+} PackedPathCoeff;
+
+typedef struct {
+    uint32_t first_coeff;  /* Index of the first path coefficient */
+    uint32_t num_paths;    /* Number of paths in the layout */
+} PackedLayout;
+
+typedef struct {
+    uint32_t diameter;     /* Index into the diameter table */
+    uint32_t layout;       /* Index into the layout table */
+} PackedMeter;
+
+typedef struct {
+    uint32_t num_meters;      /* Meters, in the order they were packed */
+    uint32_t num_layouts;     /* Distinct path layouts */
+    uint32_t num_coeffs;      /* Path coefficients across all layouts */
+    uint32_t num_diameters;   /* Distinct pipe diameters */
+    PackedMeter *meters;
+    PackedLayout *layouts;
+    PackedPathCoeff *coeffs;
+    double *diameters;        /* Pipe diameters in meters */
+    void *block;              /* Single allocation backing all tables */
+    size_t bytes;             /* Size of that allocation */
+} PackedFleet;
+
+/**
+ * Build a packed fleet, deduplicating identical path layouts and diameters
+ *
+ * @param configs Array of configurations
+ * @param num_configs Number of configurations
+ * @param packed Output packed fleet, release with packed_fleet_free()
+ * @return 0 on success, -1 on error
+ */
+int packed_fleet_build(const FlowMeterConfig *configs, uint32_t num_configs,
+                       PackedFleet *packed);
+
+/**
+ * Free a packed fleet
+ *
+ * @param packed Packed fleet to release
+ */
+void packed_fleet_free(PackedFleet *packed);
+
+/**
+ * Heap footprint of unpacked configurations, for comparison
+ *
+ * Counts the FlowMeterConfig structs and their AcousticPath arrays,
+ * excluding allocator overhead.
+ *
+ * @param configs Array of configurations
+ * @param num_configs Number of configurations
+ * @return Size in bytes
+ */
+size_t fleet_config_bytes(const FlowMeterConfig *configs, uint32_t num_configs);
+
+/**
+ * Calculate volumetric flow rate of one packed meter
+ *
+ * @param packed Packed fleet
+ * @param meter Index of the meter
+ * @param measurements Array of measurements (one per path)
+ * @return Volumetric flow rate in m³/s
+ */
+static inline double packed_flow_rate(const PackedFleet *packed, uint32_t meter,
+                                      const PathMeasurement *measurements)
+{
+    const PackedMeter *m = &packed->meters[meter];
+    const PackedLayout *layout = &packed->layouts[m->layout];
+    const PackedPathCoeff *coeffs = &packed->coeffs[layout->first_coeff];
+    double diameter = packed->diameters[m->diameter];
+    double sum = 0.0;
+
+    for (uint32_t i = 0; i < layout->num_paths; i++) {
+        sum += coeffs[i].flow_coeff * path_transit_term(&measurements[i]);
+    }
+
+    return diameter * diameter * diameter * sum;
+}
+
+/**
+ * Calculate velocity on one path of a packed meter
+ *
+ * @param packed Packed fleet
+ * @param meter Index of the meter
+ * @param path Index of the path within the meter
+ * @param measurement Measurement of that path
+ * @return Path velocity in m/s
+ */
+static inline double packed_path_velocity(const PackedFleet *packed, uint32_t meter,
+                                          uint32_t path,
+                                          const PathMeasurement *measurement)
+{
+    const PackedMeter *m = &packed->meters[meter];
+    const PackedLayout *layout = &packed->layouts[m->layout];
+
+    return packed->diameters[m->diameter] *
+           packed->coeffs[layout->first_coeff + path].velocity_scale *
+           path_transit_term(measurement);
+}
+
+#endif /* PACKED_H */
@@ -0,0 +1,159 @@
+#include "partial_fill.h"
+#include "conduit.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Area of a circular section below normalized height y (-1 at the
+ * invert, +1 at the crown)
+ */
+static double area_below(const ConduitShape *circle, double y)
+{
+    return conduit_area_below(circle, 0.5 * (y + 1.0) * circle->diameter);
+}
+
+/**
+ * Wetted area of a circular section
+ */
+double partial_fill_wetted_area(double diameter, double fraction)
+{
+    ConduitShape circle = { CONDUIT_CIRCLE, diameter, 0.0, 0.0, NULL, 0 };
+    return area_below(&circle, 2.0 * fraction - 1.0);
+}
+
+/**
+ * Tabulate flow coefficients over fill level
+ */
+int partial_fill_init(PartialFill *fill, const FlowMeterConfig *config,
+                      uint32_t num_levels)
+{
+    if (!fill || !config || !config->paths) {
+        return -1;
+    }
+
+    uint32_t num_paths = config->num_paths;
+    if (num_paths == 0 || num_paths > FLOWMETER_MAX_PATHS) {
+        return -1;
+    }
+
+    memset(fill, 0, sizeof(*fill));
+    fill->num_paths = num_paths;
+    fill->num_levels = num_levels ? num_levels : PARTIAL_FILL_DEFAULT_LEVELS;
+
+    size_t num_rows = (size_t)fill->num_levels + 1;
+    fill->levels = malloc(num_rows * sizeof(CompiledConfig));
+    fill->storage = malloc((num_rows + 2) * num_paths * sizeof(double));
+    if (!fill->levels || !fill->storage) {
+        partial_fill_free(fill);
+        return -1;
+    }
+
+    double *velocity_scale = fill->storage;
+    fill->heights = fill->storage + num_paths;
+    double *coeffs = fill->storage + 2 * num_paths;
+
+    /* Distinct chord heights in ascending order, and each path's rank */
+    double unique[FLOWMETER_MAX_PATHS];
+    uint32_t multiplicity[FLOWMETER_MAX_PATHS];
+    uint32_t rank[FLOWMETER_MAX_PATHS];
+    uint32_t num_unique = 0;
+
+    for (uint32_t i = 0; i < num_paths; i++) {
+        double sin_theta = sin(config->paths[i].angle);
+        velocity_scale[i] = (sin_theta == 0) ? 0.0 :
+                            config->paths[i].length / (2.0 * sin_theta);
+        fill->heights[i] = config->paths[i].position;
+
+        uint32_t u = 0;
+        while (u < num_unique && unique[u] < fill->heights[i]) {
+            u++;
+        }
+        if (u == num_unique || unique[u] != fill->heights[i]) {
+            memmove(&unique[u + 1], &unique[u], (num_unique - u) * sizeof(double));
+            memmove(&multiplicity[u + 1], &multiplicity[u], (num_unique - u) * sizeof(uint32_t));
+            unique[u] = fill->heights[i];
+            multiplicity[u] = 0;
+            num_unique++;
+        }
+        multiplicity[u]++;
+    }
+    for (uint32_t i = 0; i < num_paths; i++) {
+        uint32_t u = 0;
+        while (unique[u] != fill->heights[i]) {
+            u++;
+        }
+        rank[i] = u;
+    }
+
+    ConduitShape circle = { CONDUIT_CIRCLE, config->pipe_diameter, 0.0, 0.0, NULL, 0 };
+
+    for (size_t k = 0; k < num_rows; k++) {
+        double fraction = (double)k / (double)fill->num_levels;
+        double surface = 2.0 * fraction - 1.0;
+        double *row = &coeffs[k * num_paths];
+        double band_area[FLOWMETER_MAX_PATHS];
+        uint32_t submerged = 0;
+
+        while (submerged < num_unique && unique[submerged] < surface) {
+            submerged++;
+        }
+
+        for (uint32_t u = 0; u < submerged; u++) {
+            double lower = (u == 0) ? -1.0 : 0.5 * (unique[u - 1] + unique[u]);
+            double upper = (u + 1 == submerged) ? surface : 0.5 * (unique[u] + unique[u + 1]);
+            band_area[u] = (area_below(&circle, upper) - area_below(&circle, lower)) /
+                           (double)multiplicity[u];
+        }
+
+        for (uint32_t i = 0; i < num_paths; i++) {
+            row[i] = (rank[i] < submerged) ? band_area[rank[i]] * velocity_scale[i] : 0.0;
+        }
+
+        fill->levels[k].num_paths = num_paths;
+        fill->levels[k].area = partial_fill_wetted_area(config->pipe_diameter, fraction);
+        fill->levels[k].velocity_scale = velocity_scale;
+        fill->levels[k].flow_coeff = row;
+        fill->levels[k].storage = NULL;
+    }
+
+    return 0;
+}
+
+/**
+ * Infer the fill fraction from which paths have signal
+ */
+double partial_fill_infer(const PartialFill *fill, const PathMeasurement *measurements)
+{
+    double highest = -1.0;   /* Highest path with signal (or the invert) */
+
+    for (uint32_t i = 0; i < fill->num_paths; i++) {
+        int signal = (measurements[i].t_upstream > 0.0) & (measurements[i].t_downstream > 0.0);
+        double height = fill->heights[i];
+        highest = (signal && height > highest) ? height : highest;
+    }
+
+    double above = 1.0;      /* Next path above it (or the crown) */
+    for (uint32_t i = 0; i < fill->num_paths; i++) {
+        double height = fill->heights[i];
+        above = (height > highest && height < above) ? height : above;
+    }
+
+    double surface = (above >= 1.0 && highest > -1.0) ? 1.0 : 0.5 * (highest + above);
+    return 0.5 * (surface + 1.0);
+}
+
+/**
+ * Free memory owned by a partial fill table
+ */
+void partial_fill_free(PartialFill *fill)
+{
+    if (fill) {
+        free(fill->levels);
+        free(fill->storage);
+        fill->levels = NULL;
+        fill->storage = NULL;
+        fill->heights = NULL;
+        fill->num_paths = 0;
+    }
+}
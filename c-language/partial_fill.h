@@ -0,0 +1,127 @@
+#ifndef PARTIAL_FILL_H
+#define PARTIAL_FILL_H
+
+#include "flowmeter.h"
+#include <stdint.h>
+
+/* Fill levels tabulated when none is given */
+#define PARTIAL_FILL_DEFAULT_LEVELS 256
+
+/*
+ * Partially filled circular pipe
+ *
+ * Paths are horizontal chords; the path position is the chord height,
+ * normalized to the radius (-1 at the invert, +1 at the crown). At fill
+ * fraction f (water depth / diameter) the surface is at y_s = 2f - 1 and
+ * the paths below it are submerged. The wetted section is divided into
+ * horizontal bands, one per distinct submerged path height, with
+ * boundaries halfway between neighbouring paths and at the invert and
+ * surface. Each path's velocity stands for its band, so
+ *
+ *   Q = Σ band_area_i * v_i,   Σ band_area_i = wetted area A(f)
+ *
+ * and paths above the surface get no weight. The configuration's own
+ * quadrature weights assume a full pipe and are not used.
+ *
+ * Coefficients are tabulated for num_levels + 1 equally spaced fill
+ * levels when the meter is set up, so a frame costs a table lookup and
+ * the usual compiled_flow_rate() kernel. Below the lowest path nothing
+ * is measured and the flow is 0.
+ */
+typedef struct {
+    uint32_t num_paths;       /* Paths per frame */
+    uint32_t num_levels;      /* Table intervals; row k is fill k / num_levels */
+    CompiledConfig *levels;   /* num_levels + 1 coefficient views */
+    double *storage;          /* Owned coefficient storage */
+    double *heights;          /* Normalized chord height per path */
+} PartialFill;
+
+/**
+ * Tabulate flow coefficients over fill level
+ *
+ * @param fill Output structure, release with partial_fill_free()
+ * @param config Flow meter configuration (positions are chord heights)
+ * @param num_levels Table intervals, 0 for PARTIAL_FILL_DEFAULT_LEVELS
+ * @return 0 on success, -1 on error
+ */
+int partial_fill_init(PartialFill *fill, const FlowMeterConfig *config,
+                      uint32_t num_levels);
+
+/**
+ * Coefficients for a fill fraction, e.g. from a level sensor
+ *
+ * Rounds down: a row above the true level could include a path just
+ * above the surface, which has no signal, and lose its whole band.
+ * Conversely, within one table step above a path its band is merged
+ * into the one below, which matters only for the lowest path.
+ *
+ * @param fill Partial fill table
+ * @param fraction Water depth / diameter, clamped to [0, 1]
+ * @return Compiled configuration of the tabulated level at or below it
+ */
+static inline const CompiledConfig* partial_fill_select(const PartialFill *fill,
+                                                        double fraction)
+{
+    double clamped = (fraction > 0.0) ? ((fraction < 1.0) ? fraction : 1.0) : 0.0;
+    return &fill->levels[(uint32_t)(clamped * fill->num_levels)];
+}
+
+/**
+ * Flow at a measured fill fraction, e.g. from a level sensor
+ *
+ * Uses the row at or below the level and scales the flow by the wetted
+ * area interpolated between that row and the next, so the result does
+ * not step between tabulated levels.
+ *
+ * @param fill Partial fill table
+ * @param fraction Water depth / diameter, clamped to [0, 1]
+ * @param measurements Measurements of one frame (one per path)
+ * @return Volumetric flow in m³/s
+ */
+static inline double partial_fill_flow(const PartialFill *fill, double fraction,
+                                       const PathMeasurement *measurements)
+{
+    double clamped = (fraction > 0.0) ? ((fraction < 1.0) ? fraction : 1.0) : 0.0;
+    double position = clamped * fill->num_levels;
+    uint32_t k = (uint32_t)position;
+    const CompiledConfig *row = &fill->levels[k];
+    const CompiledConfig *next = &fill->levels[k + (k < fill->num_levels)];
+    double area = row->area + (position - (double)k) * (next->area - row->area);
+
+    return (row->area > 0.0) ?
+           compiled_flow_rate(row, measurements) * (area / row->area) : 0.0;
+}
+
+/**
+ * Infer the fill fraction from which paths have signal
+ *
+ * A path has signal when both transit times are positive. The surface is
+ * placed halfway between the highest path with signal and the next path
+ * above it, so the inferred level selects exactly the paths with signal.
+ * Signal on the top path means a full pipe (the level is 1): a flooded
+ * top path cannot tell a surface near the crown from a pressurized pipe,
+ * and full pipes are the common case.
+ *
+ * @param fill Partial fill table
+ * @param measurements Measurements of one frame (one per path)
+ * @return Estimated water depth / diameter
+ */
+double partial_fill_infer(const PartialFill *fill, const PathMeasurement *measurements);
+
+/**
+ * Wetted area of a circular section
+ *
+ * @param diameter Pipe diameter in meters
+ * @param fraction Water depth / diameter in [0, 1]
+ * @return Wetted area in m²
+ */
+double partial_fill_wetted_area(double diameter, double fraction);
+
+/**
+ * Free memory owned by a partial fill table
+ *
+ * @param fill Partial fill table
+ */
+void partial_fill_free(PartialFill *fill);
+
+#endif /* PARTIAL_FILL_H */
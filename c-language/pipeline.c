@@ -0,0 +1,384 @@
+#include "pipeline.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef void (*FusedKernel)(Pipeline *pipeline, const PathMeasurement *frames,
+                            size_t num_frames, double *flows, double *velocities);
+
+/**
+ * Whether a path's transit times lie in the validation window
+ *
+ * Written as in-range compares so a NaN time fails; the fused kernels
+ * and pipeline_run_staged() share it and agree on every frame.
+ */
+static inline int transit_in_window(const PathMeasurement *measurement,
+                                    double t_min, double t_max)
+{
+    return (measurement->t_upstream >= t_min) & (measurement->t_upstream <= t_max) &
+           (measurement->t_downstream >= t_min) & (measurement->t_downstream <= t_max);
+}
+
+/**
+ * Fused per-frame loop
+ *
+ * Always inlined into the specialized kernels below with a constant
+ * flags argument, so the compiler removes every disabled stage.
+ */
+static inline void fused_body(Pipeline *pipeline, const PathMeasurement *frames,
+                              size_t num_frames, double *flows, double *velocities,
+                              const uint32_t flags)
+{
+    const uint32_t num_paths = pipeline->num_paths;
+    const double *velocity_scale = pipeline->compiled.velocity_scale;
+    const double *flow_coeff = pipeline->compiled.flow_coeff;
+    const double *zero_offsets = pipeline->zero_offsets;
+    const double t_min = pipeline->t_min;
+    const double t_max = pipeline->t_max;
+    const double gain = pipeline->gain;
+    const double offset = pipeline->offset;
+    const double alpha = pipeline->alpha;
+
+    double last_valid_flow = pipeline->last_valid_flow;
+    double filter_state = pipeline->filter_state;
+    int filter_primed = pipeline->filter_primed;
+    uint64_t invalid_frames = 0;
+
+    TotalizerThresholds thresholds;
+    double forward = 0.0;
+    double reverse = 0.0;
+    int32_t direction = pipeline->totalizer.direction;
+    if (flags & PIPELINE_HAS_TOTALIZE) {
+        totalizer_thresholds(&pipeline->totalizer, &thresholds);
+    }
+
+    for (size_t f = 0; f < num_frames; f++) {
+        const PathMeasurement *frame = &frames[f * num_paths];
+        double flow = 0.0;
+        int valid = 1;
+
+        for (uint32_t i = 0; i < num_paths; i++) {
+            double t_up = frame[i].t_upstream;
+            double t_down = frame[i].t_downstream;
+            double delta_t = t_up - t_down;
+
+            if (flags & PIPELINE_HAS_VALIDATE) {
+                valid &= transit_in_window(&frame[i], t_min, t_max);
+            }
+            if (flags & PIPELINE_HAS_ZERO_OFFSET) {
+                delta_t -= zero_offsets[i];
+            }
+
+            int positive = (t_up > 0.0) & (t_down > 0.0);
+            double term = positive ? delta_t / (t_up * t_down) : 0.0;
+
+            if (velocities) {
+                velocities[f * num_paths + i] = velocity_scale[i] * term;
+            }
+            flow += flow_coeff[i] * term;
+        }
+
+        if (flags & PIPELINE_HAS_VALIDATE) {
+            flow = valid ? flow : last_valid_flow;
+            last_valid_flow = flow;
+            invalid_frames += !valid;
+        }
+        if (flags & PIPELINE_HAS_CALIBRATION) {
+            flow = gain * flow + offset;
+        }
+        if (flags & PIPELINE_HAS_FILTER) {
+            filter_state = filter_primed ? filter_state : flow;
+            filter_primed = 1;
+            filter_state += alpha * (flow - filter_state);
+            flow = filter_state;
+        }
+
+        flows[f] = flow;
+
+        if (flags & PIPELINE_HAS_TOTALIZE) {
+            direction = totalizer_step(&thresholds, direction, flow, &forward, &reverse);
+        }
+    }
+
+    pipeline->last_valid_flow = last_valid_flow;
+    pipeline->filter_state = filter_state;
+    pipeline->filter_primed = filter_primed;
+    pipeline->invalid_frames += invalid_frames;
+    pipeline->frames += num_frames;
+    if (flags & PIPELINE_HAS_TOTALIZE) {
+        totalizer_commit(&pipeline->totalizer, forward, reverse, direction, pipeline->dt);
+    }
+}
+
+/* One specialized kernel per combination of optional stages */
+#define FUSED_KERNEL(flags)                                                       \
+    static void fused_kernel_##flags(Pipeline *pipeline,                          \
+                                     const PathMeasurement *frames,               \
+                                     size_t num_frames, double *flows,            \
+                                     double *velocities)                          \
+    {                                                                             \
+        fused_body(pipeline, frames, num_frames, flows, velocities, flags##u);    \
+    }
+
+FUSED_KERNEL(0)  FUSED_KERNEL(1)  FUSED_KERNEL(2)  FUSED_KERNEL(3)
+FUSED_KERNEL(4)  FUSED_KERNEL(5)  FUSED_KERNEL(6)  FUSED_KERNEL(7)
+FUSED_KERNEL(8)  FUSED_KERNEL(9)  FUSED_KERNEL(10) FUSED_KERNEL(11)
+FUSED_KERNEL(12) FUSED_KERNEL(13) FUSED_KERNEL(14) FUSED_KERNEL(15)
+FUSED_KERNEL(16) FUSED_KERNEL(17) FUSED_KERNEL(18) FUSED_KERNEL(19)
+FUSED_KERNEL(20) FUSED_KERNEL(21) FUSED_KERNEL(22) FUSED_KERNEL(23)
+FUSED_KERNEL(24) FUSED_KERNEL(25) FUSED_KERNEL(26) FUSED_KERNEL(27)
+FUSED_KERNEL(28) FUSED_KERNEL(29) FUSED_KERNEL(30) FUSED_KERNEL(31)
+
+static const FusedKernel fused_kernels[32] = {
+    fused_kernel_0,  fused_kernel_1,  fused_kernel_2,  fused_kernel_3,
+    fused_kernel_4,  fused_kernel_5,  fused_kernel_6,  fused_kernel_7,
+    fused_kernel_8,  fused_kernel_9,  fused_kernel_10, fused_kernel_11,
+    fused_kernel_12, fused_kernel_13, fused_kernel_14, fused_kernel_15,
+    fused_kernel_16, fused_kernel_17, fused_kernel_18, fused_kernel_19,
+    fused_kernel_20, fused_kernel_21, fused_kernel_22, fused_kernel_23,
+    fused_kernel_24, fused_kernel_25, fused_kernel_26, fused_kernel_27,
+    fused_kernel_28, fused_kernel_29, fused_kernel_30, fused_kernel_31
+};
+
+/**
+ * Compile a stage list for one meter configuration
+ */
+int pipeline_compile(const PipelineStageSpec *stages, uint32_t num_stages,
+                     const FlowMeterConfig *config, Pipeline *pipeline)
+{
+    if (!stages || !config || !pipeline) {
+        return -1;
+    }
+
+    memset(pipeline, 0, sizeof(*pipeline));
+
+    int last_type = -1;
+    int has_velocity = 0;
+    int has_quadrature = 0;
+
+    for (uint32_t s = 0; s < num_stages; s++) {
+        const PipelineStageSpec *stage = &stages[s];
+
+        /* Stages must follow the canonical order, each at most once */
+        if ((int)stage->type <= last_type) {
+            goto fail;
+        }
+        last_type = (int)stage->type;
+
+        switch (stage->type) {
+        case PIPELINE_STAGE_VALIDATE:
+            if (!(stage->params.validate.t_min >= 0.0) ||
+                !(stage->params.validate.t_max > stage->params.validate.t_min)) {
+                goto fail;
+            }
+            pipeline->t_min = stage->params.validate.t_min;
+            pipeline->t_max = stage->params.validate.t_max;
+            pipeline->flags |= PIPELINE_HAS_VALIDATE;
+            break;
+
+        case PIPELINE_STAGE_ZERO_OFFSET:
+            if (!stage->params.zero_offset.offsets || config->num_paths == 0) {
+                goto fail;
+            }
+            pipeline->zero_offsets = malloc(config->num_paths * sizeof(double));
+            if (!pipeline->zero_offsets) {
+                goto fail;
+            }
+            memcpy(pipeline->zero_offsets, stage->params.zero_offset.offsets,
+                   config->num_paths * sizeof(double));
+            pipeline->flags |= PIPELINE_HAS_ZERO_OFFSET;
+            break;
+
+        case PIPELINE_STAGE_VELOCITY:
+            has_velocity = 1;
+            break;
+
+        case PIPELINE_STAGE_QUADRATURE:
+            has_quadrature = 1;
+            break;
+
+        case PIPELINE_STAGE_CALIBRATION:
+            pipeline->gain = stage->params.calibration.gain;
+            pipeline->offset = stage->params.calibration.offset;
+            pipeline->flags |= PIPELINE_HAS_CALIBRATION;
+            break;
+
+        case PIPELINE_STAGE_FILTER:
+            if (!(stage->params.filter.alpha > 0.0) || stage->params.filter.alpha > 1.0) {
+                goto fail;
+            }
+            pipeline->alpha = stage->params.filter.alpha;
+            pipeline->flags |= PIPELINE_HAS_FILTER;
+            break;
+
+        case PIPELINE_STAGE_TOTALIZE:
+            if (!(stage->params.totalize.dt > 0.0) ||
+                totalizer_init(&pipeline->totalizer, stage->params.totalize.deadband,
+                               stage->params.totalize.hysteresis) != 0) {
+                goto fail;
+            }
+            pipeline->dt = stage->params.totalize.dt;
+            pipeline->flags |= PIPELINE_HAS_TOTALIZE;
+            break;
+
+        default:
+            goto fail;
+        }
+    }
+
+    if (!has_velocity || !has_quadrature) {
+        goto fail;
+    }
+
+    if (flowmeter_compile(config, &pipeline->compiled) != 0) {
+        goto fail;
+    }
+    pipeline->num_paths = config->num_paths;
+
+    return 0;
+
+fail:
+    pipeline_free(pipeline);
+    return -1;
+}
+
+/**
+ * Run a batch of frames through the fused kernel
+ */
+int pipeline_run(Pipeline *pipeline, const PathMeasurement *frames,
+                 size_t num_frames, double *flows, double *velocities)
+{
+    if (!pipeline || pipeline->num_paths == 0 || (!frames && num_frames > 0) ||
+        (!flows && num_frames > 0)) {
+        return -1;
+    }
+
+    fused_kernels[pipeline->flags & 0x1fu](pipeline, frames, num_frames, flows, velocities);
+    return 0;
+}
+
+/**
+ * Run a batch one stage at a time
+ */
+int pipeline_run_staged(Pipeline *pipeline, const PathMeasurement *frames,
+                        size_t num_frames, double *flows, double *velocities)
+{
+    if (!pipeline || pipeline->num_paths == 0 || (!frames && num_frames > 0) ||
+        (!flows && num_frames > 0)) {
+        return -1;
+    }
+
+    const uint32_t num_paths = pipeline->num_paths;
+    size_t num_values = num_frames * num_paths;
+    unsigned char *valid = malloc(num_frames ? num_frames : 1);
+    double *delta_t = malloc((num_values ? num_values : 1) * sizeof(double));
+    double *path_velocities = velocities ? velocities :
+                              malloc((num_values ? num_values : 1) * sizeof(double));
+    if (!valid || !delta_t || !path_velocities) {
+        free(valid);
+        free(delta_t);
+        if (path_velocities != velocities) {
+            free(path_velocities);
+        }
+        return -1;
+    }
+
+    /* Validation */
+    for (size_t f = 0; f < num_frames; f++) {
+        valid[f] = 1;
+        if (pipeline->flags & PIPELINE_HAS_VALIDATE) {
+            for (uint32_t i = 0; i < num_paths; i++) {
+                const PathMeasurement *m = &frames[f * num_paths + i];
+                if (!transit_in_window(m, pipeline->t_min, pipeline->t_max)) {
+                    valid[f] = 0;
+                }
+            }
+        }
+    }
+
+    /* Time differences, with zero-offset removal */
+    for (size_t v = 0; v < num_values; v++) {
+        delta_t[v] = frames[v].t_upstream - frames[v].t_downstream;
+    }
+    if (pipeline->flags & PIPELINE_HAS_ZERO_OFFSET) {
+        for (size_t v = 0; v < num_values; v++) {
+            delta_t[v] -= pipeline->zero_offsets[v % num_paths];
+        }
+    }
+
+    /* Velocity */
+    for (size_t v = 0; v < num_values; v++) {
+        double t_up = frames[v].t_upstream;
+        double t_down = frames[v].t_downstream;
+        path_velocities[v] = (t_up > 0.0 && t_down > 0.0) ?
+            pipeline->compiled.velocity_scale[v % num_paths] * delta_t[v] / (t_up * t_down) :
+            0.0;
+    }
+
+    /* Quadrature */
+    for (size_t f = 0; f < num_frames; f++) {
+        double flow = 0.0;
+        for (uint32_t i = 0; i < num_paths; i++) {
+            double scale = pipeline->compiled.velocity_scale[i];
+            double weight = (scale == 0.0) ? 0.0 : pipeline->compiled.flow_coeff[i] / scale;
+            flow += weight * path_velocities[f * num_paths + i];
+        }
+        flows[f] = flow;
+    }
+
+    /* Hold the last valid flow over invalid frames */
+    if (pipeline->flags & PIPELINE_HAS_VALIDATE) {
+        for (size_t f = 0; f < num_frames; f++) {
+            if (valid[f]) {
+                pipeline->last_valid_flow = flows[f];
+            } else {
+                flows[f] = pipeline->last_valid_flow;
+                pipeline->invalid_frames++;
+            }
+        }
+    }
+
+    /* Calibration */
+    if (pipeline->flags & PIPELINE_HAS_CALIBRATION) {
+        for (size_t f = 0; f < num_frames; f++) {
+            flows[f] = pipeline->gain * flows[f] + pipeline->offset;
+        }
+    }
+
+    /* Filter */
+    if (pipeline->flags & PIPELINE_HAS_FILTER) {
+        for (size_t f = 0; f < num_frames; f++) {
+            if (!pipeline->filter_primed) {
+                pipeline->filter_state = flows[f];
+                pipeline->filter_primed = 1;
+            }
+            pipeline->filter_state += pipeline->alpha * (flows[f] - pipeline->filter_state);
+            flows[f] = pipeline->filter_state;
+        }
+    }
+
+    /* Totalization */
+    if (pipeline->flags & PIPELINE_HAS_TOTALIZE) {
+        totalizer_update_batch(&pipeline->totalizer, flows, num_frames, pipeline->dt);
+    }
+
+    pipeline->frames += num_frames;
+
+    free(valid);
+    free(delta_t);
+    if (path_velocities != velocities) {
+        free(path_velocities);
+    }
+    return 0;
+}
+
+/**
+ * Free memory owned by a pipeline
+ */
+void pipeline_free(Pipeline *pipeline)
+{
+    if (pipeline) {
+        flowmeter_compiled_free(&pipeline->compiled);
+        free(pipeline->zero_offsets);
+        memset(pipeline, 0, sizeof(*pipeline));
+    }
+}
@@ -0,0 +1,132 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "flowmeter.h"
+#include "totalizer.h"
+#include <stddef.h>
+
+/*
+ * Configurable processing pipeline
+ *
+ * A meter class is described by a list of stages taken from the set
+ * below, in this order; velocity and quadrature are required, the others
+ * optional. pipeline_compile() folds the stage parameters into per-path
+ * coefficients and selects a fused kernel: one loop over frames that runs
+ * every stage while the frame's values stay in registers. Each of the 32
+ * optional-stage combinations has its own kernel, specialized at build
+ * time, so disabled stages cost nothing.
+ *
+ *   VALIDATE     frames with a transit time outside [t_min, t_max] or
+ *                NaN are invalid; they repeat the last valid flow
+ *   ZERO_OFFSET  subtract a per-path zero-flow Δt offset
+ *   VELOCITY     v_i = L_i / (2 sin θ_i) * Δt_i / (t_up_i * t_down_i)
+ *   QUADRATURE   Q = (π D² / 4) * Σ w_i v_i
+ *   CALIBRATION  Q = gain * Q + offset
+ *   FILTER       first-order low-pass, y += alpha * (Q - y)
+ *   TOTALIZE     bidirectional totals (see totalizer.h)
+ */
+
+typedef enum {
+    PIPELINE_STAGE_VALIDATE,
+    PIPELINE_STAGE_ZERO_OFFSET,
+    PIPELINE_STAGE_VELOCITY,
+    PIPELINE_STAGE_QUADRATURE,
+    PIPELINE_STAGE_CALIBRATION,
+    PIPELINE_STAGE_FILTER,
+    PIPELINE_STAGE_TOTALIZE
+} PipelineStageType;
+
+/* Declarative description of one stage */
+typedef struct {
+    PipelineStageType type;
+    union {
+        struct {
+            double t_min;             /* Shortest plausible transit time (s) */
+            double t_max;             /* Longest plausible transit time (s) */
+        } validate;
+        struct {
+            const double *offsets;    /* Zero-flow Δt per path (s) */
+        } zero_offset;
+        struct {
+            double gain;              /* Meter factor */
+            double offset;            /* Flow offset (m³/s) */
+        } calibration;
+        struct {
+            double alpha;             /* Smoothing factor in (0, 1] */
+        } filter;
+        struct {
+            double deadband;          /* Low-flow cutoff (m³/s) */
+            double hysteresis;        /* Cutoff hysteresis (m³/s) */
+            double dt;                /* Frame interval (s) */
+        } totalize;
+    } params;
+} PipelineStageSpec;
+
+/* Flags of the optional stages present in a compiled pipeline */
+#define PIPELINE_HAS_VALIDATE     0x01u
+#define PIPELINE_HAS_ZERO_OFFSET  0x02u
+#define PIPELINE_HAS_CALIBRATION  0x04u
+#define PIPELINE_HAS_FILTER       0x08u
+#define PIPELINE_HAS_TOTALIZE     0x10u
+
+typedef struct {
+    uint32_t flags;            /* PIPELINE_HAS_* */
+    uint32_t num_paths;        /* Paths per frame */
+    CompiledConfig compiled;   /* Velocity and quadrature coefficients */
+    double *zero_offsets;      /* Owned copy of the zero offsets */
+    double t_min, t_max;       /* Validation window */
+    double gain, offset;       /* Calibration */
+    double alpha;              /* Filter factor */
+    double dt;                 /* Frame interval for totalization */
+    double filter_state;       /* Filter output of the last frame */
+    int filter_primed;         /* filter_state holds a real value */
+    double last_valid_flow;    /* Flow repeated for invalid frames */
+    FlowTotalizer totalizer;   /* Totals when TOTALIZE is present */
+    uint64_t frames;           /* Frames processed */
+    uint64_t invalid_frames;   /* Frames rejected by VALIDATE */
+} Pipeline;
+
+/**
+ * Compile a stage list for one meter configuration
+ *
+ * @param stages Stage descriptions, in pipeline order
+ * @param num_stages Number of stages
+ * @param config Meter configuration
+ * @param pipeline Output pipeline, release with pipeline_free()
+ * @return 0 on success, -1 on error (bad order, missing or duplicate
+ *         stage, invalid parameter)
+ */
+int pipeline_compile(const PipelineStageSpec *stages, uint32_t num_stages,
+                     const FlowMeterConfig *config, Pipeline *pipeline);
+
+/**
+ * Run a batch of frames through the fused kernel
+ *
+ * @param pipeline Compiled pipeline (filter, hold and totals carry over
+ *                 between calls)
+ * @param frames num_frames * num_paths measurements, frame-major
+ * @param num_frames Number of frames
+ * @param flows Output flow per frame (m³/s)
+ * @param velocities Output num_frames * num_paths path velocities, or NULL
+ * @return 0 on success, -1 on error
+ */
+int pipeline_run(Pipeline *pipeline, const PathMeasurement *frames,
+                 size_t num_frames, double *flows, double *velocities);
+
+/**
+ * Run a batch one stage at a time, each stage a full pass over the batch
+ *
+ * Reference implementation with the same results as pipeline_run()
+ * (up to rounding), kept for testing and benchmarking.
+ */
+int pipeline_run_staged(Pipeline *pipeline, const PathMeasurement *frames,
+                        size_t num_frames, double *flows, double *velocities);
+
+/**
+ * Free memory owned by a pipeline
+ *
+ * @param pipeline Pipeline to release
+ */
+void pipeline_free(Pipeline *pipeline);
+
+#endif /* PIPELINE_H */
@@ -0,0 +1,208 @@
+#include "quality.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Fill one table row with the default redistribution for a failure mask
+ */
+static void fill_default_mode(QualityFusion *fusion, uint32_t failed_mask)
+{
+    double *row = &fusion->mode_coeffs[(size_t)failed_mask * fusion->num_paths];
+    double good_weight = 0.0;
+
+    for (uint32_t i = 0; i < fusion->num_paths; i++) {
+        good_weight += (failed_mask >> i & 1u) ? 0.0 : fusion->weights[i];
+    }
+
+    double scale = (good_weight != 0.0) ? fusion->total_weight / good_weight : 0.0;
+    for (uint32_t i = 0; i < fusion->num_paths; i++) {
+        row[i] = (failed_mask >> i & 1u) ? 0.0 : fusion->compiled.flow_coeff[i] * scale;
+    }
+}
+
+/**
+ * Precompute the nominal coefficients and the degraded-mode table
+ */
+int quality_fusion_init(QualityFusion *fusion, const FlowMeterConfig *config,
+                        const QualityThresholds *thresholds)
+{
+    if (!fusion || !config || !thresholds) {
+        return -1;
+    }
+
+    if (config->num_paths == 0 || config->num_paths > FLOWMETER_MAX_PATHS) {
+        return -1;
+    }
+
+    memset(fusion, 0, sizeof(*fusion));
+    fusion->num_paths = config->num_paths;
+    fusion->thresholds = *thresholds;
+
+    if (flowmeter_compile(config, &fusion->compiled) != 0) {
+        return -1;
+    }
+
+    fusion->weights = malloc(config->num_paths * sizeof(double));
+    if (!fusion->weights) {
+        quality_fusion_free(fusion);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < config->num_paths; i++) {
+        fusion->weights[i] = config->paths[i].weight;
+        fusion->total_weight += config->paths[i].weight;
+    }
+
+    if (config->num_paths <= QUALITY_TABLE_MAX_PATHS) {
+        uint32_t num_modes = 1u << config->num_paths;
+
+        fusion->mode_coeffs = malloc((size_t)num_modes * config->num_paths * sizeof(double));
+        if (!fusion->mode_coeffs) {
+            quality_fusion_free(fusion);
+            return -1;
+        }
+
+        for (uint32_t mask = 0; mask < num_modes; mask++) {
+            fill_default_mode(fusion, mask);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Store calibrated weights for one failure mask
+ */
+int quality_fusion_set_mode(QualityFusion *fusion, uint32_t failed_mask,
+                            const double *weights)
+{
+    if (!fusion || !weights || !fusion->mode_coeffs) {
+        return -1;
+    }
+
+    if (failed_mask == 0 || failed_mask >= (1u << fusion->num_paths)) {
+        return -1;
+    }
+
+    double *row = &fusion->mode_coeffs[(size_t)failed_mask * fusion->num_paths];
+    for (uint32_t i = 0; i < fusion->num_paths; i++) {
+        /* flow_coeff = area * w * velocity_scale, so rescale by the new weight */
+        row[i] = (failed_mask >> i & 1u) ? 0.0 :
+                 fusion->compiled.area * weights[i] * fusion->compiled.velocity_scale[i];
+    }
+
+    return 0;
+}
+
+/**
+ * Screen and fuse the paths of one frame in a single pass
+ *
+ * The loop computes each path's transit term and its screening result
+ * together with compares and selects; a NaN quality value compares false
+ * and fails the path. Only the final weighting depends on the whole
+ * frame: a dot product with the table row of the failure mask (row 0
+ * holds the nominal coefficients), or for large meters the nominal sum
+ * rescaled by the good paths' weight. Neither needs a branch on whether
+ * the frame is degraded.
+ */
+static inline double fuse_frame(const QualityFusion *fusion,
+                                const QualifiedMeasurement *measurements,
+                                double *velocities, uint32_t *failed_mask)
+{
+    const QualityThresholds *limits = &fusion->thresholds;
+    const double *velocity_scale = fusion->compiled.velocity_scale;
+    const double *flow_coeff = fusion->compiled.flow_coeff;
+    double terms[FLOWMETER_MAX_PATHS];
+    uint32_t failed = 0;
+
+    for (uint32_t i = 0; i < fusion->num_paths; i++) {
+        const QualifiedMeasurement *m = &measurements[i];
+        int good = (m->times.t_upstream > 0.0) & (m->times.t_downstream > 0.0) &
+                   (m->snr_db >= limits->min_snr_db) &
+                   (m->gain_db <= limits->max_gain_db) &
+                   (m->correlation >= limits->min_correlation);
+        /* An and-mask on the bits rather than a select, which GCC turns into
+         * a branch around the division that mispredicts on failed paths, or
+         * a multiply, which lets an inf or NaN term of a failed path through */
+        double term = path_transit_term(&m->times);
+        uint64_t bits;
+        memcpy(&bits, &term, sizeof(bits));
+        bits &= -(uint64_t)good;
+        memcpy(&terms[i], &bits, sizeof(bits));
+        failed |= (uint32_t)!good << i;
+    }
+
+    if (velocities) {
+        for (uint32_t i = 0; i < fusion->num_paths; i++) {
+            velocities[i] = velocity_scale[i] * terms[i];
+        }
+    }
+
+    if (failed_mask) {
+        *failed_mask = failed;
+    }
+
+    if (fusion->mode_coeffs) {
+        const double *row = &fusion->mode_coeffs[(size_t)failed * fusion->num_paths];
+        double flow = 0.0;
+
+        for (uint32_t i = 0; i < fusion->num_paths; i++) {
+            flow += row[i] * terms[i];
+        }
+        return flow;
+    }
+
+    double nominal_flow = 0.0;
+    double good_weight = 0.0;
+    for (uint32_t i = 0; i < fusion->num_paths; i++) {
+        nominal_flow += flow_coeff[i] * terms[i];
+        good_weight += (failed >> i & 1u) ? 0.0 : fusion->weights[i];
+    }
+
+    return (good_weight != 0.0) ? nominal_flow * (fusion->total_weight / good_weight) : 0.0;
+}
+
+/**
+ * Screen and fuse the paths of one frame in a single pass
+ */
+double quality_fusion_flow(const QualityFusion *fusion,
+                           const QualifiedMeasurement *measurements,
+                           double *velocities, uint32_t *failed_mask)
+{
+    return fuse_frame(fusion, measurements, velocities, failed_mask);
+}
+
+/**
+ * Screen and fuse a batch of frames
+ */
+int quality_fusion_batch(const QualityFusion *fusion,
+                         const QualifiedMeasurement *frames, size_t num_frames,
+                         double *flows, uint32_t *failed_masks)
+{
+    if (!fusion || !frames || !flows || fusion->num_paths == 0) {
+        return -1;
+    }
+
+    uint32_t num_paths = fusion->num_paths;
+    for (size_t f = 0; f < num_frames; f++) {
+        flows[f] = fuse_frame(fusion, &frames[f * num_paths], NULL,
+                              failed_masks ? &failed_masks[f] : NULL);
+    }
+
+    return 0;
+}
+
+/**
+ * Free memory owned by a quality fusion
+ */
+void quality_fusion_free(QualityFusion *fusion)
+{
+    if (fusion) {
+        flowmeter_compiled_free(&fusion->compiled);
+        free(fusion->weights);
+        free(fusion->mode_coeffs);
+        fusion->weights = NULL;
+        fusion->mode_coeffs = NULL;
+        fusion->num_paths = 0;
+    }
+}
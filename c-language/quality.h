@@ -0,0 +1,112 @@
+#ifndef QUALITY_H
+#define QUALITY_H
+
+#include "flowmeter.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest meter with a precomputed weight table (2^n rows of n weights) */
+#define QUALITY_TABLE_MAX_PATHS 8
+
+/*
+ * Quality-weighted flow fusion
+ *
+ * Transmitters report signal quality alongside each path's transit
+ * times. A path passes screening when both transit times are positive,
+ * SNR and correlation peak are at or above their minimums and receiver
+ * gain is at or below its maximum. Failed paths get zero weight and the
+ * weight of the remaining paths is redistributed: each failure mask
+ * selects a row of flow coefficients, by default the nominal weights
+ * scaled so the good paths sum to the nominal total. Rows can be replaced
+ * with stored degraded-mode weights from calibration.
+ *
+ * Meters with more than QUALITY_TABLE_MAX_PATHS paths use the default
+ * redistribution computed per frame and cannot store degraded modes.
+ */
+
+/* Path measurement with the transmitter's quality report */
+typedef struct {
+    PathMeasurement times;  /* Upstream and downstream transit times */
+    float snr_db;           /* Signal-to-noise ratio in dB */
+    float gain_db;          /* Receiver gain in dB (high gain = weak signal) */
+    float correlation;      /* Normalized correlation peak, 0 to 1 */
+    float reserved;         /* Padding, set to 0 */
+} QualifiedMeasurement;
+
+/* Screening limits; a path must satisfy all of them */
+typedef struct {
+    float min_snr_db;       /* Lowest acceptable SNR in dB */
+    float max_gain_db;      /* Highest acceptable receiver gain in dB */
+    float min_correlation;  /* Lowest acceptable correlation peak */
+} QualityThresholds;
+
+typedef struct {
+    uint32_t num_paths;            /* Paths per frame */
+    QualityThresholds thresholds;  /* Screening limits */
+    CompiledConfig compiled;       /* Nominal coefficients (owned) */
+    double *weights;               /* Nominal quadrature weight per path */
+    double total_weight;           /* Sum of the nominal weights */
+    double *mode_coeffs;           /* Flow coefficients per failure mask,
+                                      NULL above QUALITY_TABLE_MAX_PATHS */
+} QualityFusion;
+
+/**
+ * Precompute the nominal coefficients and the degraded-mode table
+ *
+ * @param fusion Output structure, release with quality_fusion_free()
+ * @param config Flow meter configuration
+ * @param thresholds Screening limits
+ * @return 0 on success, -1 on error (including more than
+ *         FLOWMETER_MAX_PATHS paths)
+ */
+int quality_fusion_init(QualityFusion *fusion, const FlowMeterConfig *config,
+                        const QualityThresholds *thresholds);
+
+/**
+ * Store calibrated weights for one failure mask
+ *
+ * @param fusion Quality fusion
+ * @param failed_mask Paths that failed screening (bit i = path i); must
+ *                    not be 0 (all paths good uses the nominal weights)
+ * @param weights Quadrature weight per path; failed paths are ignored
+ * @return 0 on success, -1 on error or for meters without a table
+ */
+int quality_fusion_set_mode(QualityFusion *fusion, uint32_t failed_mask,
+                            const double *weights);
+
+/**
+ * Screen and fuse the paths of one frame in a single pass
+ *
+ * @param fusion Quality fusion
+ * @param measurements Measurements of one frame (one per path)
+ * @param velocities Output path velocities in m/s (0 for failed paths),
+ *                   or NULL
+ * @param failed_mask Output mask of failed paths, or NULL
+ * @return Volumetric flow in m³/s, 0 if every path failed
+ */
+double quality_fusion_flow(const QualityFusion *fusion,
+                           const QualifiedMeasurement *measurements,
+                           double *velocities, uint32_t *failed_mask);
+
+/**
+ * Screen and fuse a batch of frames
+ *
+ * @param fusion Quality fusion
+ * @param frames Frame-major measurements, num_paths per frame
+ * @param num_frames Number of frames
+ * @param flows Output array of num_frames flow rates in m³/s
+ * @param failed_masks Output array of num_frames failure masks, or NULL
+ * @return 0 on success, -1 on error
+ */
+int quality_fusion_batch(const QualityFusion *fusion,
+                         const QualifiedMeasurement *frames, size_t num_frames,
+                         double *flows, uint32_t *failed_masks);
+
+/**
+ * Free memory owned by a quality fusion
+ *
+ * @param fusion Quality fusion
+ */
+void quality_fusion_free(QualityFusion *fusion);
+
+#endif /* QUALITY_H */
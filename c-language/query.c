@@ -0,0 +1,1210 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "query.h"
+#include "dtoa.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Response buffer: room for the status line and headers and a chunk
+ * size line ahead of the data, and for the last chunk's trailer after */
+#define OUTPUT_SIZE (64u << 10)
+#define OUTPUT_HEAD 256u
+#define OUTPUT_TAIL 8u
+#define OUTPUT_DATA (OUTPUT_SIZE - OUTPUT_HEAD - OUTPUT_TAIL)
+
+/* Meters claimed per scan pool claim */
+#define SCAN_CHUNK 16u
+
+#define MAX_PARAMS 16u
+#define MAX_STATS 32u
+
+/* Idle keep-alive connections are closed after this long */
+#define IDLE_TIMEOUT_MS 30000
+#define POLL_MS 100
+
+typedef struct {
+    int fd;                     /* Destination */
+    int failed;                 /* A write failed */
+    int started;                /* Headers were written */
+    int chunked;                /* Chunked encoding; else the body ends at close */
+    int status;                 /* Error status, 0 while successful */
+    const char *message;        /* Error message */
+    size_t used;                /* Data bytes in the current chunk */
+    char buffer[OUTPUT_SIZE];
+} Output;
+
+typedef struct {
+    char text[QUERY_MAX_REQUEST + 1]; /* Decoded copy of the target */
+    const char *path;
+    const char *keys[MAX_PARAMS];
+    const char *values[MAX_PARAMS];
+    uint32_t count;
+} Request;
+
+/* Meters a query runs over */
+typedef struct {
+    const char *kind;           /* "meter" or "group" */
+    uint32_t id;                /* Meter ID or group */
+    const uint32_t *meters;     /* Meter indices */
+    uint32_t count;
+    uint32_t single;            /* Storage for a single meter */
+} Target;
+
+typedef struct {
+    const RollupFile *store;
+    const uint32_t *meters;
+    uint64_t first;             /* Finest bucket range */
+    uint64_t end;
+    uint32_t max_level;
+    RollupStats *partial;       /* Per worker, times points for series */
+    uint64_t *bins;             /* QUERY_HISTOGRAM_BINS per worker */
+    double low;                 /* Histogram edges */
+    double high;
+    uint64_t step;              /* Finest buckets per series interval */
+    uint32_t points;            /* Series intervals */
+} ScanContext;
+
+/* ---- Scan pool ---- */
+
+/**
+ * Claim and scan chunks until the posted scan is exhausted
+ */
+static void scan_chunks(QueryScanPool *pool, uint32_t worker)
+{
+    uint32_t items = pool->items;
+    uint32_t chunk = pool->chunk;
+    uint32_t begin;
+
+    while ((begin = __atomic_fetch_add(&pool->next, chunk, __ATOMIC_RELAXED)) < items) {
+        uint32_t end = items - begin < chunk ? items : begin + chunk;
+        pool->scan(pool->context, worker, begin, end);
+    }
+}
+
+/**
+ * Scan pool worker: join each posted scan
+ */
+static void *scan_worker(void *arg)
+{
+    QueryScanPool *pool = (QueryScanPool*)arg;
+    uint32_t worker = __atomic_add_fetch(&pool->registered, 1, __ATOMIC_RELAXED);
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stop && pool->generation == seen) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        seen = pool->generation;
+        pool->running++;
+        pthread_mutex_unlock(&pool->lock);
+
+        scan_chunks(pool, worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) {
+            pthread_cond_broadcast(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/**
+ * Stop and join the scan pool workers
+ */
+static void scan_pool_stop(QueryScanPool *pool)
+{
+    if (!pool->threads) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (uint32_t i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->busy);
+    free(pool->threads);
+    pool->threads = NULL;
+    pool->num_threads = 0;
+}
+
+/**
+ * Start the scan pool workers
+ */
+static int scan_pool_start(QueryScanPool *pool, uint32_t threads)
+{
+    memset(pool, 0, sizeof(*pool));
+    if (threads == 0) {
+        return 0;
+    }
+
+    pool->threads = calloc(threads, sizeof(pthread_t));
+    if (!pool->threads) {
+        return -1;
+    }
+    pthread_mutex_init(&pool->busy, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (uint32_t i = 0; i < threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, scan_worker, pool) != 0) {
+            scan_pool_stop(pool);
+            return -1;
+        }
+        pool->num_threads++;
+    }
+    return 0;
+}
+
+/**
+ * Run a scan over items meters; the caller takes part as worker 0
+ */
+static void scan_run(QueryScanPool *pool,
+                     void (*scan)(void *context, uint32_t worker, uint32_t begin, uint32_t end),
+                     void *context, uint32_t items)
+{
+    if (pool->num_threads == 0 || items <= SCAN_CHUNK) {
+        if (items > 0) {
+            scan(context, 0, 0, items);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->busy);
+    pthread_mutex_lock(&pool->lock);
+    /* A worker that woke too late for the previous scan may still be
+     * inside it, finding nothing to claim */
+    while (pool->running > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pool->scan = scan;
+    pool->context = context;
+    pool->items = items;
+    pool->chunk = SCAN_CHUNK;
+    __atomic_store_n(&pool->next, 0, __ATOMIC_RELAXED);
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    scan_chunks(pool, 0);
+
+    /* Every chunk is claimed; wait for the workers still scanning one */
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_unlock(&pool->busy);
+}
+
+/**
+ * Aggregate meters [begin, end) into the worker's partial
+ */
+static void scan_aggregate(void *arg, uint32_t worker, uint32_t begin, uint32_t end)
+{
+    ScanContext *context = (ScanContext*)arg;
+    for (uint32_t k = begin; k < end; k++) {
+        rollup_aggregate(context->store, context->meters[k], context->first, context->end,
+                         context->max_level, &context->partial[worker]);
+    }
+}
+
+/**
+ * Add meters [begin, end) to the worker's histogram
+ */
+static void scan_histogram(void *arg, uint32_t worker, uint32_t begin, uint32_t end)
+{
+    ScanContext *context = (ScanContext*)arg;
+    uint64_t *bins = context->bins + (size_t)worker * QUERY_HISTOGRAM_BINS;
+    for (uint32_t k = begin; k < end; k++) {
+        rollup_histogram(context->store, context->meters[k], context->first, context->end,
+                         context->low, context->high, bins, QUERY_HISTOGRAM_BINS);
+    }
+}
+
+/**
+ * Aggregate meters [begin, end) into the worker's series intervals
+ */
+static void scan_series(void *arg, uint32_t worker, uint32_t begin, uint32_t end)
+{
+    ScanContext *context = (ScanContext*)arg;
+    RollupStats *partial = context->partial + (size_t)worker * context->points;
+    for (uint32_t k = begin; k < end; k++) {
+        uint64_t first = context->first;
+        for (uint32_t i = 0; i < context->points; i++) {
+            uint64_t last = context->end - first < context->step ? context->end :
+                            first + context->step;
+            rollup_aggregate(context->store, context->meters[k], first, last,
+                             context->max_level, &partial[i]);
+            first = last;
+        }
+    }
+}
+
+/* ---- Response output ---- */
+
+/**
+ * Write a whole buffer to a socket or file
+ */
+static int write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == ENOTSOCK) {
+            n = write(fd, data, size);
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * Reason phrase of a status code
+ */
+static const char *status_reason(int status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 431: return "Request Header Fields Too Large";
+    default: return "Internal Server Error";
+    }
+}
+
+/**
+ * Write a complete error response with a JSON body
+ */
+static int send_error(int fd, int status, const char *message)
+{
+    char body[256];
+    char response[512];
+    int body_size = snprintf(body, sizeof(body), "{\"error\":\"%s\"}\n", message);
+    int size = snprintf(response, sizeof(response),
+                        "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\n"
+                        "Content-Length: %d\r\n\r\n%s",
+                        status, status_reason(status), body_size, body);
+    return write_all(fd, response, (size_t)size);
+}
+
+/**
+ * Reset an output for a new response
+ */
+static void output_init(Output *out, int fd, int chunked)
+{
+    out->fd = fd;
+    out->chunked = chunked;
+    out->failed = 0;
+    out->started = 0;
+    out->status = 0;
+    out->message = NULL;
+    out->used = 0;
+}
+
+/**
+ * Record an error to answer instead of the result
+ */
+static int output_error(Output *out, int status, const char *message)
+{
+    out->status = status;
+    out->message = message;
+    return -1;
+}
+
+/**
+ * Send the buffered data as one chunk, after the headers on the first
+ * call and followed by the terminating chunk on the last. Without
+ * chunked encoding (HTTP/1.0) the data is sent as is.
+ */
+static void output_flush(Output *out, int last)
+{
+    char head[OUTPUT_HEAD];
+    size_t size = 0;
+    char *data = out->buffer + OUTPUT_HEAD;
+    size_t end = out->used;
+
+    if (out->failed) {
+        return;
+    }
+    if (!out->started) {
+        size = (size_t)snprintf(head, sizeof(head),
+                                "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n%s\r\n",
+                                out->chunked ? "Transfer-Encoding: chunked\r\n" :
+                                               "Connection: close\r\n");
+        out->started = 1;
+    }
+    if (out->used > 0 && out->chunked) {
+        size += (size_t)snprintf(head + size, sizeof(head) - size, "%zx\r\n", out->used);
+        data[end++] = '\r';
+        data[end++] = '\n';
+    }
+    if (last && out->chunked) {
+        memcpy(data + end, "0\r\n\r\n", 5);
+        end += 5;
+    }
+
+    memcpy(data - size, head, size);
+    if (write_all(out->fd, data - size, size + end) != 0) {
+        out->failed = 1;
+    }
+    out->used = 0;
+}
+
+static void output_bytes(Output *out, const char *text, size_t size)
+{
+    while (size > 0) {
+        size_t room = OUTPUT_DATA - out->used;
+        if (room == 0) {
+            output_flush(out, 0);
+            room = OUTPUT_DATA;
+        }
+        size_t n = size < room ? size : room;
+        memcpy(out->buffer + OUTPUT_HEAD + out->used, text, n);
+        out->used += n;
+        text += n;
+        size -= n;
+    }
+}
+
+static void output_string(Output *out, const char *text)
+{
+    output_bytes(out, text, strlen(text));
+}
+
+static void output_u64(Output *out, uint64_t value)
+{
+    char digits[20];
+    size_t n = sizeof(digits);
+    do {
+        digits[--n] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    output_bytes(out, digits + n, sizeof(digits) - n);
+}
+
+/**
+ * Write a number, or null when it is not finite (JSON has no NaN)
+ */
+static void output_double(Output *out, double value)
+{
+    char text[DTOA_BUFFER_SIZE];
+    if (!isfinite(value)) {
+        output_string(out, "null");
+        return;
+    }
+    output_bytes(out, text, dtoa_shortest(value, text));
+}
+
+/**
+ * Write "count", "mean", "min" and "max" members of an aggregate
+ */
+static void output_stats(Output *out, const RollupStats *stats)
+{
+    int empty = stats->count == 0;
+    output_string(out, "\"count\":");
+    output_u64(out, stats->count);
+    output_string(out, ",\"mean\":");
+    output_double(out, empty ? NAN : stats->sum / (double)stats->count);
+    output_string(out, ",\"min\":");
+    output_double(out, empty ? NAN : stats->min);
+    output_string(out, ",\"max\":");
+    output_double(out, empty ? NAN : stats->max);
+}
+
+/* ---- Request parameters ---- */
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * Split a target into its path and decoded query parameters
+ */
+static int parse_target(const char *target, Request *request)
+{
+    size_t length = strlen(target);
+    if (length > QUERY_MAX_REQUEST) {
+        return -1;
+    }
+    memcpy(request->text, target, length + 1);
+    request->path = request->text;
+    request->count = 0;
+
+    char *query = strchr(request->text, '?');
+    if (!query) {
+        return 0;
+    }
+    *query++ = '\0';
+
+    while (*query) {
+        char *next = strchr(query, '&');
+        if (next) {
+            *next++ = '\0';
+        }
+        if (*query) {
+            if (request->count == MAX_PARAMS) {
+                return -1;
+            }
+            char *value = strchr(query, '=');
+            if (value) {
+                *value++ = '\0';
+            } else {
+                value = query + strlen(query);
+            }
+
+            /* Percent-decode the value in place */
+            char *to = value;
+            for (const char *from = value; *from; from++) {
+                if (*from == '%' && hex_value(from[1]) >= 0 && hex_value(from[2]) >= 0) {
+                    *to++ = (char)(hex_value(from[1]) * 16 + hex_value(from[2]));
+                    from += 2;
+                } else {
+                    *to++ = *from == '+' ? ' ' : *from;
+                }
+            }
+            *to = '\0';
+
+            request->keys[request->count] = query;
+            request->values[request->count] = value;
+            request->count++;
+        }
+        query = next ? next : query + strlen(query);
+    }
+    return 0;
+}
+
+static const char *param(const Request *request, const char *key)
+{
+    for (uint32_t i = 0; i < request->count; i++) {
+        if (strcmp(request->keys[i], key) == 0) {
+            return request->values[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Unsigned integer parameter
+ *
+ * @return 0 with *value set (fallback when absent), -1 if malformed
+ */
+static int param_u64(const Request *request, const char *key, uint64_t fallback,
+                     uint64_t *value)
+{
+    const char *text = param(request, key);
+    char *end;
+
+    *value = fallback;
+    if (!text) {
+        return 0;
+    }
+    if (*text < '0' || *text > '9') {
+        return -1;
+    }
+    errno = 0;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (*end != '\0' || errno != 0) {
+        return -1;
+    }
+    *value = (uint64_t)parsed;
+    return 0;
+}
+
+/**
+ * Resolve meter=ID or group=G to meter indices
+ */
+static int resolve_target(const QueryServer *server, const Request *request, Output *out,
+                          Target *target)
+{
+    const RollupHeader *header = server->store->header;
+    int has_meter = param(request, "meter") != NULL;
+    int has_group = param(request, "group") != NULL;
+    uint64_t id;
+
+    if (has_meter == has_group) {
+        return output_error(out, 400, "give one of meter and group");
+    }
+
+    if (has_meter) {
+        if (param_u64(request, "meter", 0, &id) != 0 || id > UINT32_MAX) {
+            return output_error(out, 400, "bad meter");
+        }
+        int64_t index = rollup_find_meter(server->store->meters, header->num_meters,
+                                          (uint32_t)id);
+        if (index < 0) {
+            return output_error(out, 404, "unknown meter");
+        }
+        target->kind = "meter";
+        target->single = (uint32_t)index;
+        target->meters = &target->single;
+        target->count = 1;
+    } else {
+        if (param_u64(request, "group", 0, &id) != 0) {
+            return output_error(out, 400, "bad group");
+        }
+        if (id >= header->num_groups) {
+            return output_error(out, 404, "unknown group");
+        }
+        target->kind = "group";
+        target->meters = server->group_meters + server->group_start[id];
+        target->count = server->group_start[id + 1] - server->group_start[id];
+    }
+    target->id = (uint32_t)id;
+    return 0;
+}
+
+/**
+ * Resolve from and to to finest buckets, and max_level
+ */
+static int resolve_range(const QueryServer *server, const Request *request, Output *out,
+                         uint64_t *first, uint64_t *end, uint32_t *max_level)
+{
+    const RollupHeader *header = server->store->header;
+    uint64_t from, to, level;
+
+    if (param_u64(request, "from", 0, &from) != 0 ||
+        param_u64(request, "to", UINT64_MAX, &to) != 0) {
+        return output_error(out, 400, "bad from or to");
+    }
+    if (param_u64(request, "max_level", header->num_levels - 1, &level) != 0 ||
+        level >= header->num_levels) {
+        return output_error(out, 400, "bad max_level");
+    }
+
+    rollup_bucket_range(server->store, from, to, first, end);
+    *max_level = (uint32_t)level;
+    return 0;
+}
+
+/**
+ * Write the common members of a target and range
+ */
+static void output_target(Output *out, const QueryServer *server, const Target *target,
+                          uint64_t first, uint64_t end)
+{
+    const RollupHeader *header = server->store->header;
+    output_string(out, "{\"");
+    output_string(out, target->kind);
+    output_string(out, "\":");
+    output_u64(out, target->id);
+    output_string(out, ",\"from\":");
+    output_u64(out, header->start_ns + first * header->width_ns[0]);
+    output_string(out, ",\"to\":");
+    output_u64(out, header->start_ns + end * header->width_ns[0]);
+}
+
+/* ---- Endpoints ---- */
+
+static int handle_info(QueryServer *server, const Request *request, Output *out)
+{
+    const RollupHeader *header = server->store->header;
+    (void)request;
+
+    output_string(out, "{\"start\":");
+    output_u64(out, header->start_ns);
+    output_string(out, ",\"end\":");
+    output_u64(out, header->start_ns + header->buckets[0] * header->width_ns[0]);
+    output_string(out, ",\"meters\":");
+    output_u64(out, header->num_meters);
+    output_string(out, ",\"groups\":");
+    output_u64(out, header->num_groups);
+    output_string(out, ",\"levels\":[");
+    for (uint32_t l = 0; l < header->num_levels; l++) {
+        output_string(out, l > 0 ? ",{\"width\":" : "{\"width\":");
+        output_u64(out, header->width_ns[l]);
+        output_string(out, ",\"buckets\":");
+        output_u64(out, header->buckets[l]);
+        output_string(out, "}");
+    }
+    output_string(out, "],\"requests\":");
+    output_u64(out, __atomic_load_n(&server->requests, __ATOMIC_RELAXED));
+    output_string(out, "}\n");
+    return 0;
+}
+
+static int handle_range(QueryServer *server, const Request *request, Output *out)
+{
+    const RollupHeader *header = server->store->header;
+    Target target;
+    uint64_t first, end, level;
+    uint32_t max_level;
+
+    if (resolve_target(server, request, out, &target) != 0 ||
+        resolve_range(server, request, out, &first, &end, &max_level) != 0) {
+        return -1;
+    }
+    if (target.count != 1) {
+        return output_error(out, 400, "range takes a meter");
+    }
+    if (param_u64(request, "level", 0, &level) != 0 || level >= header->num_levels) {
+        return output_error(out, 400, "bad level");
+    }
+
+    /* Buckets of the level whose start lies in the range */
+    uint64_t ratio = header->width_ns[level] / header->width_ns[0];
+    uint64_t a = (first + ratio - 1) / ratio;
+    uint64_t b = (end + ratio - 1) / ratio;
+    const RollupBucket *buckets = rollup_series(server->store, (uint32_t)level, target.single);
+    uint64_t t = header->start_ns + a * header->width_ns[level];
+
+    output_string(out, "[");
+    for (uint64_t i = a; i < b; i++) {
+        RollupStats stats = { buckets[i].count, buckets[i].sum, buckets[i].min,
+                              buckets[i].max };
+        output_string(out, i > a ? ",\n{\"t\":" : "{\"t\":");
+        output_u64(out, t);
+        output_string(out, ",");
+        output_stats(out, &stats);
+        output_string(out, "}");
+        t += header->width_ns[level];
+        if (out->failed) {
+            break;
+        }
+    }
+    output_string(out, "]\n");
+    return 0;
+}
+
+/**
+ * Parse a "pNN" statistic to a quantile
+ */
+static int parse_percentile(const char *name, double *q)
+{
+    char *end;
+    if (name[0] != 'p' || name[1] < '0' || name[1] > '9') {
+        return -1;
+    }
+    double percent = strtod(name + 1, &end);
+    if (*end != '\0' || percent < 0.0 || percent > 100.0) {
+        return -1;
+    }
+    *q = percent / 100.0;
+    return 0;
+}
+
+static int handle_aggregate(QueryServer *server, const Request *request, Output *out)
+{
+    static const char default_stats[] = "count,sum,min,max,mean";
+    char list[QUERY_MAX_REQUEST + 1];
+    const char *names[MAX_STATS];
+    double quantiles[MAX_STATS];
+    uint32_t num_stats = 0;
+    int want_histogram = 0;
+    Target target;
+    ScanContext context;
+    uint32_t workers = server->pool.num_threads + 1;
+
+    memset(&context, 0, sizeof(context));
+    if (resolve_target(server, request, out, &target) != 0 ||
+        resolve_range(server, request, out, &context.first, &context.end,
+                      &context.max_level) != 0) {
+        return -1;
+    }
+
+    /* Statistics to report, in the order asked for */
+    const char *stats = param(request, "stats");
+    snprintf(list, sizeof(list), "%s", stats ? stats : default_stats);
+    for (char *name = list; name; ) {
+        char *next = strchr(name, ',');
+        if (next) {
+            *next++ = '\0';
+        }
+        if (num_stats == MAX_STATS) {
+            return output_error(out, 400, "too many stats");
+        }
+        quantiles[num_stats] = -1.0;
+        if (parse_percentile(name, &quantiles[num_stats]) == 0) {
+            want_histogram = 1;
+        } else if (strcmp(name, "count") != 0 && strcmp(name, "sum") != 0 &&
+                   strcmp(name, "min") != 0 && strcmp(name, "max") != 0 &&
+                   strcmp(name, "mean") != 0) {
+            return output_error(out, 400, "unknown stat");
+        }
+        names[num_stats++] = name;
+        name = next;
+    }
+
+    context.store = server->store;
+    context.meters = target.meters;
+    context.partial = malloc(workers * sizeof(RollupStats));
+    if (!context.partial) {
+        return output_error(out, 500, "out of memory");
+    }
+    for (uint32_t w = 0; w < workers; w++) {
+        rollup_stats_init(&context.partial[w]);
+    }
+    scan_run(&server->pool, scan_aggregate, &context, target.count);
+
+    RollupStats total;
+    rollup_stats_init(&total);
+    for (uint32_t w = 0; w < workers; w++) {
+        rollup_stats_merge(&total, &context.partial[w]);
+    }
+    free(context.partial);
+
+    /* Percentiles: a histogram between the extremes found above */
+    uint64_t *bins = NULL;
+    if (want_histogram && total.count > 0) {
+        context.bins = calloc((size_t)workers * QUERY_HISTOGRAM_BINS, sizeof(uint64_t));
+        if (!context.bins) {
+            return output_error(out, 500, "out of memory");
+        }
+        context.low = total.min;
+        context.high = total.max;
+        scan_run(&server->pool, scan_histogram, &context, target.count);
+        bins = context.bins;
+        for (uint32_t w = 1; w < workers; w++) {
+            const uint64_t *other = bins + (size_t)w * QUERY_HISTOGRAM_BINS;
+            for (uint32_t i = 0; i < QUERY_HISTOGRAM_BINS; i++) {
+                bins[i] += other[i];
+            }
+        }
+    }
+
+    int empty = total.count == 0;
+    output_target(out, server, &target, context.first, context.end);
+    for (uint32_t s = 0; s < num_stats; s++) {
+        double value;
+        output_string(out, ",\"");
+        output_string(out, names[s]);
+        output_string(out, "\":");
+        if (strcmp(names[s], "count") == 0) {
+            output_u64(out, total.count);
+            continue;
+        }
+        if (quantiles[s] >= 0.0) {
+            value = bins ? rollup_quantile(bins, QUERY_HISTOGRAM_BINS, total.min, total.max,
+                                           quantiles[s]) : NAN;
+        } else if (strcmp(names[s], "sum") == 0) {
+            value = total.sum;
+        } else if (empty) {
+            value = NAN;
+        } else if (strcmp(names[s], "min") == 0) {
+            value = total.min;
+        } else if (strcmp(names[s], "max") == 0) {
+            value = total.max;
+        } else {
+            value = total.sum / (double)total.count;
+        }
+        output_double(out, value);
+    }
+    output_string(out, "}\n");
+    free(bins);
+    return 0;
+}
+
+static int handle_series(QueryServer *server, const Request *request, Output *out)
+{
+    const RollupHeader *header = server->store->header;
+    uint32_t workers = server->pool.num_threads + 1;
+    Target target;
+    ScanContext context;
+    uint64_t points;
+
+    memset(&context, 0, sizeof(context));
+    if (resolve_target(server, request, out, &target) != 0 ||
+        resolve_range(server, request, out, &context.first, &context.end,
+                      &context.max_level) != 0) {
+        return -1;
+    }
+    if (param_u64(request, "points", 100, &points) != 0 || points == 0 ||
+        points > QUERY_MAX_POINTS) {
+        return output_error(out, 400, "bad points");
+    }
+
+    /* Equal intervals of whole finest buckets, the last one shorter */
+    uint64_t span = context.end - context.first;
+    context.step = (span + points - 1) / points;
+    context.points = span == 0 ? 0 : (uint32_t)((span + context.step - 1) / context.step);
+    context.store = server->store;
+    context.meters = target.meters;
+
+    size_t size = (size_t)workers * context.points;
+    context.partial = malloc((size > 0 ? size : 1) * sizeof(RollupStats));
+    if (!context.partial) {
+        return output_error(out, 500, "out of memory");
+    }
+    for (size_t i = 0; i < size; i++) {
+        rollup_stats_init(&context.partial[i]);
+    }
+    scan_run(&server->pool, scan_series, &context, target.count);
+    for (uint32_t w = 1; w < workers; w++) {
+        const RollupStats *other = context.partial + (size_t)w * context.points;
+        for (uint32_t i = 0; i < context.points; i++) {
+            rollup_stats_merge(&context.partial[i], &other[i]);
+        }
+    }
+
+    uint64_t t = header->start_ns + context.first * header->width_ns[0];
+    uint64_t interval = context.step * header->width_ns[0];
+    output_string(out, "[");
+    for (uint32_t i = 0; i < context.points; i++) {
+        output_string(out, i > 0 ? ",\n{\"t\":" : "{\"t\":");
+        output_u64(out, t);
+        output_string(out, ",");
+        output_stats(out, &context.partial[i]);
+        output_string(out, "}");
+        t += interval;
+    }
+    output_string(out, "]\n");
+    free(context.partial);
+    return 0;
+}
+
+/**
+ * Answer one request target into an output buffer
+ */
+static int handle_request(QueryServer *server, const char *target, Output *out)
+{
+    Request *request = malloc(sizeof(Request));
+    int result;
+
+    __atomic_add_fetch(&server->requests, 1, __ATOMIC_RELAXED);
+    if (!request) {
+        result = output_error(out, 500, "out of memory");
+    } else if (parse_target(target, request) != 0) {
+        result = output_error(out, 400, "bad request target");
+    } else if (strcmp(request->path, "/info") == 0) {
+        result = handle_info(server, request, out);
+    } else if (strcmp(request->path, "/range") == 0) {
+        result = handle_range(server, request, out);
+    } else if (strcmp(request->path, "/aggregate") == 0) {
+        result = handle_aggregate(server, request, out);
+    } else if (strcmp(request->path, "/series") == 0) {
+        result = handle_series(server, request, out);
+    } else {
+        result = output_error(out, 404, "unknown path");
+    }
+    free(request);
+
+    if (result != 0) {
+        __atomic_add_fetch(&server->errors, 1, __ATOMIC_RELAXED);
+        return send_error(out->fd, out->status, out->message);
+    }
+    output_flush(out, 1);
+    return out->failed ? -1 : 0;
+}
+
+/**
+ * Answer one request target, writing a complete HTTP response
+ */
+int query_handle(QueryServer *server, const char *target, int fd)
+{
+    if (!server || !target) {
+        return -1;
+    }
+
+    Output *out = malloc(sizeof(Output));
+    if (!out) {
+        return send_error(fd, 500, "out of memory");
+    }
+    output_init(out, fd, 1);
+    int result = handle_request(server, target, out);
+    free(out);
+    return result;
+}
+
+/* ---- Connections ---- */
+
+/**
+ * Wait until a connection is readable, giving up on stop or when idle
+ */
+static int wait_readable(QueryServer *server, int fd)
+{
+    struct pollfd entry = { fd, POLLIN, 0 };
+    int waited = 0;
+
+    while (!__atomic_load_n(&server->stop, __ATOMIC_RELAXED)) {
+        int ready = poll(&entry, 1, POLL_MS);
+        if (ready > 0) {
+            return 0;
+        }
+        if (ready < 0 && errno != EINTR) {
+            return -1;
+        }
+        waited += POLL_MS;
+        if (waited >= IDLE_TIMEOUT_MS) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Whether a request asks to keep the connection open
+ */
+static int keep_alive(const char *version, const char *headers)
+{
+    int keep = strcmp(version, "HTTP/1.1") == 0;
+
+    for (const char *line = headers; line && *line; ) {
+        const char *next = strstr(line, "\r\n");
+        if (strncasecmp(line, "connection:", 11) == 0) {
+            const char *value = line + 11;
+            while (*value == ' ' || *value == '\t') {
+                value++;
+            }
+            if (strncasecmp(value, "close", 5) == 0) {
+                keep = 0;
+            } else if (strncasecmp(value, "keep-alive", 10) == 0) {
+                keep = 1;
+            }
+        }
+        line = next ? next + 2 : NULL;
+    }
+    return keep;
+}
+
+/**
+ * Serve the requests of one connection until it closes
+ */
+static void serve_connection(QueryServer *server, int fd, char *buffer, Output *out)
+{
+    size_t used = 0;
+
+    for (;;) {
+        char *end;
+        buffer[used] = '\0';
+        while (!(end = strstr(buffer, "\r\n\r\n"))) {
+            if (used == QUERY_MAX_REQUEST) {
+                send_error(fd, 431, "request too large");
+                return;
+            }
+            if (wait_readable(server, fd) != 0) {
+                return;
+            }
+            ssize_t n = recv(fd, buffer + used, QUERY_MAX_REQUEST - used, 0);
+            if (n <= 0) {
+                return;
+            }
+            used += (size_t)n;
+            buffer[used] = '\0';
+        }
+        end[2] = '\0';
+
+        /* Request line: METHOD SP target SP version CRLF */
+        char *method = buffer;
+        char *target = strchr(method, ' ');
+        char *version = target ? strchr(target + 1, ' ') : NULL;
+        char *headers = version ? strstr(version, "\r\n") : NULL;
+        if (!headers) {
+            send_error(fd, 400, "bad request line");
+            return;
+        }
+        *target++ = '\0';
+        *version++ = '\0';
+        *headers = '\0';
+        headers += 2;
+
+        int keep = keep_alive(version, headers);
+        if (strcmp(method, "GET") != 0) {
+            send_error(fd, 405, "only GET is supported");
+            return;
+        }
+        /* HTTP/1.0 clients get the body delimited by the close */
+        output_init(out, fd, strcmp(version, "HTTP/1.0") != 0);
+        if (handle_request(server, target, out) != 0 || !keep || !out->chunked) {
+            return;
+        }
+
+        /* Keep a pipelined request that arrived with this one */
+        size_t consumed = (size_t)(end + 4 - buffer);
+        memmove(buffer, buffer + consumed, used - consumed);
+        used -= consumed;
+    }
+}
+
+/**
+ * Connection thread: accept and serve one connection at a time
+ */
+static void *connection_main(void *arg)
+{
+    QueryServer *server = (QueryServer*)arg;
+    char *buffer = malloc(QUERY_MAX_REQUEST + 1);
+    Output *out = malloc(sizeof(Output));
+
+    while (buffer && out && !__atomic_load_n(&server->stop, __ATOMIC_RELAXED)) {
+        int fd = accept(server->listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        serve_connection(server, fd, buffer, out);
+        close(fd);
+    }
+
+    free(out);
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * Index the meters of each group
+ */
+static int build_group_index(QueryServer *server)
+{
+    const RollupHeader *header = server->store->header;
+    uint32_t num_groups = header->num_groups;
+
+    server->group_start = calloc((size_t)num_groups + 1, sizeof(uint32_t));
+    server->group_meters = malloc(((size_t)header->num_meters + 1) * sizeof(uint32_t));
+    if (!server->group_start || !server->group_meters) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < header->num_meters; i++) {
+        uint32_t group = server->store->meters[i].group;
+        if (group >= num_groups) {
+            return -1;
+        }
+        server->group_start[group + 1]++;
+    }
+    for (uint32_t g = 0; g < num_groups; g++) {
+        server->group_start[g + 1] += server->group_start[g];
+    }
+    for (uint32_t i = 0; i < header->num_meters; i++) {
+        uint32_t group = server->store->meters[i].group;
+        server->group_meters[server->group_start[group]++] = i;
+    }
+    /* Filling advanced each start to the next group's start; shift back */
+    for (uint32_t g = num_groups; g > 0; g--) {
+        server->group_start[g] = server->group_start[g - 1];
+    }
+    server->group_start[0] = 0;
+    return 0;
+}
+
+/**
+ * Stop the server and free its resources (the store stays open)
+ */
+void query_server_stop(QueryServer *server)
+{
+    if (!server || server->listener < 0) {
+        return;
+    }
+
+    /* Shutting the listener down wakes the threads blocked in accept() */
+    __atomic_store_n(&server->stop, 1, __ATOMIC_RELAXED);
+    shutdown(server->listener, SHUT_RDWR);
+    for (uint32_t i = 0; i < server->num_threads; i++) {
+        pthread_join(server->threads[i], NULL);
+    }
+    close(server->listener);
+    scan_pool_stop(&server->pool);
+
+    free(server->threads);
+    free(server->group_start);
+    free(server->group_meters);
+    server->listener = -1;
+    server->threads = NULL;
+    server->group_start = NULL;
+    server->group_meters = NULL;
+}
+
+/**
+ * Start serving a store
+ */
+int query_server_start(QueryServer *server, const RollupFile *store, const char *address,
+                       uint16_t port, uint32_t threads, uint32_t scan_threads)
+{
+    if (!server || !store || !store->header || threads == 0) {
+        return -1;
+    }
+
+    memset(server, 0, sizeof(*server));
+    server->store = store;
+    server->listener = -1;
+
+    struct sockaddr_in bound;
+    socklen_t length = sizeof(bound);
+    int one = 1;
+    memset(&bound, 0, sizeof(bound));
+    bound.sin_family = AF_INET;
+    bound.sin_port = htons(port);
+    if (!address) {
+        bound.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    } else if (inet_pton(AF_INET, address, &bound.sin_addr) != 1) {
+        return -1;
+    }
+
+    if (build_group_index(server) != 0 || scan_pool_start(&server->pool, scan_threads) != 0) {
+        free(server->group_start);
+        free(server->group_meters);
+        return -1;
+    }
+
+    server->listener = socket(AF_INET, SOCK_STREAM, 0);
+    server->threads = calloc(threads, sizeof(pthread_t));
+    if (server->listener >= 0) {
+        setsockopt(server->listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    if (server->listener < 0 || !server->threads ||
+        bind(server->listener, (struct sockaddr*)&bound, sizeof(bound)) != 0 ||
+        listen(server->listener, 64) != 0 ||
+        getsockname(server->listener, (struct sockaddr*)&bound, &length) != 0) {
+        if (server->listener >= 0) {
+            close(server->listener);
+        }
+        server->listener = -1;
+        scan_pool_stop(&server->pool);
+        free(server->threads);
+        free(server->group_start);
+        free(server->group_meters);
+        return -1;
+    }
+    server->port = ntohs(bound.sin_port);
+
+    for (uint32_t i = 0; i < threads; i++) {
+        if (pthread_create(&server->threads[i], NULL, connection_main, server) != 0) {
+            query_server_stop(server);
+            return -1;
+        }
+        server->num_threads++;
+    }
+    return 0;
+}
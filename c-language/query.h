@@ -0,0 +1,114 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "rollup.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * HTTP/JSON query service over a rollup store
+ *
+ * GET requests, times in nanoseconds since the epoch, [from, to)
+ * defaulting to the whole store:
+ *
+ *   /info
+ *       Levels, time span, meter and group counts.
+ *   /range?meter=ID[&from=&to=][&level=L]
+ *       The meter's buckets at level L (default 0, the finest):
+ *       [{"t":..,"count":..,"mean":..,"min":..,"max":..},...]
+ *   /aggregate?meter=ID|group=G[&from=&to=][&stats=count,sum,min,max,mean,p50,p99.9]
+ *       One object with the requested statistics (default count, sum,
+ *       min, max and mean) over every result of the meter or group.
+ *   /series?meter=ID|group=G[&from=&to=][&points=N]
+ *       The range cut into N equal intervals (default 100), each rounded
+ *       to whole finest buckets, with count, mean, min and max per
+ *       interval. A group interval covers all results of its meters.
+ *
+ * Aggregates and series combine the coarsest buckets that tile each
+ * range (see rollup.h). max_level=L limits them to levels up to L,
+ * which shows what the rollups save. Percentiles are estimated from
+ * QUERY_HISTOGRAM_BINS histogram bins between the minimum and maximum.
+ *
+ * Group queries are split across the scan pool, a chunk of meters at a
+ * time, with partial results merged at the end. The pool runs one scan
+ * at a time, and concurrent scans queue for it. Responses use chunked
+ * transfer encoding and are written while the result is produced, so a
+ * long range never needs to be held in memory. HTTP/1.1 connections are
+ * kept alive; HTTP/1.0 responses end with the connection instead. Each
+ * connection thread accepts and serves one connection at a time.
+ */
+
+#define QUERY_HISTOGRAM_BINS 4096
+#define QUERY_MAX_REQUEST 8192
+#define QUERY_MAX_POINTS 100000
+
+/* Persistent threads that run a scan over meters in chunks */
+typedef struct {
+    pthread_mutex_t busy;       /* Held by the caller running a scan */
+    pthread_mutex_t lock;       /* Guards the fields below */
+    pthread_cond_t start;       /* Signalled when a scan is posted */
+    pthread_cond_t done;        /* Signalled when a worker finishes */
+    void (*scan)(void *context, uint32_t worker, uint32_t begin, uint32_t end);
+    void *context;              /* Argument of scan */
+    uint32_t items;             /* Meters to scan */
+    uint32_t chunk;             /* Meters per claim */
+    uint32_t next;              /* Next unclaimed meter (atomic) */
+    uint32_t running;           /* Workers inside the current scan */
+    uint64_t generation;        /* Incremented per posted scan */
+    uint32_t registered;        /* Workers started; gives each its index */
+    int stop;                   /* Set to end the workers */
+    uint32_t num_threads;       /* Worker threads */
+    pthread_t *threads;
+} QueryScanPool;
+
+typedef struct {
+    const RollupFile *store;    /* Store being served */
+    int listener;               /* Listening socket */
+    uint16_t port;              /* Bound port */
+    int stop;                   /* Set to stop the connection threads */
+    uint32_t num_threads;       /* Connection threads */
+    pthread_t *threads;
+    QueryScanPool pool;         /* Parallel scans */
+
+    /* Meters of each group, as index ranges into group_meters */
+    uint32_t *group_start;      /* num_groups + 1 entries */
+    uint32_t *group_meters;     /* Meter indices ordered by group */
+
+    uint64_t requests;          /* Requests answered (atomic) */
+    uint64_t errors;            /* Requests answered with an error (atomic) */
+} QueryServer;
+
+/**
+ * Start serving a store
+ *
+ * @param server Output structure, release with query_server_stop()
+ * @param store Mapped store, kept open while the server runs
+ * @param address IPv4 address to listen on (NULL for loopback)
+ * @param port Port to listen on, 0 to let the system choose
+ * @param threads Connection threads (at least 1)
+ * @param scan_threads Extra threads for group scans (0 scans on the
+ *                     connection thread only)
+ * @return 0 on success, -1 on error
+ */
+int query_server_start(QueryServer *server, const RollupFile *store, const char *address,
+                       uint16_t port, uint32_t threads, uint32_t scan_threads);
+
+/**
+ * Answer one request target, writing a complete HTTP response
+ *
+ * @param server Query server
+ * @param target Request target, e.g. "/aggregate?meter=7"
+ * @param fd Socket or file to write the response to
+ * @return 0 on success, -1 if the response could not be written
+ */
+int query_handle(QueryServer *server, const char *target, int fd);
+
+/**
+ * Stop the server and free its resources (the store stays open)
+ *
+ * @param server Query server
+ */
+void query_server_stop(QueryServer *server);
+
+#endif /* QUERY_H */
@@ -0,0 +1,275 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "result_writer.h"
+#include "dtoa.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define RESULT_DEFAULT_BUFFER (1u << 20)
+
+/**
+ * Format an unsigned integer, two digits at a time
+ */
+static size_t format_uint64(uint64_t value, char *out)
+{
+    static const char pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char digits[20];
+    char *p = digits + sizeof(digits);
+
+    while (value >= 100) {
+        unsigned pair = (unsigned)(value % 100) * 2;
+        value /= 100;
+        *--p = pairs[pair + 1];
+        *--p = pairs[pair];
+    }
+    if (value >= 10) {
+        *--p = pairs[value * 2 + 1];
+        *--p = pairs[value * 2];
+    } else {
+        *--p = (char)('0' + value);
+    }
+
+    size_t length = (size_t)(digits + sizeof(digits) - p);
+    memcpy(out, p, length);
+    return length;
+}
+
+/**
+ * Format a double for JSON, where NaN and infinity are not allowed
+ */
+static size_t format_json_double(double value, char *out)
+{
+    if (value != value || value - value != 0.0) {
+        memcpy(out, "null", 4);
+        return 4;
+    }
+    return dtoa_shortest(value, out);
+}
+
+/**
+ * Write a byte range to the file descriptor, retrying partial writes
+ */
+static int write_all(ResultWriter *writer, const char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t written = write(writer->fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            writer->error = 1;
+            return -1;
+        }
+        data += written;
+        size -= (size_t)written;
+        writer->bytes_written += (uint64_t)written;
+    }
+    return 0;
+}
+
+/**
+ * Start writing a result stream
+ */
+int result_writer_open(ResultWriter *writer, int fd, ResultFormat format,
+                       uint32_t paths_per_record, size_t buffer_size)
+{
+    if (!writer || fd < 0 || paths_per_record > FLOWMETER_MAX_PATHS) {
+        return -1;
+    }
+
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = fd;
+    writer->format = format;
+    writer->paths_per_record = paths_per_record;
+
+    if (format == RESULT_FORMAT_BINARY) {
+        writer->record_limit = sizeof(ResultRecordHeader) +
+                               paths_per_record * sizeof(double);
+    } else {
+        /* Keys, two integers and one formatted double per value */
+        writer->record_limit = 96 + (paths_per_record + 1) * (DTOA_BUFFER_SIZE + 1);
+    }
+
+    if (buffer_size == 0) {
+        buffer_size = RESULT_DEFAULT_BUFFER;
+    }
+    if (buffer_size < 4 * writer->record_limit) {
+        buffer_size = 4 * writer->record_limit;
+    }
+
+    writer->buffer = malloc(buffer_size);
+    if (!writer->buffer) {
+        return -1;
+    }
+    writer->capacity = buffer_size;
+
+    if (format == RESULT_FORMAT_BINARY) {
+        ResultFileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, RESULT_FILE_MAGIC, sizeof(header.magic));
+        header.version = RESULT_FILE_VERSION;
+        header.paths_per_record = paths_per_record;
+        memcpy(writer->buffer, &header, sizeof(header));
+        writer->used = sizeof(header);
+    } else if (format == RESULT_FORMAT_CSV) {
+        static const char header[] = "timestamp_ns,meter,flow,velocities...\n";
+        memcpy(writer->buffer, header, sizeof(header) - 1);
+        writer->used = sizeof(header) - 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Append one result
+ */
+int result_writer_append(ResultWriter *writer, uint64_t timestamp_ns,
+                         uint32_t meter_id, const FlowResult *result,
+                         uint32_t num_paths)
+{
+    if (!writer || !writer->buffer || !result || writer->error) {
+        return -1;
+    }
+
+    if (!result->path_velocities) {
+        num_paths = 0;
+    }
+    if (num_paths > writer->paths_per_record) {
+        return -1;
+    }
+
+    if (writer->capacity - writer->used < writer->record_limit &&
+        result_writer_flush(writer) != 0) {
+        return -1;
+    }
+
+    char *start = writer->buffer + writer->used;
+    char *p = start;
+
+    switch (writer->format) {
+    case RESULT_FORMAT_JSONL:
+        memcpy(p, "{\"timestamp_ns\":", 16);
+        p += 16;
+        p += format_uint64(timestamp_ns, p);
+        memcpy(p, ",\"meter\":", 9);
+        p += 9;
+        p += format_uint64(meter_id, p);
+        memcpy(p, ",\"flow\":", 8);
+        p += 8;
+        p += format_json_double(result->volumetric_flow, p);
+        if (num_paths > 0) {
+            memcpy(p, ",\"velocities\":[", 15);
+            p += 15;
+            for (uint32_t i = 0; i < num_paths; i++) {
+                if (i > 0) {
+                    *p++ = ',';
+                }
+                p += format_json_double(result->path_velocities[i], p);
+            }
+            *p++ = ']';
+        }
+        *p++ = '}';
+        *p++ = '\n';
+        break;
+
+    case RESULT_FORMAT_CSV:
+        p += format_uint64(timestamp_ns, p);
+        *p++ = ',';
+        p += format_uint64(meter_id, p);
+        *p++ = ',';
+        p += dtoa_shortest(result->volumetric_flow, p);
+        for (uint32_t i = 0; i < num_paths; i++) {
+            *p++ = ',';
+            p += dtoa_shortest(result->path_velocities[i], p);
+        }
+        *p++ = '\n';
+        break;
+
+    case RESULT_FORMAT_BINARY: {
+        ResultRecordHeader header;
+        header.timestamp_ns = timestamp_ns;
+        header.meter_id = meter_id;
+        header.num_paths = num_paths;
+        header.volumetric_flow = result->volumetric_flow;
+        memcpy(p, &header, sizeof(header));
+        p += sizeof(header);
+
+        size_t velocity_bytes = num_paths * sizeof(double);
+        size_t slot_bytes = writer->paths_per_record * sizeof(double);
+        if (num_paths > 0) {
+            memcpy(p, result->path_velocities, velocity_bytes);
+        }
+        memset(p + velocity_bytes, 0, slot_bytes - velocity_bytes);
+        p += slot_bytes;
+        break;
+    }
+
+    default:
+        return -1;
+    }
+
+    writer->used += (size_t)(p - start);
+    writer->records++;
+
+    return 0;
+}
+
+/**
+ * Write out everything buffered so far
+ */
+int result_writer_flush(ResultWriter *writer)
+{
+    if (!writer || !writer->buffer || writer->error) {
+        return -1;
+    }
+
+    if (write_all(writer, writer->buffer, writer->used) != 0) {
+        return -1;
+    }
+    writer->used = 0;
+
+    return 0;
+}
+
+/**
+ * Flush and release the writer's buffer
+ */
+int result_writer_close(ResultWriter *writer)
+{
+    if (!writer || !writer->buffer) {
+        return -1;
+    }
+
+    int status = result_writer_flush(writer);
+    free(writer->buffer);
+    writer->buffer = NULL;
+
+    return (status == 0 && !writer->error) ? 0 : -1;
+}
+
+/**
+ * Parse a format name
+ */
+int result_format_parse(const char *name, ResultFormat *format)
+{
+    if (!name || !format) {
+        return -1;
+    }
+
+    if (strcmp(name, "jsonl") == 0) {
+        *format = RESULT_FORMAT_JSONL;
+    } else if (strcmp(name, "csv") == 0) {
+        *format = RESULT_FORMAT_CSV;
+    } else if (strcmp(name, "binary") == 0) {
+        *format = RESULT_FORMAT_BINARY;
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+#ifndef RESULT_WRITER_H
+#define RESULT_WRITER_H
+
+#include "flowmeter.h"
+#include <stddef.h>
+
+/*
+ * Buffered serializers for FlowResult streams
+ *
+ * Records are formatted straight into one large output buffer, which is
+ * written to a file descriptor only when nearly full, so there is no
+ * allocation and no system call per record. Doubles use the shortest
+ * round-trip formatting of dtoa_shortest().
+ *
+ * JSON Lines: {"timestamp_ns":..,"meter":..,"flow":..,"velocities":[..]}
+ * CSV:        timestamp_ns,meter,flow[,v1,...,vN]
+ * Binary:     ResultFileHeader, then fixed-size records of a
+ *             ResultRecordHeader followed by paths_per_record doubles
+ *             (unused slots zero), in native byte order
+ *
+ * Path velocities are omitted when FlowResult.path_velocities is NULL.
+ */
+
+typedef enum {
+    RESULT_FORMAT_JSONL,
+    RESULT_FORMAT_CSV,
+    RESULT_FORMAT_BINARY
+} ResultFormat;
+
+#define RESULT_FILE_MAGIC "FMRES\0\0\0"
+#define RESULT_FILE_VERSION 1u
+
+typedef struct {
+    char magic[8];              /* RESULT_FILE_MAGIC */
+    uint32_t version;           /* RESULT_FILE_VERSION */
+    uint32_t paths_per_record;  /* Velocity slots in every record */
+} ResultFileHeader;
+
+typedef struct {
+    uint64_t timestamp_ns;      /* Frame timestamp in nanoseconds */
+    uint32_t meter_id;          /* Meter ID */
+    uint32_t num_paths;         /* Valid velocity slots (0 if omitted) */
+    double volumetric_flow;     /* Flow rate in m³/s */
+} ResultRecordHeader;
+
+typedef struct {
+    int fd;                     /* Destination file descriptor */
+    ResultFormat format;        /* Output format */
+    uint32_t paths_per_record;  /* Maximum velocities per record */
+    char *buffer;               /* Output buffer */
+    size_t capacity;            /* Buffer size in bytes */
+    size_t used;                /* Bytes pending in the buffer */
+    size_t record_limit;        /* Worst-case size of one record */
+    uint64_t records;           /* Records appended */
+    uint64_t bytes_written;     /* Bytes written to fd */
+    int error;                  /* Sticky write error */
+} ResultWriter;
+
+/**
+ * Start writing a result stream
+ *
+ * Binary streams get their file header immediately; CSV streams a
+ * header row.
+ *
+ * @param writer Writer to initialize
+ * @param fd Destination file descriptor (not closed by the writer)
+ * @param format Output format
+ * @param paths_per_record Maximum path velocities per record
+ *                         (<= FLOWMETER_MAX_PATHS)
+ * @param buffer_size Output buffer size in bytes, 0 for the default (1 MiB)
+ * @return 0 on success, -1 on error
+ */
+int result_writer_open(ResultWriter *writer, int fd, ResultFormat format,
+                       uint32_t paths_per_record, size_t buffer_size);
+
+/**
+ * Append one result
+ *
+ * @param writer Writer
+ * @param timestamp_ns Frame timestamp in nanoseconds
+ * @param meter_id Meter ID
+ * @param result Flow result
+ * @param num_paths Number of path velocities in the result
+ * @return 0 on success, -1 on error
+ */
+int result_writer_append(ResultWriter *writer, uint64_t timestamp_ns,
+                         uint32_t meter_id, const FlowResult *result,
+                         uint32_t num_paths);
+
+/**
+ * Write out everything buffered so far
+ *
+ * @param writer Writer
+ * @return 0 on success, -1 on error
+ */
+int result_writer_flush(ResultWriter *writer);
+
+/**
+ * Flush and release the writer's buffer
+ *
+ * @param writer Writer
+ * @return 0 on success, -1 if any write failed
+ */
+int result_writer_close(ResultWriter *writer);
+
+/**
+ * Parse a format name ("jsonl", "csv" or "binary")
+ *
+ * @param name Format name
+ * @param format Output format
+ * @return 0 on success, -1 if the name is unknown
+ */
+int result_format_parse(const char *name, ResultFormat *format);
+
+#endif /* RESULT_WRITER_H */
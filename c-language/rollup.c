@@ -0,0 +1,441 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "rollup.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ROLLUP_ALIGN 64u
+
+static uint64_t align_up(uint64_t value)
+{
+    return (value + ROLLUP_ALIGN - 1) & ~(uint64_t)(ROLLUP_ALIGN - 1);
+}
+
+/**
+ * Quotient rounded up, without overflow
+ */
+static inline uint64_t ceil_div(uint64_t value, uint64_t divisor)
+{
+    return value / divisor + (value % divisor != 0);
+}
+
+/**
+ * Add an aggregate to a bucket
+ */
+static inline void bucket_add(RollupBucket *bucket, uint64_t count, double sum, double min,
+                              double max)
+{
+    if (bucket->count == 0) {
+        bucket->min = (float)min;
+        bucket->max = (float)max;
+    } else {
+        bucket->min = (float)min < bucket->min ? (float)min : bucket->min;
+        bucket->max = (float)max > bucket->max ? (float)max : bucket->max;
+    }
+    bucket->count += count;
+    bucket->sum += sum;
+}
+
+/**
+ * Create a store with empty buckets covering [start_ns, end_ns)
+ */
+int rollup_writer_open(RollupWriter *writer, const char *filename, const RollupMeter *meters,
+                       uint32_t num_meters, uint64_t start_ns, uint64_t end_ns,
+                       const uint64_t *width_ns, uint32_t num_levels)
+{
+    if (!writer || !filename || (!meters && num_meters > 0) || end_ns <= start_ns ||
+        !width_ns || num_levels == 0 || num_levels > ROLLUP_MAX_LEVELS || width_ns[0] == 0) {
+        return -1;
+    }
+
+    RollupHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ROLLUP_MAGIC, sizeof(header.magic));
+    header.version = ROLLUP_VERSION;
+    header.num_meters = num_meters;
+    header.num_levels = num_levels;
+    header.start_ns = start_ns;
+
+    for (uint32_t m = 0; m < num_meters; m++) {
+        if ((m > 0 && meters[m].meter_id <= meters[m - 1].meter_id) ||
+            meters[m].group == UINT32_MAX) {
+            return -1;
+        }
+        if (meters[m].group >= header.num_groups) {
+            header.num_groups = meters[m].group + 1;
+        }
+    }
+
+    /* Whole coarsest buckets, so every coarse bucket has all its children */
+    uint64_t coarsest = width_ns[num_levels - 1];
+    uint64_t span = ceil_div(end_ns - start_ns, coarsest) * coarsest;
+    uint64_t offset = align_up(sizeof(RollupHeader));
+    header.meters_offset = offset;
+    offset = align_up(offset + (uint64_t)num_meters * sizeof(RollupMeter));
+
+    for (uint32_t l = 0; l < num_levels; l++) {
+        if (l > 0 && (width_ns[l] <= width_ns[l - 1] || width_ns[l] % width_ns[l - 1] != 0)) {
+            return -1;
+        }
+        header.width_ns[l] = width_ns[l];
+        header.buckets[l] = span / width_ns[l];
+        header.level_offset[l] = offset;
+        offset = align_up(offset + (uint64_t)num_meters * header.buckets[l] *
+                                   sizeof(RollupBucket));
+    }
+    header.file_size = offset;
+
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    if (ftruncate(fd, (off_t)header.file_size) != 0) {
+        close(fd);
+        unlink(filename);
+        return -1;
+    }
+
+    void *base = mmap(NULL, (size_t)header.file_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        unlink(filename);
+        return -1;
+    }
+
+    unsigned char *bytes = base;
+    memset(writer, 0, sizeof(*writer));
+    writer->base = base;
+    writer->size = (size_t)header.file_size;
+    writer->header = base;
+    writer->meters = (RollupMeter *)(bytes + header.meters_offset);
+    writer->finest = (RollupBucket *)(bytes + header.level_offset[0]);
+
+    /* The file is zero-filled: every bucket starts empty */
+    memcpy(writer->meters, meters, (size_t)num_meters * sizeof(RollupMeter));
+    memcpy(writer->header, &header, sizeof(header));
+    return 0;
+}
+
+/**
+ * Finest bucket of a result, NULL if outside the grid
+ */
+static RollupBucket *writer_bucket(RollupWriter *writer, uint32_t meter_index,
+                                   uint64_t timestamp_ns)
+{
+    const RollupHeader *header = writer->header;
+    if (timestamp_ns < header->start_ns) {
+        return NULL;
+    }
+
+    uint64_t index = (timestamp_ns - header->start_ns) / header->width_ns[0];
+    if (index >= header->buckets[0]) {
+        return NULL;
+    }
+    return writer->finest + (size_t)meter_index * header->buckets[0] + index;
+}
+
+/**
+ * Add one result to its finest bucket
+ */
+int rollup_writer_add(RollupWriter *writer, uint32_t meter_index, uint64_t timestamp_ns,
+                      double flow)
+{
+    if (!writer || !writer->base || meter_index >= writer->header->num_meters) {
+        return -1;
+    }
+
+    /* One NaN would poison the bucket and every coarser one above it */
+    RollupBucket *bucket = writer_bucket(writer, meter_index, timestamp_ns);
+    if (!bucket || !isfinite(flow)) {
+        writer->rejected++;
+        return 1;
+    }
+
+    bucket_add(bucket, 1, flow, flow, flow);
+    return 0;
+}
+
+/**
+ * Add an aggregate of results to the finest bucket containing a time
+ */
+int rollup_writer_add_stats(RollupWriter *writer, uint32_t meter_index, uint64_t timestamp_ns,
+                            const RollupStats *stats)
+{
+    if (!writer || !writer->base || !stats || meter_index >= writer->header->num_meters) {
+        return -1;
+    }
+    if (stats->count == 0) {
+        return 0;
+    }
+
+    RollupBucket *bucket = writer_bucket(writer, meter_index, timestamp_ns);
+    if (!bucket || !isfinite(stats->sum) || !isfinite(stats->min) || !isfinite(stats->max)) {
+        writer->rejected += stats->count;
+        return 1;
+    }
+
+    bucket_add(bucket, stats->count, stats->sum, stats->min, stats->max);
+    return 0;
+}
+
+/**
+ * Compute the coarser levels from the finest and close the store
+ */
+int rollup_writer_close(RollupWriter *writer)
+{
+    if (!writer || !writer->base) {
+        return -1;
+    }
+
+    const RollupHeader *header = writer->header;
+    unsigned char *bytes = writer->base;
+
+    for (uint32_t l = 1; l < header->num_levels; l++) {
+        const RollupBucket *fine = (const RollupBucket *)(bytes + header->level_offset[l - 1]);
+        RollupBucket *coarse = (RollupBucket *)(bytes + header->level_offset[l]);
+        uint64_t ratio = header->width_ns[l] / header->width_ns[l - 1];
+
+        for (uint64_t c = 0; c < (uint64_t)header->num_meters * header->buckets[l]; c++) {
+            for (uint64_t f = c * ratio; f < (c + 1) * ratio; f++) {
+                if (fine[f].count > 0) {
+                    bucket_add(&coarse[c], fine[f].count, fine[f].sum, fine[f].min,
+                               fine[f].max);
+                }
+            }
+        }
+    }
+
+    int status = munmap(writer->base, writer->size) == 0 ? 0 : -1;
+    writer->base = NULL;
+    return status;
+}
+
+/**
+ * Map a store and validate its header and section bounds
+ */
+int rollup_open(const char *filename, RollupFile *file)
+{
+    if (!filename || !file) {
+        return -1;
+    }
+
+    memset(file, 0, sizeof(*file));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(RollupHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)info.st_size;
+    void *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+
+    const RollupHeader *header = base;
+    int valid = memcmp(header->magic, ROLLUP_MAGIC, sizeof(header->magic)) == 0 &&
+                header->version == ROLLUP_VERSION &&
+                header->file_size == size &&
+                header->num_levels >= 1 && header->num_levels <= ROLLUP_MAX_LEVELS &&
+                header->width_ns[0] > 0 &&
+                header->meters_offset % ROLLUP_ALIGN == 0 &&
+                header->meters_offset <= size &&
+                header->num_meters <= (size - header->meters_offset) / sizeof(RollupMeter);
+    for (uint32_t l = 0; valid && l < header->num_levels; l++) {
+        uint64_t offset = header->level_offset[l];
+        valid = offset % ROLLUP_ALIGN == 0 && offset <= size &&
+                (l == 0 || (header->width_ns[l] > header->width_ns[l - 1] &&
+                            header->width_ns[l] % header->width_ns[l - 1] == 0 &&
+                            header->buckets[l] * (header->width_ns[l] / header->width_ns[l - 1])
+                                == header->buckets[l - 1])) &&
+                (header->num_meters == 0 ||
+                 header->buckets[l] <= (size - offset) / sizeof(RollupBucket) /
+                                       header->num_meters);
+    }
+    if (!valid) {
+        munmap(base, size);
+        return -1;
+    }
+
+    const unsigned char *bytes = base;
+    file->base = base;
+    file->size = size;
+    file->header = header;
+    file->meters = (const RollupMeter *)(bytes + header->meters_offset);
+    for (uint32_t l = 0; l < header->num_levels; l++) {
+        file->levels[l] = (const RollupBucket *)(bytes + header->level_offset[l]);
+    }
+
+    return 0;
+}
+
+/**
+ * Unmap a store
+ */
+void rollup_close(RollupFile *file)
+{
+    if (file && file->base) {
+        munmap(file->base, file->size);
+        memset(file, 0, sizeof(*file));
+    }
+}
+
+/**
+ * Find a meter in a sorted meter table (binary search)
+ */
+int64_t rollup_find_meter(const RollupMeter *meters, uint32_t num_meters, uint32_t meter_id)
+{
+    uint32_t low = 0, high = num_meters;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (meters[middle].meter_id < meter_id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return (low < num_meters && meters[low].meter_id == meter_id) ? (int64_t)low : -1;
+}
+
+/**
+ * Finest-level bucket range of a time range
+ */
+void rollup_bucket_range(const RollupFile *file, uint64_t from_ns, uint64_t to_ns,
+                         uint64_t *first, uint64_t *end)
+{
+    const RollupHeader *header = file->header;
+    uint64_t width = header->width_ns[0];
+    uint64_t limit = header->buckets[0];
+
+    /* Buckets whose start lies in [from, to); the rounding up cannot
+     * overflow, as to_ns is often UINT64_MAX */
+    uint64_t a = from_ns <= header->start_ns ? 0 : ceil_div(from_ns - header->start_ns, width);
+    uint64_t b = to_ns <= header->start_ns ? 0 : ceil_div(to_ns - header->start_ns, width);
+    a = a < limit ? a : limit;
+    b = b < limit ? b : limit;
+    *first = a;
+    *end = b > a ? b : a;
+}
+
+/**
+ * Aggregate a run of buckets of one level
+ */
+static void aggregate_buckets(const RollupBucket *buckets, uint64_t first, uint64_t end,
+                              RollupStats *stats)
+{
+    uint64_t count = 0;
+    double sum = 0.0;
+    float min = INFINITY, max = -INFINITY;
+
+    for (uint64_t i = first; i < end; i++) {
+        /* Empty buckets have a zero count and sum; skip only their extremes */
+        count += buckets[i].count;
+        sum += buckets[i].sum;
+        if (buckets[i].count > 0) {
+            min = buckets[i].min < min ? buckets[i].min : min;
+            max = buckets[i].max > max ? buckets[i].max : max;
+        }
+    }
+
+    RollupStats part = { count, sum, min, max };
+    rollup_stats_merge(stats, &part);
+}
+
+/**
+ * Aggregate a meter over finest buckets [first, end) using levels up to
+ * level, coarse buckets in the middle and finer ones at the edges
+ */
+static void aggregate_level(const RollupFile *file, uint32_t meter_index, uint64_t first,
+                            uint64_t end, uint32_t level, RollupStats *stats)
+{
+    const RollupHeader *header = file->header;
+
+    while (level > 0) {
+        uint64_t ratio = header->width_ns[level] / header->width_ns[0];
+        uint64_t a = (first + ratio - 1) / ratio;
+        uint64_t b = end / ratio;
+        if (a < b) {
+            aggregate_level(file, meter_index, first, a * ratio, level - 1, stats);
+            aggregate_buckets(rollup_series(file, level, meter_index), a, b, stats);
+            first = b * ratio;
+        }
+        level--;
+    }
+
+    aggregate_buckets(rollup_series(file, 0, meter_index), first, end, stats);
+}
+
+/**
+ * Aggregate a meter over a range of finest buckets
+ */
+void rollup_aggregate(const RollupFile *file, uint32_t meter_index, uint64_t first,
+                      uint64_t end, uint32_t max_level, RollupStats *stats)
+{
+    uint32_t level = file->header->num_levels - 1;
+    if (max_level < level) {
+        level = max_level;
+    }
+    if (first < end) {
+        aggregate_level(file, meter_index, first, end, level, stats);
+    }
+}
+
+/**
+ * Add a meter's finest bucket means over a range to a histogram
+ */
+void rollup_histogram(const RollupFile *file, uint32_t meter_index, uint64_t first,
+                      uint64_t end, double low, double high, uint64_t *bins, uint32_t num_bins)
+{
+    const RollupBucket *buckets = rollup_series(file, 0, meter_index);
+    double scale = high > low ? (double)num_bins / (high - low) : 0.0;
+    double last = (double)(num_bins - 1);
+
+    for (uint64_t i = first; i < end; i++) {
+        if (buckets[i].count == 0) {
+            continue;
+        }
+        /* Written so a NaN mean lands in the first bin rather than in an
+         * undefined conversion */
+        double position = (buckets[i].sum / buckets[i].count - low) * scale;
+        position = !(position >= 0.0) ? 0.0 : position > last ? last : position;
+        bins[(uint32_t)position] += buckets[i].count;
+    }
+}
+
+/**
+ * Quantile of a histogram, interpolated linearly within its bin
+ */
+double rollup_quantile(const uint64_t *bins, uint32_t num_bins, double low, double high,
+                       double q)
+{
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < num_bins; i++) {
+        total += bins[i];
+    }
+    if (total == 0) {
+        return NAN;
+    }
+
+    double target = q * (double)total;
+    double width = (high - low) / num_bins;
+    double below = 0.0;
+    for (uint32_t i = 0; i < num_bins; i++) {
+        if (bins[i] > 0 && below + (double)bins[i] >= target) {
+            return low + width * (i + (target - below) / (double)bins[i]);
+        }
+        below += (double)bins[i];
+    }
+    return high;
+}
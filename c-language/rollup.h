@@ -0,0 +1,267 @@
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Rollup store of flow results
+ *
+ * Flow results are kept per meter on fixed time grids of buckets, at up
+ * to ROLLUP_MAX_LEVELS resolutions (for example minute, hour and day).
+ * Each level's bucket width is a whole multiple of the previous one,
+ * and every grid starts at start_ns. A bucket holds the count, sum,
+ * minimum and maximum of the results that fall in it.
+ *
+ * A range is resolved to finest-level buckets: a bucket belongs to
+ * [from, to) when its start does. Aggregates over a range combine the
+ * fewest buckets that tile it, coarse buckets in the middle and finer
+ * ones at the edges. A year of hourly data per meter thus takes about
+ * 365 day buckets and a few dozen hour buckets. Percentiles are
+ * estimated from a histogram of the finest buckets' means, weighted by
+ * their counts, so they describe finest-interval averages rather than
+ * single results.
+ *
+ * File layout (native byte order, sections 64-byte aligned):
+ *   RollupHeader
+ *   RollupMeter[num_meters], sorted by meter ID
+ *   per level: RollupBucket[num_meters * buckets[level]], meter-major,
+ *              so each meter's series is contiguous
+ */
+
+#define ROLLUP_MAGIC "FMROLL\0\0"
+#define ROLLUP_VERSION 2u
+#define ROLLUP_MAX_LEVELS 4
+
+typedef struct {
+    char magic[8];                          /* ROLLUP_MAGIC */
+    uint32_t version;                       /* ROLLUP_VERSION */
+    uint32_t num_meters;                    /* Entries in the meter table */
+    uint32_t num_levels;                    /* Resolutions, finest first */
+    uint32_t num_groups;                    /* One more than the largest group */
+    uint64_t file_size;                     /* Total file size in bytes */
+    uint64_t start_ns;                      /* Start of the first bucket of every level */
+    uint64_t width_ns[ROLLUP_MAX_LEVELS];   /* Bucket width per level */
+    uint64_t buckets[ROLLUP_MAX_LEVELS];    /* Buckets per meter per level */
+    uint64_t level_offset[ROLLUP_MAX_LEVELS];
+    uint64_t meters_offset;                 /* Offset of the meter table */
+} RollupHeader;
+
+typedef struct {
+    uint32_t meter_id;          /* Meter ID */
+    uint32_t group;             /* Meter group */
+} RollupMeter;
+
+typedef struct {
+    double sum;                 /* Sum of flows in m³/s */
+    float min;                  /* Smallest flow */
+    float max;                  /* Largest flow */
+    uint64_t count;             /* Results in the bucket, 0 if empty */
+} RollupBucket;
+
+/* Aggregate of buckets */
+typedef struct {
+    uint64_t count;             /* Results */
+    double sum;                 /* Sum of flows */
+    double min;                 /* Smallest flow (INFINITY if empty) */
+    double max;                 /* Largest flow (-INFINITY if empty) */
+} RollupStats;
+
+/* A mapped store; all pointers reference the mapping */
+typedef struct {
+    void *base;                                   /* Start of the mapping */
+    size_t size;                                  /* Mapping size in bytes */
+    const RollupHeader *header;
+    const RollupMeter *meters;                    /* Meter table */
+    const RollupBucket *levels[ROLLUP_MAX_LEVELS]; /* First bucket of each level */
+} RollupFile;
+
+/* Writer filling the finest level of a new store in a shared mapping */
+typedef struct {
+    void *base;                 /* Start of the mapping */
+    size_t size;                /* Mapping size in bytes */
+    RollupHeader *header;
+    RollupMeter *meters;        /* Meter table */
+    RollupBucket *finest;       /* Finest level */
+    uint64_t rejected;          /* Results outside the grid or not finite */
+} RollupWriter;
+
+/**
+ * Empty aggregate
+ *
+ * @param stats Aggregate to clear
+ */
+static inline void rollup_stats_init(RollupStats *stats)
+{
+    stats->count = 0;
+    stats->sum = 0.0;
+    stats->min = INFINITY;
+    stats->max = -INFINITY;
+}
+
+/**
+ * Add one aggregate into another
+ *
+ * @param stats Accumulated aggregate
+ * @param other Aggregate to add
+ */
+static inline void rollup_stats_merge(RollupStats *stats, const RollupStats *other)
+{
+    stats->count += other->count;
+    stats->sum += other->sum;
+    stats->min = other->min < stats->min ? other->min : stats->min;
+    stats->max = other->max > stats->max ? other->max : stats->max;
+}
+
+/**
+ * Create a store with empty buckets covering [start_ns, end_ns)
+ *
+ * @param writer Writer to initialize
+ * @param filename Output file path (truncated)
+ * @param meters Meters and their groups, sorted by meter ID with unique IDs
+ * @param num_meters Number of meters
+ * @param start_ns Start of the grid
+ * @param end_ns End of the grid (rounded up to whole coarsest buckets)
+ * @param width_ns Bucket width per level, finest first, each a multiple
+ *                 of the previous
+ * @param num_levels Number of levels (1 to ROLLUP_MAX_LEVELS)
+ * @return 0 on success, -1 on error
+ */
+int rollup_writer_open(RollupWriter *writer, const char *filename, const RollupMeter *meters,
+                       uint32_t num_meters, uint64_t start_ns, uint64_t end_ns,
+                       const uint64_t *width_ns, uint32_t num_levels);
+
+/**
+ * Add one result to its finest bucket
+ *
+ * @param writer Writer
+ * @param meter_index Index of the meter in the sorted table
+ * @param timestamp_ns Result time in nanoseconds
+ * @param flow Flow rate in m³/s
+ * @return 0 on success, 1 if outside the grid or not finite (counted in
+ *         rejected), -1 on error
+ */
+int rollup_writer_add(RollupWriter *writer, uint32_t meter_index, uint64_t timestamp_ns,
+                      double flow);
+
+/**
+ * Add an aggregate of results to the finest bucket containing a time
+ *
+ * For importing data that was aggregated elsewhere.
+ *
+ * @param writer Writer
+ * @param meter_index Index of the meter in the sorted table
+ * @param timestamp_ns Any time within the bucket
+ * @param stats Aggregate to add (ignored if empty)
+ * @return 0 on success, 1 if outside the grid or not finite (counted in
+ *         rejected), -1 on error
+ */
+int rollup_writer_add_stats(RollupWriter *writer, uint32_t meter_index, uint64_t timestamp_ns,
+                            const RollupStats *stats);
+
+/**
+ * Compute the coarser levels from the finest and close the store
+ *
+ * @param writer Writer
+ * @return 0 on success, -1 on error
+ */
+int rollup_writer_close(RollupWriter *writer);
+
+/**
+ * Map a store and validate its header and section bounds
+ *
+ * @param filename Store file path
+ * @param file Output mapping, release with rollup_close()
+ * @return 0 on success, -1 on error
+ */
+int rollup_open(const char *filename, RollupFile *file);
+
+/**
+ * Unmap a store
+ *
+ * @param file Store to release
+ */
+void rollup_close(RollupFile *file);
+
+/**
+ * Find a meter in a sorted meter table (binary search)
+ *
+ * @param meters Meter table
+ * @param num_meters Entries in the table
+ * @param meter_id Meter ID to look up
+ * @return Index of the meter, -1 if not found
+ */
+int64_t rollup_find_meter(const RollupMeter *meters, uint32_t num_meters, uint32_t meter_id);
+
+/**
+ * Finest-level bucket range of a time range
+ *
+ * @param file Mapped store
+ * @param from_ns Start of the range
+ * @param to_ns End of the range (exclusive)
+ * @param first Output first bucket
+ * @param end Output end bucket (exclusive, equal to first if empty)
+ */
+void rollup_bucket_range(const RollupFile *file, uint64_t from_ns, uint64_t to_ns,
+                         uint64_t *first, uint64_t *end);
+
+/**
+ * Buckets of one meter at one level
+ *
+ * @param file Mapped store
+ * @param level Level index
+ * @param meter_index Index of the meter
+ * @return The meter's header->buckets[level] buckets
+ */
+static inline const RollupBucket *rollup_series(const RollupFile *file, uint32_t level,
+                                                uint32_t meter_index)
+{
+    return file->levels[level] + (size_t)meter_index * file->header->buckets[level];
+}
+
+/**
+ * Aggregate a meter over a range of finest buckets
+ *
+ * @param file Mapped store
+ * @param meter_index Index of the meter
+ * @param first First finest bucket
+ * @param end End finest bucket (exclusive)
+ * @param max_level Coarsest level to use (0 scans the finest buckets only)
+ * @param stats Aggregate to add the range into
+ */
+void rollup_aggregate(const RollupFile *file, uint32_t meter_index, uint64_t first,
+                      uint64_t end, uint32_t max_level, RollupStats *stats);
+
+/**
+ * Add a meter's finest bucket means over a range to a histogram
+ *
+ * Each bucket adds its count to the bin of its mean. Means outside
+ * [low, high] go to the end bins.
+ *
+ * @param file Mapped store
+ * @param meter_index Index of the meter
+ * @param first First finest bucket
+ * @param end End finest bucket (exclusive)
+ * @param low Lower edge of the first bin
+ * @param high Upper edge of the last bin
+ * @param bins Histogram counts to add to
+ * @param num_bins Number of bins
+ */
+void rollup_histogram(const RollupFile *file, uint32_t meter_index, uint64_t first,
+                      uint64_t end, double low, double high, uint64_t *bins, uint32_t num_bins);
+
+/**
+ * Quantile of a histogram, interpolated linearly within its bin
+ *
+ * @param bins Histogram counts
+ * @param num_bins Number of bins
+ * @param low Lower edge of the first bin
+ * @param high Upper edge of the last bin
+ * @param q Quantile (0 to 1)
+ * @return Estimated value, NAN if the histogram is empty
+ */
+double rollup_quantile(const uint64_t *bins, uint32_t num_bins, double low, double high,
+                       double q);
+
+#endif /* ROLLUP_H */
@@ -0,0 +1,162 @@
+#include "sequence.h"
+#include <string.h>
+
+/**
+ * Initialize a tracker with no frames seen
+ */
+int sequence_tracker_init(SequenceTracker *tracker, uint32_t max_fill)
+{
+    if (!tracker || max_fill >= SEQUENCE_WINDOW) {
+        return -1;
+    }
+
+    memset(tracker, 0, sizeof(*tracker));
+    tracker->max_fill = max_fill;
+    return 0;
+}
+
+/**
+ * Age the window by shift numbers (bits move towards higher ages)
+ */
+static void window_shift(uint64_t *seen, uint64_t shift)
+{
+    if (shift >= SEQUENCE_WINDOW) {
+        memset(seen, 0, SEQUENCE_WINDOW_WORDS * sizeof(uint64_t));
+        return;
+    }
+
+    unsigned words = (unsigned)(shift / 64);
+    unsigned bits = (unsigned)(shift % 64);
+
+    for (int w = SEQUENCE_WINDOW_WORDS - 1; w >= 0; w--) {
+        int from = w - (int)words;
+        uint64_t word = from >= 0 ? seen[from] << bits : 0;
+        if (bits && from >= 1) {
+            word |= seen[from - 1] >> (64 - bits);
+        }
+        seen[w] = word;
+    }
+}
+
+/**
+ * Mark ages first..last (inclusive, within the window) as seen
+ */
+static void window_mark(uint64_t *seen, uint64_t first, uint64_t last)
+{
+    for (uint64_t age = first; age <= last;) {
+        unsigned w = (unsigned)(age / 64);
+        unsigned low = (unsigned)(age % 64);
+        unsigned high = (last / 64 == w) ? (unsigned)(last % 64) : 63;
+        uint64_t mask = (high == 63 ? ~(uint64_t)0 : (((uint64_t)1 << (high + 1)) - 1)) &
+                        ~(((uint64_t)1 << low) - 1);
+        seen[w] |= mask;
+        age = (uint64_t)w * 64 + high + 1;
+    }
+}
+
+/**
+ * Check and record a sequence number
+ */
+int sequence_tracker_check(SequenceTracker *tracker, uint64_t sequence, uint64_t *gap)
+{
+    *gap = 0;
+
+    if (!tracker->started) {
+        tracker->started = 1;
+        tracker->highest = sequence;
+        tracker->seen[0] = 1;
+        tracker->accepted++;
+        return SEQUENCE_ACCEPTED;
+    }
+
+    if (sequence <= tracker->highest) {
+        uint64_t age = tracker->highest - sequence;
+        if (age >= SEQUENCE_WINDOW) {
+            tracker->stale++;
+            return SEQUENCE_STALE;
+        }
+
+        uint64_t bit = (uint64_t)1 << (age % 64);
+        uint64_t *word = &tracker->seen[age / 64];
+        if (*word & bit) {
+            tracker->duplicates++;
+            return SEQUENCE_DUPLICATE;
+        }
+
+        /* Filled holes are marked, so this frame is from an open gap (or
+         * from before the first frame) */
+        *word |= bit;
+        tracker->accepted++;
+        tracker->late++;
+        tracker->missing -= tracker->missing > 0;
+        return SEQUENCE_LATE;
+    }
+
+    uint64_t shift = sequence - tracker->highest;
+    window_shift(tracker->seen, shift);
+    tracker->seen[0] |= 1;
+    tracker->highest = sequence;
+    tracker->accepted++;
+    *gap = shift - 1;
+
+    if (shift == 1) {
+        return SEQUENCE_ACCEPTED;
+    }
+    if (*gap <= tracker->max_fill) {
+        window_mark(tracker->seen, 1, *gap);
+        tracker->filled += *gap;
+        return SEQUENCE_ACCEPTED;
+    }
+
+    tracker->gaps++;
+    tracker->missing += *gap;
+    return SEQUENCE_GAP;
+}
+
+/**
+ * Check a frame's flow and produce fill values for a short gap
+ */
+int sequence_tracker_flow(SequenceTracker *tracker, uint64_t sequence, double flow,
+                          double *fill, uint32_t *num_fill)
+{
+    uint64_t gap;
+    double previous = tracker->last_flow;
+    int result = sequence_tracker_check(tracker, sequence, &gap);
+
+    *num_fill = 0;
+    if (result == SEQUENCE_ACCEPTED && gap > 0) {
+        double step = (flow - previous) / (double)(gap + 1);
+        for (uint32_t k = 0; k < (uint32_t)gap; k++) {
+            fill[k] = previous + step * (double)(k + 1);
+        }
+        *num_fill = (uint32_t)gap;
+    }
+    if (result <= SEQUENCE_GAP) {
+        tracker->last_flow = flow;
+    }
+
+    return result;
+}
+
+/**
+ * Interpolate the measurements of missing frames
+ */
+void sequence_fill_measurements(const PathMeasurement *previous,
+                                const PathMeasurement *current, uint32_t num_paths,
+                                uint32_t gap, PathMeasurement *out)
+{
+    for (uint32_t i = 0; i < num_paths; i++) {
+        double up0 = previous[i].t_upstream;
+        double down0 = previous[i].t_downstream;
+        double up1 = current[i].t_upstream;
+        double down1 = current[i].t_downstream;
+        int valid = up0 > 0.0 && down0 > 0.0 && up1 > 0.0 && down1 > 0.0;
+
+        for (uint32_t k = 0; k < gap; k++) {
+            double a = (double)(k + 1) / (double)(gap + 1);
+            PathMeasurement *m = &out[(size_t)k * num_paths + i];
+            m->t_upstream = valid ? up0 + a * (up1 - up0) : 0.0;
+            m->t_downstream = valid ? down0 + a * (down1 - down0) : 0.0;
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include "flowmeter.h"
+#include <stddef.h>
+
+/*
+ * Sequence-window deduplication and gap filling
+ *
+ * UDP retransmissions and collector failover deliver some frames twice
+ * and lose others, which double-counts or under-counts totals. Each
+ * meter keeps a SequenceTracker: the highest sequence number seen and a
+ * bitmap of the SEQUENCE_WINDOW numbers below it. Checking a frame is a
+ * compare and a bit test; advancing shifts a four-word bitmap.
+ *
+ * A frame that advances the window by more than one leaves a gap. Gaps
+ * of up to max_fill frames are filled by linear interpolation between
+ * the frames either side, and the filled numbers are marked seen, so a
+ * frame that arrives after its gap was filled is dropped as a duplicate.
+ * Longer gaps are flagged and left open: their frames are still
+ * accepted if they arrive while inside the window.
+ *
+ * The tracker takes two cache lines; previous measurements for
+ * path-level filling are kept by the caller.
+ */
+
+#define SEQUENCE_WINDOW 256
+#define SEQUENCE_WINDOW_WORDS (SEQUENCE_WINDOW / 64)
+
+/* Results of sequence_tracker_check(); frames >= SEQUENCE_DUPLICATE are dropped */
+#define SEQUENCE_ACCEPTED  0  /* Next in order, or after a gap that was filled */
+#define SEQUENCE_GAP       1  /* Accepted after a gap too long to fill */
+#define SEQUENCE_LATE      2  /* Accepted, filling a hole below the highest number */
+#define SEQUENCE_DUPLICATE 3  /* Already seen (or already filled) */
+#define SEQUENCE_STALE     4  /* Older than the window */
+
+typedef struct {
+    uint64_t highest;                     /* Highest sequence number seen */
+    uint64_t seen[SEQUENCE_WINDOW_WORDS]; /* Bit k of word w: highest - 64w - k seen */
+    double last_flow;                     /* Flow of frame highest, for filling */
+    uint32_t max_fill;                    /* Longest gap filled, in frames */
+    uint32_t started;                     /* A frame has been accepted */
+
+    /* Statistics */
+    uint64_t accepted;                    /* Frames accepted, including late ones */
+    uint64_t late;                        /* Frames accepted out of order */
+    uint64_t duplicates;                  /* Frames dropped as duplicates */
+    uint64_t stale;                       /* Frames dropped as older than the window */
+    uint64_t filled;                      /* Frames synthesized by interpolation */
+    uint64_t gaps;                        /* Gaps too long to fill */
+    uint64_t missing;                     /* Frames in those gaps, minus late arrivals */
+} SequenceTracker;
+
+/**
+ * Initialize a tracker with no frames seen
+ *
+ * @param tracker Tracker to initialize
+ * @param max_fill Longest gap to fill, in frames (< SEQUENCE_WINDOW)
+ * @return 0 on success, -1 on error
+ */
+int sequence_tracker_init(SequenceTracker *tracker, uint32_t max_fill);
+
+/**
+ * Check and record a sequence number
+ *
+ * @param tracker Tracker
+ * @param sequence Sequence number of the frame
+ * @param gap Output number of frames skipped when the window advanced
+ *            (0 unless the result is SEQUENCE_ACCEPTED or SEQUENCE_GAP)
+ * @return SEQUENCE_* result
+ */
+int sequence_tracker_check(SequenceTracker *tracker, uint64_t sequence, uint64_t *gap);
+
+/**
+ * Check a frame's flow and produce fill values for a short gap
+ *
+ * On SEQUENCE_ACCEPTED after a gap of n <= max_fill frames, writes the n
+ * interpolated flows of the missing frames to fill. The caller adds them
+ * before the frame's own flow (e.g. to a totalizer).
+ *
+ * @param tracker Tracker
+ * @param sequence Sequence number of the frame
+ * @param flow Volumetric flow of the frame in m³/s
+ * @param fill Output fill flows (max_fill entries)
+ * @param num_fill Output number of fill flows written
+ * @return SEQUENCE_* result
+ */
+int sequence_tracker_flow(SequenceTracker *tracker, uint64_t sequence, double flow,
+                          double *fill, uint32_t *num_fill);
+
+/**
+ * Interpolate the measurements of missing frames
+ *
+ * Frame k of gap frames lies (k + 1) / (gap + 1) of the way from
+ * previous to current. Paths invalid in either frame stay invalid.
+ *
+ * @param previous Last frame before the gap (num_paths measurements)
+ * @param current Frame after the gap (num_paths measurements)
+ * @param num_paths Number of paths
+ * @param gap Number of missing frames
+ * @param out Output frame-major measurements (gap * num_paths)
+ */
+void sequence_fill_measurements(const PathMeasurement *previous,
+                                const PathMeasurement *current, uint32_t num_paths,
+                                uint32_t gap, PathMeasurement *out);
+
+#endif /* SEQUENCE_H */
@@ -0,0 +1,563 @@
+#define _XOPEN_SOURCE 600
+
+#include "serial.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/* CRC-16/CCITT of each nibble, shifted into the top bits */
+static const uint16_t crc_nibbles[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+};
+
+/**
+ * CRC-16/CCITT-FALSE, a nibble at a time
+ */
+static uint16_t serial_crc(const uint8_t *data, size_t size)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < size; i++) {
+        crc = (uint16_t)((crc << 4) ^ crc_nibbles[(crc >> 12) ^ (data[i] >> 4)]);
+        crc = (uint16_t)((crc << 4) ^ crc_nibbles[(crc >> 12) ^ (data[i] & 0x0F)]);
+    }
+    return crc;
+}
+
+/**
+ * Little-endian u32 from bytes
+ */
+static inline uint32_t load_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+/**
+ * Little-endian u32 to bytes
+ */
+static inline void store_le32(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+/**
+ * Create a decoder
+ */
+int serial_decoder_init(SerialDecoder *decoder, uint32_t num_paths, double tick,
+                        size_t buffer_size)
+{
+    if (!decoder || num_paths == 0 || num_paths > FLOWMETER_MAX_PATHS || !(tick > 0.0)) {
+        return -1;
+    }
+
+    size_t minimum = 2 * serial_frame_size(num_paths);
+    if (buffer_size == 0) {
+        buffer_size = SERIAL_DEFAULT_BUFFER;
+    }
+    if (buffer_size < minimum) {
+        buffer_size = minimum;
+    }
+
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->buffer = malloc(buffer_size);
+    if (!decoder->buffer) {
+        return -1;
+    }
+    decoder->num_paths = num_paths;
+    decoder->tick = tick;
+    decoder->capacity = buffer_size;
+    return 0;
+}
+
+/**
+ * Free space to receive into, after moving undecoded bytes to the front
+ *
+ * Fewer than two frames are left undecoded between calls, so the move
+ * is short.
+ */
+uint8_t* serial_decoder_space(SerialDecoder *decoder, size_t *size)
+{
+    if (decoder->start > 0) {
+        memmove(decoder->buffer, decoder->buffer + decoder->start,
+                decoder->end - decoder->start);
+        decoder->end -= decoder->start;
+        decoder->start = 0;
+    }
+
+    *size = decoder->capacity - decoder->end;
+    return decoder->buffer + decoder->end;
+}
+
+/**
+ * Mark bytes written into serial_decoder_space() as received
+ */
+void serial_decoder_commit(SerialDecoder *decoder, size_t size)
+{
+    decoder->end += size;
+}
+
+/**
+ * Decode complete frames from the received bytes
+ */
+size_t serial_decode(SerialDecoder *decoder, PathMeasurement *frames, uint64_t *sequences,
+                     size_t max_frames)
+{
+    uint32_t num_paths = decoder->num_paths;
+    size_t frame_size = serial_frame_size(num_paths);
+    double tick = decoder->tick;
+    size_t count = 0;
+
+    while (count < max_frames && decoder->end - decoder->start >= frame_size) {
+        const uint8_t *p = decoder->buffer + decoder->start;
+        size_t available = decoder->end - decoder->start;
+
+        if (p[0] != SERIAL_SYNC0 || p[1] != SERIAL_SYNC1) {
+            const uint8_t *sync = memchr(p + 1, SERIAL_SYNC0, available - 1);
+            size_t skip = sync ? (size_t)(sync - p) : available;
+            decoder->skipped += skip;
+            decoder->start += skip;
+            continue;
+        }
+
+        if (p[2] != num_paths) {
+            decoder->wrong_paths++;
+            decoder->skipped++;
+            decoder->start++;
+            continue;
+        }
+
+        uint16_t crc = (uint16_t)(p[frame_size - 2] | (p[frame_size - 1] << 8));
+        if (serial_crc(p + 2, frame_size - 4) != crc) {
+            decoder->crc_errors++;
+            decoder->skipped++;
+            decoder->start++;
+            continue;
+        }
+
+        PathMeasurement *measurements = &frames[count * num_paths];
+        const uint8_t *counts = p + SERIAL_HEADER_SIZE;
+        for (uint32_t i = 0; i < num_paths; i++) {
+            measurements[i].t_upstream = (double)load_le32(counts + 8 * i) * tick;
+            measurements[i].t_downstream = (double)load_le32(counts + 8 * i + 4) * tick;
+        }
+
+        /* Unwrap the 8-bit sequence: frames are never 256 apart */
+        uint64_t sequence = p[3];
+        if (decoder->has_sequence) {
+            sequence = decoder->sequence + (uint8_t)(p[3] - (uint8_t)decoder->sequence);
+        }
+        decoder->sequence = sequence;
+        decoder->has_sequence = 1;
+        if (sequences) {
+            sequences[count] = sequence;
+        }
+
+        decoder->start += frame_size;
+        decoder->frames++;
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * Free memory owned by a decoder
+ */
+void serial_decoder_free(SerialDecoder *decoder)
+{
+    if (!decoder) {
+        return;
+    }
+
+    free(decoder->buffer);
+    memset(decoder, 0, sizeof(*decoder));
+}
+
+/**
+ * Encode one frame
+ */
+size_t serial_encode_frame(uint8_t *out, uint64_t sequence, const uint32_t *counts,
+                           uint32_t num_paths)
+{
+    size_t frame_size = serial_frame_size(num_paths);
+
+    out[0] = SERIAL_SYNC0;
+    out[1] = SERIAL_SYNC1;
+    out[2] = (uint8_t)num_paths;
+    out[3] = (uint8_t)sequence;
+    for (uint32_t i = 0; i < 2 * num_paths; i++) {
+        store_le32(out + SERIAL_HEADER_SIZE + 4 * i, counts[i]);
+    }
+
+    uint16_t crc = serial_crc(out + 2, frame_size - 4);
+    out[frame_size - 2] = (uint8_t)crc;
+    out[frame_size - 1] = (uint8_t)(crc >> 8);
+    return frame_size;
+}
+
+/**
+ * Put a serial line in raw 8N1 mode
+ *
+ * Note for Linux 5.11 and later: a tty read copies through a 64-byte
+ * kernel buffer, and with VMIN above 64 each read() is satisfied (and
+ * returns) after 64 bytes even when more are waiting. VMIN of 64 or
+ * less returns everything available in one call.
+ */
+int serial_configure(int fd, uint32_t baud, uint32_t vmin, uint32_t vtime)
+{
+    static const struct {
+        uint32_t rate;
+        speed_t speed;
+    } rates[] = {
+        { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 },
+#ifdef B57600
+        { 57600, B57600 },
+#endif
+#ifdef B115200
+        { 115200, B115200 },
+#endif
+#ifdef B230400
+        { 230400, B230400 },
+#endif
+#ifdef B460800
+        { 460800, B460800 },
+#endif
+#ifdef B921600
+        { 921600, B921600 },
+#endif
+#ifdef B2000000
+        { 2000000, B2000000 },
+#endif
+#ifdef B4000000
+        { 4000000, B4000000 },
+#endif
+    };
+    struct termios options;
+
+    if (fd < 0 || vmin > 255 || vtime > 255 || tcgetattr(fd, &options) != 0) {
+        return -1;
+    }
+
+    options.c_iflag &= ~(tcflag_t)(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR |
+                                   ICRNL | IXON | IXOFF);
+    options.c_oflag &= ~(tcflag_t)OPOST;
+    options.c_lflag &= ~(tcflag_t)(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    options.c_cflag &= ~(tcflag_t)(CSIZE | PARENB | CSTOPB);
+    options.c_cflag |= CS8 | CLOCAL | CREAD;
+    options.c_cc[VMIN] = (cc_t)vmin;
+    options.c_cc[VTIME] = (cc_t)vtime;
+
+    if (baud != 0) {
+        size_t r = 0;
+        while (r < sizeof(rates) / sizeof(rates[0]) && rates[r].rate != baud) {
+            r++;
+        }
+        if (r == sizeof(rates) / sizeof(rates[0]) ||
+            cfsetispeed(&options, rates[r].speed) != 0 ||
+            cfsetospeed(&options, rates[r].speed) != 0) {
+            return -1;
+        }
+    }
+
+    return tcsetattr(fd, TCSANOW, &options);
+}
+
+/**
+ * Open and configure a serial line for batched reads
+ *
+ * VMIN is 64, the largest that still returns a whole burst per read()
+ * (see serial_configure()); VTIME of 0.1 s returns a partial burst at
+ * the end of a transmission.
+ */
+int serial_port_open(SerialPort *port, const char *device, uint32_t baud,
+                     uint32_t num_paths, double tick)
+{
+    if (!port || !device) {
+        return -1;
+    }
+
+    memset(port, 0, sizeof(*port));
+    port->fd = open(device, O_RDWR | O_NOCTTY);
+    if (port->fd < 0) {
+        return -1;
+    }
+
+    if (serial_configure(port->fd, baud, 64, 1) != 0 ||
+        serial_decoder_init(&port->decoder, num_paths, tick, 0) != 0) {
+        close(port->fd);
+        port->fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Read frames, blocking until at least one byte arrives
+ */
+int serial_port_read(SerialPort *port, PathMeasurement *frames, uint64_t *sequences,
+                     size_t max_frames, size_t *num_frames)
+{
+    if (!port || port->fd < 0 || !frames || !num_frames) {
+        return -1;
+    }
+
+    /* No room for frames; a read() here could return 0 and look like a hang-up */
+    *num_frames = 0;
+    if (max_frames == 0) {
+        return 0;
+    }
+
+    *num_frames = serial_decode(&port->decoder, frames, sequences, max_frames);
+    if (*num_frames > 0) {
+        return 0;
+    }
+
+    size_t space;
+    uint8_t *buffer = serial_decoder_space(&port->decoder, &space);
+    ssize_t received = read(port->fd, buffer, space);
+    port->reads++;
+    if (received < 0) {
+        if (errno == EINTR || errno == EAGAIN) {
+            return 0;
+        }
+        return errno == EIO ? 1 : -1;
+    }
+    if (received == 0) {
+        return 1;
+    }
+
+    serial_decoder_commit(&port->decoder, (size_t)received);
+    port->bytes += (uint64_t)received;
+    *num_frames = serial_decode(&port->decoder, frames, sequences, max_frames);
+    return 0;
+}
+
+/**
+ * Close a serial port
+ */
+void serial_port_close(SerialPort *port)
+{
+    if (!port) {
+        return;
+    }
+
+    if (port->fd >= 0) {
+        close(port->fd);
+    }
+    serial_decoder_free(&port->decoder);
+    port->fd = -1;
+}
+
+/**
+ * Monotonic time in seconds
+ */
+static double emulator_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Write all of data, waiting for the reader; fails once stopped
+ */
+static int emulator_write(SerialEmulator *emulator, const uint8_t *data, size_t size)
+{
+    while (size > 0) {
+        struct pollfd pfd = { emulator->master, POLLOUT, 0 };
+        if (__atomic_load_n(&emulator->stop, __ATOMIC_RELAXED)) {
+            return -1;
+        }
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+
+        ssize_t written = write(emulator->master, data, size);
+        if (written < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            return -1;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    return 0;
+}
+
+/**
+ * Emulator thread: a meter with a slowly varying flow and 50 ps timer
+ * jitter, sending batches of whole frames
+ */
+static void* emulator_main(void *arg)
+{
+    SerialEmulator *emulator = arg;
+    uint32_t num_paths = emulator->num_paths;
+    size_t frame_size = serial_frame_size(num_paths);
+    size_t batch = 4096 / frame_size > 0 ? 4096 / frame_size : 1;
+    uint8_t *buffer = malloc(batch * frame_size);
+    uint32_t counts[2 * FLOWMETER_MAX_PATHS];
+    uint64_t rng = 0x9e3779b97f4a7c15ULL;
+    double start = emulator_now();
+
+    while (buffer && !__atomic_load_n(&emulator->stop, __ATOMIC_RELAXED) &&
+           (emulator->max_frames == 0 || emulator->frames_sent < emulator->max_frames)) {
+        size_t frames = batch;
+        if (emulator->max_frames != 0 && emulator->max_frames - emulator->frames_sent < frames) {
+            frames = (size_t)(emulator->max_frames - emulator->frames_sent);
+        }
+        if (emulator->baud != 0) {
+            double due = (emulator_now() - start) * (double)emulator->baud / 10.0 -
+                         (double)emulator->bytes_sent;
+            size_t due_frames = due > 0.0 ? (size_t)(due / (double)frame_size) : 0;
+            if (due_frames == 0) {
+                struct timespec pause = { 0, 500000 };
+                nanosleep(&pause, NULL);
+                continue;
+            }
+            frames = due_frames < frames ? due_frames : frames;
+        }
+
+        for (size_t f = 0; f < frames; f++) {
+            uint64_t sequence = emulator->frames_sent + f;
+            double delta = 40e-9 * (1.0 + 0.1 * sin((double)sequence * 1e-3));
+            for (uint32_t i = 0; i < num_paths; i++) {
+                rng ^= rng << 13;
+                rng ^= rng >> 7;
+                rng ^= rng << 17;
+                double jitter = ((double)(rng >> 40) / 16777216.0 - 0.5) * 100e-12;
+                double up = 120e-6 + 10e-6 * i + 0.5 * delta + jitter;
+                double down = up - delta;
+                counts[2 * i] = (uint32_t)(up / SERIAL_EMULATOR_TICK + 0.5);
+                counts[2 * i + 1] = (uint32_t)(down / SERIAL_EMULATOR_TICK + 0.5);
+            }
+
+            uint8_t *frame = buffer + f * frame_size;
+            serial_encode_frame(frame, sequence, counts, num_paths);
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            if ((double)(rng >> 11) / 9007199254740992.0 < emulator->corrupt_rate) {
+                frame[(rng >> 3) % frame_size] ^= 0x5A;
+                emulator->corrupted++;
+            }
+        }
+
+        if (emulator_write(emulator, buffer, frames * frame_size) != 0) {
+            break;
+        }
+        emulator->frames_sent += frames;
+        emulator->bytes_sent += frames * frame_size;
+    }
+
+    /*
+     * Closing the master discards unread input, so let the reader drain
+     * it. FIONREAD counts only the line discipline's buffer, which refills
+     * from the pty's own buffer after the reader empties it, so the count
+     * must stay at zero for a while.
+     */
+    int quiet = 0;
+    while (quiet < 20 && !__atomic_load_n(&emulator->stop, __ATOMIC_RELAXED)) {
+        int pending = 0;
+        if (ioctl(emulator->slave, FIONREAD, &pending) != 0) {
+            break;
+        }
+        quiet = (pending == 0) ? quiet + 1 : 0;
+        struct timespec pause = { 0, 1000000 };
+        nanosleep(&pause, NULL);
+    }
+
+    close(emulator->master);
+    emulator->master = -1;
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * Create a pty and start emulating a transmitter on it
+ */
+int serial_emulator_start(SerialEmulator *emulator, uint32_t num_paths, uint32_t baud,
+                          uint64_t max_frames, double corrupt_rate)
+{
+    if (!emulator || num_paths == 0 || num_paths > FLOWMETER_MAX_PATHS ||
+        !(corrupt_rate >= 0.0 && corrupt_rate <= 1.0)) {
+        return -1;
+    }
+
+    memset(emulator, 0, sizeof(*emulator));
+    emulator->slave = -1;
+    emulator->num_paths = num_paths;
+    emulator->baud = baud;
+    emulator->max_frames = max_frames;
+    emulator->corrupt_rate = corrupt_rate;
+
+    emulator->master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (emulator->master < 0) {
+        return -1;
+    }
+
+    const char *name = NULL;
+    if (grantpt(emulator->master) != 0 || unlockpt(emulator->master) != 0 ||
+        !(name = ptsname(emulator->master)) ||
+        strlen(name) >= sizeof(emulator->slave_path)) {
+        close(emulator->master);
+        return -1;
+    }
+    strcpy(emulator->slave_path, name);
+
+    /* Raw mode before any frame is written, or the line discipline echoes */
+    emulator->slave = open(emulator->slave_path, O_RDWR | O_NOCTTY);
+    if (emulator->slave < 0 || serial_configure(emulator->slave, 0, 1, 0) != 0 ||
+        pthread_create(&emulator->thread, NULL, emulator_main, emulator) != 0) {
+        if (emulator->slave >= 0) {
+            close(emulator->slave);
+        }
+        close(emulator->master);
+        return -1;
+    }
+
+    emulator->running = 1;
+    return 0;
+}
+
+/**
+ * Wait for the emulator to send its frames and hang up
+ */
+void serial_emulator_wait(SerialEmulator *emulator)
+{
+    if (!emulator || !emulator->running) {
+        return;
+    }
+
+    pthread_join(emulator->thread, NULL);
+    emulator->running = 0;
+}
+
+/**
+ * Stop the emulator and close the pty
+ */
+void serial_emulator_stop(SerialEmulator *emulator)
+{
+    if (!emulator) {
+        return;
+    }
+
+    __atomic_store_n(&emulator->stop, 1, __ATOMIC_RELAXED);
+    serial_emulator_wait(emulator);
+    if (emulator->slave >= 0) {
+        close(emulator->slave);
+        emulator->slave = -1;
+    }
+}
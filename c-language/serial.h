@@ -0,0 +1,247 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include "flowmeter.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Serial transmitter frames
+ *
+ * Legacy multi-path transmitters send one frame per measurement cycle
+ * over RS-485:
+ *
+ *   0xAA 0x55 | num_paths (u8) | sequence (u8) |
+ *   num_paths x (t_upstream u32, t_downstream u32) | CRC-16 (u16)
+ *
+ * All values are little-endian. Transit times are counts of the
+ * transmitter's timer tick. The CRC is CRC-16/CCITT-FALSE (polynomial
+ * 0x1021, initial value 0xFFFF) over the bytes from num_paths up to the
+ * CRC itself.
+ *
+ * The decoder works on a buffer that the reader fills directly, so
+ * bytes are copied once, from the kernel. It finds frames by their sync
+ * bytes. A frame with a wrong CRC or path count is skipped by advancing
+ * one byte and searching again, so the decoder resynchronizes after
+ * line noise, dropped bytes or joining mid-frame. The 8-bit sequence
+ * number is unwrapped into a 64-bit count for SequenceTracker.
+ * Unwrapping assumes fewer than 256 frames are lost in a row.
+ */
+
+#define SERIAL_SYNC0 0xAAu
+#define SERIAL_SYNC1 0x55u
+#define SERIAL_HEADER_SIZE 4u
+#define SERIAL_CRC_SIZE 2u
+#define SERIAL_DEFAULT_BUFFER (64u << 10)
+
+/**
+ * Encoded size of a frame
+ *
+ * @param num_paths Paths per frame
+ * @return Frame size in bytes
+ */
+static inline size_t serial_frame_size(uint32_t num_paths)
+{
+    return SERIAL_HEADER_SIZE + 8 * (size_t)num_paths + SERIAL_CRC_SIZE;
+}
+
+typedef struct {
+    uint32_t num_paths;       /* Paths expected per frame */
+    double tick;              /* Seconds per transit-time count */
+    uint8_t *buffer;          /* Received bytes not yet decoded */
+    size_t capacity;          /* Buffer size */
+    size_t start;             /* First undecoded byte */
+    size_t end;               /* End of received bytes */
+    uint64_t sequence;        /* Unwrapped sequence of the last frame */
+    int has_sequence;         /* A frame has been decoded */
+
+    uint64_t frames;          /* Frames decoded */
+    uint64_t crc_errors;      /* Candidate frames with a bad CRC */
+    uint64_t wrong_paths;     /* Candidate frames with another path count */
+    uint64_t skipped;         /* Bytes discarded while resynchronizing */
+} SerialDecoder;
+
+/**
+ * Create a decoder
+ *
+ * @param decoder Output structure, release with serial_decoder_free()
+ * @param num_paths Paths per frame (1 to FLOWMETER_MAX_PATHS)
+ * @param tick Seconds per transit-time count
+ * @param buffer_size Buffer size in bytes, 0 for SERIAL_DEFAULT_BUFFER;
+ *                    raised to hold at least two frames
+ * @return 0 on success, -1 on error
+ */
+int serial_decoder_init(SerialDecoder *decoder, uint32_t num_paths, double tick,
+                        size_t buffer_size);
+
+/**
+ * Free space to receive into, after moving undecoded bytes to the front
+ *
+ * @param decoder Serial decoder
+ * @param size Output number of bytes that may be written
+ * @return Pointer to the free space
+ */
+uint8_t* serial_decoder_space(SerialDecoder *decoder, size_t *size);
+
+/**
+ * Mark bytes written into serial_decoder_space() as received
+ *
+ * @param decoder Serial decoder
+ * @param size Number of bytes written
+ */
+void serial_decoder_commit(SerialDecoder *decoder, size_t size);
+
+/**
+ * Decode complete frames from the received bytes
+ *
+ * Stops when max_frames frames are decoded or no complete frame is
+ * left. The remaining bytes are kept for the next call.
+ *
+ * @param decoder Serial decoder
+ * @param frames Output frame-major measurements, num_paths per frame
+ * @param sequences Output unwrapped sequence per frame, or NULL
+ * @param max_frames Capacity of frames in frames (0 returns at once)
+ * @return Number of frames decoded
+ */
+size_t serial_decode(SerialDecoder *decoder, PathMeasurement *frames, uint64_t *sequences,
+                     size_t max_frames);
+
+/**
+ * Free memory owned by a decoder
+ *
+ * @param decoder Serial decoder
+ */
+void serial_decoder_free(SerialDecoder *decoder);
+
+/**
+ * Encode one frame
+ *
+ * @param out Output buffer of serial_frame_size(num_paths) bytes
+ * @param sequence Sequence number (low 8 bits are sent)
+ * @param counts Transit-time counts, t_upstream and t_downstream per path
+ * @param num_paths Paths per frame (1 to 255)
+ * @return Frame size in bytes
+ */
+size_t serial_encode_frame(uint8_t *out, uint64_t sequence, const uint32_t *counts,
+                           uint32_t num_paths);
+
+/**
+ * Put a serial line in raw 8N1 mode
+ *
+ * read() then returns once vmin bytes have arrived, or vtime tenths of
+ * a second after the last byte when fewer have. This takes one system
+ * call per burst rather than per byte.
+ *
+ * @param fd Open terminal file descriptor
+ * @param baud Line speed in bits per second (a standard rate), or 0 to
+ *             leave it unchanged (pseudo-terminals have none)
+ * @param vmin Minimum bytes per read (at most 255)
+ * @param vtime Inter-byte timeout in tenths of a second
+ * @return 0 on success, -1 on error or an unsupported rate
+ */
+int serial_configure(int fd, uint32_t baud, uint32_t vmin, uint32_t vtime);
+
+/* A serial line with its decoder */
+typedef struct {
+    int fd;                   /* Open line */
+    SerialDecoder decoder;    /* Frame decoder */
+    uint64_t reads;           /* read() calls made */
+    uint64_t bytes;           /* Bytes received */
+} SerialPort;
+
+/**
+ * Open and configure a serial line for batched reads
+ *
+ * @param port Output structure, release with serial_port_close()
+ * @param device Device path (for example /dev/ttyUSB0 or a pty slave)
+ * @param baud Line speed, or 0 to leave it unchanged
+ * @param num_paths Paths per frame
+ * @param tick Seconds per transit-time count
+ * @return 0 on success, -1 on error
+ */
+int serial_port_open(SerialPort *port, const char *device, uint32_t baud,
+                     uint32_t num_paths, double tick);
+
+/**
+ * Read frames, blocking until at least one byte arrives
+ *
+ * Frames already buffered are returned without a system call;
+ * otherwise one read() fills the decoder's free space.
+ *
+ * @param port Serial port
+ * @param frames Output frame-major measurements
+ * @param sequences Output unwrapped sequences, or NULL
+ * @param max_frames Capacity of frames in frames (0 returns at once)
+ * @param num_frames Output number of frames decoded (may be 0)
+ * @return 0 on success, 1 at end of stream (hang-up), -1 on error
+ */
+int serial_port_read(SerialPort *port, PathMeasurement *frames, uint64_t *sequences,
+                     size_t max_frames, size_t *num_frames);
+
+/**
+ * Close a serial port
+ *
+ * @param port Serial port
+ */
+void serial_port_close(SerialPort *port);
+
+/*
+ * Pseudo-terminal transmitter emulator
+ *
+ * A thread writes frames of a synthetic multi-path meter to a pty
+ * master. The slave side behaves like the transmitter's serial line. A
+ * pty has no line speed, so the emulator paces its writes to the byte
+ * rate of the configured baud rate (10 bits per byte), or writes as
+ * fast as the reader drains when baud is 0. A fraction of the frames
+ * gets a corrupted byte to exercise resynchronization. The master is
+ * closed after the last frame, which the reader sees as a hang-up.
+ */
+
+/* Seconds per transit-time count sent by the emulator */
+#define SERIAL_EMULATOR_TICK 1e-11
+
+typedef struct {
+    int master;               /* pty master */
+    int slave;                /* Slave kept open to configure it and watch the drain */
+    char slave_path[64];      /* Device path of the slave */
+    uint32_t num_paths;       /* Paths per frame */
+    uint32_t baud;            /* Paced line speed, 0 for unpaced */
+    uint64_t max_frames;      /* Frames to send, 0 for no limit */
+    double corrupt_rate;      /* Fraction of frames with a corrupted byte */
+    uint64_t frames_sent;     /* Frames written */
+    uint64_t bytes_sent;      /* Bytes written */
+    uint64_t corrupted;       /* Frames corrupted */
+    int stop;                 /* Set to stop the thread */
+    int running;              /* Thread started */
+    pthread_t thread;
+} SerialEmulator;
+
+/**
+ * Create a pty and start emulating a transmitter on it
+ *
+ * @param emulator Output structure, release with serial_emulator_stop()
+ * @param num_paths Paths per frame
+ * @param baud Paced line speed in bits per second, 0 for unpaced
+ * @param max_frames Frames to send before hanging up, 0 for no limit
+ * @param corrupt_rate Fraction of frames to corrupt, 0 to 1
+ * @return 0 on success, -1 on error
+ */
+int serial_emulator_start(SerialEmulator *emulator, uint32_t num_paths, uint32_t baud,
+                          uint64_t max_frames, double corrupt_rate);
+
+/**
+ * Wait for the emulator to send its frames and hang up
+ *
+ * @param emulator Serial emulator started with a frame limit
+ */
+void serial_emulator_wait(SerialEmulator *emulator);
+
+/**
+ * Stop the emulator and close the pty
+ *
+ * @param emulator Serial emulator
+ */
+void serial_emulator_stop(SerialEmulator *emulator);
+
+#endif /* SERIAL_H */
@@ -0,0 +1,341 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "snapshot.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNAPSHOT_ALIGN 64u
+
+static uint64_t align_up(uint64_t value)
+{
+    return (value + SNAPSHOT_ALIGN - 1) & ~(uint64_t)(SNAPSHOT_ALIGN - 1);
+}
+
+/**
+ * 64-bit FNV-1a hash
+ */
+static uint64_t fnv1a(const unsigned char *data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+/* Fleet entry in meter ID order */
+typedef struct {
+    uint32_t meter_id;  /* Meter ID */
+    uint32_t index;     /* Position in the fleet */
+} MeterOrder;
+
+/* qsort helper: order fleet entries by meter ID, then fleet position */
+static int compare_meter_order(const void *a, const void *b)
+{
+    const MeterOrder *x = a;
+    const MeterOrder *y = b;
+
+    if (x->meter_id != y->meter_id) {
+        return (x->meter_id > y->meter_id) - (x->meter_id < y->meter_id);
+    }
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+/**
+ * Compile a fleet into a snapshot file
+ *
+ * The image is built in memory and written with a single write, then
+ * renamed over the destination so readers never map a partial file.
+ */
+int snapshot_write(const char *filename, const FleetConfig *fleet)
+{
+    if (!filename || !fleet || fleet->num_meters == 0) {
+        return -1;
+    }
+
+    uint64_t total_paths = 0;
+    for (uint32_t i = 0; i < fleet->num_meters; i++) {
+        total_paths += fleet->configs[i].num_paths;
+    }
+    if (total_paths > UINT32_MAX) {
+        return -1;
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.num_meters = fleet->num_meters;
+    header.total_paths = (uint32_t)total_paths;
+    header.meters_offset = align_up(sizeof(SnapshotHeader));
+    header.paths_offset = align_up(header.meters_offset +
+                                   fleet->num_meters * sizeof(SnapshotMeter));
+    header.scale_offset = align_up(header.paths_offset +
+                                   total_paths * sizeof(AcousticPath));
+    header.coeff_offset = align_up(header.scale_offset +
+                                   total_paths * sizeof(double));
+    header.file_size = header.coeff_offset + total_paths * sizeof(double);
+
+    unsigned char *image = calloc(1, header.file_size);
+    MeterOrder *order = malloc(fleet->num_meters * sizeof(MeterOrder));
+    if (!image || !order) {
+        free(image);
+        free(order);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < fleet->num_meters; i++) {
+        order[i].meter_id = fleet->meter_ids[i];
+        order[i].index = i;
+    }
+    qsort(order, fleet->num_meters, sizeof(MeterOrder), compare_meter_order);
+
+    SnapshotMeter *meters = (SnapshotMeter *)(image + header.meters_offset);
+    AcousticPath *paths = (AcousticPath *)(image + header.paths_offset);
+    double *velocity_scale = (double *)(image + header.scale_offset);
+    double *flow_coeff = (double *)(image + header.coeff_offset);
+
+    int status = 0;
+    uint32_t next_path = 0;
+    for (uint32_t m = 0; m < fleet->num_meters && status == 0; m++) {
+        const FlowMeterConfig *config = &fleet->configs[order[m].index];
+        CompiledConfig compiled;
+
+        if (m > 0 && order[m].meter_id == meters[m - 1].meter_id) {
+            fprintf(stderr, "Error: Duplicate meter ID %u\n", meters[m - 1].meter_id);
+            status = -1;
+            break;
+        }
+
+        if (flowmeter_compile(config, &compiled) != 0) {
+            status = -1;
+            break;
+        }
+
+        meters[m].meter_id = order[m].meter_id;
+        meters[m].num_paths = config->num_paths;
+        meters[m].first_path = next_path;
+        meters[m].pipe_diameter = config->pipe_diameter;
+        meters[m].area = compiled.area;
+
+        memcpy(&paths[next_path], config->paths,
+               config->num_paths * sizeof(AcousticPath));
+        memcpy(&velocity_scale[next_path], compiled.velocity_scale,
+               config->num_paths * sizeof(double));
+        memcpy(&flow_coeff[next_path], compiled.flow_coeff,
+               config->num_paths * sizeof(double));
+        next_path += config->num_paths;
+
+        flowmeter_compiled_free(&compiled);
+    }
+    free(order);
+
+    if (status == 0) {
+        header.checksum = fnv1a(image + sizeof(SnapshotHeader),
+                                header.file_size - sizeof(SnapshotHeader));
+        memcpy(image, &header, sizeof(header));
+
+        size_t name_length = strlen(filename);
+        char *temp_name = malloc(name_length + 5);
+        FILE *file = NULL;
+
+        if (temp_name) {
+            memcpy(temp_name, filename, name_length);
+            memcpy(temp_name + name_length, ".tmp", 5);
+            file = fopen(temp_name, "wb");
+        }
+
+        if (!file ||
+            fwrite(image, 1, header.file_size, file) != header.file_size) {
+            status = -1;
+        }
+        if (file && fclose(file) != 0) {
+            status = -1;
+        }
+        if (temp_name) {
+            if (status == 0 && rename(temp_name, filename) != 0) {
+                status = -1;
+            }
+            if (status != 0) {
+                remove(temp_name);
+            }
+        } else {
+            status = -1;
+        }
+        free(temp_name);
+    }
+
+    free(image);
+    return status;
+}
+
+/**
+ * Check that a section of count * element_size bytes lies inside the file
+ */
+static int section_in_bounds(uint64_t offset, uint64_t count,
+                             uint64_t element_size, uint64_t file_size)
+{
+    if (offset % SNAPSHOT_ALIGN != 0 || offset > file_size) {
+        return 0;
+    }
+    return count <= (file_size - offset) / element_size;
+}
+
+/**
+ * Map a snapshot file and validate its header and section bounds
+ */
+int snapshot_open(const char *filename, FleetSnapshot *snapshot)
+{
+    if (!filename || !snapshot) {
+        return -1;
+    }
+
+    memset(snapshot, 0, sizeof(*snapshot));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)info.st_size;
+    void *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+
+    const SnapshotHeader *header = base;
+    int valid = memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0 &&
+                header->version == SNAPSHOT_VERSION &&
+                header->byte_order == SNAPSHOT_BYTE_ORDER &&
+                header->file_size == size &&
+                section_in_bounds(header->meters_offset, header->num_meters,
+                                  sizeof(SnapshotMeter), size) &&
+                section_in_bounds(header->paths_offset, header->total_paths,
+                                  sizeof(AcousticPath), size) &&
+                section_in_bounds(header->scale_offset, header->total_paths,
+                                  sizeof(double), size) &&
+                section_in_bounds(header->coeff_offset, header->total_paths,
+                                  sizeof(double), size);
+    if (!valid) {
+        munmap(base, size);
+        return -1;
+    }
+
+    const unsigned char *bytes = base;
+    snapshot->base = base;
+    snapshot->size = size;
+    snapshot->header = header;
+    snapshot->meters = (const SnapshotMeter *)(bytes + header->meters_offset);
+    snapshot->paths = (const AcousticPath *)(bytes + header->paths_offset);
+    snapshot->velocity_scale = (const double *)(bytes + header->scale_offset);
+    snapshot->flow_coeff = (const double *)(bytes + header->coeff_offset);
+
+    return 0;
+}
+
+/**
+ * Verify the snapshot checksum
+ */
+int snapshot_verify(const FleetSnapshot *snapshot)
+{
+    if (!snapshot || !snapshot->header) {
+        return -1;
+    }
+
+    const unsigned char *bytes = snapshot->base;
+    uint64_t checksum = fnv1a(bytes + sizeof(SnapshotHeader),
+                              snapshot->size - sizeof(SnapshotHeader));
+
+    return checksum == snapshot->header->checksum ? 0 : -1;
+}
+
+/**
+ * Unmap a snapshot
+ */
+void snapshot_close(FleetSnapshot *snapshot)
+{
+    if (snapshot && snapshot->base) {
+        munmap(snapshot->base, snapshot->size);
+        memset(snapshot, 0, sizeof(*snapshot));
+    }
+}
+
+/**
+ * Find a meter by ID
+ */
+int64_t snapshot_find_meter(const FleetSnapshot *snapshot, uint32_t meter_id)
+{
+    if (!snapshot || !snapshot->header) {
+        return -1;
+    }
+
+    uint32_t low = 0;
+    uint32_t high = snapshot->header->num_meters;
+
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (snapshot->meters[mid].meter_id < meter_id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if (low < snapshot->header->num_meters &&
+        snapshot->meters[low].meter_id == meter_id) {
+        return low;
+    }
+
+    return -1;
+}
+
+/**
+ * Get configuration and compiled coefficients of one meter in place
+ */
+int snapshot_meter_view(const FleetSnapshot *snapshot, uint32_t index,
+                        FlowMeterConfig *config, CompiledConfig *compiled)
+{
+    if (!snapshot || !snapshot->header || index >= snapshot->header->num_meters) {
+        return -1;
+    }
+
+    const SnapshotMeter *meter = &snapshot->meters[index];
+    if (meter->num_paths == 0 ||
+        meter->first_path > snapshot->header->total_paths ||
+        meter->num_paths > snapshot->header->total_paths - meter->first_path) {
+        return -1;
+    }
+
+    if (config) {
+        config->pipe_diameter = meter->pipe_diameter;
+        config->num_paths = meter->num_paths;
+        /* FlowMeterConfig has no const variant; the mapping is read-only */
+        config->paths = (AcousticPath *)&snapshot->paths[meter->first_path];
+    }
+
+    if (compiled) {
+        compiled->num_paths = meter->num_paths;
+        compiled->area = meter->area;
+        compiled->velocity_scale = &snapshot->velocity_scale[meter->first_path];
+        compiled->flow_coeff = &snapshot->flow_coeff[meter->first_path];
+        compiled->storage = NULL;
+    }
+
+    return 0;
+}
@@ -0,0 +1,121 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "flowmeter.h"
+#include "fleet.h"
+#include <stddef.h>
+
+/*
+ * Precompiled fleet snapshot
+ *
+ * A versioned binary image of a whole fleet: the meter table (sorted by
+ * meter ID), every AcousticPath and the derived per-path coefficients.
+ * All references are file offsets, so the image is relocatable and can
+ * be mapped read-only and used in place without parsing.
+ *
+ * File layout (native byte order, sections 64-byte aligned):
+ *   SnapshotHeader
+ *   SnapshotMeter[num_meters]
+ *   AcousticPath[total_paths]
+ *   double velocity_scale[total_paths]
+ *   double flow_coeff[total_paths]
+ */
+
+#define SNAPSHOT_MAGIC "FMSNAP\0\0"
+#define SNAPSHOT_VERSION 1u
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[8];           /* SNAPSHOT_MAGIC */
+    uint32_t version;        /* SNAPSHOT_VERSION */
+    uint32_t byte_order;     /* SNAPSHOT_BYTE_ORDER as written */
+    uint64_t file_size;      /* Total image size in bytes */
+    uint32_t num_meters;     /* Entries in the meter table */
+    uint32_t total_paths;    /* Paths across all meters */
+    uint64_t meters_offset;  /* Offset of SnapshotMeter table */
+    uint64_t paths_offset;   /* Offset of AcousticPath table */
+    uint64_t scale_offset;   /* Offset of velocity_scale array */
+    uint64_t coeff_offset;   /* Offset of flow_coeff array */
+    uint64_t checksum;       /* FNV-1a of everything after the header */
+} SnapshotHeader;
+
+typedef struct {
+    uint32_t meter_id;       /* Meter ID */
+    uint32_t num_paths;      /* Number of paths of this meter */
+    uint32_t first_path;     /* Index of the first path in the path tables */
+    uint32_t reserved;       /* Zero */
+    double pipe_diameter;    /* Pipe diameter in meters */
+    double area;             /* Cross-sectional area in m² */
+} SnapshotMeter;
+
+/* A mapped snapshot; all pointers reference the read-only mapping */
+typedef struct {
+    void *base;                   /* Start of the mapping */
+    size_t size;                  /* Mapping size in bytes */
+    const SnapshotHeader *header;
+    const SnapshotMeter *meters;
+    const AcousticPath *paths;
+    const double *velocity_scale;
+    const double *flow_coeff;
+} FleetSnapshot;
+
+/**
+ * Compile a fleet into a snapshot file
+ *
+ * @param filename Output file path
+ * @param fleet Fleet to compile (meter IDs must be unique)
+ * @return 0 on success, -1 on error
+ */
+int snapshot_write(const char *filename, const FleetConfig *fleet);
+
+/**
+ * Map a snapshot file and validate its header and section bounds
+ *
+ * Cost is independent of fleet size; the contents are not read.
+ *
+ * @param filename Snapshot file path
+ * @param snapshot Output mapping, release with snapshot_close()
+ * @return 0 on success, -1 on error
+ */
+int snapshot_open(const char *filename, FleetSnapshot *snapshot);
+
+/**
+ * Verify the snapshot checksum (reads the whole image)
+ *
+ * @param snapshot Mapped snapshot
+ * @return 0 if the checksum matches, -1 otherwise
+ */
+int snapshot_verify(const FleetSnapshot *snapshot);
+
+/**
+ * Unmap a snapshot
+ *
+ * @param snapshot Snapshot to release
+ */
+void snapshot_close(FleetSnapshot *snapshot);
+
+/**
+ * Find a meter by ID (binary search over the sorted meter table)
+ *
+ * @param snapshot Mapped snapshot
+ * @param meter_id Meter ID to look up
+ * @return Index into the meter table, -1 if not present
+ */
+int64_t snapshot_find_meter(const FleetSnapshot *snapshot, uint32_t meter_id);
+
+/**
+ * Get configuration and compiled coefficients of one meter in place
+ *
+ * Both outputs point into the mapping: they must not be modified or
+ * freed, and are valid until snapshot_close().
+ *
+ * @param snapshot Mapped snapshot
+ * @param index Index into the meter table
+ * @param config Output configuration view (may be NULL)
+ * @param compiled Output coefficient view (may be NULL)
+ * @return 0 on success, -1 on error
+ */
+int snapshot_meter_view(const FleetSnapshot *snapshot, uint32_t index,
+                        FlowMeterConfig *config, CompiledConfig *compiled);
+
+#endif /* SNAPSHOT_H */
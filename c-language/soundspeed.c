@@ -0,0 +1,237 @@
+#include "soundspeed.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Invert a small symmetric positive definite matrix in place
+ * (Gauss-Jordan with partial pivoting)
+ *
+ * @return 0 on success, -1 if the matrix is singular
+ */
+static int invert_small(double matrix[3][3], uint32_t size)
+{
+    double inverse[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+
+    for (uint32_t col = 0; col < size; col++) {
+        uint32_t pivot = col;
+        for (uint32_t row = col + 1; row < size; row++) {
+            if (fabs(matrix[row][col]) > fabs(matrix[pivot][col])) {
+                pivot = row;
+            }
+        }
+        if (fabs(matrix[pivot][col]) < 1e-12) {
+            return -1;
+        }
+
+        for (uint32_t k = 0; k < size; k++) {
+            double swap = matrix[col][k];
+            matrix[col][k] = matrix[pivot][k];
+            matrix[pivot][k] = swap;
+            swap = inverse[col][k];
+            inverse[col][k] = inverse[pivot][k];
+            inverse[pivot][k] = swap;
+        }
+
+        double scale = 1.0 / matrix[col][col];
+        for (uint32_t k = 0; k < size; k++) {
+            matrix[col][k] *= scale;
+            inverse[col][k] *= scale;
+        }
+
+        for (uint32_t row = 0; row < size; row++) {
+            if (row != col) {
+                double factor = matrix[row][col];
+                for (uint32_t k = 0; k < size; k++) {
+                    matrix[row][k] -= factor * matrix[col][k];
+                    inverse[row][k] -= factor * inverse[col][k];
+                }
+            }
+        }
+    }
+
+    memcpy(matrix, inverse, sizeof(inverse));
+    return 0;
+}
+
+/**
+ * Precompute path half-lengths and the profile fit for a configuration
+ *
+ * With A the num_paths x (degree + 1) matrix of position powers, the fit
+ * is (AᵀA)⁻¹Aᵀ; positions lie in [-1, 1], so AᵀA is well conditioned
+ * whenever the positions are distinct enough to support the degree.
+ */
+int sound_speed_init(SoundSpeedModel *model, const FlowMeterConfig *config,
+                     double stratification_threshold, double gas_threshold)
+{
+    if (!model || !config || !config->paths || !(stratification_threshold >= 0.0) ||
+        !(gas_threshold >= 0.0)) {
+        return -1;
+    }
+
+    uint32_t num_paths = config->num_paths;
+    if (num_paths == 0 || num_paths > FLOWMETER_MAX_PATHS) {
+        return -1;
+    }
+
+    uint32_t distinct = 0;
+    for (uint32_t i = 0; i < num_paths; i++) {
+        uint32_t j = 0;
+        while (j < i && fabs(config->paths[j].position - config->paths[i].position) > 1e-9) {
+            j++;
+        }
+        distinct += (j == i);
+    }
+
+    uint32_t degree = (distinct > 3) ? 2 : distinct - 1;
+    uint32_t terms = degree + 1;
+
+    double normal[3][3] = { { 0 } };
+    for (uint32_t i = 0; i < num_paths; i++) {
+        double p = config->paths[i].position;
+        double powers[3] = { 1.0, p, p * p };
+        for (uint32_t j = 0; j < terms; j++) {
+            for (uint32_t k = 0; k < terms; k++) {
+                normal[j][k] += powers[j] * powers[k];
+            }
+        }
+    }
+    if (invert_small(normal, terms) != 0) {
+        return -1;
+    }
+
+    double *storage = malloc((1 + terms) * num_paths * sizeof(double));
+    if (!storage) {
+        return -1;
+    }
+
+    model->num_paths = num_paths;
+    model->degree = degree;
+    model->half_length = storage;
+    model->fit = storage + num_paths;
+    model->stratification_threshold = stratification_threshold;
+    model->gas_threshold = gas_threshold;
+
+    for (uint32_t i = 0; i < num_paths; i++) {
+        double p = config->paths[i].position;
+        double powers[3] = { 1.0, p, p * p };
+
+        model->half_length[i] = 0.5 * config->paths[i].length;
+        for (uint32_t j = 0; j < terms; j++) {
+            double value = 0.0;
+            for (uint32_t k = 0; k < terms; k++) {
+                value += normal[j][k] * powers[k];
+            }
+            model->fit[j * num_paths + i] = value;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Flow and sound-speed profile of one frame in a single pass
+ *
+ * Each path needs one division: 1 / (t_up * t_down) scales both the
+ * transit-time difference (velocity term) and the sum (sound speed), so
+ * the flow may differ from compiled_flow_rate() in the last bit. Invalid
+ * paths contribute no flow and a sound speed of 0.
+ */
+static inline double profile_frame(const SoundSpeedModel *model,
+                                   const CompiledConfig *compiled,
+                                   const PathMeasurement *measurements,
+                                   double *path_sound_speeds, SoundSpeedProfile *profile)
+{
+    double speeds[FLOWMETER_MAX_PATHS];
+    double flow = 0.0;
+    double sum = 0.0;
+    double minimum = INFINITY;
+    int valid_all = 1;
+
+    for (uint32_t i = 0; i < model->num_paths; i++) {
+        double t_up = measurements[i].t_upstream;
+        double t_down = measurements[i].t_downstream;
+        int valid = (t_up > 0.0) & (t_down > 0.0);
+        double inverse = 1.0 / (t_up * t_down);
+        double term = valid ? (t_up - t_down) * inverse : 0.0;
+        double speed = valid ? model->half_length[i] * (t_up + t_down) * inverse : 0.0;
+
+        flow += compiled->flow_coeff[i] * term;
+        speeds[i] = speed;
+        sum += speed;
+        minimum = (speed < minimum) ? speed : minimum;
+        valid_all &= valid;
+    }
+
+    for (uint32_t j = 0; j < 3; j++) {
+        double value = 0.0;
+        if (j <= model->degree) {
+            const double *row = &model->fit[j * model->num_paths];
+            for (uint32_t i = 0; i < model->num_paths; i++) {
+                value += row[i] * speeds[i];
+            }
+        }
+        profile->coeffs[j] = value;
+    }
+
+    profile->mean = sum / (double)model->num_paths;
+    profile->minimum = minimum;
+
+    uint32_t stratified = 2.0 * fabs(profile->coeffs[1]) >
+                          model->stratification_threshold * profile->coeffs[0];
+    uint32_t gas = profile->mean - minimum > model->gas_threshold * profile->mean;
+    profile->flags = valid_all ? (stratified * SOUND_SPEED_STRATIFIED) | (gas * SOUND_SPEED_GAS) :
+                                 SOUND_SPEED_INVALID;
+
+    if (path_sound_speeds) {
+        memcpy(path_sound_speeds, speeds, model->num_paths * sizeof(double));
+    }
+
+    return flow;
+}
+
+/**
+ * Flow and sound-speed profile of one frame in a single pass
+ */
+double sound_speed_frame(const SoundSpeedModel *model, const CompiledConfig *compiled,
+                         const PathMeasurement *measurements,
+                         double *path_sound_speeds, SoundSpeedProfile *profile)
+{
+    return profile_frame(model, compiled, measurements, path_sound_speeds, profile);
+}
+
+/**
+ * Flow and sound-speed profiles for a batch of frames
+ */
+int sound_speed_batch(const SoundSpeedModel *model, const CompiledConfig *compiled,
+                      const PathMeasurement *frames, size_t num_frames,
+                      double *flows, SoundSpeedProfile *profiles)
+{
+    if (!model || !compiled || !frames || !flows || !profiles) {
+        return -1;
+    }
+
+    if (compiled->num_paths != model->num_paths || !compiled->flow_coeff) {
+        return -1;
+    }
+
+    for (size_t f = 0; f < num_frames; f++) {
+        flows[f] = profile_frame(model, compiled, &frames[f * model->num_paths],
+                                 NULL, &profiles[f]);
+    }
+
+    return 0;
+}
+
+/**
+ * Free memory owned by a sound-speed model
+ */
+void sound_speed_free(SoundSpeedModel *model)
+{
+    if (model) {
+        free(model->half_length);
+        model->half_length = NULL;
+        model->fit = NULL;
+        model->num_paths = 0;
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef SOUNDSPEED_H
+#define SOUNDSPEED_H
+
+#include "flowmeter.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Profile flags */
+#define SOUND_SPEED_STRATIFIED 0x1u  /* Sound speed varies across the section */
+#define SOUND_SPEED_GAS        0x2u  /* A path is much slower than the others */
+#define SOUND_SPEED_INVALID    0x4u  /* A path had a non-positive transit time */
+
+/*
+ * Cross-sectional sound-speed profile
+ *
+ * The transit times of a path give its sound speed independently of flow:
+ *
+ *   1/t_up + 1/t_down = 2c/L   =>   c = L * (t_up + t_down) / (2 * t_up * t_down)
+ *
+ * sharing the 1 / (t_up * t_down) factor with the velocity term. Path
+ * sound speeds are fitted by least squares with c(p) = c0 + c1 p + c2 p²
+ * over the normalized path positions p; the fit is a fixed linear map
+ * (the pseudo-inverse of the position matrix), so it is precomputed per
+ * configuration. The polynomial degree is limited by the number of
+ * distinct positions (a 2-path meter fits a line).
+ *
+ * A thermally stratified fluid shows as a gradient across the section:
+ * the frame is flagged when |c(1) - c(-1)| / c0 = 2|c1| / c0 exceeds
+ * the stratification threshold. Entrained gas slows sound sharply in the
+ * layer it occupies: the frame is flagged when the slowest path is more
+ * than the gas threshold (relative) below the mean path sound speed.
+ */
+typedef struct {
+    uint32_t num_paths;               /* Paths per frame */
+    uint32_t degree;                  /* Fitted polynomial degree, 0 to 2 */
+    double *half_length;              /* L_i / 2 per path */
+    double *fit;                      /* (degree + 1) x num_paths pseudo-inverse */
+    double stratification_threshold;  /* Limit on 2|c1| / c0 */
+    double gas_threshold;             /* Limit on (mean - min) / mean */
+} SoundSpeedModel;
+
+/* Fitted profile of one frame */
+typedef struct {
+    double coeffs[3];   /* c(p) = coeffs[0] + coeffs[1] p + coeffs[2] p² in m/s */
+    double mean;        /* Mean path sound speed in m/s */
+    double minimum;     /* Slowest path sound speed in m/s */
+    uint32_t flags;     /* SOUND_SPEED_* */
+} SoundSpeedProfile;
+
+/**
+ * Precompute path half-lengths and the profile fit for a configuration
+ *
+ * @param model Output structure, release with sound_speed_free()
+ * @param config Flow meter configuration
+ * @param stratification_threshold Relative sound-speed difference across
+ *                                 the section that counts as stratified
+ * @param gas_threshold Relative drop of the slowest path below the mean
+ *                      that counts as gas
+ * @return 0 on success, -1 on error (including more than
+ *         FLOWMETER_MAX_PATHS paths)
+ */
+int sound_speed_init(SoundSpeedModel *model, const FlowMeterConfig *config,
+                     double stratification_threshold, double gas_threshold);
+
+/**
+ * Flow and sound-speed profile of one frame in a single pass
+ *
+ * @param model Sound-speed model of the configuration
+ * @param compiled Compiled configuration with the same paths
+ * @param measurements Measurements of one frame (one per path)
+ * @param path_sound_speeds Output sound speed per path in m/s, or NULL
+ * @param profile Output profile
+ * @return Volumetric flow in m³/s
+ */
+double sound_speed_frame(const SoundSpeedModel *model, const CompiledConfig *compiled,
+                         const PathMeasurement *measurements,
+                         double *path_sound_speeds, SoundSpeedProfile *profile);
+
+/**
+ * Flow and sound-speed profiles for a batch of frames
+ *
+ * @param model Sound-speed model of the configuration
+ * @param compiled Compiled configuration with the same paths
+ * @param frames Frame-major measurements, num_paths per frame
+ * @param num_frames Number of frames
+ * @param flows Output array of num_frames flow rates in m³/s
+ * @param profiles Output array of num_frames profiles
+ * @return 0 on success, -1 on error
+ */
+int sound_speed_batch(const SoundSpeedModel *model, const CompiledConfig *compiled,
+                      const PathMeasurement *frames, size_t num_frames,
+                      double *flows, SoundSpeedProfile *profiles);
+
+/**
+ * Free memory owned by a sound-speed model
+ *
+ * @param model Sound-speed model
+ */
+void sound_speed_free(SoundSpeedModel *model);
+
+#endif /* SOUNDSPEED_H */
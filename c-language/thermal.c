@@ -0,0 +1,112 @@
+#include "thermal.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Fill buffer b with the reference coefficients scaled to a temperature
+ */
+static void thermal_fill(ThermalCompensation *thermal, int b, double temperature)
+{
+    const CompiledConfig *reference = &thermal->reference;
+    uint32_t num_paths = reference->num_paths;
+    double *velocity_scale = thermal->storage + (size_t)(2 * b) * num_paths;
+    double *flow_coeff = thermal->storage + (size_t)(2 * b + 1) * num_paths;
+    double s = 1.0 + thermal->alpha * (temperature - thermal->reference_temperature);
+    double s3 = s * s * s;
+
+    for (uint32_t i = 0; i < num_paths; i++) {
+        velocity_scale[i] = reference->velocity_scale[i] * s;
+        flow_coeff[i] = reference->flow_coeff[i] * s3;
+    }
+    thermal->buffers[b].area = reference->area * s * s;
+}
+
+/**
+ * Compile a configuration for temperature compensation
+ */
+int thermal_init(ThermalCompensation *thermal, const FlowMeterConfig *config,
+                 double alpha, double reference_temperature, double threshold)
+{
+    if (!thermal || !config || !isfinite(alpha) || !isfinite(reference_temperature) ||
+        !(threshold >= 0.0)) {
+        return -1;
+    }
+
+    memset(thermal, 0, sizeof(*thermal));
+    if (flowmeter_compile(config, &thermal->reference) != 0) {
+        return -1;
+    }
+
+    uint32_t num_paths = thermal->reference.num_paths;
+    thermal->storage = malloc(4 * num_paths * sizeof(double));
+    if (!thermal->storage) {
+        flowmeter_compiled_free(&thermal->reference);
+        return -1;
+    }
+
+    for (int b = 0; b < 2; b++) {
+        thermal->buffers[b].num_paths = num_paths;
+        thermal->buffers[b].velocity_scale = thermal->storage + (size_t)(2 * b) * num_paths;
+        thermal->buffers[b].flow_coeff = thermal->storage + (size_t)(2 * b + 1) * num_paths;
+        thermal->buffers[b].storage = NULL;
+    }
+
+    thermal->alpha = alpha;
+    thermal->reference_temperature = reference_temperature;
+    thermal->threshold = threshold;
+    thermal->applied_temperature = reference_temperature;
+
+    thermal_fill(thermal, 0, reference_temperature);
+    __atomic_store_n(&thermal->active, &thermal->buffers[0], __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/**
+ * Report a new process temperature
+ *
+ * Only the updating thread writes applied_temperature and the inactive
+ * buffer, so plain accesses suffice for them. The inactive buffer may
+ * still be held by readers from two updates ago: its sequence goes odd,
+ * with a release fence before the refill, so those readers see the change
+ * in thermal_read_retry(). The release store of the active pointer orders
+ * the buffer contents before its publication.
+ */
+int thermal_update(ThermalCompensation *thermal, double temperature)
+{
+    if (!thermal || !thermal->storage || !isfinite(temperature)) {
+        return -1;
+    }
+
+    if (fabs(temperature - thermal->applied_temperature) < thermal->threshold) {
+        return 0;
+    }
+
+    const CompiledConfig *active = __atomic_load_n(&thermal->active, __ATOMIC_RELAXED);
+    int next = (active == &thermal->buffers[0]) ? 1 : 0;
+
+    uint64_t sequence = thermal->sequences[next];
+    __atomic_store_n(&thermal->sequences[next], sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    thermal_fill(thermal, next, temperature);
+    __atomic_store_n(&thermal->sequences[next], sequence + 2, __ATOMIC_RELEASE);
+    thermal->applied_temperature = temperature;
+    thermal->recomputes++;
+    __atomic_store_n(&thermal->active, &thermal->buffers[next], __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+/**
+ * Free memory owned by a thermal compensation
+ */
+void thermal_free(ThermalCompensation *thermal)
+{
+    if (thermal) {
+        flowmeter_compiled_free(&thermal->reference);
+        free(thermal->storage);
+        thermal->storage = NULL;
+        thermal->active = NULL;
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef THERMAL_H
+#define THERMAL_H
+
+#include "flowmeter.h"
+
+/* Linear expansion coefficients of common pipe materials in 1/K */
+#define THERMAL_ALPHA_CARBON_STEEL    12.0e-6
+#define THERMAL_ALPHA_STAINLESS_STEEL 16.0e-6
+
+/*
+ * Temperature-compensated meter geometry
+ *
+ * The pipe and transducer mounting expand isotropically by
+ * s = 1 + alpha * (T - T_ref): diameter and path lengths scale by s and
+ * path angles are unchanged. Per-path coefficients therefore follow from
+ * the reference ones without trigonometry:
+ *
+ *   velocity_scale(T) = s   * velocity_scale(T_ref)
+ *   flow_coeff(T)     = s^3 * flow_coeff(T_ref)      (area scales by s^2)
+ *
+ * Coefficients are double-buffered. thermal_update() recomputes them only
+ * when the temperature has moved by at least the threshold since the
+ * last recomputation, fills the inactive buffer and publishes it with a
+ * release store. One thread may update while others read. A buffer is
+ * refilled two updates after it was published, so each buffer carries a
+ * sequence number that is odd while it is being rewritten: readers fetch
+ * the config with thermal_read_begin(), run their batch, and repeat it if
+ * thermal_read_retry() reports that the buffer changed underneath them.
+ * Readers never block the updater and only retry when a batch spans two
+ * updates.
+ */
+typedef struct {
+    CompiledConfig reference;      /* Coefficients at the reference temperature */
+    CompiledConfig buffers[2];     /* Compensated coefficients (views into storage) */
+    double *storage;               /* Owned storage for both buffers */
+    const CompiledConfig *active;  /* Published buffer, see thermal_read_begin() */
+    uint64_t sequences[2];         /* Per-buffer sequence, odd while being refilled */
+    double alpha;                  /* Linear expansion coefficient in 1/K */
+    double reference_temperature;  /* Temperature of the configured geometry in °C */
+    double threshold;              /* Temperature change that triggers a recompute in K */
+    double applied_temperature;    /* Temperature of the active coefficients in °C */
+    uint64_t recomputes;           /* Number of coefficient recomputations */
+} ThermalCompensation;
+
+/**
+ * Compile a configuration for temperature compensation
+ *
+ * The active coefficients start at the reference temperature.
+ *
+ * @param thermal Output structure, release with thermal_free()
+ * @param config Geometry measured at the reference temperature
+ * @param alpha Linear expansion coefficient in 1/K
+ * @param reference_temperature Temperature of the configured geometry in °C
+ * @param threshold Temperature change in K that triggers a recompute (>= 0)
+ * @return 0 on success, -1 on error
+ */
+int thermal_init(ThermalCompensation *thermal, const FlowMeterConfig *config,
+                 double alpha, double reference_temperature, double threshold);
+
+/**
+ * Report a new process temperature
+ *
+ * @param thermal Thermal compensation (single updating thread)
+ * @param temperature Pipe temperature in °C
+ * @return 1 if new coefficients were published, 0 if the change was
+ *         below the threshold, -1 on error
+ */
+int thermal_update(ThermalCompensation *thermal, double temperature);
+
+/**
+ * Start reading the compensated coefficients for the current temperature
+ *
+ * @param thermal Thermal compensation
+ * @param sequence Output sequence to pass to thermal_read_retry()
+ * @return Active compiled configuration (owned by thermal)
+ */
+static inline const CompiledConfig* thermal_read_begin(const ThermalCompensation *thermal,
+                                                       uint64_t *sequence)
+{
+    for (;;) {
+        const CompiledConfig *config = __atomic_load_n(&thermal->active, __ATOMIC_ACQUIRE);
+        uint64_t current = __atomic_load_n(&thermal->sequences[config - thermal->buffers],
+                                           __ATOMIC_ACQUIRE);
+        /* Odd: the updater is already refilling it, so a newer one is published */
+        if (!(current & 1)) {
+            *sequence = current;
+            return config;
+        }
+    }
+}
+
+/**
+ * Check whether coefficients read since thermal_read_begin() may be torn
+ *
+ * @param thermal Thermal compensation
+ * @param config Configuration returned by thermal_read_begin()
+ * @param sequence Sequence returned by thermal_read_begin()
+ * @return 1 if the buffer was rewritten meanwhile and the results must be
+ *         recomputed, 0 if they are consistent
+ */
+static inline int thermal_read_retry(const ThermalCompensation *thermal,
+                                     const CompiledConfig *config, uint64_t sequence)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&thermal->sequences[config - thermal->buffers],
+                           __ATOMIC_RELAXED) != sequence;
+}
+
+/**
+ * Free memory owned by a thermal compensation
+ *
+ * @param thermal Thermal compensation
+ */
+void thermal_free(ThermalCompensation *thermal);
+
+#endif /* THERMAL_H */
@@ -0,0 +1,374 @@
+#include "tomography.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* tomography_batch() keeps one sum per frame of a block in a register */
+#if TOMOGRAPHY_BLOCK != 4
+#error "tomography_batch() is written for blocks of 4 frames"
+#endif
+
+/* Chord samples per pixel width when building the projection matrix */
+#define SAMPLES_PER_PIXEL 16
+
+/**
+ * Cholesky factorization of a symmetric positive definite matrix in
+ * place (lower triangle)
+ *
+ * @return 0 on success, -1 if the matrix is not positive definite
+ */
+static int cholesky_factor(double *matrix, uint32_t size)
+{
+    for (uint32_t j = 0; j < size; j++) {
+        double *row_j = &matrix[(size_t)j * size];
+        double diagonal = row_j[j];
+
+        for (uint32_t k = 0; k < j; k++) {
+            diagonal -= row_j[k] * row_j[k];
+        }
+        if (!(diagonal > 0.0)) {
+            return -1;
+        }
+        row_j[j] = sqrt(diagonal);
+
+        for (uint32_t i = j + 1; i < size; i++) {
+            double *row_i = &matrix[(size_t)i * size];
+            double value = row_i[j];
+            for (uint32_t k = 0; k < j; k++) {
+                value -= row_i[k] * row_j[k];
+            }
+            row_i[j] = value / row_j[j];
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Solve L Lᵀ x = b in place with a factor from cholesky_factor()
+ */
+static void cholesky_solve(const double *factor, uint32_t size, double *x)
+{
+    for (uint32_t i = 0; i < size; i++) {
+        const double *row = &factor[(size_t)i * size];
+        double value = x[i];
+        for (uint32_t k = 0; k < i; k++) {
+            value -= row[k] * x[k];
+        }
+        x[i] = value / row[i];
+    }
+
+    for (uint32_t i = size; i-- > 0;) {
+        double value = x[i];
+        for (uint32_t k = i + 1; k < size; k++) {
+            value -= factor[(size_t)k * size + i] * x[k];
+        }
+        x[i] = value / factor[(size_t)i * size + i];
+    }
+}
+
+/**
+ * Fill row `path` of the projection matrix by sampling the chord
+ *
+ * The chord is p·n + s·d for |s| <= sqrt(1 - p²), with d the chord
+ * direction and n its normal. Samples falling in pixels whose centres are
+ * outside the pipe are dropped and the row renormalized to sum to 1.
+ */
+static void project_chord(const Tomography *tomography, double position,
+                          double orientation, double *row)
+{
+    uint32_t grid = tomography->grid;
+    uint32_t samples = SAMPLES_PER_PIXEL * grid;
+    double half_chord = sqrt(fmax(0.0, 1.0 - position * position));
+    double dx = cos(orientation), dy = sin(orientation);
+    double counted = 0.0;
+
+    memset(row, 0, tomography->num_pixels * sizeof(double));
+
+    for (uint32_t k = 0; k < samples; k++) {
+        double s = half_chord * (2.0 * ((double)k + 0.5) / (double)samples - 1.0);
+        double x = -position * dy + s * dx;
+        double y = position * dx + s * dy;
+        int32_t column = (int32_t)floor((x + 1.0) * 0.5 * grid);
+        int32_t line = (int32_t)floor((y + 1.0) * 0.5 * grid);
+
+        if (column < 0 || line < 0 || column >= (int32_t)grid || line >= (int32_t)grid) {
+            continue;
+        }
+        int32_t pixel = tomography->pixel_map[line * (int32_t)grid + column];
+        if (pixel >= 0) {
+            row[pixel] += 1.0;
+            counted += 1.0;
+        }
+    }
+
+    for (uint32_t j = 0; counted > 0.0 && j < tomography->num_pixels; j++) {
+        row[j] /= counted;
+    }
+}
+
+/**
+ * Build the reconstruction operator for a configuration
+ */
+int tomography_init(Tomography *tomography, const FlowMeterConfig *config,
+                    const double *orientations, uint32_t grid, double regularization)
+{
+    if (!tomography || !config || !config->paths || grid < 4 || grid > 64 ||
+        !(regularization > 0.0)) {
+        return -1;
+    }
+
+    if (config->num_paths == 0 || config->num_paths > FLOWMETER_MAX_PATHS) {
+        return -1;
+    }
+
+    memset(tomography, 0, sizeof(*tomography));
+    if (flowmeter_compile(config, &tomography->compiled) != 0) {
+        return -1;
+    }
+
+    uint32_t num_paths = config->num_paths;
+    tomography->num_paths = num_paths;
+    tomography->grid = grid;
+    tomography->pixel_map = malloc((size_t)grid * grid * sizeof(int32_t));
+    if (!tomography->pixel_map) {
+        tomography_free(tomography);
+        return -1;
+    }
+
+    uint32_t num_pixels = 0;
+    for (uint32_t line = 0; line < grid; line++) {
+        for (uint32_t column = 0; column < grid; column++) {
+            double x = 2.0 * ((double)column + 0.5) / grid - 1.0;
+            double y = 2.0 * ((double)line + 0.5) / grid - 1.0;
+            tomography->pixel_map[line * grid + column] =
+                (x * x + y * y < 1.0) ? (int32_t)num_pixels++ : -1;
+        }
+    }
+    tomography->num_pixels = num_pixels;
+
+    double *projection = malloc((size_t)num_paths * num_pixels * sizeof(double));
+    double *normal = calloc((size_t)num_pixels * num_pixels, sizeof(double));
+    tomography->rows = malloc((size_t)(num_pixels + 1) * num_paths * sizeof(double));
+    if (!projection || !normal || !tomography->rows) {
+        free(projection);
+        free(normal);
+        tomography_free(tomography);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < num_paths; i++) {
+        project_chord(tomography, config->paths[i].position,
+                      orientations ? orientations[i] : 0.0,
+                      &projection[(size_t)i * num_pixels]);
+    }
+
+    /* AᵀA, accumulated chord by chord over the pixels each one crosses */
+    for (uint32_t i = 0; i < num_paths; i++) {
+        const double *row = &projection[(size_t)i * num_pixels];
+        for (uint32_t j = 0; j < num_pixels; j++) {
+            if (row[j] == 0.0) {
+                continue;
+            }
+            for (uint32_t k = 0; k < num_pixels; k++) {
+                normal[(size_t)j * num_pixels + k] += row[j] * row[k];
+            }
+        }
+    }
+
+    /*
+     * λLᵀL: each Laplacian row is -1 at the neighbours inside the pipe and
+     * their count at the pixel. Penalizing the wall as zero velocity
+     * instead biases a turbulent profile's flow by several percent low.
+     */
+    for (uint32_t line = 0; line < grid; line++) {
+        for (uint32_t column = 0; column < grid; column++) {
+            int32_t centre = tomography->pixel_map[line * grid + column];
+            if (centre < 0) {
+                continue;
+            }
+
+            int32_t indices[5] = { centre, -1, -1, -1, -1 };
+            double values[5] = { 0.0, -1.0, -1.0, -1.0, -1.0 };
+            if (column > 0) indices[1] = tomography->pixel_map[line * grid + column - 1];
+            if (column + 1 < grid) indices[2] = tomography->pixel_map[line * grid + column + 1];
+            if (line > 0) indices[3] = tomography->pixel_map[(line - 1) * grid + column];
+            if (line + 1 < grid) indices[4] = tomography->pixel_map[(line + 1) * grid + column];
+
+            for (int a = 1; a < 5; a++) {
+                values[0] += (indices[a] >= 0) ? 1.0 : 0.0;
+            }
+
+            for (int a = 0; a < 5; a++) {
+                for (int b = 0; b < 5 && indices[a] >= 0; b++) {
+                    if (indices[b] >= 0) {
+                        normal[(size_t)indices[a] * num_pixels + (size_t)indices[b]] +=
+                            regularization * values[a] * values[b];
+                    }
+                }
+            }
+        }
+    }
+
+    if (cholesky_factor(normal, num_pixels) != 0) {
+        free(projection);
+        free(normal);
+        tomography_free(tomography);
+        return -1;
+    }
+
+    /* Column i of R solves (AᵀA + λLᵀL) r = Aᵀ e_i, i.e. row i of A */
+    double *column = malloc(num_pixels * sizeof(double));
+    if (!column) {
+        free(projection);
+        free(normal);
+        tomography_free(tomography);
+        return -1;
+    }
+
+    /* Pixel areas scaled so the pixels cover exactly the pipe area */
+    double pixel_area = tomography->compiled.area / (double)num_pixels;
+    double *flow_row = &tomography->rows[(size_t)num_pixels * num_paths];
+
+    for (uint32_t i = 0; i < num_paths; i++) {
+        memcpy(column, &projection[(size_t)i * num_pixels], num_pixels * sizeof(double));
+        cholesky_solve(normal, num_pixels, column);
+
+        double flow = 0.0;
+        for (uint32_t j = 0; j < num_pixels; j++) {
+            tomography->rows[(size_t)j * num_paths + i] = column[j];
+            flow += pixel_area * column[j];
+        }
+        flow_row[i] = flow;
+    }
+
+    free(column);
+    free(projection);
+    free(normal);
+    return 0;
+}
+
+/**
+ * Reconstruct the velocity field and flow of one frame
+ */
+double tomography_frame(const Tomography *tomography,
+                        const PathMeasurement *measurements, double *field)
+{
+    uint32_t num_paths = tomography->num_paths;
+    double velocities[FLOWMETER_MAX_PATHS];
+
+    calculate_path_velocities_compiled(&tomography->compiled, measurements, velocities);
+
+    const double *flow_row = &tomography->rows[(size_t)tomography->num_pixels * num_paths];
+    double flow = 0.0;
+    for (uint32_t i = 0; i < num_paths; i++) {
+        flow += flow_row[i] * velocities[i];
+    }
+
+    for (uint32_t j = 0; field && j < tomography->num_pixels; j++) {
+        const double *row = &tomography->rows[(size_t)j * num_paths];
+        double value = 0.0;
+        for (uint32_t i = 0; i < num_paths; i++) {
+            value += row[i] * velocities[i];
+        }
+        field[j] = value;
+    }
+
+    return flow;
+}
+
+/**
+ * Store the sums of one operator row for a block of frames: a pixel of
+ * each frame's field, or the flows for the last row
+ */
+static inline void store_row(double *fields, double *flows, uint32_t num_pixels,
+                             uint32_t row, const double *sums, size_t count)
+{
+    for (size_t b = 0; b < count; b++) {
+        if (row < num_pixels) {
+            fields[b * num_pixels + row] = sums[b];
+        } else {
+            flows[b] = sums[b];
+        }
+    }
+}
+
+/**
+ * Reconstruct fields and flows for a batch of frames
+ *
+ * The velocities of a block are transposed to path-major order, and two
+ * operator rows are applied to the block at a time. That keeps eight
+ * independent sums in registers, where a single frame has one chain of
+ * dependent additions per row. Each sum still adds its terms in path
+ * order, so the results match tomography_frame() exactly. Without
+ * fields only the flow row is applied.
+ */
+int tomography_batch(const Tomography *tomography, const PathMeasurement *frames,
+                     size_t num_frames, double *fields, double *flows)
+{
+    if (!tomography || !tomography->rows || !frames || !flows) {
+        return -1;
+    }
+
+    uint32_t num_paths = tomography->num_paths;
+    uint32_t num_pixels = tomography->num_pixels;
+    uint32_t first = fields ? 0 : num_pixels;
+    uint32_t end = num_pixels + 1;
+    double block[FLOWMETER_MAX_PATHS][TOMOGRAPHY_BLOCK];
+
+    for (size_t f = 0; f < num_frames; f += TOMOGRAPHY_BLOCK) {
+        size_t count = (num_frames - f < TOMOGRAPHY_BLOCK) ? num_frames - f : TOMOGRAPHY_BLOCK;
+        double *block_fields = fields ? &fields[f * num_pixels] : NULL;
+
+        for (uint32_t b = 0; b < TOMOGRAPHY_BLOCK; b++) {
+            const PathMeasurement *measurements = &frames[(f + (b < count ? b : 0)) * num_paths];
+            for (uint32_t i = 0; i < num_paths; i++) {
+                block[i][b] = tomography->compiled.velocity_scale[i] *
+                              path_transit_term(&measurements[i]);
+            }
+        }
+
+        for (uint32_t r = first; r < end; r += 2) {
+            /* An odd last row is paired with itself and stored once */
+            const double *row0 = &tomography->rows[(size_t)r * num_paths];
+            const double *row1 = (r + 1 < end) ? row0 + num_paths : row0;
+            double a0 = 0.0, a1 = 0.0, a2 = 0.0, a3 = 0.0;
+            double b0 = 0.0, b1 = 0.0, b2 = 0.0, b3 = 0.0;
+
+            for (uint32_t i = 0; i < num_paths; i++) {
+                a0 += row0[i] * block[i][0];
+                a1 += row0[i] * block[i][1];
+                a2 += row0[i] * block[i][2];
+                a3 += row0[i] * block[i][3];
+                b0 += row1[i] * block[i][0];
+                b1 += row1[i] * block[i][1];
+                b2 += row1[i] * block[i][2];
+                b3 += row1[i] * block[i][3];
+            }
+
+            double sums0[TOMOGRAPHY_BLOCK] = { a0, a1, a2, a3 };
+            double sums1[TOMOGRAPHY_BLOCK] = { b0, b1, b2, b3 };
+            store_row(block_fields, &flows[f], num_pixels, r, sums0, count);
+            if (r + 1 < end) {
+                store_row(block_fields, &flows[f], num_pixels, r + 1, sums1, count);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Free memory owned by a tomography operator
+ */
+void tomography_free(Tomography *tomography)
+{
+    if (tomography) {
+        flowmeter_compiled_free(&tomography->compiled);
+        free(tomography->pixel_map);
+        free(tomography->rows);
+        tomography->pixel_map = NULL;
+        tomography->rows = NULL;
+        tomography->num_pixels = 0;
+    }
+}
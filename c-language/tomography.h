@@ -0,0 +1,95 @@
+#ifndef TOMOGRAPHY_H
+#define TOMOGRAPHY_H
+
+#include "flowmeter.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Frames processed together by tomography_batch() */
+#define TOMOGRAPHY_BLOCK 4
+
+/*
+ * Tomographic reconstruction of the axial velocity field
+ *
+ * The cross-section is divided into a grid of square pixels; the pixels
+ * whose centres lie inside the pipe carry the unknown axial velocities u.
+ * Each path measures the mean of u along its chord, v = A u, where row i
+ * of A holds the fraction of chord i inside each pixel. A chord is
+ * located by its offset (the path position, normalized to the radius)
+ * and its orientation in the cross-section; parallel chords alone only
+ * resolve the field across them, so high-path-count meters should use
+ * several orientations.
+ *
+ * With far fewer paths than pixels the field is found by Tikhonov
+ * regularized least squares,
+ *
+ *   u = argmin |A u - v|² + λ |L u|²  =  (AᵀA + λLᵀL)⁻¹ Aᵀ v  =  R v
+ *
+ * where L is the 5-point Laplacian over the pixels inside the pipe. No
+ * wall condition is imposed, so the field is as flat near the wall as
+ * the chords allow. R is precomputed per configuration by Cholesky
+ * factorization, together with the flow row q = aᵀR (a = pixel areas),
+ * so a frame costs one matrix-vector product with the stacked
+ * (pixels + 1) x paths matrix [R; q].
+ */
+typedef struct {
+    uint32_t num_paths;        /* Paths per frame */
+    uint32_t grid;             /* Pixels per side of the square grid */
+    uint32_t num_pixels;       /* Pixels inside the pipe */
+    int32_t *pixel_map;        /* grid x grid, pixel index or -1 outside */
+    double *rows;              /* (num_pixels + 1) x num_paths, [R; q] row-major */
+    CompiledConfig compiled;   /* Path velocity coefficients (owned) */
+} Tomography;
+
+/**
+ * Build the reconstruction operator for a configuration
+ *
+ * @param tomography Output structure, release with tomography_free()
+ * @param config Flow meter configuration
+ * @param orientations Chord orientation per path in radians within the
+ *                     cross-section, or NULL for all parallel
+ * @param grid Pixels per side (4 to 64)
+ * @param regularization Smoothing weight λ (> 0); larger values give
+ *                       smoother fields
+ * @return 0 on success, -1 on error (including more than
+ *         FLOWMETER_MAX_PATHS paths)
+ */
+int tomography_init(Tomography *tomography, const FlowMeterConfig *config,
+                    const double *orientations, uint32_t grid, double regularization);
+
+/**
+ * Reconstruct the velocity field and flow of one frame
+ *
+ * @param tomography Tomography operator
+ * @param measurements Measurements of one frame (one per path)
+ * @param field Output axial velocity per pixel in m/s, or NULL
+ * @return Volumetric flow integrated over the field in m³/s
+ */
+double tomography_frame(const Tomography *tomography,
+                        const PathMeasurement *measurements, double *field);
+
+/**
+ * Reconstruct fields and flows for a batch of frames
+ *
+ * Frames are processed in blocks of TOMOGRAPHY_BLOCK so every operator
+ * row is loaded once per block and the sums of a block run in parallel.
+ * Results are identical to tomography_frame().
+ *
+ * @param tomography Tomography operator
+ * @param frames Frame-major measurements, num_paths per frame
+ * @param num_frames Number of frames
+ * @param fields Output num_frames x num_pixels velocities, or NULL
+ * @param flows Output array of num_frames flow rates in m³/s
+ * @return 0 on success, -1 on error
+ */
+int tomography_batch(const Tomography *tomography, const PathMeasurement *frames,
+                     size_t num_frames, double *fields, double *flows);
+
+/**
+ * Free memory owned by a tomography operator
+ *
+ * @param tomography Tomography operator
+ */
+void tomography_free(Tomography *tomography);
+
+#endif /* TOMOGRAPHY_H */
@@ -0,0 +1,79 @@
+#include "totalizer.h"
+
+/**
+ * Initialize a totalizer with all totals at zero
+ */
+int totalizer_init(FlowTotalizer *totalizer, double deadband, double hysteresis)
+{
+    if (!totalizer || !(deadband >= 0.0) || !(hysteresis >= 0.0)) {
+        return -1;
+    }
+
+    totalizer->deadband = deadband;
+    totalizer->hysteresis = hysteresis;
+    totalizer_reset(totalizer);
+
+    return 0;
+}
+
+/**
+ * Reset all totals and the latched direction
+ */
+void totalizer_reset(FlowTotalizer *totalizer)
+{
+    if (!totalizer) {
+        return;
+    }
+
+    totalizer->forward_total = 0.0;
+    totalizer->reverse_total = 0.0;
+    totalizer->net_total = 0.0;
+    totalizer->direction = 0;
+}
+
+/**
+ * Accumulate a single flow sample
+ */
+int32_t totalizer_update(FlowTotalizer *totalizer, double flow, double dt)
+{
+    if (!totalizer) {
+        return 0;
+    }
+
+    totalizer_update_batch(totalizer, &flow, 1, dt);
+    return totalizer->direction;
+}
+
+/**
+ * Accumulate a batch of equally spaced flow samples
+ *
+ * Direction state machine, with T = deadband + hysteresis:
+ * - forward stays latched while flow > deadband, entered when flow > T
+ * - reverse stays latched while flow < -deadband, entered when flow < -T
+ * - anything else is cut off and not counted
+ *
+ * The thresholds are looked up from the previous direction, and the
+ * contributions by ternary selects that compile to maxsd/blend,
+ * so there are no data-dependent branches. A NaN sample compares false
+ * everywhere and is treated as cut off.
+ */
+void totalizer_update_batch(FlowTotalizer *totalizer, const double *flows,
+                            size_t count, double dt)
+{
+    if (!totalizer || !flows) {
+        return;
+    }
+
+    TotalizerThresholds thresholds;
+    double forward = 0.0;
+    double reverse = 0.0;
+    int32_t direction = totalizer->direction;
+
+    totalizer_thresholds(totalizer, &thresholds);
+
+    for (size_t i = 0; i < count; i++) {
+        direction = totalizer_step(&thresholds, direction, flows[i], &forward, &reverse);
+    }
+
+    totalizer_commit(totalizer, forward, reverse, direction, dt);
+}
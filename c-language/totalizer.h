@@ -0,0 +1,125 @@
+#ifndef TOTALIZER_H
+#define TOTALIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Bidirectional flow totalizer
+ *
+ * Keeps separate forward, reverse and net volume totals. Flow inside the
+ * deadband (low-flow cutoff) is not counted; once cut off, the flow must
+ * exceed deadband + hysteresis to be counted again, which stops noise
+ * around zero from chattering between directions.
+ */
+typedef struct {
+    double forward_total;  /* Accumulated forward volume in m³ */
+    double reverse_total;  /* Accumulated reverse volume in m³ (positive) */
+    double net_total;      /* forward_total - reverse_total in m³ */
+    double deadband;       /* Low-flow cutoff around zero in m³/s */
+    double hysteresis;     /* Extra margin to leave the cutoff in m³/s */
+    int32_t direction;     /* Latched direction: +1 forward, -1 reverse, 0 cut off */
+} FlowTotalizer;
+
+/* Entry thresholds indexed by direction + 1 */
+typedef struct {
+    double enter_forward[3];  /* Flow above which forward is counted */
+    double enter_reverse[3];  /* Flow below minus this is counted as reverse */
+} TotalizerThresholds;
+
+/**
+ * Precompute entry thresholds; hysteresis only applies when entering a
+ * direction, not while it is latched
+ */
+static inline void totalizer_thresholds(const FlowTotalizer *totalizer,
+                                        TotalizerThresholds *thresholds)
+{
+    double entry = totalizer->deadband + totalizer->hysteresis;
+
+    thresholds->enter_forward[0] = entry;
+    thresholds->enter_forward[1] = entry;
+    thresholds->enter_forward[2] = totalizer->deadband;
+    thresholds->enter_reverse[0] = totalizer->deadband;
+    thresholds->enter_reverse[1] = entry;
+    thresholds->enter_reverse[2] = entry;
+}
+
+/**
+ * One branch-free totalizer step for callers that fuse totalization into
+ * their own per-frame loop; forward/reverse accumulate flow (not volume)
+ *
+ * @return New latched direction
+ */
+static inline int32_t totalizer_step(const TotalizerThresholds *thresholds,
+                                     int32_t direction, double flow,
+                                     double *forward, double *reverse)
+{
+    int32_t is_forward = flow > thresholds->enter_forward[direction + 1];
+    int32_t is_reverse = flow < -thresholds->enter_reverse[direction + 1];
+
+    *forward += is_forward ? flow : 0.0;
+    *reverse += is_reverse ? -flow : 0.0;
+
+    return is_forward - is_reverse;
+}
+
+/**
+ * Add flow sums accumulated with totalizer_step() to the totals
+ *
+ * @param totalizer Totalizer to update
+ * @param forward Sum of forward flow samples in m³/s
+ * @param reverse Sum of reverse flow samples in m³/s
+ * @param direction Latched direction after the last step
+ * @param dt Sample interval in seconds
+ */
+static inline void totalizer_commit(FlowTotalizer *totalizer, double forward,
+                                    double reverse, int32_t direction, double dt)
+{
+    totalizer->forward_total += forward * dt;
+    totalizer->reverse_total += reverse * dt;
+    totalizer->net_total = totalizer->forward_total - totalizer->reverse_total;
+    totalizer->direction = direction;
+}
+
+/**
+ * Initialize a totalizer with all totals at zero
+ *
+ * @param totalizer Totalizer to initialize
+ * @param deadband Low-flow cutoff in m³/s (>= 0)
+ * @param hysteresis Extra margin to leave the cutoff in m³/s (>= 0)
+ * @return 0 on success, -1 on error
+ */
+int totalizer_init(FlowTotalizer *totalizer, double deadband, double hysteresis);
+
+/**
+ * Reset all totals and the latched direction, keeping the cutoff settings
+ *
+ * @param totalizer Totalizer to reset
+ */
+void totalizer_reset(FlowTotalizer *totalizer);
+
+/**
+ * Accumulate a single flow sample
+ *
+ * @param totalizer Totalizer to update
+ * @param flow Volumetric flow rate in m³/s (negative for reverse flow)
+ * @param dt Sample interval in seconds
+ * @return Latched direction after the sample (+1, -1 or 0)
+ */
+int32_t totalizer_update(FlowTotalizer *totalizer, double flow, double dt);
+
+/**
+ * Accumulate a batch of equally spaced flow samples
+ *
+ * The loop is branch-free: direction changes are computed with compares
+ * and selects, so mixed-sign batches cost the same as single-sign ones.
+ *
+ * @param totalizer Totalizer to update
+ * @param flows Array of volumetric flow rates in m³/s
+ * @param count Number of samples
+ * @param dt Sample interval in seconds
+ */
+void totalizer_update_batch(FlowTotalizer *totalizer, const double *flows,
+                            size_t count, double dt);
+
+#endif /* TOTALIZER_H */
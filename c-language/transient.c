@@ -0,0 +1,244 @@
+#include "transient.h"
+#include <math.h>
+#include <string.h>
+
+/**
+ * Initialize a detector for a meter configuration
+ */
+int transient_detector_init(TransientDetector *detector, const FlowMeterConfig *config,
+                            const TransientLimits *limits)
+{
+    if (!detector || !config || !config->paths || !limits ||
+        !(limits->variance_ratio > 1.0) || !(limits->sound_speed_rate > 0.0) ||
+        !(limits->kurtosis > 0.0) || !(limits->noise_floor_ns > 0.0) ||
+        !(limits->half_life > 0.0) || limits->warmup == 0 || limits->hold == 0) {
+        return -1;
+    }
+
+    uint32_t num_paths = config->num_paths;
+    if (num_paths == 0 || num_paths > FLOWMETER_MAX_PATHS) {
+        return -1;
+    }
+
+    memset(detector, 0, sizeof(*detector));
+    detector->num_paths = num_paths;
+    detector->limits = *limits;
+    detector->decay = pow(0.5, 1.0 / limits->half_life);
+    detector->delta_scale = 1e9 / (double)num_paths;
+    for (uint32_t i = 0; i < num_paths; i++) {
+        if (!(config->paths[i].length > 0.0)) {
+            return -1;
+        }
+        detector->half_length[i] = 0.5 * config->paths[i].length / (double)num_paths;
+    }
+
+    return 0;
+}
+
+/**
+ * Mean Δt and sound speed of up to TRANSIENT_BLOCK frames
+ *
+ * The transit times of each path are gathered into contiguous block
+ * arrays first, so the arithmetic runs over a block's frames and
+ * vectorizes. Lanes past count repeat the first frame and are ignored.
+ */
+static void block_features(const TransientDetector *detector, const PathMeasurement *frames,
+                           size_t count, double *delta, double *speed)
+{
+    uint32_t num_paths = detector->num_paths;
+    double up[TRANSIENT_BLOCK];
+    double down[TRANSIENT_BLOCK];
+
+    for (uint32_t b = 0; b < TRANSIENT_BLOCK; b++) {
+        delta[b] = 0.0;
+        speed[b] = 0.0;
+    }
+
+    for (uint32_t i = 0; i < num_paths; i++) {
+        for (uint32_t b = 0; b < TRANSIENT_BLOCK; b++) {
+            const PathMeasurement *measurement = &frames[(b < count ? b : 0) * num_paths + i];
+            up[b] = measurement->t_upstream;
+            down[b] = measurement->t_downstream;
+        }
+
+        double half_length = detector->half_length[i];
+        for (uint32_t b = 0; b < TRANSIENT_BLOCK; b++) {
+            delta[b] += up[b] - down[b];
+            speed[b] += half_length * (up[b] + down[b]) / (up[b] * down[b]);
+        }
+    }
+
+    for (uint32_t b = 0; b < TRANSIENT_BLOCK; b++) {
+        delta[b] *= detector->delta_scale;
+    }
+}
+
+/**
+ * Evaluate the completed pending block
+ *
+ * Sums run in TRANSIENT_LANES independent accumulators so the loops
+ * vectorize without reassociating floating-point additions.
+ *
+ * @return 1 if an event was raised into event, 0 otherwise
+ */
+static int evaluate_block(TransientDetector *detector, TransientEvent *event)
+{
+    const double *delta = detector->delta_ns;
+    const double *speed = detector->sound_speed;
+    const TransientLimits *limits = &detector->limits;
+    double delta_sums[TRANSIENT_LANES] = { 0.0 };
+    double speed_sums[TRANSIENT_LANES] = { 0.0 };
+
+    for (uint32_t b = 0; b < TRANSIENT_BLOCK; b += TRANSIENT_LANES) {
+        for (uint32_t l = 0; l < TRANSIENT_LANES; l++) {
+            delta_sums[l] += delta[b + l];
+            speed_sums[l] += speed[b + l];
+        }
+    }
+
+    double delta_mean = 0.0;
+    double speed_mean = 0.0;
+    for (uint32_t l = 0; l < TRANSIENT_LANES; l++) {
+        delta_mean += delta_sums[l];
+        speed_mean += speed_sums[l];
+    }
+    delta_mean /= TRANSIENT_BLOCK;
+    speed_mean /= TRANSIENT_BLOCK;
+
+    double second[TRANSIENT_LANES] = { 0.0 };
+    double fourth[TRANSIENT_LANES] = { 0.0 };
+    for (uint32_t b = 0; b < TRANSIENT_BLOCK; b += TRANSIENT_LANES) {
+        for (uint32_t l = 0; l < TRANSIENT_LANES; l++) {
+            double y = delta[b + l] - delta_mean;
+            double y2 = y * y;
+            second[l] += y2;
+            fourth[l] += y2 * y2;
+        }
+    }
+
+    double variance = 0.0;
+    double moment4 = 0.0;
+    for (uint32_t l = 0; l < TRANSIENT_LANES; l++) {
+        variance += second[l];
+        moment4 += fourth[l];
+    }
+    variance /= TRANSIENT_BLOCK;
+    moment4 /= TRANSIENT_BLOCK;
+
+    double floor = limits->noise_floor_ns * limits->noise_floor_ns;
+    double mid_time = 0.5 * ((double)detector->timestamp_us[0] +
+                             (double)detector->timestamp_us[TRANSIENT_BLOCK - 1]);
+    double rate = 0.0;
+    if (detector->blocks == 0) {
+        detector->baseline = variance > floor ? variance : floor;
+    } else if (mid_time > detector->last_time_us) {
+        rate = (speed_mean - detector->last_sound_speed) /
+               ((mid_time - detector->last_time_us) * 1e-6);
+    }
+
+    double baseline = detector->baseline;
+    double ratio = (baseline > 0.0) ? variance / baseline : 0.0;
+    double kurtosis = (variance > 0.0) ? moment4 / (variance * variance) : 0.0;
+
+    uint32_t flags = 0;
+    if (detector->blocks >= limits->warmup) {
+        flags |= (ratio > limits->variance_ratio) ? TRANSIENT_VARIANCE : 0u;
+        flags |= (fabs(rate) > limits->sound_speed_rate) ? TRANSIENT_SOUND_SPEED : 0u;
+        flags |= (kurtosis > limits->kurtosis) ? TRANSIENT_IMPULSIVE : 0u;
+    }
+
+    int raised = flags != 0 && detector->hold == 0;
+    if (raised) {
+        double delta_limit = 4.0 * sqrt(baseline);
+        double speed_limit = 0.5 * fabs(speed_mean - detector->last_sound_speed);
+        uint32_t onset = 0;
+        for (uint32_t b = 0; b < TRANSIENT_BLOCK; b++) {
+            if (((flags & (TRANSIENT_VARIANCE | TRANSIENT_IMPULSIVE)) &&
+                 fabs(delta[b] - detector->last_delta_ns) > delta_limit) ||
+                ((flags & TRANSIENT_SOUND_SPEED) &&
+                 fabs(speed[b] - detector->last_sound_speed) > speed_limit)) {
+                onset = b;
+                break;
+            }
+        }
+
+        event->timestamp_us = detector->timestamp_us[onset];
+        event->kind = ((flags & TRANSIENT_IMPULSIVE) ||
+                       ((flags & TRANSIENT_SOUND_SPEED) && rate < 0.0)) ?
+                      TRANSIENT_CAVITATION : TRANSIENT_HAMMER;
+        event->flags = flags;
+        event->variance_ratio = ratio;
+        event->kurtosis = kurtosis;
+        event->sound_speed = speed_mean;
+        event->sound_speed_rate = rate;
+    }
+    if (flags) {
+        detector->hold = limits->hold;
+    } else if (detector->hold > 0) {
+        detector->hold--;
+    }
+
+    /* A block can raise the baseline by at most the variance limit */
+    double capped = variance < baseline * limits->variance_ratio ?
+                    variance : baseline * limits->variance_ratio;
+    baseline = detector->decay * baseline + (1.0 - detector->decay) * capped;
+    detector->baseline = baseline > floor ? baseline : floor;
+
+    detector->last_delta_ns = delta_mean;
+    detector->last_sound_speed = speed_mean;
+    detector->last_time_us = mid_time;
+    detector->variance_ratio = ratio;
+    detector->kurtosis = kurtosis;
+    detector->sound_speed_rate = rate;
+    detector->blocks++;
+    return raised;
+}
+
+/**
+ * Feed frames and collect the events they complete
+ */
+int transient_detector_process(TransientDetector *detector, const PathMeasurement *frames,
+                               const uint64_t *timestamps_us, size_t num_frames,
+                               TransientEvent *events, size_t max_events,
+                               size_t *num_events)
+{
+    if (!detector || !num_events || (num_frames > 0 && (!frames || !timestamps_us)) ||
+        (max_events > 0 && !events)) {
+        return -1;
+    }
+
+    size_t written = 0;
+    size_t f = 0;
+    while (f < num_frames) {
+        size_t count = TRANSIENT_BLOCK - detector->fill;
+        if (count > num_frames - f) {
+            count = num_frames - f;
+        }
+
+        double delta[TRANSIENT_BLOCK];
+        double speed[TRANSIENT_BLOCK];
+        block_features(detector, &frames[f * detector->num_paths], count, delta, speed);
+        memcpy(&detector->delta_ns[detector->fill], delta, count * sizeof(double));
+        memcpy(&detector->sound_speed[detector->fill], speed, count * sizeof(double));
+        memcpy(&detector->timestamp_us[detector->fill], &timestamps_us[f],
+               count * sizeof(uint64_t));
+        detector->fill += (uint32_t)count;
+        f += count;
+
+        if (detector->fill == TRANSIENT_BLOCK) {
+            TransientEvent event;
+            detector->fill = 0;
+            if (evaluate_block(detector, &event)) {
+                detector->events++;
+                if (written < max_events) {
+                    events[written++] = event;
+                } else {
+                    detector->dropped++;
+                }
+            }
+        }
+    }
+
+    *num_events = written;
+    return 0;
+}
@@ -0,0 +1,140 @@
+#ifndef TRANSIENT_H
+#define TRANSIENT_H
+
+#include "flowmeter.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Frames per statistics block */
+#define TRANSIENT_BLOCK 32
+
+/* Independent accumulators per block statistic */
+#define TRANSIENT_LANES 4
+
+/* Features that fired for an event */
+#define TRANSIENT_VARIANCE    0x1u  /* Δt variance jumped above the baseline */
+#define TRANSIENT_SOUND_SPEED 0x2u  /* Mean sound speed changed too fast */
+#define TRANSIENT_IMPULSIVE   0x4u  /* Δt kurtosis too high (spiky noise) */
+
+/* Event kinds */
+#define TRANSIENT_HAMMER     1u
+#define TRANSIENT_CAVITATION 2u
+
+/*
+ * Water hammer and cavitation detection on raw transit times
+ *
+ * Pressure transients are over within milliseconds. Averaged flow hides
+ * them, but they show clearly in the raw bursts. The detector reduces
+ * each frame to its mean Δt = t_up - t_down in ns and its mean path sound
+ * speed (L_i / 2)(1/t_up + 1/t_down). It summarizes every
+ * TRANSIENT_BLOCK frames by:
+ *
+ *   - Δt variance, relative to a slowly adapting baseline. Water hammer
+ *     oscillates the flow and raises the variance.
+ *   - Δt kurtosis (3 for Gaussian noise). Collapsing cavitation bubbles
+ *     give impulsive noise and a high kurtosis.
+ *   - Rate of change of the mean sound speed from the previous block.
+ *     Gas from cavitation slows sound sharply.
+ *
+ * An event is raised when a block crosses a limit and no transient is
+ * active. A transient ends after limits.hold blocks in a row with no
+ * limit crossed, so an intermittent one raises a single event. The kind
+ * is CAVITATION for impulsive noise or falling sound speed, and HAMMER
+ * otherwise. The timestamp is the first frame of the block that deviates
+ * by more than four baseline standard deviations in Δt, or by more than
+ * half the sound-speed step. The baseline follows
+ * every block, but a single block can raise it by at most the variance
+ * limit, so a transient takes several half-lives to be absorbed while a
+ * lasting change of noise level is.
+ *
+ * The state is fixed-size and allocation-free. Per-frame work is a
+ * division per path plus a few block-level operations, with the block
+ * loops laid out to vectorize. Frames must have positive transit times
+ * (screen them first, see quality.h).
+ */
+typedef struct {
+    double variance_ratio;    /* Block Δt variance over baseline that fires */
+    double sound_speed_rate;  /* |dc/dt| of the block mean in m/s per second */
+    double kurtosis;          /* Block Δt kurtosis that fires */
+    double noise_floor_ns;    /* Lowest baseline Δt standard deviation in ns (> 0) */
+    double half_life;         /* Baseline half-life in blocks */
+    uint32_t warmup;          /* Blocks before events can be raised, at least 1 */
+    uint32_t hold;            /* Quiet blocks that end a transient, at least 1 */
+} TransientLimits;
+
+/* One detected transient */
+typedef struct {
+    uint64_t timestamp_us;    /* Onset frame in µs */
+    uint32_t kind;            /* TRANSIENT_HAMMER or TRANSIENT_CAVITATION */
+    uint32_t flags;           /* TRANSIENT_* features that fired */
+    double variance_ratio;    /* Block Δt variance over baseline */
+    double kurtosis;          /* Block Δt kurtosis */
+    double sound_speed;       /* Block mean sound speed in m/s */
+    double sound_speed_rate;  /* Change from the previous block in m/s per second */
+} TransientEvent;
+
+typedef struct {
+    uint32_t num_paths;                       /* Paths per frame */
+    uint32_t fill;                            /* Frames in the pending block */
+    TransientLimits limits;                   /* Detection limits */
+    double decay;                             /* Baseline weight kept per block */
+    double delta_scale;                       /* 1e9 / num_paths */
+    double half_length[FLOWMETER_MAX_PATHS];  /* L_i / (2 * num_paths) */
+
+    /* Pending block, one entry per frame */
+    double delta_ns[TRANSIENT_BLOCK];         /* Mean Δt in ns */
+    double sound_speed[TRANSIENT_BLOCK];      /* Mean path sound speed in m/s */
+    uint64_t timestamp_us[TRANSIENT_BLOCK];   /* Frame time in µs */
+
+    /* State carried between blocks */
+    double baseline;                          /* Baseline Δt variance in ns² */
+    double last_delta_ns;                     /* Mean Δt of the previous block */
+    double last_sound_speed;                  /* Mean sound speed of the previous block */
+    double last_time_us;                      /* Mid time of the previous block */
+    uint32_t hold;                            /* Quiet blocks left in the current transient */
+
+    /* Statistics of the latest block, for monitoring */
+    double variance_ratio;
+    double kurtosis;
+    double sound_speed_rate;
+
+    uint64_t blocks;                          /* Blocks evaluated */
+    uint64_t events;                          /* Events raised */
+    uint64_t dropped;                         /* Events that did not fit the output */
+} TransientDetector;
+
+/**
+ * Initialize a detector for a meter configuration
+ *
+ * @param detector Output structure (no allocation, nothing to free)
+ * @param config Flow meter configuration
+ * @param limits Detection limits
+ * @return 0 on success, -1 on error (including more than
+ *         FLOWMETER_MAX_PATHS paths, or a noise floor of 0, which would
+ *         let a silent first block pin the baseline at 0)
+ */
+int transient_detector_init(TransientDetector *detector, const FlowMeterConfig *config,
+                            const TransientLimits *limits);
+
+/**
+ * Feed frames and collect the events they complete
+ *
+ * Frames may arrive in any chunking. A block is evaluated as soon as its
+ * last frame arrives.
+ *
+ * @param detector Transient detector
+ * @param frames Frame-major measurements, num_paths per frame
+ * @param timestamps_us Time of each frame in µs, non-decreasing
+ * @param num_frames Number of frames
+ * @param events Output array for raised events
+ * @param max_events Capacity of events; further events are counted in
+ *                   detector->dropped
+ * @param num_events Output number of events written
+ * @return 0 on success, -1 on error
+ */
+int transient_detector_process(TransientDetector *detector, const PathMeasurement *frames,
+                               const uint64_t *timestamps_us, size_t num_frames,
+                               TransientEvent *events, size_t max_events,
+                               size_t *num_events);
+
+#endif /* TRANSIENT_H */
@@ -0,0 +1,279 @@
+#include "wire.h"
+#include <math.h>
+#include <string.h>
+
+#define WIRE_HIGH_BITS 0x8080808080808080ULL
+#define WIRE_LOW_BITS 0x0101010101010101ULL
+
+/* Largest tick count sent; keeps deltas far from int64 overflow */
+#define WIRE_MAX_TICKS ((int64_t)1 << 52)
+
+static inline uint64_t zigzag_encode(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t zigzag_decode(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static inline uint8_t *put_varint(uint8_t *out, uint64_t value)
+{
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+/**
+ * Read one varint; returns NULL if truncated, sets *malformed if too long
+ */
+static inline const uint8_t *get_varint(const uint8_t *in, const uint8_t *end,
+                                        uint64_t *value, int *malformed)
+{
+    uint64_t result = 0;
+
+    for (unsigned shift = 0; shift < 7 * WIRE_MAX_VARINT; shift += 7) {
+        if (in == end) {
+            return NULL;
+        }
+        uint8_t byte = *in++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return in;
+        }
+    }
+
+    *malformed = 1;
+    return NULL;
+}
+
+/**
+ * Quantize a transit time to ticks; invalid times become 0
+ */
+static inline int64_t to_ticks(double seconds, double ticks_per_second)
+{
+    double ticks = seconds * ticks_per_second;
+
+    if (!(seconds > 0.0) || !(ticks < (double)WIRE_MAX_TICKS)) {
+        return 0;
+    }
+    return (int64_t)(ticks + 0.5);
+}
+
+/**
+ * Initialize an encoder
+ */
+int wire_encoder_init(WireEncoder *encoder, uint32_t num_paths, double tick_seconds,
+                      uint32_t keyframe_interval)
+{
+    if (!encoder || num_paths == 0 || num_paths > FLOWMETER_MAX_PATHS ||
+        !(tick_seconds > 0.0) || !isfinite(tick_seconds) || keyframe_interval == 0) {
+        return -1;
+    }
+
+    memset(encoder, 0, sizeof(*encoder));
+    encoder->num_paths = num_paths;
+    encoder->keyframe_interval = keyframe_interval;
+    encoder->since_keyframe = keyframe_interval;
+    encoder->ticks_per_second = 1.0 / tick_seconds;
+    return 0;
+}
+
+/**
+ * Upper bound on the encoded size of a run of frames
+ */
+size_t wire_encode_bound(uint32_t num_paths, size_t num_frames)
+{
+    return num_frames * (1 + WIRE_MAX_VARINT * (1 + 2 * (size_t)num_paths));
+}
+
+/**
+ * Force the next frame to be a keyframe
+ */
+void wire_encoder_restart(WireEncoder *encoder)
+{
+    encoder->since_keyframe = encoder->keyframe_interval;
+}
+
+/**
+ * Encode frames
+ */
+size_t wire_encode(WireEncoder *encoder, const PathMeasurement *frames,
+                   size_t num_frames, uint8_t *out)
+{
+    uint32_t num_paths = encoder->num_paths;
+    double ticks_per_second = encoder->ticks_per_second;
+    int64_t *previous = encoder->previous;
+    uint8_t *p = out;
+
+    for (size_t f = 0; f < num_frames; f++) {
+        const PathMeasurement *m = &frames[f * num_paths];
+        int key = encoder->since_keyframe >= encoder->keyframe_interval;
+
+        *p++ = key ? WIRE_KEYFRAME : WIRE_DELTA;
+        if (key) {
+            p = put_varint(p, num_paths);
+            encoder->since_keyframe = 0;
+        }
+        encoder->since_keyframe++;
+
+        for (uint32_t i = 0; i < num_paths; i++) {
+            int64_t up = to_ticks(m[i].t_upstream, ticks_per_second);
+            int64_t down = to_ticks(m[i].t_downstream, ticks_per_second);
+            int64_t sum = up + down;
+            int64_t diff = down - up;
+
+            p = put_varint(p, zigzag_encode(key ? sum : sum - previous[2 * i]));
+            p = put_varint(p, zigzag_encode(key ? diff : diff - previous[2 * i + 1]));
+            previous[2 * i] = sum;
+            previous[2 * i + 1] = diff;
+        }
+    }
+
+    return (size_t)(p - out);
+}
+
+/**
+ * Initialize a decoder
+ */
+int wire_decoder_init(WireDecoder *decoder, uint32_t num_paths, double tick_seconds)
+{
+    if (!decoder || num_paths == 0 || num_paths > FLOWMETER_MAX_PATHS ||
+        !(tick_seconds > 0.0) || !isfinite(tick_seconds)) {
+        return -1;
+    }
+
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->num_paths = num_paths;
+    decoder->tick_seconds = tick_seconds;
+    return 0;
+}
+
+/**
+ * Decode the 2 * num_paths values of one frame into values[]
+ *
+ * Returns the end of the frame, or NULL if it is truncated or malformed.
+ */
+static const uint8_t *decode_values(const uint8_t *p, const uint8_t *end,
+                                    uint32_t count, int64_t *values, int *malformed)
+{
+    uint32_t i = 0;
+
+    while (i < count) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        /* Eight one-byte varints: zigzag-decode all lanes at once */
+        if (count - i >= 8 && end - p >= 8) {
+            uint64_t word;
+            memcpy(&word, p, sizeof(word));
+            if (!(word & WIRE_HIGH_BITS)) {
+                uint64_t half = (word >> 1) & ~WIRE_HIGH_BITS;
+                uint64_t sign = (word & WIRE_LOW_BITS) * 0xff;
+                uint64_t lanes = half ^ sign;  /* One int8 per lane */
+                for (int j = 0; j < 8; j++) {
+                    values[i + j] = (int8_t)(uint8_t)(lanes >> (8 * j));
+                }
+                p += 8;
+                i += 8;
+                continue;
+            }
+        }
+#endif
+
+        /* One or two bytes without a data-dependent branch */
+        if (end - p >= 2) {
+            uint32_t b0 = p[0];
+            uint32_t b1 = p[1];
+            uint32_t more = b0 >> 7;
+            if (!(more & (b1 >> 7))) {
+                uint64_t raw = (b0 & 0x7f) | (((b1 & 0x7f) << 7) & (0u - more));
+                values[i++] = zigzag_decode(raw);
+                p += 1 + more;
+                continue;
+            }
+        }
+
+        uint64_t raw;
+        p = get_varint(p, end, &raw, malformed);
+        if (!p) {
+            return NULL;
+        }
+        values[i++] = zigzag_decode(raw);
+    }
+
+    return p;
+}
+
+/**
+ * Decode complete frames from a buffer
+ */
+int wire_decode(WireDecoder *decoder, const uint8_t *data, size_t size,
+                PathMeasurement *frames, size_t max_frames,
+                size_t *num_frames, size_t *consumed)
+{
+    uint32_t num_paths = decoder->num_paths;
+    uint32_t count = 2 * num_paths;
+    double tick = decoder->tick_seconds;
+    int64_t *previous = decoder->previous;
+    const uint8_t *p = data;
+    const uint8_t *end = data + size;
+    size_t written = 0;
+    int malformed = 0;
+    int64_t values[2 * FLOWMETER_MAX_PATHS];
+
+    while (written < max_frames && p < end) {
+        const uint8_t *q = p;
+        uint8_t tag = *q++;
+
+        if (tag == WIRE_KEYFRAME) {
+            uint64_t paths;
+            q = get_varint(q, end, &paths, &malformed);
+            if (!q) {
+                break;
+            }
+            if (paths != num_paths) {
+                malformed = 1;
+                break;
+            }
+        } else if (tag != WIRE_DELTA) {
+            malformed = 1;
+            break;
+        }
+
+        q = decode_values(q, end, count, values, &malformed);
+        if (!q) {
+            break;
+        }
+        p = q;
+
+        if (tag == WIRE_KEYFRAME) {
+            memcpy(previous, values, count * sizeof(int64_t));
+            decoder->synchronized = 1;
+        } else if (!decoder->synchronized) {
+            decoder->skipped++;
+            continue;
+        } else {
+            for (uint32_t i = 0; i < count; i++) {
+                previous[i] += values[i];
+            }
+        }
+
+        PathMeasurement *m = &frames[written * num_paths];
+        for (uint32_t i = 0; i < num_paths; i++) {
+            /* sum and diff share parity, so the halves are exact */
+            int64_t sum = previous[2 * i];
+            int64_t diff = previous[2 * i + 1];
+            m[i].t_upstream = (double)((sum - diff) / 2) * tick;
+            m[i].t_downstream = (double)((sum + diff) / 2) * tick;
+        }
+        written++;
+    }
+
+    *num_frames = written;
+    *consumed = (size_t)(p - data);
+    return malformed ? -1 : 0;
+}
@@ -0,0 +1,122 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include "flowmeter.h"
+#include <stddef.h>
+
+/*
+ * Compact transmitter-to-collector wire format
+ *
+ * Transit times are sent as integer TDC ticks of tick_seconds each. Per
+ * path, a frame carries the sum t_up + t_down, which follows sound speed
+ * and changes slowly, and the difference t_down - t_up, which carries the
+ * flow. Each value is sent as a zigzag LEB128
+ * varint of its change from the previous frame on the same path; a
+ * keyframe every keyframe_interval frames carries absolute values so a
+ * receiver can join or recover mid-stream.
+ *
+ * Frame layout:
+ *   uint8 tag                 WIRE_KEYFRAME or WIRE_DELTA
+ *   varint num_paths          keyframes only
+ *   varint value[2 * num_paths]
+ *
+ * Times that are exact multiples of the tick (as a TDC produces them)
+ * round-trip exactly. Non-positive or non-finite times are sent as 0 and
+ * decode to an invalid path. Runs of eight one-byte varints, the common
+ * case for steady flow, are decoded eight at a time with SWAR arithmetic
+ * on a 64-bit word.
+ */
+
+#define WIRE_DELTA 0x00u
+#define WIRE_KEYFRAME 0x01u
+
+/* Longest encoding of a 64-bit varint */
+#define WIRE_MAX_VARINT 10
+
+typedef struct {
+    uint32_t num_paths;                 /* Paths per frame */
+    uint32_t keyframe_interval;         /* Frames between keyframes */
+    uint32_t since_keyframe;            /* Frames sent since the last keyframe */
+    double ticks_per_second;            /* 1 / tick_seconds */
+    int64_t previous[2 * FLOWMETER_MAX_PATHS];  /* Last (sum, difference) ticks */
+} WireEncoder;
+
+typedef struct {
+    uint32_t num_paths;                 /* Paths per frame */
+    int synchronized;                   /* A keyframe has been seen */
+    double tick_seconds;                /* TDC tick in seconds */
+    uint64_t skipped;                   /* Delta frames dropped before a keyframe */
+    int64_t previous[2 * FLOWMETER_MAX_PATHS];  /* Last (sum, difference) ticks */
+} WireDecoder;
+
+/**
+ * Initialize an encoder
+ *
+ * @param encoder Encoder to initialize
+ * @param num_paths Paths per frame (1 to FLOWMETER_MAX_PATHS)
+ * @param tick_seconds TDC tick in seconds
+ * @param keyframe_interval Frames between keyframes (1 makes every frame a keyframe)
+ * @return 0 on success, -1 on error
+ */
+int wire_encoder_init(WireEncoder *encoder, uint32_t num_paths, double tick_seconds,
+                      uint32_t keyframe_interval);
+
+/**
+ * Upper bound on the encoded size of a run of frames
+ *
+ * @param num_paths Paths per frame
+ * @param num_frames Number of frames
+ * @return Size in bytes
+ */
+size_t wire_encode_bound(uint32_t num_paths, size_t num_frames);
+
+/**
+ * Encode frames
+ *
+ * @param encoder Encoder
+ * @param frames Frame-major measurements (num_frames * num_paths)
+ * @param num_frames Number of frames
+ * @param out Output buffer of at least wire_encode_bound() bytes
+ * @return Bytes written
+ */
+size_t wire_encode(WireEncoder *encoder, const PathMeasurement *frames,
+                   size_t num_frames, uint8_t *out);
+
+/**
+ * Force the next frame to be a keyframe, e.g. after the link reconnects
+ *
+ * @param encoder Encoder
+ */
+void wire_encoder_restart(WireEncoder *encoder);
+
+/**
+ * Initialize a decoder, unsynchronized until the first keyframe
+ *
+ * @param decoder Decoder to initialize
+ * @param num_paths Paths per frame (1 to FLOWMETER_MAX_PATHS)
+ * @param tick_seconds TDC tick in seconds
+ * @return 0 on success, -1 on error
+ */
+int wire_decoder_init(WireDecoder *decoder, uint32_t num_paths, double tick_seconds);
+
+/**
+ * Decode complete frames from a buffer
+ *
+ * Stops at the end of the last complete frame or when max_frames have
+ * been written; the caller keeps the remaining bytes for the next call.
+ * Delta frames before the first keyframe are parsed and dropped.
+ *
+ * @param decoder Decoder
+ * @param data Encoded bytes
+ * @param size Number of bytes available
+ * @param frames Output frame-major measurements (max_frames * num_paths)
+ * @param max_frames Capacity of frames
+ * @param num_frames Output number of frames written
+ * @param consumed Output number of bytes consumed
+ * @return 0 on success, -1 on malformed input (decoder must be reinitialized)
+ */
+int wire_decode(WireDecoder *decoder, const uint8_t *data, size_t size,
+                PathMeasurement *frames, size_t max_frames,
+                size_t *num_frames, size_t *consumed);
+
+#endif /* WIRE_H */